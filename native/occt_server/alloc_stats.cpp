@@ -0,0 +1,100 @@
+#include "alloc_stats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Trivially constructible so it is usable from operator new at any point of a
+// thread's life, including before and after its dynamic TLS is set up.
+struct ThreadTally {
+  std::uint64_t allocations;
+  std::uint64_t bytes;
+  std::uint64_t frees;
+};
+
+thread_local ThreadTally tlTally = {0, 0, 0};
+
+std::atomic<std::uint64_t> gRequestAllocations{0};
+std::atomic<std::uint64_t> gRequestBytes{0};
+std::atomic<std::uint64_t> gRequestFrees{0};
+
+}  // namespace
+
+#if defined(OCCT_SERVER_ALLOC_STATS)
+
+void* operator new(std::size_t size) {
+  if (size == 0) size = 1;
+  void* ptr = std::malloc(size);
+  while (!ptr) {
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc();
+    handler();
+    ptr = std::malloc(size);
+  }
+  tlTally.allocations += 1;
+  tlTally.bytes += size;
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (!ptr) return;
+  tlTally.frees += 1;
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  operator delete(ptr);
+}
+
+#endif
+
+bool allocationCountingEnabled() {
+#if defined(OCCT_SERVER_ALLOC_STATS)
+  return true;
+#else
+  return false;
+#endif
+}
+
+AllocTally threadAllocTally() {
+  return {tlTally.allocations, tlTally.bytes, tlTally.frees};
+}
+
+void addRequestAllocations(const AllocTally& tally) {
+  gRequestAllocations.fetch_add(tally.allocations, std::memory_order_relaxed);
+  gRequestBytes.fetch_add(tally.bytes, std::memory_order_relaxed);
+  gRequestFrees.fetch_add(tally.frees, std::memory_order_relaxed);
+}
+
+AllocTally requestAllocationTotals() {
+  return {gRequestAllocations.load(std::memory_order_relaxed),
+          gRequestBytes.load(std::memory_order_relaxed),
+          gRequestFrees.load(std::memory_order_relaxed)};
+}
+
+HeapStats heapStats() {
+  HeapStats stats;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  const struct mallinfo2 info = mallinfo2();
+  stats.available = true;
+  stats.arenaBytes = info.arena;
+  stats.inUseBytes = info.uordblks;
+  stats.freeBytes = info.fordblks;
+  stats.mmapBytes = info.hblkhd;
+#elif defined(__GLIBC__)
+  // mallinfo's int fields wrap above 2 GiB.
+  const struct mallinfo info = mallinfo();
+  stats.available = true;
+  stats.arenaBytes = static_cast<unsigned int>(info.arena);
+  stats.inUseBytes = static_cast<unsigned int>(info.uordblks);
+  stats.freeBytes = static_cast<unsigned int>(info.fordblks);
+  stats.mmapBytes = static_cast<unsigned int>(info.hblkhd);
+#endif
+  return stats;
+}
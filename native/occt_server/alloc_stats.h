@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocation counters. When built with OCCT_SERVER_ALLOC_STATS the global
+// operator new/delete are replaced with versions that bump thread-local
+// tallies, so the cost of a request (or of a phase within it) is the
+// difference between two snapshots taken on the handling thread. Memory OCCT
+// allocates through Standard::Allocate, and work done on other threads (e.g.
+// parallel meshing), is not included.
+
+struct AllocTally {
+  std::uint64_t allocations = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t frees = 0;
+
+  AllocTally operator-(const AllocTally& other) const {
+    return {allocations - other.allocations, bytes - other.bytes, frees - other.frees};
+  }
+};
+
+bool allocationCountingEnabled();
+
+// Totals for the calling thread since it started.
+AllocTally threadAllocTally();
+
+// Process-wide totals across finished requests, fed by the HTTP layer.
+void addRequestAllocations(const AllocTally& tally);
+AllocTally requestAllocationTotals();
+
+// malloc arena statistics (mallinfo2, or mallinfo on older glibc).
+struct HeapStats {
+  bool available = false;
+  std::size_t arenaBytes = 0;
+  std::size_t inUseBytes = 0;
+  std::size_t freeBytes = 0;
+  std::size_t mmapBytes = 0;
+};
+
+HeapStats heapStats();
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "httplib.h"
+#include "json.hpp"
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Helpers shared by the benchmarks that drive a real occt_server over HTTP
+// (occt_history_bench, occt_soak). Linux only: memory is read from /proc.
+
+using json = nlohmann::json;
+
+// Resident set size of `pid` in KiB, or -1 when unknown.
+inline long readRssKiB(pid_t pid) {
+  if (pid <= 0) return -1;
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) return std::stol(line.substr(6));
+  }
+  return -1;
+}
+
+// Parses `parse;dur=0.41, merge;dur=1.2, total;dur=3.0`.
+inline std::map<std::string, double> parseServerTiming(const std::string& header) {
+  std::map<std::string, double> phases;
+  std::size_t pos = 0;
+  while (pos < header.size()) {
+    std::size_t end = header.find(',', pos);
+    if (end == std::string::npos) end = header.size();
+    const std::string entry = header.substr(pos, end - pos);
+    const std::size_t dur = entry.find(";dur=");
+    if (dur != std::string::npos) {
+      std::string name = entry.substr(0, dur);
+      name.erase(0, name.find_first_not_of(' '));
+      phases[name] = std::atof(entry.c_str() + dur + 5);
+    }
+    pos = end + 1;
+  }
+  return phases;
+}
+
+// Runs `occt_server 127.0.0.1 <port>` for the lifetime of the object.
+class ServerProcess {
+ public:
+  ServerProcess(const std::string& path, int port) {
+    pid_ = fork();
+    if (pid_ == 0) {
+      const std::string portArg = std::to_string(port);
+      execl(path.c_str(), path.c_str(), "127.0.0.1", portArg.c_str(), static_cast<char*>(nullptr));
+      std::perror("exec occt_server");
+      _exit(127);
+    }
+    if (pid_ < 0) throw std::runtime_error("fork failed");
+  }
+
+  ~ServerProcess() {
+    if (pid_ <= 0) return;
+    kill(pid_, SIGTERM);
+    waitpid(pid_, nullptr, 0);
+  }
+
+  ServerProcess(const ServerProcess&) = delete;
+  ServerProcess& operator=(const ServerProcess&) = delete;
+
+  pid_t pid() const { return pid_; }
+
+ private:
+  pid_t pid_ = -1;
+};
+
+inline void waitForServer(httplib::Client& client) {
+  for (int attempt = 0; attempt < 200; ++attempt) {
+    if (auto res = client.Get("/v1/capabilities")) {
+      if (res->status == 200) return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  throw std::runtime_error("occt_server did not become ready");
+}
+
+// Client-side copy of the accumulated state, merged the way mergeResults
+// does it: outputs replace by key, selections are replaced per ownerKey.
+class UpstreamState {
+ public:
+  void merge(const json& result) {
+    for (const auto& entry : result.value("outputs", json::array())) {
+      outputs_[entry.value("key", "")] = entry;
+    }
+    std::vector<std::string> owners;
+    const json next = result.value("selections", json::array());
+    for (const auto& sel : next) {
+      const json& meta = sel.value("meta", json::object());
+      if (meta.contains("ownerKey") && meta["ownerKey"].is_string()) owners.push_back(meta["ownerKey"]);
+    }
+    if (!owners.empty()) {
+      selections_.erase(std::remove_if(selections_.begin(), selections_.end(), [&](const json& sel) {
+        const json& meta = sel.value("meta", json::object());
+        if (!meta.contains("ownerKey") || !meta["ownerKey"].is_string()) return false;
+        return std::find(owners.begin(), owners.end(), meta["ownerKey"].get<std::string>()) != owners.end();
+      }), selections_.end());
+    }
+    for (const auto& sel : next) selections_.push_back(sel);
+  }
+
+  void clear() {
+    outputs_.clear();
+    selections_.clear();
+  }
+
+  // Handles of the solid outputs, in key order.
+  std::vector<std::string> solidHandles() const {
+    std::vector<std::string> handles;
+    for (const auto& entry : outputs_) {
+      const json& object = entry.second.value("object", json::object());
+      if (object.value("kind", "") != "solid") continue;
+      const std::string handle = object.value("meta", json::object()).value("handle", "");
+      if (!handle.empty()) handles.push_back(handle);
+    }
+    return handles;
+  }
+
+  json serialize() const {
+    json outputs = json::array();
+    for (const auto& entry : outputs_) outputs.push_back(entry.second);
+    return {{"outputs", outputs}, {"selections", selections_}};
+  }
+
+ private:
+  std::map<std::string, json> outputs_;
+  std::vector<json> selections_;
+};
@@ -0,0 +1,388 @@
+#include "bench_http.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Feature-history scaling benchmark. Builds synthetic parts of up to
+// --max-features features through a running occt_server, sending the full
+// upstream state with every exec-feature call exactly like the JS client, and
+// records per-feature latency, the server's phase timings and its RSS as the
+// history grows:
+//
+//   occt_history_bench --server ./build/occt_server [--max-features 2000]
+//       [--scenario stacked|datum|selector] [--csv <file>] [--svg-dir <dir>] [--out <file>]
+//
+// The total build time T(n) and the server's memory growth M(n) are fitted as
+// n^k over history lengths >= --fit-from. Constant per-feature cost gives
+// k = 1; the run fails (exit 1) when k exceeds --max-time-exponent or
+// --max-memory-exponent. Memory is read from /proc, so it needs Linux and
+// either --server (spawned per scenario) or --url together with --pid.
+
+namespace {
+
+struct HistoryOptions {
+  std::string serverPath;
+  std::string url;
+  int port = 18181;
+  pid_t pid = 0;
+  int maxFeatures = 2000;
+  int fitFrom = 100;
+  double maxTimeExponent = 1.25;
+  double maxMemoryExponent = 1.25;
+  std::vector<std::string> scenarios;
+  std::string csvPath;
+  std::string svgDir;
+  std::string outPath;
+};
+
+struct FeatureSample {
+  int index = 0;
+  std::string kind;
+  double latencyMs = 0.0;
+  std::size_t requestBytes = 0;
+  std::size_t responseBytes = 0;
+  std::map<std::string, double> phasesMs;
+  long rssKiB = -1;
+};
+
+struct Checkpoint {
+  int features = 0;
+  double totalMs = 0.0;
+  double perFeatureMs = 0.0;
+  long rssKiB = -1;
+};
+
+void usage() {
+  std::cerr << "usage: occt_history_bench (--server <occt_server> [--port <n>] | --url <base-url> [--pid <n>])\n"
+               "                          [--max-features <n>] [--scenario <stacked|datum|selector>]...\n"
+               "                          [--fit-from <n>] [--max-time-exponent <k>] [--max-memory-exponent <k>]\n"
+               "                          [--csv <file>] [--svg-dir <dir>] [--out <file>]"
+            << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, HistoryOptions& options) {
+  for (int index = 1; index < argc; ++index) {
+    const std::string arg = argv[index];
+    if (index + 1 >= argc) return false;
+    const std::string value = argv[++index];
+    if (arg == "--server") {
+      options.serverPath = value;
+    } else if (arg == "--url") {
+      options.url = value;
+    } else if (arg == "--port") {
+      options.port = std::stoi(value);
+    } else if (arg == "--pid") {
+      options.pid = static_cast<pid_t>(std::stol(value));
+    } else if (arg == "--max-features") {
+      options.maxFeatures = std::max(10, std::stoi(value));
+    } else if (arg == "--fit-from") {
+      options.fitFrom = std::max(1, std::stoi(value));
+    } else if (arg == "--max-time-exponent") {
+      options.maxTimeExponent = std::stod(value);
+    } else if (arg == "--max-memory-exponent") {
+      options.maxMemoryExponent = std::stod(value);
+    } else if (arg == "--scenario") {
+      options.scenarios.push_back(value);
+    } else if (arg == "--csv") {
+      options.csvPath = value;
+    } else if (arg == "--svg-dir") {
+      options.svgDir = value;
+    } else if (arg == "--out") {
+      options.outPath = value;
+    } else {
+      return false;
+    }
+  }
+  if (options.serverPath.empty() == options.url.empty()) return false;
+  if (options.scenarios.empty()) options.scenarios = {"stacked", "datum", "selector"};
+  return true;
+}
+
+json polyProfile(int sides, double z) {
+  return {{"kind", "profile.poly"}, {"sides", sides}, {"radius", 10.0}, {"center", json::array({0, 0, z})}};
+}
+
+json extrudeFeature(int index, double z) {
+  const std::string id = "extrude-" + std::to_string(index);
+  return {
+      {"kind", "feature.extrude"},
+      {"id", id},
+      {"profile", polyProfile(6, z)},
+      {"depth", 10.0},
+      {"axis", "+Z"},
+      {"result", "body:" + std::to_string(index)},
+  };
+}
+
+// Feature `index` of a scenario:
+//   stacked  - every feature is a new prism stacked on the previous one
+//   datum    - one base prism, then datum planes (history grows, geometry does not)
+//   selector - prisms alternating with datum frames placed on the top planar face
+//              of the whole history, so every other feature scans all upstream faces
+json scenarioFeature(const std::string& scenario, int index) {
+  if (scenario == "stacked") return extrudeFeature(index, 10.0 * index);
+  if (scenario == "datum") {
+    if (index == 0) return extrudeFeature(0, 0.0);
+    return {
+        {"kind", "datum.plane"},
+        {"id", "datum-" + std::to_string(index)},
+        {"origin", json::array({0, 0, 0.01 * index})},
+        {"normal", "+Z"},
+    };
+  }
+  if (scenario == "selector") {
+    if (index % 2 == 0) return extrudeFeature(index, 5.0 * index);
+    return {
+        {"kind", "datum.frame"},
+        {"id", "frame-" + std::to_string(index)},
+        {"on",
+         {{"kind", "selector.face"},
+          {"predicates", json::array({{{"kind", "pred.planar"}}, {{"kind", "pred.normal"}, {"value", "+Z"}}})},
+          {"rank", json::array({{{"kind", "rank.maxZ"}}})}}},
+    };
+  }
+  throw std::runtime_error("unknown scenario " + scenario);
+}
+
+std::vector<FeatureSample> runScenario(httplib::Client& client,
+                                       const std::string& scenario,
+                                       int maxFeatures,
+                                       pid_t pid) {
+  const std::string sessionId = "history-" + scenario;
+  UpstreamState upstream;
+  std::vector<FeatureSample> samples;
+  samples.reserve(static_cast<std::size_t>(maxFeatures));
+  for (int index = 0; index < maxFeatures; ++index) {
+    const json feature = scenarioFeature(scenario, index);
+    const std::string body =
+        json{{"sessionId", sessionId}, {"feature", feature}, {"upstream", upstream.serialize()}}.dump();
+    const auto start = std::chrono::steady_clock::now();
+    httplib::Result res = client.Post("/v1/exec-feature", body, "application/json");
+    const double latencyMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!res) throw std::runtime_error("exec-feature failed: " + httplib::to_string(res.error()));
+    if (res->status != 200) {
+      throw std::runtime_error("exec-feature " + std::to_string(index) + " returned " +
+                               std::to_string(res->status) + ": " + res->body);
+    }
+    upstream.merge(json::parse(res->body).at("result"));
+
+    FeatureSample sample;
+    sample.index = index;
+    sample.kind = feature.value("kind", "");
+    sample.latencyMs = latencyMs;
+    sample.requestBytes = body.size();
+    sample.responseBytes = res->body.size();
+    sample.phasesMs = parseServerTiming(res->get_header_value("Server-Timing"));
+    sample.rssKiB = readRssKiB(pid);
+    samples.push_back(std::move(sample));
+    if ((index + 1) % 250 == 0) {
+      std::cerr << "  " << scenario << " " << index + 1 << " features, last " << latencyMs << " ms" << std::endl;
+    }
+  }
+  return samples;
+}
+
+std::vector<Checkpoint> checkpoints(const std::vector<FeatureSample>& samples) {
+  std::vector<Checkpoint> out;
+  const int count = static_cast<int>(samples.size());
+  std::vector<int> lengths = {10, 25, 50, 100, 250, 500, 1000, 2000, 5000, 10000};
+  if (std::find(lengths.begin(), lengths.end(), count) == lengths.end()) lengths.push_back(count);
+  std::sort(lengths.begin(), lengths.end());
+  double total = 0.0;
+  int next = 0;
+  for (int n : lengths) {
+    if (n > count) break;
+    for (; next < n; ++next) total += samples[static_cast<std::size_t>(next)].latencyMs;
+    // Per-feature cost at this history length: mean over the last 10% of it.
+    const int window = std::max(1, n / 10);
+    double windowMs = 0.0;
+    for (int i = n - window; i < n; ++i) windowMs += samples[static_cast<std::size_t>(i)].latencyMs;
+    out.push_back({n, total, windowMs / window, samples[static_cast<std::size_t>(n - 1)].rssKiB});
+  }
+  return out;
+}
+
+// Least-squares slope of log(y) over log(x).
+double logLogSlope(const std::vector<std::pair<double, double>>& points) {
+  if (points.size() < 2) return std::nan("");
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const auto& p : points) {
+    const double x = std::log(p.first);
+    const double y = std::log(p.second);
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  const double n = static_cast<double>(points.size());
+  const double denom = n * sxx - sx * sx;
+  return denom == 0.0 ? std::nan("") : (n * sxy - sx * sy) / denom;
+}
+
+std::string svgPolyline(const std::vector<std::pair<double, double>>& points,
+                        double maxX, double maxY, const char* color) {
+  std::string out = "<polyline fill=\"none\" stroke=\"";
+  out += color;
+  out += "\" stroke-width=\"1.5\" points=\"";
+  char buffer[64];
+  for (const auto& p : points) {
+    const double x = 60.0 + 700.0 * p.first / maxX;
+    const double y = 340.0 - 300.0 * p.second / maxY;
+    std::snprintf(buffer, sizeof(buffer), "%.1f,%.1f ", x, y);
+    out += buffer;
+  }
+  return out + "\"/>\n";
+}
+
+// Per-feature latency (rolling mean over 1% of the run) and server RSS against
+// history length, each scaled to its own axis.
+void writeSvg(const std::string& path, const std::string& scenario, const std::vector<FeatureSample>& samples) {
+  const std::size_t window = std::max<std::size_t>(1, samples.size() / 100);
+  std::vector<std::pair<double, double>> latency;
+  std::vector<std::pair<double, double>> rss;
+  double sum = 0.0, maxLatency = 1e-9, maxRss = 1e-9;
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    sum += samples[i].latencyMs;
+    if (i >= window) sum -= samples[i - window].latencyMs;
+    const double mean = sum / static_cast<double>(std::min(i + 1, window));
+    latency.emplace_back(static_cast<double>(i + 1), mean);
+    maxLatency = std::max(maxLatency, mean);
+    if (samples[i].rssKiB >= 0) {
+      const double mib = static_cast<double>(samples[i].rssKiB) / 1024.0;
+      rss.emplace_back(static_cast<double>(i + 1), mib);
+      maxRss = std::max(maxRss, mib);
+    }
+  }
+  const double maxX = static_cast<double>(samples.size());
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  char buffer[256];
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"820\" height=\"380\" font-family=\"sans-serif\" font-size=\"12\">\n";
+  out << "<rect width=\"820\" height=\"380\" fill=\"white\"/>\n";
+  out << "<line x1=\"60\" y1=\"340\" x2=\"760\" y2=\"340\" stroke=\"black\"/>\n";
+  out << "<line x1=\"60\" y1=\"40\" x2=\"60\" y2=\"340\" stroke=\"black\"/>\n";
+  std::snprintf(buffer, sizeof(buffer),
+                "<text x=\"60\" y=\"24\">%s: per-feature latency (blue, max %.2f ms) and RSS (red, max %.1f MiB)</text>\n",
+                scenario.c_str(), maxLatency, maxRss);
+  out << buffer;
+  std::snprintf(buffer, sizeof(buffer),
+                "<text x=\"760\" y=\"360\" text-anchor=\"end\">history length (%zu features)</text>\n", samples.size());
+  out << buffer;
+  out << svgPolyline(latency, maxX, maxLatency, "#1f6fd1");
+  if (!rss.empty()) out << svgPolyline(rss, maxX, maxRss, "#d1301f");
+  out << "</svg>\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  HistoryOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage();
+    return 2;
+  }
+
+  std::ofstream csv;
+  if (!options.csvPath.empty()) {
+    csv.open(options.csvPath, std::ios::binary | std::ios::trunc);
+    csv << "scenario,feature,kind,latency_ms,request_bytes,response_bytes,parse_ms,selector_ms,merge_ms,"
+           "serialize_ms,server_total_ms,rss_kib\n";
+  }
+
+  json report = {{"maxFeatures", options.maxFeatures}, {"scenarios", json::object()}};
+  bool failed = false;
+  for (const std::string& scenario : options.scenarios) {
+    std::cerr << "scenario " << scenario << std::endl;
+    std::unique_ptr<ServerProcess> server;
+    std::string url = options.url;
+    pid_t pid = options.pid;
+    if (!options.serverPath.empty()) {
+      server = std::make_unique<ServerProcess>(options.serverPath, options.port);
+      url = "http://127.0.0.1:" + std::to_string(options.port);
+      pid = server->pid();
+    }
+    httplib::Client client(url);
+    client.set_keep_alive(true);
+    client.set_tcp_nodelay(true);
+    client.set_read_timeout(600, 0);
+    client.set_write_timeout(600, 0);
+
+    std::vector<FeatureSample> samples;
+    long baselineKiB = -1;
+    try {
+      waitForServer(client);
+      baselineKiB = readRssKiB(pid);
+      samples = runScenario(client, scenario, options.maxFeatures, pid);
+    } catch (const std::exception& ex) {
+      std::cerr << "scenario " << scenario << " failed: " << ex.what() << std::endl;
+      report["scenarios"][scenario] = {{"error", ex.what()}};
+      failed = true;
+      continue;
+    }
+
+    for (const auto& sample : samples) {
+      if (!csv.is_open()) break;
+      const auto phase = [&](const char* name) {
+        auto it = sample.phasesMs.find(name);
+        return it == sample.phasesMs.end() ? 0.0 : it->second;
+      };
+      csv << scenario << ',' << sample.index + 1 << ',' << sample.kind << ',' << sample.latencyMs << ','
+          << sample.requestBytes << ',' << sample.responseBytes << ',' << phase("parse") << ','
+          << phase("selector") << ',' << phase("merge") << ',' << phase("serialize") << ','
+          << phase("total") << ',' << sample.rssKiB << '\n';
+    }
+    if (!options.svgDir.empty()) writeSvg(options.svgDir + "/history-" + scenario + ".svg", scenario, samples);
+
+    const std::vector<Checkpoint> points = checkpoints(samples);
+    std::vector<std::pair<double, double>> timeFit;
+    std::vector<std::pair<double, double>> memoryFit;
+    json rows = json::array();
+    std::printf("%-9s %9s %12s %14s %10s\n", scenario.c_str(), "features", "total ms", "ms/feature", "rss MiB");
+    for (const auto& point : points) {
+      std::printf("%-9s %9d %12.1f %14.3f %10.1f\n", "", point.features, point.totalMs, point.perFeatureMs,
+                  point.rssKiB >= 0 ? static_cast<double>(point.rssKiB) / 1024.0 : -1.0);
+      rows.push_back({{"features", point.features},
+                      {"totalMs", point.totalMs},
+                      {"perFeatureMs", point.perFeatureMs},
+                      {"rssKiB", point.rssKiB}});
+      if (point.features < options.fitFrom) continue;
+      timeFit.emplace_back(point.features, point.totalMs);
+      if (baselineKiB >= 0 && point.rssKiB > baselineKiB) {
+        memoryFit.emplace_back(point.features, static_cast<double>(point.rssKiB - baselineKiB));
+      }
+    }
+    const double timeExponent = logLogSlope(timeFit);
+    const double memoryExponent = logLogSlope(memoryFit);
+    const bool timeOver = !std::isnan(timeExponent) && timeExponent > options.maxTimeExponent;
+    const bool memoryOver = !std::isnan(memoryExponent) && memoryExponent > options.maxMemoryExponent;
+    std::printf("%-9s time ~ n^%.2f (budget %.2f)%s, memory ~ n^%.2f (budget %.2f)%s\n", "",
+                timeExponent, options.maxTimeExponent, timeOver ? " OVER" : "",
+                memoryExponent, options.maxMemoryExponent, memoryOver ? " OVER" : "");
+    failed = failed || timeOver || memoryOver;
+    report["scenarios"][scenario] = {
+        {"checkpoints", rows},
+        {"baselineRssKiB", baselineKiB},
+        {"timeExponent", std::isnan(timeExponent) ? json(nullptr) : json(timeExponent)},
+        {"memoryExponent", std::isnan(memoryExponent) ? json(nullptr) : json(memoryExponent)},
+        {"timeOverBudget", timeOver},
+        {"memoryOverBudget", memoryOver},
+    };
+  }
+
+  report["failed"] = failed;
+  if (!options.outPath.empty()) {
+    std::ofstream out(options.outPath, std::ios::binary | std::ios::trunc);
+    out << report.dump(2) << "\n";
+  }
+  return failed ? 1 : 0;
+}
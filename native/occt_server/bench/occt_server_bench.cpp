@@ -0,0 +1,606 @@
+#include "kernel.h"
+#include "worker_pool.h"
+
+#include <BRepTools.hxx>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Microbenchmarks for the occt_server hot paths. Results are written as JSON
+// (stdout, or --out <file>) so runs can be diffed and tracked over time:
+//
+//   occt_server_bench [--filter <substring>] [--min-time <seconds>] [--out <file>]
+
+namespace {
+
+struct BenchOptions {
+  std::string filter;
+  double minTimeSeconds = 0.2;
+  std::string outPath;
+};
+
+struct BenchStats {
+  std::size_t iterations = 0;
+  double meanNs = 0.0;
+  double medianNs = 0.0;
+  double minNs = 0.0;
+  double maxNs = 0.0;
+  double p95Ns = 0.0;
+  double stddevNs = 0.0;
+};
+
+BenchStats summarize(std::vector<double> samples) {
+  BenchStats stats;
+  stats.iterations = samples.size();
+  if (samples.empty()) return stats;
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for (double value : samples) sum += value;
+  stats.meanNs = sum / static_cast<double>(samples.size());
+  double variance = 0.0;
+  for (double value : samples) variance += (value - stats.meanNs) * (value - stats.meanNs);
+  stats.stddevNs = std::sqrt(variance / static_cast<double>(samples.size()));
+  stats.minNs = samples.front();
+  stats.maxNs = samples.back();
+  stats.medianNs = samples[samples.size() / 2];
+  stats.p95Ns = samples[std::min(samples.size() - 1,
+                                 static_cast<std::size_t>(0.95 * static_cast<double>(samples.size())))];
+  return stats;
+}
+
+class BenchRunner {
+ public:
+  explicit BenchRunner(const BenchOptions& options) : options_(options) {}
+
+  // Times `body` repeatedly; `setup` runs before every iteration outside the
+  // timed region (e.g. to drop cached triangulations).
+  void run(const std::string& name,
+           const json& params,
+           const std::function<void()>& body,
+           const std::function<void()>& setup = nullptr) {
+    if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos) return;
+    std::cerr << "bench " << name << std::flush;
+    try {
+      if (setup) setup();
+      body();
+      std::vector<double> samples;
+      const auto budget = std::chrono::duration<double>(options_.minTimeSeconds);
+      const auto began = std::chrono::steady_clock::now();
+      while (samples.size() < 3 ||
+             (std::chrono::steady_clock::now() - began < budget && samples.size() < 100000)) {
+        if (setup) setup();
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+      }
+      const BenchStats stats = summarize(samples);
+      std::cerr << "  " << stats.medianNs / 1000.0 << " us (n=" << stats.iterations << ")" << std::endl;
+      results_.push_back({
+          {"name", name},
+          {"params", params},
+          {"iterations", stats.iterations},
+          {"time_unit", "ns"},
+          {"real_time", stats.meanNs},
+          {"median", stats.medianNs},
+          {"min", stats.minNs},
+          {"max", stats.maxNs},
+          {"p95", stats.p95Ns},
+          {"stddev", stats.stddevNs},
+      });
+    } catch (const std::exception& ex) {
+      std::cerr << "  failed: " << ex.what() << std::endl;
+      results_.push_back({{"name", name}, {"params", params}, {"error", ex.what()}});
+    }
+  }
+
+  json report() const {
+    const std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return {
+        {"context", {{"date", date}, {"executable", "occt_server_bench"}, {"min_time_s", options_.minTimeSeconds}}},
+        {"benchmarks", results_},
+    };
+  }
+
+ private:
+  BenchOptions options_;
+  json results_ = json::array();
+};
+
+json polyProfile(int sides, double radius = 10.0) {
+  return {{"kind", "profile.poly"}, {"sides", sides}, {"radius", radius}, {"center", json::array({0, 0})}};
+}
+
+json extrudeFeature(const std::string& id, const json& profile, double depth, const std::string& result) {
+  return {
+      {"kind", "feature.extrude"},
+      {"id", id},
+      {"profile", profile},
+      {"depth", depth},
+      {"axis", "+Z"},
+      {"result", result},
+  };
+}
+
+// A part with `bodies` stacked prisms of `sides` sides each, merged into one
+// upstream state the way the server accumulates it.
+KernelResult stackedPrisms(ShapeRegistry& registry, int bodies, int sides) {
+  KernelResult upstream;
+  for (int index = 0; index < bodies; ++index) {
+    json profile = polyProfile(sides);
+    profile["center"] = json::array({0, 0, 10.0 * index});
+    const json feature = extrudeFeature(
+        "extrude-" + std::to_string(index), profile, 10.0, "body:" + std::to_string(index));
+    upstream = mergeResults(upstream, executeFeature(feature, upstream, registry));
+  }
+  return upstream;
+}
+
+TopoDS_Shape bodyShape(const KernelResult& result, const ShapeRegistry& registry, const std::string& key) {
+  auto it = result.outputs.find(key);
+  if (it == result.outputs.end()) throw std::runtime_error("missing output " + key);
+  return registry.get(it->second.meta.value("handle", ""));
+}
+
+void benchProfiles(BenchRunner& runner) {
+  const std::vector<std::pair<std::string, json>> profiles = {
+      {"rectangle", {{"kind", "profile.rectangle"}, {"width", 20}, {"height", 10}}},
+      {"circle", {{"kind", "profile.circle"}, {"radius", 8}}},
+      {"poly:8", polyProfile(8)},
+      {"poly:64", polyProfile(64)},
+      {"poly:512", polyProfile(512)},
+  };
+  for (const auto& entry : profiles) {
+    runner.run("buildProfileFace/" + entry.first, {{"profile", entry.first}},
+               [&] { buildProfileFace(entry.second); });
+    runner.run("buildProfileWire/" + entry.first, {{"profile", entry.first}},
+               [&] { buildProfileWire(entry.second); });
+  }
+}
+
+void benchSelections(BenchRunner& runner, const std::vector<int>& sizes) {
+  for (int sides : sizes) {
+    ShapeRegistry registry;
+    const KernelResult part = stackedPrisms(registry, 1, sides);
+    const TopoDS_Shape shape = bodyShape(part, registry, "body:0");
+    const json params = {{"sides", sides}};
+
+    runner.run("collectSelections/prism:" + std::to_string(sides), params, [&] {
+      ShapeRegistry scratch;
+      collectSelections(shape, scratch, "bench", "body:main", "solid", json::array());
+    });
+
+    const json topFace = {
+        {"kind", "selector.face"},
+        {"predicates", json::array({{{"kind", "pred.normal"}, {"value", "+Z"}}})},
+    };
+    const std::vector<std::pair<std::string, json>> selectors = {
+        {"predicates", topFace},
+        {"rank.maxArea",
+         {{"kind", "selector.face"},
+          {"rank", json::array({{{"kind", "rank.maxArea"}}, {{"kind", "rank.maxZ"}}})}}},
+        {"rank.minZ",
+         {{"kind", "selector.face"},
+          {"predicates", json::array({{{"kind", "pred.planar"}}})},
+          {"rank", json::array({{{"kind", "rank.minZ"}}})}}},
+        {"rank.maxZ",
+         {{"kind", "selector.face"},
+          {"predicates", json::array({{{"kind", "pred.planar"}}})},
+          {"rank", json::array({{{"kind", "rank.maxZ"}}})}}},
+        {"rank.closestTo",
+         {{"kind", "selector.edge"},
+          {"rank", json::array({{{"kind", "rank.closestTo"}, {"target", topFace}}})}}},
+        {"named", {{"kind", "selector.named"}, {"name", "body:0"}}},
+    };
+    for (const auto& entry : selectors) {
+      runner.run("resolveSelector/" + entry.first + "/prism:" + std::to_string(sides), params, [&] {
+        std::string error;
+        resolveSelector(entry.second, part, error);
+      });
+    }
+  }
+}
+
+void benchResults(BenchRunner& runner, const std::vector<int>& bodyCounts) {
+  for (int bodies : bodyCounts) {
+    ShapeRegistry registry;
+    const KernelResult upstream = stackedPrisms(registry, bodies, 16);
+    const KernelResult next = executeFeature(
+        extrudeFeature("extrude-next", polyProfile(16), 5.0, "body:next"), upstream, registry);
+    const json serialized = serializeKernelResult(upstream);
+    const std::string body = json{{"upstream", serialized}}.dump();
+    const json params = {{"bodies", bodies}, {"selections", upstream.selections.size()}};
+    const std::string suffix = "/bodies:" + std::to_string(bodies);
+
+    runner.run("mergeResults" + suffix, params, [&] { mergeResults(upstream, next); });
+    runner.run("parseKernelResult" + suffix, params, [&] { parseKernelResult(serialized); });
+    runner.run("serializeKernelResult" + suffix, params, [&] { serializeKernelResult(upstream); });
+    runner.run("serializeKernelResult+dump" + suffix, params,
+               [&] { serializeKernelResult(upstream).dump(); });
+    // The exec-feature request path: parse the body and its upstream, on the
+    // heap versus in a request arena.
+    runner.run("parseUpstreamBody/heap" + suffix, params, [&] {
+      parseKernelResult(json::parse(body)["upstream"]);
+    });
+    runner.run("parseUpstreamBody/arena" + suffix, params, [&] {
+      ScopedRequestArena arena;
+      const RequestJson payload = RequestJson::parse(body);
+      parseKernelResult(payload["upstream"], requestResource());
+    });
+    // Pool routing: the router's tail check versus the SAX fallback it takes
+    // when sessionId is not the last member.
+    const std::string tailBody = body.substr(0, body.size() - 1) + ",\"sessionId\":\"bench\"}";
+    const std::string leadingBody = "{\"sessionId\":\"bench\"," + body.substr(1);
+    runner.run("sessionIdFromBody/tail" + suffix, params, [&] { sessionIdFromBody(tailBody); });
+    runner.run("sessionIdFromBody/sax" + suffix, params, [&] { sessionIdFromBody(leadingBody); });
+  }
+}
+
+// A bolt circle: N pins cut from a plate one feature at a time, versus one
+// feature.boolean with every pin as a tool.
+void benchBooleans(BenchRunner& runner, const std::vector<int>& holeCounts) {
+  for (int holes : holeCounts) {
+    ShapeRegistry registry;
+    KernelResult upstream = executeFeature(
+        extrudeFeature("plate", {{"kind", "profile.circle"}, {"radius", 120.0}}, 10.0, "body:plate"),
+        KernelResult{}, registry);
+    json tools = json::array();
+    for (int index = 0; index < holes; ++index) {
+      const double angle = 2.0 * M_PI * index / holes;
+      const json pin = {
+          {"kind", "profile.circle"},
+          {"radius", 3.0},
+          {"center", json::array({90.0 * std::cos(angle), 90.0 * std::sin(angle), -2.0})},
+      };
+      const std::string key = "body:pin" + std::to_string(index);
+      upstream = mergeResults(
+          upstream, executeFeature(extrudeFeature("pin" + std::to_string(index), pin, 14.0, key), upstream, registry));
+      tools.push_back({{"kind", "selector.named"}, {"name", key}});
+    }
+    const json params = {{"holes", holes}};
+    const std::string suffix = "/holes:" + std::to_string(holes);
+
+    runner.run("boolean/sequential" + suffix, params, [&] {
+      KernelResult state = upstream;
+      std::string body = "body:plate";
+      for (int index = 0; index < holes; ++index) {
+        const std::string result = "body:cut" + std::to_string(index);
+        const json feature = {
+            {"kind", "feature.boolean"},
+            {"id", "cut" + std::to_string(index)},
+            {"op", "subtract"},
+            {"left", {{"kind", "selector.named"}, {"name", body}}},
+            {"right", tools[index]},
+            {"result", result},
+        };
+        state = mergeResults(state, executeFeature(feature, state, registry));
+        body = result;
+      }
+    });
+    runner.run("boolean/multiTool" + suffix, params, [&] {
+      const json feature = {
+          {"kind", "feature.boolean"},
+          {"id", "cut"},
+          {"op", "subtract"},
+          {"left", {{"kind", "selector.named"}, {"name", "body:plate"}}},
+          {"right", tools[0]},
+          {"tools", json(tools.begin() + 1, tools.end())},
+          {"result", "body:cut"},
+      };
+      executeFeature(feature, upstream, registry);
+    });
+  }
+}
+
+// A circular pattern of one pin about a plate's top face: building the
+// instanced compound (selections transformed from the prototype) and meshing
+// it, where each pin face is triangulated once whatever the count.
+void benchPatterns(BenchRunner& runner, const std::vector<int>& counts) {
+  ShapeRegistry registry;
+  KernelResult upstream = executeFeature(
+      extrudeFeature("plate", {{"kind", "profile.circle"}, {"radius", 120.0}}, 10.0, "body:plate"),
+      KernelResult{}, registry);
+  const json pin = {
+      {"kind", "profile.circle"},
+      {"radius", 3.0},
+      {"center", json::array({90.0, 0.0, 10.0})},
+  };
+  upstream = mergeResults(upstream, executeFeature(extrudeFeature("pin", pin, 14.0, "body:pin"), upstream, registry));
+  const json top = {
+      {"kind", "selector.face"},
+      {"predicates", json::array({{{"kind", "pred.planar"}}, {{"kind", "pred.createdBy"}, {"featureId", "plate"}}})},
+      {"rank", json::array({{{"kind", "rank.maxZ"}}})},
+  };
+  for (int count : counts) {
+    const json feature = {
+        {"kind", "pattern.circular"},
+        {"id", "ring"},
+        {"origin", top},
+        {"axis", "+Z"},
+        {"count", count},
+        {"source", {{"kind", "selector.named"}, {"name", "body:pin"}}},
+        {"result", "body:ring"},
+    };
+    const json params = {{"count", count}};
+    const std::string suffix = "/count:" + std::to_string(count);
+    runner.run("pattern/circular" + suffix, params, [&] { executeFeature(feature, upstream, registry); });
+
+    const KernelResult ring = executeFeature(feature, upstream, registry);
+    const TopoDS_Shape shape = bodyShape(ring, registry, "body:ring");
+    const json options = {{"linearDeflection", 0.1}, {"angularDeflection", 0.5}};
+    runner.run("pattern/mesh" + suffix, params,
+               [&] { meshShape(shape, options); },
+               [&] { BRepTools::Clean(shape); });
+  }
+}
+
+// /v1/query over every body and face of eight prisms: adaptive exact
+// integration (never cached), exact from the registry cache, and fast from
+// the triangulation.
+void benchQueries(BenchRunner& runner, const std::vector<int>& sizes) {
+  for (int sides : sizes) {
+    ShapeRegistry registry;
+    const KernelResult part = stackedPrisms(registry, 8, sides);
+    json handles = json::array();
+    for (const auto& sel : part.selections) {
+      if (sel.kind == "solid" || sel.kind == "face") handles.push_back(sel.meta.value("handle", ""));
+    }
+    for (int index = 0; index < 8; ++index) {
+      meshShape(bodyShape(part, registry, "body:" + std::to_string(index)), {{"linearDeflection", 0.1}});
+    }
+    const json params = {{"sides", sides}, {"handles", handles.size()}};
+    const std::string suffix = "/prism:" + std::to_string(sides);
+    const json quantities = json::array({"bounds", "area", "volume", "centroid"});
+    runner.run("query/exact:tolerance" + suffix, params, [&] {
+      queryShapes(registry, {{"handles", handles}, {"quantities", quantities}, {"tolerance", 1e-6}});
+    });
+    runner.run("query/exact:cached" + suffix, params, [&] {
+      queryShapes(registry, {{"handles", handles}, {"quantities", quantities}});
+    });
+    runner.run("query/fast" + suffix, params, [&] {
+      queryShapes(registry, {{"handles", handles}, {"quantities", quantities}, {"precision", "fast"}});
+    });
+  }
+}
+
+// /v1/pick: a 32x32 grid of rays down onto eight stacked prisms, once with
+// the BVH built inside the call and once against the cached one.
+void benchPicking(BenchRunner& runner, const std::vector<int>& sizes) {
+  for (int sides : sizes) {
+    ShapeRegistry registry;
+    const KernelResult part = stackedPrisms(registry, 8, sides);
+    json handles = json::array();
+    for (int index = 0; index < 8; ++index) {
+      handles.push_back(part.outputs.at("body:" + std::to_string(index)).meta.value("handle", ""));
+    }
+    json rays = json::array();
+    for (int x = 0; x < 32; ++x) {
+      for (int y = 0; y < 32; ++y) {
+        rays.push_back({
+            {"origin", json::array({-12.0 + 0.75 * x, -12.0 + 0.75 * y, 200.0})},
+            {"direction", json::array({0.0, 0.0, -1.0})},
+        });
+      }
+    }
+    const json request = {{"handles", handles}, {"rays", rays}, {"edgeTolerance", 0.2}};
+    const json params = {{"sides", sides}, {"rays", rays.size()}};
+    const std::string suffix = "/prism:" + std::to_string(sides);
+    runner.run("pick/build" + suffix, params,
+               [&] { pickShapes(registry, part, request); },
+               [&] {
+                 for (const auto& handle : handles) registry.setPickIndex(handle.get<std::string>(), nullptr);
+               });
+    runner.run("pick/cached" + suffix, params, [&] { pickShapes(registry, part, request); });
+  }
+}
+
+// /v1/slice through a 64-sided prism: exact sections against the single
+// sweep over the triangulation.
+void benchSlicing(BenchRunner& runner, const std::vector<int>& counts) {
+  ShapeRegistry registry;
+  const KernelResult part = stackedPrisms(registry, 1, 64);
+  const std::string handle = part.outputs.at("body:0").meta.value("handle", "");
+  for (int count : counts) {
+    const json params = {{"planes", count}};
+    const std::string suffix = "/planes:" + std::to_string(count);
+    for (const char* mode : {"exact", "fast"}) {
+      const json request = {
+          {"handle", handle},
+          {"origin", json::array({0.0, 0.0, 0.05})},
+          {"normal", "+Z"},
+          {"spacing", 9.9 / count},
+          {"count", count},
+          {"mode", mode},
+      };
+      runner.run(std::string("slice/") + mode + suffix, params, [&] { sliceShape(registry, request); });
+    }
+  }
+}
+
+// /v1/interference over a row-major grid of one placed prism (radius 12),
+// spaced so each instance overlaps its right-hand neighbour only: the broad
+// phase should leave about one exact check per instance.
+void benchInterference(BenchRunner& runner, const std::vector<int>& sizes) {
+  ShapeRegistry registry;
+  const KernelResult part = stackedPrisms(registry, 1, 16);
+  const std::string handle = part.outputs.at("body:0").meta.value("handle", "");
+  for (int side : sizes) {
+    json instances = json::array();
+    for (int x = 0; x < side; ++x) {
+      for (int y = 0; y < side; ++y) {
+        instances.push_back({
+            {"id", std::to_string(x) + "," + std::to_string(y)},
+            {"handle", handle},
+            {"transform", {{"translation", json::array({22.0 * x, 40.0 * y, 0.0})}}},
+        });
+      }
+    }
+    const json request = {{"instances", instances}};
+    runner.run("interference/grid:" + std::to_string(side), {{"instances", side * side}},
+               [&] { checkInterference(registry, request); });
+  }
+}
+
+// /v1/measure: the distance from every face of the bottom prism of a stack
+// of three to the whole top prism, as one batch and one request each.
+void benchMeasurement(BenchRunner& runner, const std::vector<int>& sizes) {
+  for (int sides : sizes) {
+    ShapeRegistry registry;
+    const KernelResult part = stackedPrisms(registry, 3, sides);
+    const std::string top = part.outputs.at("body:2").meta.value("handle", "");
+    json measurements = json::array();
+    for (const auto& sel : part.selections) {
+      if (sel.kind != "face" || sel.meta.value("ownerKey", "") != "body:0") continue;
+      measurements.push_back({{"kind", "distance"}, {"a", sel.meta.value("handle", "")}, {"b", top}});
+    }
+    const json params = {{"sides", sides}, {"measurements", measurements.size()}};
+    const std::string suffix = "/prism:" + std::to_string(sides);
+    runner.run("measure/batch" + suffix, params, [&] {
+      measureShapes(registry, part, {{"measurements", measurements}});
+    });
+    runner.run("measure/single" + suffix, params, [&] {
+      for (const auto& measurement : measurements) {
+        measureShapes(registry, part, {{"measurements", json::array({measurement})}});
+      }
+    });
+  }
+}
+
+// /v1/sweep over the height of a boss fused onto a shared 64-sided plate,
+// reporting volume and bounds, with the variants in parallel and serially.
+void benchSweeps(BenchRunner& runner, const std::vector<int>& counts) {
+  json boss = extrudeFeature("boss", {{"kind", "profile.circle"}, {"radius", 4.0}}, 0.0, "body:boss");
+  boss["depth"] = {{"kind", "expr.param"}, {"id", "height"}};
+  const json features = json::array({
+      extrudeFeature("plate", polyProfile(64, 40.0), 10.0, "body:plate"),
+      boss,
+      {
+          {"kind", "feature.boolean"},
+          {"id", "join"},
+          {"op", "union"},
+          {"left", {{"kind", "selector.named"}, {"name", "body:plate"}}},
+          {"right", {{"kind", "selector.named"}, {"name", "body:boss"}}},
+          {"result", "body:main"},
+      },
+  });
+  for (int count : counts) {
+    ShapeRegistry registry;
+    const json params = {{"variants", count}};
+    const std::string suffix = "/variants:" + std::to_string(count);
+    for (bool parallel : {true, false}) {
+      const json request = {
+          {"features", features},
+          {"parameter", "height"},
+          {"range", {{"from", 20.0}, {"to", 60.0}, {"count", count}}},
+          {"outputs", json::array({"body:main"})},
+          {"parallel", parallel},
+      };
+      runner.run(std::string("sweep/") + (parallel ? "parallel" : "serial") + suffix, params, [&] {
+        runSweep(*prepareSweep(registry, KernelResult{}, request), [](const json&) { return true; });
+      });
+    }
+  }
+}
+
+void benchMeshing(BenchRunner& runner, const std::vector<int>& sizes) {
+  for (int sides : sizes) {
+    ShapeRegistry registry;
+    const KernelResult part = stackedPrisms(registry, 1, sides);
+    const TopoDS_Shape shape = bodyShape(part, registry, "body:0");
+    for (double deflection : {0.5, 0.1, 0.02}) {
+      const json options = {{"linearDeflection", deflection}, {"angularDeflection", 0.5}};
+      char label[32];
+      std::snprintf(label, sizeof(label), "%g", deflection);
+      runner.run("meshShape/deflection:" + std::string(label) + "/prism:" + std::to_string(sides),
+                 {{"sides", sides}, {"linearDeflection", deflection}},
+                 [&] { meshShape(shape, options); },
+                 [&] { BRepTools::Clean(shape); });
+    }
+  }
+
+  ShapeRegistry registry;
+  const json circle = {{"kind", "profile.circle"}, {"radius", 10.0}};
+  const KernelResult cylinder = executeFeature(
+      extrudeFeature("cylinder", circle, 20.0, "body:cylinder"), KernelResult{}, registry);
+  const TopoDS_Shape shape = bodyShape(cylinder, registry, "body:cylinder");
+  for (double deflection : {0.5, 0.1, 0.02}) {
+    const json options = {{"linearDeflection", deflection}, {"angularDeflection", 0.5}};
+    char label[32];
+    std::snprintf(label, sizeof(label), "%g", deflection);
+    runner.run("meshShape/deflection:" + std::string(label) + "/cylinder",
+               {{"linearDeflection", deflection}},
+               [&] { meshShape(shape, options); },
+               [&] { BRepTools::Clean(shape); });
+  }
+}
+
+void benchStepExport(BenchRunner& runner, const std::vector<int>& sizes) {
+  ensureStepControllersReady();
+  for (int sides : sizes) {
+    ShapeRegistry registry;
+    const KernelResult part = stackedPrisms(registry, 1, sides);
+    const TopoDS_Shape shape = bodyShape(part, registry, "body:0");
+    runner.run("exportStep/AP242/prism:" + std::to_string(sides), {{"sides", sides}},
+               [&] { exportStep(shape, "AP242"); });
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  for (int index = 1; index < argc; ++index) {
+    const std::string arg = argv[index];
+    const bool hasValue = index + 1 < argc;
+    if (arg == "--filter" && hasValue) {
+      options.filter = argv[++index];
+    } else if (arg == "--min-time" && hasValue) {
+      options.minTimeSeconds = std::stod(argv[++index]);
+    } else if (arg == "--out" && hasValue) {
+      options.outPath = argv[++index];
+    } else {
+      std::cerr << "usage: occt_server_bench [--filter <substring>] [--min-time <seconds>] [--out <file>]"
+                << std::endl;
+      return 2;
+    }
+  }
+
+  BenchRunner runner(options);
+  benchProfiles(runner);
+  benchSelections(runner, {8, 64, 512});
+  benchResults(runner, {1, 8, 32, 128});
+  benchBooleans(runner, {8, 48});
+  benchPatterns(runner, {8, 48});
+  benchQueries(runner, {8, 64});
+  benchPicking(runner, {8, 64, 512});
+  benchSlicing(runner, {8, 64});
+  benchInterference(runner, {4, 8});
+  benchMeasurement(runner, {8, 64});
+  benchSweeps(runner, {4, 16});
+  benchMeshing(runner, {8, 64, 512});
+  benchStepExport(runner, {8, 64, 512});
+
+  const std::string report = runner.report().dump(2) + "\n";
+  if (options.outPath.empty()) {
+    std::cout << report;
+  } else {
+    std::ofstream out(options.outPath, std::ios::binary | std::ios::trunc);
+    out << report;
+    if (!out) {
+      std::cerr << "failed to write " << options.outPath << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,389 @@
+#include "bench_http.h"
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+
+// Long-running soak test for occt_server. Workers drive a seeded random mix of
+// exec-feature, mesh and export-step calls across many sessions, each session
+// growing a part up to --max-history features and then rebuilding it from
+// scratch the way a client regenerates. A sampler records server RSS and the
+// /v1/metrics counters (session/registry sizes, OSD_MemInfo heap usage) every
+// --sample-interval seconds:
+//
+//   occt_soak --server ./build/occt_server --duration 4h [--seed 1] [--sessions 32]
+//       [--concurrency 4] [--csv soak.csv] [--out soak.json]
+//
+// Growth is the least-squares slope of each series over the samples after the
+// warm-up fraction. The run fails (exit 1) when RSS still grows faster than
+// --max-rss-slope MiB/hour there, i.e. memory has not plateaued.
+
+namespace {
+
+struct SoakOptions {
+  std::string serverPath;
+  std::string url;
+  int port = 18182;
+  pid_t pid = 0;
+  double durationSeconds = 3600.0;
+  std::uint64_t seed = 1;
+  int sessions = 32;
+  int concurrency = 4;
+  int maxHistory = 40;
+  double sampleIntervalSeconds = 10.0;
+  double warmupFraction = 0.5;
+  double maxRssSlopeMiBPerHour = 8.0;
+  std::string csvPath;
+  std::string outPath;
+};
+
+struct SoakSample {
+  double elapsedSeconds = 0.0;
+  double rssMiB = -1.0;
+  double heapMiB = -1.0;
+  double sessions = 0.0;
+  double shapes = 0.0;
+  std::uint64_t requests = 0;
+  std::uint64_t errors = 0;
+};
+
+struct SoakCounters {
+  std::atomic<std::uint64_t> execs{0};
+  std::atomic<std::uint64_t> rebuilds{0};
+  std::atomic<std::uint64_t> meshes{0};
+  std::atomic<std::uint64_t> exports{0};
+  std::atomic<std::uint64_t> errors{0};
+
+  std::uint64_t requests() const { return execs + meshes + exports; }
+};
+
+void usage() {
+  std::cerr << "usage: occt_soak (--server <occt_server> [--port <n>] | --url <base-url> [--pid <n>])\n"
+               "                 [--duration <seconds|30m|4h>] [--seed <n>] [--sessions <n>] [--concurrency <n>]\n"
+               "                 [--max-history <n>] [--sample-interval <seconds>] [--warmup <fraction>]\n"
+               "                 [--max-rss-slope <MiB/hour>] [--csv <file>] [--out <file>]"
+            << std::endl;
+}
+
+double parseDuration(const std::string& value) {
+  const double number = std::stod(value);
+  switch (value.empty() ? 's' : value.back()) {
+    case 'h': return number * 3600.0;
+    case 'm': return number * 60.0;
+    default: return number;
+  }
+}
+
+bool parseOptions(int argc, char** argv, SoakOptions& options) {
+  for (int index = 1; index < argc; ++index) {
+    const std::string arg = argv[index];
+    if (index + 1 >= argc) return false;
+    const std::string value = argv[++index];
+    if (arg == "--server") {
+      options.serverPath = value;
+    } else if (arg == "--url") {
+      options.url = value;
+    } else if (arg == "--port") {
+      options.port = std::stoi(value);
+    } else if (arg == "--pid") {
+      options.pid = static_cast<pid_t>(std::stol(value));
+    } else if (arg == "--duration") {
+      options.durationSeconds = parseDuration(value);
+    } else if (arg == "--seed") {
+      options.seed = std::stoull(value);
+    } else if (arg == "--sessions") {
+      options.sessions = std::max(1, std::stoi(value));
+    } else if (arg == "--concurrency") {
+      options.concurrency = std::max(1, std::stoi(value));
+    } else if (arg == "--max-history") {
+      options.maxHistory = std::max(1, std::stoi(value));
+    } else if (arg == "--sample-interval") {
+      options.sampleIntervalSeconds = std::max(0.1, std::stod(value));
+    } else if (arg == "--warmup") {
+      options.warmupFraction = std::min(0.9, std::max(0.0, std::stod(value)));
+    } else if (arg == "--max-rss-slope") {
+      options.maxRssSlopeMiBPerHour = std::stod(value);
+    } else if (arg == "--csv") {
+      options.csvPath = value;
+    } else if (arg == "--out") {
+      options.outPath = value;
+    } else {
+      return false;
+    }
+  }
+  return options.serverPath.empty() != options.url.empty();
+}
+
+struct SoakSession {
+  std::string id;
+  UpstreamState upstream;
+  int history = 0;
+  int generation = 0;
+};
+
+class SoakWorker {
+ public:
+  SoakWorker(const std::string& url, std::uint64_t seed, int maxHistory, SoakCounters& counters)
+      : client_(url), random_(seed), maxHistory_(maxHistory), counters_(counters) {
+    client_.set_keep_alive(true);
+    client_.set_tcp_nodelay(true);
+    client_.set_read_timeout(600, 0);
+    client_.set_write_timeout(600, 0);
+  }
+
+  void addSession(const std::string& id) { sessions_.push_back({id, {}, 0, 0}); }
+
+  void step() {
+    SoakSession& session = sessions_[pick(sessions_.size())];
+    const std::vector<std::string> handles = session.upstream.solidHandles();
+    const double roll = uniform();
+    if (handles.empty() || roll < 0.6) {
+      execFeature(session);
+    } else if (roll < 0.85) {
+      const json options = {{"linearDeflection", 0.02 + 0.5 * uniform()}, {"angularDeflection", 0.5}};
+      post("/v1/mesh", {{"sessionId", session.id}, {"handle", handles[pick(handles.size())]}, {"options", options}});
+      ++counters_.meshes;
+    } else {
+      post("/v1/export-step", {{"sessionId", session.id}, {"handle", handles[pick(handles.size())]}});
+      ++counters_.exports;
+    }
+  }
+
+ private:
+  std::size_t pick(std::size_t count) {
+    return static_cast<std::size_t>(random_() % static_cast<std::uint64_t>(count));
+  }
+
+  double uniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(random_); }
+
+  void execFeature(SoakSession& session) {
+    if (session.history >= maxHistory_ || (session.history > 0 && uniform() < 0.05)) {
+      session.upstream.clear();
+      session.history = 0;
+      ++session.generation;
+      ++counters_.rebuilds;
+    }
+    const std::string id = "g" + std::to_string(session.generation) + "-f" + std::to_string(session.history);
+    json feature;
+    const double roll = uniform();
+    if (session.history == 0 || roll < 0.6) {
+      feature = {
+          {"kind", "feature.extrude"},
+          {"id", id},
+          {"profile",
+           {{"kind", "profile.poly"},
+            {"sides", 3 + static_cast<int>(pick(46))},
+            {"radius", 2.0 + 10.0 * uniform()},
+            {"center", json::array({0, 0, 10.0 * session.history})}}},
+          {"depth", 1.0 + 9.0 * uniform()},
+          {"axis", "+Z"},
+          {"result", "body:" + std::to_string(session.history)},
+      };
+    } else if (roll < 0.8) {
+      feature = {{"kind", "datum.plane"}, {"id", id}, {"origin", json::array({0, 0, uniform()})}, {"normal", "+Z"}};
+    } else {
+      feature = {
+          {"kind", "datum.frame"},
+          {"id", id},
+          {"on",
+           {{"kind", "selector.face"},
+            {"predicates", json::array({{{"kind", "pred.planar"}}})},
+            {"rank", json::array({{{"kind", "rank.maxZ"}}})}}},
+      };
+    }
+    const std::string body =
+        json{{"sessionId", session.id}, {"feature", feature}, {"upstream", session.upstream.serialize()}}.dump();
+    ++counters_.execs;
+    httplib::Result res = client_.Post("/v1/exec-feature", body, "application/json");
+    if (!res || res->status != 200) {
+      ++counters_.errors;
+      return;
+    }
+    session.upstream.merge(json::parse(res->body).at("result"));
+    ++session.history;
+  }
+
+  void post(const char* path, const json& payload) {
+    httplib::Result res = client_.Post(path, payload.dump(), "application/json");
+    if (!res || res->status != 200) ++counters_.errors;
+  }
+
+  httplib::Client client_;
+  std::mt19937_64 random_;
+  int maxHistory_;
+  SoakCounters& counters_;
+  std::vector<SoakSession> sessions_;
+};
+
+SoakSample takeSample(httplib::Client& client, pid_t pid, double elapsedSeconds, const SoakCounters& counters) {
+  SoakSample sample;
+  sample.elapsedSeconds = elapsedSeconds;
+  const long rssKiB = readRssKiB(pid);
+  if (rssKiB >= 0) sample.rssMiB = static_cast<double>(rssKiB) / 1024.0;
+  sample.requests = counters.requests();
+  sample.errors = counters.errors;
+  if (httplib::Result res = client.Get("/v1/metrics")) {
+    if (res->status == 200) {
+      const json metrics = json::parse(res->body, nullptr, false);
+      if (metrics.is_object()) {
+        const json sessions = metrics.value("sessions", json::object());
+        const json memory = metrics.value("memory", json::object());
+        sample.sessions = sessions.value("count", 0.0);
+        sample.shapes = sessions.value("shapes", 0.0);
+        if (memory.contains("heapUsedBytes") && memory["heapUsedBytes"].is_number()) {
+          sample.heapMiB = memory["heapUsedBytes"].get<double>() / (1024.0 * 1024.0);
+        }
+        if (sample.rssMiB < 0 && memory.contains("rssBytes") && memory["rssBytes"].is_number()) {
+          sample.rssMiB = memory["rssBytes"].get<double>() / (1024.0 * 1024.0);
+        }
+      }
+    }
+  }
+  return sample;
+}
+
+// Least-squares slope of `value` per hour over samples from `first` on.
+double slopePerHour(const std::vector<SoakSample>& samples,
+                    std::size_t first,
+                    const std::function<double(const SoakSample&)>& value) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (std::size_t i = first; i < samples.size(); ++i) {
+    const double y = value(samples[i]);
+    if (y < 0) continue;
+    const double x = samples[i].elapsedSeconds / 3600.0;
+    n += 1;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  const double denom = n * sxx - sx * sx;
+  return n < 2 || denom == 0.0 ? std::nan("") : (n * sxy - sx * sy) / denom;
+}
+
+json jsonNumber(double value) { return std::isnan(value) ? json(nullptr) : json(value); }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  SoakOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage();
+    return 2;
+  }
+
+  std::unique_ptr<ServerProcess> server;
+  std::string url = options.url;
+  pid_t pid = options.pid;
+  if (!options.serverPath.empty()) {
+    server = std::make_unique<ServerProcess>(options.serverPath, options.port);
+    url = "http://127.0.0.1:" + std::to_string(options.port);
+    pid = server->pid();
+  }
+  httplib::Client sampler(url);
+  sampler.set_keep_alive(true);
+  sampler.set_tcp_nodelay(true);
+  try {
+    waitForServer(sampler);
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+
+  SoakCounters counters;
+  std::vector<std::unique_ptr<SoakWorker>> workers;
+  for (int index = 0; index < options.concurrency; ++index) {
+    workers.push_back(std::make_unique<SoakWorker>(url, options.seed * 7919 + static_cast<std::uint64_t>(index),
+                                                   options.maxHistory, counters));
+  }
+  for (int index = 0; index < options.sessions; ++index) {
+    workers[static_cast<std::size_t>(index % options.concurrency)]->addSession("soak-" + std::to_string(index));
+  }
+
+  std::ofstream csv;
+  if (!options.csvPath.empty()) {
+    csv.open(options.csvPath, std::ios::binary | std::ios::trunc);
+    csv << "elapsed_s,rss_mib,heap_mib,sessions,shapes,requests,errors\n";
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(options.durationSeconds));
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (auto& worker : workers) {
+    threads.emplace_back([&, workerPtr = worker.get()] {
+      while (!stop && std::chrono::steady_clock::now() < deadline) workerPtr->step();
+    });
+  }
+
+  std::vector<SoakSample> samples;
+  const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(options.sampleIntervalSeconds));
+  for (auto next = start; next <= deadline; next += interval) {
+    std::this_thread::sleep_until(next);
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const SoakSample sample = takeSample(sampler, pid, elapsed, counters);
+    samples.push_back(sample);
+    if (csv.is_open()) {
+      csv << sample.elapsedSeconds << ',' << sample.rssMiB << ',' << sample.heapMiB << ',' << sample.sessions << ','
+          << sample.shapes << ',' << sample.requests << ',' << sample.errors << '\n';
+      csv.flush();
+    }
+    std::fprintf(stderr, "%8.0fs rss %8.1f MiB heap %8.1f MiB shapes %9.0f requests %9llu errors %llu\n",
+                 sample.elapsedSeconds, sample.rssMiB, sample.heapMiB, sample.shapes,
+                 static_cast<unsigned long long>(sample.requests), static_cast<unsigned long long>(sample.errors));
+  }
+  stop = true;
+  for (auto& thread : threads) thread.join();
+
+  const std::size_t first = static_cast<std::size_t>(options.warmupFraction * static_cast<double>(samples.size()));
+  const double rssSlope = slopePerHour(samples, first, [](const SoakSample& s) { return s.rssMiB; });
+  const double heapSlope = slopePerHour(samples, first, [](const SoakSample& s) { return s.heapMiB; });
+  const double shapeSlope = slopePerHour(samples, first, [](const SoakSample& s) { return s.shapes; });
+  const bool plateaued = !std::isnan(rssSlope) && rssSlope <= options.maxRssSlopeMiBPerHour;
+
+  std::printf("requests %llu (exec %llu, rebuilds %llu, mesh %llu, export %llu), errors %llu\n",
+              static_cast<unsigned long long>(counters.requests()),
+              static_cast<unsigned long long>(counters.execs.load()),
+              static_cast<unsigned long long>(counters.rebuilds.load()),
+              static_cast<unsigned long long>(counters.meshes.load()),
+              static_cast<unsigned long long>(counters.exports.load()),
+              static_cast<unsigned long long>(counters.errors.load()));
+  std::printf("after warm-up: rss %+.2f MiB/h (budget %.2f), heap %+.2f MiB/h, registry %+.0f shapes/h -> %s\n",
+              rssSlope, options.maxRssSlopeMiBPerHour, heapSlope, shapeSlope,
+              plateaued ? "plateaued" : "STILL GROWING");
+
+  if (!options.outPath.empty()) {
+    json series = json::array();
+    for (const auto& sample : samples) {
+      series.push_back({{"elapsedSeconds", sample.elapsedSeconds},
+                        {"rssMiB", jsonNumber(sample.rssMiB)},
+                        {"heapMiB", jsonNumber(sample.heapMiB)},
+                        {"sessions", sample.sessions},
+                        {"shapes", sample.shapes},
+                        {"requests", sample.requests},
+                        {"errors", sample.errors}});
+    }
+    const json report = {
+        {"seed", options.seed},
+        {"durationSeconds", options.durationSeconds},
+        {"sessions", options.sessions},
+        {"concurrency", options.concurrency},
+        {"requests", counters.requests()},
+        {"errors", counters.errors.load()},
+        {"rssSlopeMiBPerHour", jsonNumber(rssSlope)},
+        {"heapSlopeMiBPerHour", jsonNumber(heapSlope)},
+        {"shapeSlopePerHour", jsonNumber(shapeSlope)},
+        {"maxRssSlopeMiBPerHour", options.maxRssSlopeMiBPerHour},
+        {"plateaued", plateaued},
+        {"samples", series},
+    };
+    std::ofstream out(options.outPath, std::ios::binary | std::ios::trunc);
+    out << report.dump(2) << "\n";
+  }
+  return plateaued ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+// Environment lookups for TF_NATIVE_* server settings. Unset or unparsable
+// values fall back to the given default.
+
+inline std::string envString(const char* name, const std::string& fallback) {
+  const char* value = std::getenv(name);
+  return value && value[0] != '\0' ? std::string(value) : fallback;
+}
+
+inline double envDouble(const char* name, double fallback) {
+  const char* value = std::getenv(name);
+  if (!value || value[0] == '\0') return fallback;
+  try {
+    return std::stod(value);
+  } catch (...) {
+    return fallback;
+  }
+}
@@ -0,0 +1,3603 @@
+#include "kernel.h"
+
+#include "alloc_stats.h"
+#include "mesh_prefetch.h"
+#include "pick_bvh.h"
+#include "selection_ids.h"
+#include "slice.h"
+#include "request_phases.h"
+#include "trace.h"
+
+#include <BRepAdaptor_Surface.hxx>
+#include <BRepAdaptor_Curve.hxx>
+#include <BOPAlgo_GlueEnum.hxx>
+#include <BRepAlgoAPI_Common.hxx>
+#include <BRepAlgoAPI_Cut.hxx>
+#include <BRepAlgoAPI_Fuse.hxx>
+#include <BRepAlgoAPI_Section.hxx>
+#include <BRepBndLib.hxx>
+#include <BRepBuilderAPI_Copy.hxx>
+#include <BRepExtrema_DistShapeShape.hxx>
+#include <BRepBuilderAPI_MakeEdge.hxx>
+#include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakePolygon.hxx>
+#include <BRepBuilderAPI_MakeWire.hxx>
+#include <BRepGProp.hxx>
+#include <BRepOffsetAPI_MakePipe.hxx>
+#include <BRepOffsetAPI_ThruSections.hxx>
+#include <BRepPrimAPI_MakeCylinder.hxx>
+#include <BRepPrimAPI_MakeRevol.hxx>
+#include <BRepPrimAPI_MakePrism.hxx>
+#include <BRepTools.hxx>
+#include <BRepTools_History.hxx>
+#include <BRep_Builder.hxx>
+#include <BRep_Tool.hxx>
+#include <BRepMesh_IncrementalMesh.hxx>
+#include <BinTools.hxx>
+#include <GCPnts_TangentialDeflection.hxx>
+#include <GeomAbs_SurfaceType.hxx>
+#include <GProp_GProps.hxx>
+#include <IMeshTools_Parameters.hxx>
+#include <Interface_Static.hxx>
+#include <OSD_MemInfo.hxx>
+#include <OSD_Parallel.hxx>
+#include <Poly_Triangulation.hxx>
+#include <STEPCAFControl_Controller.hxx>
+#include <STEPCAFControl_Writer.hxx>
+#include <STEPControl_Controller.hxx>
+#include <STEPControl_Writer.hxx>
+#include <TCollection_HAsciiString.hxx>
+#include <TDF_Label.hxx>
+#include <TDF_LabelSequence.hxx>
+#include <TDocStd_Document.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopExp.hxx>
+#include <TopLoc_Location.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Compound.hxx>
+#include <TopoDS_Edge.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopoDS_Iterator.hxx>
+#include <TopoDS_Shape.hxx>
+#include <TopoDS_Wire.hxx>
+#include <TopTools_DataMapOfShapeInteger.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopTools_ListOfShape.hxx>
+#include <XCAFDoc_Datum.hxx>
+#include <XCAFDoc_DimTolTool.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_GeomTolerance.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+#include <XCAFDimTolObjects_DatumObject.hxx>
+#include <XCAFDimTolObjects_DatumSingleModif.hxx>
+#include <XCAFDimTolObjects_GeomToleranceModif.hxx>
+#include <XCAFDimTolObjects_GeomToleranceObject.hxx>
+#include <XCAFDimTolObjects_GeomToleranceType.hxx>
+#include <XCAFDimTolObjects_GeomToleranceTypeValue.hxx>
+#include <gp_Ax1.hxx>
+#include <gp_Dir.hxx>
+#include <gp_Pln.hxx>
+#include <gp_Pnt.hxx>
+#include <gp_Trsf.hxx>
+#include <gp_Vec.hxx>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+static double parseScalar(const json& value, double fallback = 0.0) {
+  if (value.is_number()) {
+    return value.get<double>();
+  }
+  if (value.is_object()) {
+    const std::string kind = value.value("kind", "");
+    if (kind == "expr.literal") {
+      return value.value("value", fallback);
+    }
+  }
+  return fallback;
+}
+
+static gp_Pnt parsePoint2D(const json& value, double z = 0.0) {
+  if (!value.is_array() || value.size() < 2) {
+    return gp_Pnt(0, 0, z);
+  }
+  const double zValue = value.size() >= 3 ? parseScalar(value[2]) : z;
+  return gp_Pnt(parseScalar(value[0]), parseScalar(value[1]), zValue);
+}
+
+static gp_Pnt parsePoint3D(const json& value) {
+  if (!value.is_array() || value.size() < 3) {
+    return gp_Pnt(0, 0, 0);
+  }
+  return gp_Pnt(parseScalar(value[0]), parseScalar(value[1]), parseScalar(value[2]));
+}
+
+static gp_Vec axisVectorFromString(const std::string& dir) {
+  if (dir == "+X") return gp_Vec(1, 0, 0);
+  if (dir == "-X") return gp_Vec(-1, 0, 0);
+  if (dir == "+Y") return gp_Vec(0, 1, 0);
+  if (dir == "-Y") return gp_Vec(0, -1, 0);
+  if (dir == "+Z") return gp_Vec(0, 0, 1);
+  if (dir == "-Z") return gp_Vec(0, 0, -1);
+  return gp_Vec(0, 0, 1);
+}
+
+static std::string axisDirectionFromVector(const gp_Vec& vec) {
+  const double ax = std::abs(vec.X());
+  const double ay = std::abs(vec.Y());
+  const double az = std::abs(vec.Z());
+  const double maxVal = std::max(ax, std::max(ay, az));
+  if (maxVal < 0.9) return "";
+  if (ax >= ay && ax >= az) return vec.X() >= 0 ? "+X" : "-X";
+  if (ay >= ax && ay >= az) return vec.Y() >= 0 ? "+Y" : "-Y";
+  return vec.Z() >= 0 ? "+Z" : "-Z";
+}
+
+static json vecToJson(const gp_Vec& vec) {
+  return json::array({vec.X(), vec.Y(), vec.Z()});
+}
+
+static json pointToJson(const gp_Pnt& pnt) {
+  return json::array({pnt.X(), pnt.Y(), pnt.Z()});
+}
+
+static std::string selectionOwnerToken(const std::string& ownerKey) {
+  std::string token = ownerKey;
+  for (char& ch : token) {
+    if (ch == ':') ch = '.';
+  }
+  return token;
+}
+
+static TopoDS_Face makeRectangleFace(double width, double height, const gp_Pnt& center) {
+  const double halfW = width / 2.0;
+  const double halfH = height / 2.0;
+  const double cx = center.X();
+  const double cy = center.Y();
+  const double cz = center.Z();
+  BRepBuilderAPI_MakePolygon poly;
+  poly.Add(gp_Pnt(cx - halfW, cy - halfH, cz));
+  poly.Add(gp_Pnt(cx + halfW, cy - halfH, cz));
+  poly.Add(gp_Pnt(cx + halfW, cy + halfH, cz));
+  poly.Add(gp_Pnt(cx - halfW, cy + halfH, cz));
+  poly.Close();
+  TopoDS_Wire wire = poly.Wire();
+  return BRepBuilderAPI_MakeFace(gp_Pln(center, gp_Dir(0, 0, 1)), wire, true);
+}
+
+static TopoDS_Face makeCircleFace(double radius, const gp_Pnt& center) {
+  gp_Circ circ(gp_Ax2(center, gp_Dir(0, 0, 1)), radius);
+  TopoDS_Edge edge = BRepBuilderAPI_MakeEdge(circ);
+  TopoDS_Wire wire = BRepBuilderAPI_MakeWire(edge);
+  return BRepBuilderAPI_MakeFace(gp_Pln(center, gp_Dir(0, 0, 1)), wire, true);
+}
+
+static TopoDS_Face makePolygonFace(int sides, double radius, const gp_Pnt& center, double rotation) {
+  if (sides < 3) {
+    throw std::runtime_error("profile.poly requires sides >= 3");
+  }
+  BRepBuilderAPI_MakePolygon poly;
+  const double step = (2.0 * M_PI) / static_cast<double>(sides);
+  for (int i = 0; i < sides; ++i) {
+    const double angle = rotation + step * static_cast<double>(i);
+    const double x = center.X() + radius * std::cos(angle);
+    const double y = center.Y() + radius * std::sin(angle);
+    poly.Add(gp_Pnt(x, y, center.Z()));
+  }
+  poly.Close();
+  TopoDS_Wire wire = poly.Wire();
+  return BRepBuilderAPI_MakeFace(gp_Pln(center, gp_Dir(0, 0, 1)), wire, true);
+}
+
+TopoDS_Face buildProfileFace(const json& profile) {
+  const std::string kind = profile.value("kind", "");
+  if (kind == "profile.rectangle") {
+    double width = parseScalar(profile["width"]);
+    double height = parseScalar(profile["height"]);
+    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
+    return makeRectangleFace(width, height, center);
+  }
+  if (kind == "profile.circle") {
+    double radius = parseScalar(profile["radius"]);
+    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
+    return makeCircleFace(radius, center);
+  }
+  if (kind == "profile.poly") {
+    int sides = static_cast<int>(parseScalar(profile["sides"]));
+    double radius = parseScalar(profile["radius"]);
+    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
+    double rotation = parseScalar(profile.value("rotation", 0.0));
+    return makePolygonFace(sides, radius, center, rotation);
+  }
+  throw std::runtime_error("Unsupported profile kind: " + kind);
+}
+
+TopoDS_Wire buildProfileWire(const json& profile) {
+  const std::string kind = profile.value("kind", "");
+  if (kind == "profile.rectangle") {
+    double width = parseScalar(profile["width"]);
+    double height = parseScalar(profile["height"]);
+    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
+    const double halfW = width / 2.0;
+    const double halfH = height / 2.0;
+    const double cx = center.X();
+    const double cy = center.Y();
+    const double cz = center.Z();
+    BRepBuilderAPI_MakePolygon poly;
+    poly.Add(gp_Pnt(cx - halfW, cy - halfH, cz));
+    poly.Add(gp_Pnt(cx + halfW, cy - halfH, cz));
+    poly.Add(gp_Pnt(cx + halfW, cy + halfH, cz));
+    poly.Add(gp_Pnt(cx - halfW, cy + halfH, cz));
+    poly.Close();
+    return poly.Wire();
+  }
+  if (kind == "profile.circle") {
+    double radius = parseScalar(profile["radius"]);
+    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
+    gp_Circ circ(gp_Ax2(center, gp_Dir(0, 0, 1)), radius);
+    TopoDS_Edge edge = BRepBuilderAPI_MakeEdge(circ);
+    return BRepBuilderAPI_MakeWire(edge);
+  }
+  if (kind == "profile.poly") {
+    int sides = static_cast<int>(parseScalar(profile["sides"]));
+    double radius = parseScalar(profile["radius"]);
+    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
+    double rotation = parseScalar(profile.value("rotation", 0.0));
+    BRepBuilderAPI_MakePolygon poly;
+    const double step = (2.0 * M_PI) / static_cast<double>(sides);
+    for (int i = 0; i < sides; ++i) {
+      const double angle = rotation + step * static_cast<double>(i);
+      const double x = center.X() + radius * std::cos(angle);
+      const double y = center.Y() + radius * std::sin(angle);
+      poly.Add(gp_Pnt(x, y, center.Z()));
+    }
+    poly.Close();
+    return poly.Wire();
+  }
+  throw std::runtime_error("Unsupported profile kind for wire: " + kind);
+}
+
+static TopoDS_Wire buildPathWire(const json& path) {
+  const std::string kind = path.value("kind", "");
+  if (kind == "path.polyline") {
+    const json points = path.value("points", json::array());
+    if (!points.is_array() || points.size() < 2) {
+      throw std::runtime_error("path.polyline requires at least two points");
+    }
+    BRepBuilderAPI_MakePolygon poly;
+    for (const auto& point : points) {
+      poly.Add(parsePoint3D(point));
+    }
+    if (path.value("closed", false)) {
+      poly.Close();
+    }
+    return poly.Wire();
+  }
+  if (kind == "path.segments") {
+    const json segments = path.value("segments", json::array());
+    if (!segments.is_array() || segments.empty()) {
+      throw std::runtime_error("path.segments requires at least one segment");
+    }
+    BRepBuilderAPI_MakeWire wire;
+    for (const auto& segment : segments) {
+      if (segment.value("kind", "") != "path.line") {
+        throw std::runtime_error("Native backend sweep currently supports only line path segments");
+      }
+      wire.Add(BRepBuilderAPI_MakeEdge(
+          parsePoint3D(segment.value("start", json::array({0, 0, 0}))),
+          parsePoint3D(segment.value("end", json::array({0, 0, 0})))));
+    }
+    return wire.Wire();
+  }
+  throw std::runtime_error("Native backend sweep currently supports path.polyline or line-only path.segments");
+}
+
+static json resolveProfileJson(const json& profileRef, const KernelResult& upstream) {
+  const std::string kind = profileRef.value("kind", "");
+  if (kind != "profile.ref") return profileRef;
+  const std::string name = profileRef.value("name", "");
+  auto it = upstream.outputs.find(name);
+  if (it == upstream.outputs.end()) {
+    throw std::runtime_error("Missing profile output: " + name);
+  }
+  if (it->second.kind != "profile") {
+    throw std::runtime_error("Output is not a profile: " + name);
+  }
+  if (!it->second.meta.contains("profile") || !it->second.meta["profile"].is_object()) {
+    throw std::runtime_error("Profile output missing profile data: " + name);
+  }
+  return it->second.meta["profile"];
+}
+
+static json resolvePlaneBasisJson(const json& planeRef, const KernelResult& upstream) {
+  if (!planeRef.is_object()) {
+    return {
+        {"origin", json::array({0, 0, 0})},
+        {"xDir", json::array({1, 0, 0})},
+        {"yDir", json::array({0, 1, 0})},
+        {"normal", json::array({0, 0, 1})},
+    };
+  }
+  if (planeRef.value("kind", "") == "plane.datum") {
+    const std::string ref = planeRef.value("ref", "");
+    auto it = upstream.outputs.find("datum:" + ref);
+    if (it == upstream.outputs.end()) {
+      throw std::runtime_error("Missing plane datum: " + ref);
+    }
+    if (it->second.kind != "datum") {
+      throw std::runtime_error("Referenced plane datum is not a datum: " + ref);
+    }
+    const json meta = it->second.meta;
+    if (meta.value("type", "") != "plane") {
+      throw std::runtime_error("Referenced datum is not a plane: " + ref);
+    }
+    return {
+        {"origin", meta.value("origin", json::array({0, 0, 0}))},
+        {"xDir", meta.value("xDir", json::array({1, 0, 0}))},
+        {"yDir", meta.value("yDir", json::array({0, 1, 0}))},
+        {"normal", meta.value("normal", json::array({0, 0, 1}))},
+    };
+  }
+  throw std::runtime_error("Native backend plane feature currently supports default or plane.datum references only");
+}
+
+static gp_Vec parseAxis(const json& axis) {
+  if (axis.is_string()) {
+    return axisVectorFromString(axis.get<std::string>());
+  }
+  if (axis.is_object()) {
+    const std::string kind = axis.value("kind", "");
+    if (kind == "axis.vector") {
+      auto direction = axis.value("direction", json::array({0, 0, 1}));
+      if (!direction.is_array() || direction.size() < 3) return gp_Vec(0, 0, 1);
+      return gp_Vec(parseScalar(direction[0]), parseScalar(direction[1]), parseScalar(direction[2]));
+    }
+    if (kind == "axis.sketch.normal") {
+      return gp_Vec(0, 0, 1);
+    }
+  }
+  return gp_Vec(0, 0, 1);
+}
+
+// Most planes one /v1/slice request may cut with.
+constexpr int kMaxSliceCount = 10000;
+
+// Rounded and clamped to at least 1, like the WASM backend's counts. Counts
+// above `max` are rejected rather than cast out of range.
+static int parseCount(const json& value,
+                      const std::string& label,
+                      int max = std::numeric_limits<int>::max()) {
+  const double count = std::round(parseScalar(value));
+  if (!std::isfinite(count)) {
+    throw std::runtime_error(label + " must be a number");
+  }
+  if (count > max) {
+    throw std::runtime_error(label + " must be at most " + std::to_string(max));
+  }
+  return static_cast<int>(std::max(1.0, count));
+}
+
+static json makeSolidMeta(const std::string& handle,
+                          const std::string& ownerKey,
+                          const std::string& featureId,
+                          const gp_Pnt& center,
+                          const json& tags) {
+  json meta;
+  meta["handle"] = handle;
+  meta["ownerHandle"] = handle;
+  meta["ownerKey"] = ownerKey;
+  meta["createdBy"] = featureId;
+  meta["role"] = "body";
+  meta["center"] = pointToJson(center);
+  meta["centerZ"] = center.Z();
+  if (!tags.is_null()) meta["featureTags"] = tags;
+  return meta;
+}
+
+static json makeFaceMeta(const std::string& handle,
+                         const std::string& ownerHandle,
+                         const std::string& ownerKey,
+                         const std::string& featureId,
+                         const gp_Pnt& center,
+                         double area,
+                         bool planar,
+                         const std::string& normal,
+                         const std::optional<gp_Vec>& normalVec,
+                         const json& tags) {
+  json meta;
+  meta["handle"] = handle;
+  meta["ownerHandle"] = ownerHandle;
+  meta["ownerKey"] = ownerKey;
+  meta["createdBy"] = featureId;
+  meta["planar"] = planar;
+  meta["area"] = area;
+  meta["center"] = pointToJson(center);
+  meta["centerZ"] = center.Z();
+  if (!normal.empty()) meta["normal"] = normal;
+  if (normalVec) meta["normalVec"] = vecToJson(*normalVec);
+  if (!tags.is_null()) meta["featureTags"] = tags;
+  return meta;
+}
+
+static json makeEdgeMeta(const std::string& handle,
+                         const std::string& ownerHandle,
+                         const std::string& ownerKey,
+                         const std::string& featureId,
+                         const gp_Pnt& center,
+                         const json& tags) {
+  json meta;
+  meta["handle"] = handle;
+  meta["ownerHandle"] = ownerHandle;
+  meta["ownerKey"] = ownerKey;
+  meta["createdBy"] = featureId;
+  meta["role"] = "edge";
+  meta["center"] = pointToJson(center);
+  meta["centerZ"] = center.Z();
+  if (!tags.is_null()) meta["featureTags"] = tags;
+  return meta;
+}
+
+static KernelResult makeDatumResult(const std::string& key,
+                                    const std::string& id,
+                                    const json& meta) {
+  KernelResult result;
+  KernelObject output;
+  output.id = id;
+  output.kind = "datum";
+  output.meta = meta;
+  result.outputs[key] = output;
+  return result;
+}
+
+static KernelResult makeSketchProfileResult(const json& feature) {
+  KernelResult result;
+  const std::string featureId = feature.value("id", "sketch");
+  const json profiles = feature.value("profiles", json::array());
+  for (const auto& entry : profiles) {
+    const std::string name = entry.value("name", "");
+    if (name.empty()) {
+      throw std::runtime_error("feature.sketch2d profile entry missing name");
+    }
+    const json profile = entry.value("profile", json::object());
+    const std::string profileKind = profile.value("kind", "");
+    if (profileKind != "profile.rectangle" &&
+        profileKind != "profile.circle" &&
+        profileKind != "profile.poly") {
+      throw std::runtime_error("Native backend sketch2d currently supports only primitive profile outputs");
+    }
+    KernelObject output;
+    output.id = featureId + ":" + name;
+    output.kind = "profile";
+    output.meta = {
+        {"profile", profile},
+        {"createdBy", featureId},
+    };
+    result.outputs[name] = output;
+  }
+  return result;
+}
+
+static TopoDS_Face makePlaneFaceFromBasis(const json& basis,
+                                          double width,
+                                          double height,
+                                          const json& originOffset) {
+  gp_Pnt origin = parsePoint3D(basis.value("origin", json::array({0, 0, 0})));
+  json xDirJson = basis.value("xDir", json::array({1, 0, 0}));
+  json yDirJson = basis.value("yDir", json::array({0, 1, 0}));
+  gp_Vec xDir(parseScalar(xDirJson[0]), parseScalar(xDirJson[1]), parseScalar(xDirJson[2]));
+  gp_Vec yDir(parseScalar(yDirJson[0]), parseScalar(yDirJson[1]), parseScalar(yDirJson[2]));
+  if (xDir.Magnitude() == 0 || yDir.Magnitude() == 0) {
+    throw std::runtime_error("Invalid plane basis");
+  }
+  xDir.Normalize();
+  yDir.Normalize();
+
+  gp_Vec offset(
+      parseScalar(originOffset[0]),
+      parseScalar(originOffset[1]),
+      parseScalar(originOffset[2]));
+  gp_Pnt center(
+      origin.X() + offset.X(),
+      origin.Y() + offset.Y(),
+      origin.Z() + offset.Z());
+
+  const double halfW = width / 2.0;
+  const double halfH = height / 2.0;
+  auto addVec = [](const gp_Pnt& p, const gp_Vec& v) {
+    return gp_Pnt(p.X() + v.X(), p.Y() + v.Y(), p.Z() + v.Z());
+  };
+  gp_Vec xOff = xDir.Multiplied(halfW);
+  gp_Vec yOff = yDir.Multiplied(halfH);
+  BRepBuilderAPI_MakePolygon poly;
+  poly.Add(addVec(addVec(center, xOff), yOff));
+  poly.Add(addVec(addVec(center, xOff.Reversed()), yOff));
+  poly.Add(addVec(addVec(center, xOff.Reversed()), yOff.Reversed()));
+  poly.Add(addVec(addVec(center, xOff), yOff.Reversed()));
+  poly.Close();
+  return BRepBuilderAPI_MakeFace(poly.Wire());
+}
+
+template <typename Value, typename Compute>
+Value ShapeRegistry::cachedProperty(const std::string& handle,
+                                    std::optional<Value> ShapeProperties::*slot,
+                                    Compute compute) const {
+  const TopoDS_Shape shape = get(handle);
+  {
+    std::lock_guard<std::mutex> lock(propertiesMutex_);
+    auto it = properties_.find(shape);
+    if (it != properties_.end() && it->second.*slot) return *(it->second.*slot);
+  }
+  // Computed outside the lock so queries on different shapes run in parallel;
+  // two threads racing on one shape just compute it twice.
+  const Value value = compute(shape);
+  std::lock_guard<std::mutex> lock(propertiesMutex_);
+  properties_[shape].*slot = value;
+  return value;
+}
+
+Bnd_Box ShapeRegistry::boundingBox(const std::string& handle) const {
+  return cachedProperty(handle, &ShapeProperties::box, [](const TopoDS_Shape& shape) {
+    Bnd_Box box;
+    BRepBndLib::Add(shape, box);
+    return box;
+  });
+}
+
+Bnd_OBB ShapeRegistry::orientedBox(const std::string& handle) const {
+  return cachedProperty(handle, &ShapeProperties::orientedBox, [](const TopoDS_Shape& shape) {
+    Bnd_OBB box;
+    BRepBndLib::AddOBB(shape, box, true, false, true);
+    return box;
+  });
+}
+
+ShapeMass ShapeRegistry::surfaceProperties(const std::string& handle) const {
+  return cachedProperty(handle, &ShapeProperties::surface, [](const TopoDS_Shape& shape) {
+    GProp_GProps props;
+    BRepGProp::SurfaceProperties(shape, props);
+    return ShapeMass{props.Mass(), props.CentreOfMass()};
+  });
+}
+
+ShapeMass ShapeRegistry::volumeProperties(const std::string& handle) const {
+  return cachedProperty(handle, &ShapeProperties::volume, [](const TopoDS_Shape& shape) {
+    GProp_GProps props;
+    BRepGProp::VolumeProperties(shape, props);
+    return ShapeMass{props.Mass(), props.CentreOfMass()};
+  });
+}
+
+json boundsToJson(const Bnd_Box& box) {
+  if (box.IsVoid()) return nullptr;
+  return {
+      {"min", pointToJson(box.CornerMin())},
+      {"max", pointToJson(box.CornerMax())},
+  };
+}
+
+static gp_Pnt boxCenter(const Bnd_Box& box) {
+  gp_Pnt minPnt = box.CornerMin();
+  gp_Pnt maxPnt = box.CornerMax();
+  return gp_Pnt((minPnt.X() + maxPnt.X()) / 2.0,
+                (minPnt.Y() + maxPnt.Y()) / 2.0,
+                (minPnt.Z() + maxPnt.Z()) / 2.0);
+}
+
+KernelResult collectSelections(const TopoDS_Shape& shape,
+                               ShapeRegistry& registry,
+                               const std::string& featureId,
+                               const std::string& ownerKey,
+                               const std::string& outputKind,
+                               const json& tags) {
+  ScopedPhase phase("collect");
+  KernelResult result;
+  const std::string ownerHandle = registry.registerShape(shape);
+  const std::string ownerToken = selectionOwnerToken(ownerKey);
+
+  if (outputKind == "solid") {
+    gp_Pnt solidCenter = boxCenter(registry.boundingBox(ownerHandle));
+    KernelSelection solidSelection;
+    solidSelection.id = "solid:" + ownerToken + "~" + featureId + ".body";
+    solidSelection.kind = "solid";
+    solidSelection.meta = makeSolidMeta(ownerHandle, ownerKey, featureId, solidCenter, tags);
+    result.selections.push_back(solidSelection);
+  }
+
+  TopTools_IndexedMapOfShape faceMap;
+  TopExp::MapShapes(shape, TopAbs_FACE, faceMap);
+  for (int index = 1; index <= faceMap.Extent(); ++index) {
+    TopoDS_Face face = TopoDS::Face(faceMap(index));
+    std::string faceHandle = registry.registerShape(face);
+
+    double area = 0.0;
+    gp_Pnt center = gp_Pnt(0, 0, 0);
+    try {
+      const ShapeMass mass = registry.surfaceProperties(faceHandle);
+      area = mass.value;
+      center = mass.centroid;
+    } catch (...) {
+      center = boxCenter(registry.boundingBox(faceHandle));
+    }
+
+    bool planar = false;
+    std::string normalDir;
+    std::optional<gp_Vec> normalVec;
+    std::string surfaceType;
+    try {
+      BRepAdaptor_Surface adaptor(face, true);
+      const auto type = adaptor.GetType();
+      if (type == GeomAbs_Plane) {
+        planar = true;
+        surfaceType = "plane";
+        gp_Pln plane = adaptor.Plane();
+        gp_Dir dir = plane.Axis().Direction();
+        gp_Vec vec(dir.X(), dir.Y(), dir.Z());
+        if (face.Orientation() == TopAbs_REVERSED) {
+          vec.Reverse();
+        }
+        normalVec = vec;
+        normalDir = axisDirectionFromVector(vec);
+      } else if (type == GeomAbs_Cylinder) {
+        surfaceType = "cylinder";
+      } else if (type == GeomAbs_Cone) {
+        surfaceType = "cone";
+      } else if (type == GeomAbs_Sphere) {
+        surfaceType = "sphere";
+      } else if (type == GeomAbs_Torus) {
+        surfaceType = "torus";
+      } else if (type == GeomAbs_BSplineSurface) {
+        surfaceType = "bspline";
+      } else if (type == GeomAbs_BezierSurface) {
+        surfaceType = "bezier";
+      } else if (type == GeomAbs_SurfaceOfExtrusion) {
+        surfaceType = "extrusion";
+      } else if (type == GeomAbs_SurfaceOfRevolution) {
+        surfaceType = "revolution";
+      } else if (type == GeomAbs_OffsetSurface) {
+        surfaceType = "offset";
+      } else {
+        surfaceType = "other";
+      }
+    } catch (...) {
+    }
+
+    KernelSelection sel;
+    if (outputKind == "surface" && faceMap.Extent() == 1) {
+      sel.id = "face:" + ownerToken + "~" + featureId + ".seed";
+    } else {
+      sel.id = "face";
+    }
+    sel.kind = "face";
+    sel.meta = makeFaceMeta(faceHandle, ownerHandle, ownerKey, featureId, center, area,
+                            planar, normalDir, normalVec, tags);
+    if (!surfaceType.empty()) {
+      sel.meta["surfaceType"] = surfaceType;
+    }
+    result.selections.push_back(sel);
+  }
+
+  TopTools_IndexedMapOfShape edgeMap;
+  TopExp::MapShapes(shape, TopAbs_EDGE, edgeMap);
+  for (int index = 1; index <= edgeMap.Extent(); ++index) {
+    TopoDS_Edge edge = TopoDS::Edge(edgeMap(index));
+    std::string edgeHandle = registry.registerShape(edge);
+    gp_Pnt center = boxCenter(registry.boundingBox(edgeHandle));
+    std::string curveType;
+    std::optional<double> radius;
+    try {
+      BRepAdaptor_Curve adaptor(edge);
+      const auto type = adaptor.GetType();
+      if (type == GeomAbs_Line) {
+        curveType = "line";
+      } else if (type == GeomAbs_Circle) {
+        curveType = "circle";
+        radius = adaptor.Circle().Radius();
+      } else if (type == GeomAbs_Ellipse) {
+        curveType = "ellipse";
+      } else if (type == GeomAbs_Hyperbola) {
+        curveType = "hyperbola";
+      } else if (type == GeomAbs_Parabola) {
+        curveType = "parabola";
+      } else if (type == GeomAbs_BezierCurve) {
+        curveType = "bezier";
+      } else if (type == GeomAbs_BSplineCurve) {
+        curveType = "bspline";
+      } else {
+        curveType = "other";
+      }
+    } catch (...) {
+    }
+    KernelSelection sel;
+    sel.id = "edge";
+    sel.kind = "edge";
+    sel.meta = makeEdgeMeta(edgeHandle, ownerHandle, ownerKey, featureId, center, tags);
+    if (!curveType.empty()) {
+      sel.meta["curveType"] = curveType;
+    }
+    if (radius && std::isfinite(*radius) && *radius > 0) {
+      sel.meta["radius"] = *radius;
+    }
+    result.selections.push_back(sel);
+  }
+
+  KernelObject output;
+  output.id = featureId + ":" + (outputKind == "solid" ? "solid" : "face");
+  output.kind = outputKind == "solid" ? "solid" : "face";
+  output.meta = json::object();
+  output.meta["handle"] = ownerHandle;
+  output.meta["ownerKey"] = ownerKey;
+  output.meta["createdBy"] = featureId;
+  output.meta["role"] = outputKind == "solid" ? "body" : "surface";
+  result.outputs[ownerKey] = output;
+  return result;
+}
+
+KernelResult mergeResults(const KernelResult& upstream, const KernelResult& next) {
+  ScopedPhase phase("merge");
+  KernelResult merged;
+  merged.outputs = upstream.outputs;
+  for (const auto& entry : next.outputs) {
+    merged.outputs[entry.first] = entry.second;
+  }
+  std::vector<std::string> ownerKeys;
+  for (const auto& sel : next.selections) {
+    if (sel.meta.contains("ownerKey") && sel.meta["ownerKey"].is_string()) {
+      ownerKeys.push_back(sel.meta["ownerKey"].get<std::string>());
+    }
+  }
+  for (const auto& sel : upstream.selections) {
+    bool skip = false;
+    if (sel.meta.contains("ownerKey") && sel.meta["ownerKey"].is_string()) {
+      const std::string owner = sel.meta["ownerKey"].get<std::string>();
+      for (const auto& key : ownerKeys) {
+        if (key == owner) {
+          skip = true;
+          break;
+        }
+      }
+    }
+    if (!skip) merged.selections.push_back(sel);
+  }
+  for (const auto& sel : next.selections) {
+    merged.selections.push_back(sel);
+  }
+  return merged;
+}
+
+template <class Json>
+static json metaOf(const Json& value) {
+  auto it = value.find("meta");
+  if (it == value.end()) return json::object();
+  return json(*it);
+}
+
+template <class Json>
+static void parseKernelResultInto(const Json& value, KernelResult& result) {
+  ScopedPhase phase("upstream");
+  if (!value.is_object()) return;
+  if (value.contains("outputs")) {
+    for (const auto& entry : value["outputs"]) {
+      const Json& object = entry["object"];
+      KernelObject obj;
+      obj.id = object.value("id", "");
+      obj.kind = object.value("kind", "");
+      obj.meta = metaOf(object);
+      const std::string key = entry.value("key", obj.id);
+      result.outputs[key] = std::move(obj);
+    }
+  }
+  if (value.contains("selections")) {
+    const Json& selections = value["selections"];
+    result.selections.reserve(selections.size());
+    for (const auto& entry : selections) {
+      KernelSelection sel;
+      sel.id = entry.value("id", "");
+      sel.kind = entry.value("kind", "");
+      sel.meta = metaOf(entry);
+      auto record = entry.find("record");
+      if (record != entry.end()) sel.record = json(*record);
+      result.selections.push_back(std::move(sel));
+    }
+  }
+}
+
+KernelResult parseKernelResult(const json& value) {
+  KernelResult result;
+  parseKernelResultInto(value, result);
+  return result;
+}
+
+KernelResult parseKernelResult(const RequestJson& value, std::pmr::memory_resource* resource) {
+  KernelResult result(resource);
+  parseKernelResultInto(value, result);
+  return result;
+}
+
+RequestJson serializeKernelResult(const KernelResult& result) {
+  ScopedPhase phase("serialize");
+  RequestJson outputs = RequestJson::array();
+  outputs.get_ref<RequestJson::array_t&>().reserve(result.outputs.size());
+  for (const auto& entry : result.outputs) {
+    outputs.push_back({
+        {"key", entry.first},
+        {"object", {{"id", entry.second.id}, {"kind", entry.second.kind}, {"meta", entry.second.meta}}},
+    });
+  }
+  RequestJson selections = RequestJson::array();
+  selections.get_ref<RequestJson::array_t&>().reserve(result.selections.size());
+  for (const auto& sel : result.selections) {
+    selections.push_back({{"id", sel.id}, {"kind", sel.kind}, {"meta", sel.meta}});
+    if (!sel.record.is_null()) selections.back()["record"] = sel.record;
+  }
+  return {
+      {"outputs", std::move(outputs)},
+      {"selections", std::move(selections)},
+      {"selectionIds", kSelectionIdVersion},
+  };
+}
+
+std::optional<KernelSelection> resolveSelector(const json& selector,
+                                               const KernelResult& current,
+                                               std::string& error) {
+  const std::string kind = selector.value("kind", "");
+  ScopedPhase phase("selector");
+  TraceSpan span("selector.resolve");
+  span.setAttribute("selector.kind", kind);
+  if (kind == "selector.named") {
+    const std::string name = selector.value("name", "");
+    auto it = current.outputs.find(name);
+    if (it == current.outputs.end()) {
+      error = "Missing named output: " + name;
+      return std::nullopt;
+    }
+    KernelSelection sel;
+    sel.id = it->second.id;
+    sel.kind = it->second.kind;
+    sel.meta = it->second.meta;
+    return sel;
+  }
+
+  std::vector<KernelSelection> candidates;
+  for (const auto& sel : current.selections) {
+    if (kind == "selector.face" && sel.kind != "face") continue;
+    if (kind == "selector.edge" && sel.kind != "edge") continue;
+    if (kind == "selector.solid" && sel.kind != "solid") continue;
+    bool matches = true;
+    for (const auto& pred : selector.value("predicates", json::array())) {
+      const std::string predKind = pred.value("kind", "");
+      if (predKind == "pred.planar") {
+        if (!sel.meta.value("planar", false)) matches = false;
+      } else if (predKind == "pred.normal") {
+        if (sel.meta.value("normal", "") != pred.value("value", "")) matches = false;
+      } else if (predKind == "pred.createdBy") {
+        if (sel.meta.value("createdBy", "") != pred.value("featureId", "")) matches = false;
+      } else if (predKind == "pred.role") {
+        if (sel.meta.value("role", "") != pred.value("value", "")) matches = false;
+      }
+      if (!matches) break;
+    }
+    if (matches) candidates.push_back(sel);
+  }
+
+  span.setAttribute("selector.candidates", static_cast<std::int64_t>(candidates.size()));
+  if (candidates.empty()) {
+    error = "Selector matched 0 candidates";
+    return std::nullopt;
+  }
+
+  auto rankRules = selector.value("rank", json::array());
+  for (const auto& rule : rankRules) {
+    if (candidates.size() <= 1) break;
+    const std::string ruleKind = rule.value("kind", "");
+    if (ruleKind == "rank.maxArea") {
+      double best = -1.0;
+      for (const auto& c : candidates) best = std::max(best, c.meta.value("area", 0.0));
+      std::vector<KernelSelection> filtered;
+      for (const auto& c : candidates) {
+        if (c.meta.value("area", 0.0) == best) filtered.push_back(c);
+      }
+      candidates.swap(filtered);
+    } else if (ruleKind == "rank.minZ") {
+      double best = std::numeric_limits<double>::infinity();
+      for (const auto& c : candidates) best = std::min(best, c.meta.value("centerZ", 0.0));
+      std::vector<KernelSelection> filtered;
+      for (const auto& c : candidates) {
+        if (c.meta.value("centerZ", 0.0) == best) filtered.push_back(c);
+      }
+      candidates.swap(filtered);
+    } else if (ruleKind == "rank.maxZ") {
+      double best = -std::numeric_limits<double>::infinity();
+      for (const auto& c : candidates) best = std::max(best, c.meta.value("centerZ", 0.0));
+      std::vector<KernelSelection> filtered;
+      for (const auto& c : candidates) {
+        if (c.meta.value("centerZ", 0.0) == best) filtered.push_back(c);
+      }
+      candidates.swap(filtered);
+    } else if (ruleKind == "rank.closestTo") {
+      std::string innerErr;
+      auto targetSel = resolveSelector(rule["target"], current, innerErr);
+      if (!targetSel) {
+        error = innerErr;
+        return std::nullopt;
+      }
+      auto center = targetSel->meta.value("center", json::array({0, 0, 0}));
+      if (!center.is_array() || center.size() < 3) {
+        error = "Selector requires center metadata";
+        return std::nullopt;
+      }
+      auto tx = center[0].get<double>();
+      auto ty = center[1].get<double>();
+      auto tz = center[2].get<double>();
+      double bestScore = std::numeric_limits<double>::infinity();
+      for (const auto& c : candidates) {
+        auto cc = c.meta.value("center", json::array({0, 0, 0}));
+        double dx = cc[0].get<double>() - tx;
+        double dy = cc[1].get<double>() - ty;
+        double dz = cc[2].get<double>() - tz;
+        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        bestScore = std::min(bestScore, dist);
+      }
+      std::vector<KernelSelection> filtered;
+      for (const auto& c : candidates) {
+        auto cc = c.meta.value("center", json::array({0, 0, 0}));
+        double dx = cc[0].get<double>() - tx;
+        double dy = cc[1].get<double>() - ty;
+        double dz = cc[2].get<double>() - tz;
+        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (dist == bestScore) filtered.push_back(c);
+      }
+      candidates.swap(filtered);
+    }
+  }
+
+  if (candidates.size() != 1) {
+    error = "Selector ambiguity after ranking";
+    return std::nullopt;
+  }
+  return candidates.front();
+}
+
+TopoDS_Shape resolveGeometryRef(const json& ref,
+                                const KernelResult& current,
+                                const ShapeRegistry& registry) {
+  if (!ref.is_object()) {
+    throw std::runtime_error("Invalid geometry ref");
+  }
+  const std::string kind = ref.value("kind", "");
+  json selector = ref.value("selector", json::object());
+  std::string error;
+  auto selection = resolveSelector(selector, current, error);
+  if (!selection) {
+    throw std::runtime_error(error);
+  }
+  if (kind == "ref.surface" && selection->kind != "face") {
+    throw std::runtime_error("Expected face selection for ref.surface");
+  }
+  if (kind == "ref.edge" && selection->kind != "edge") {
+    throw std::runtime_error("Expected edge selection for ref.edge");
+  }
+  if (kind == "ref.axis" || kind == "ref.point" || kind == "ref.frame") {
+    throw std::runtime_error("Geometry ref kind not supported yet: " + kind);
+  }
+  const std::string handle = selection->meta.value("handle", "");
+  if (handle.empty()) {
+    throw std::runtime_error("Selection missing handle metadata");
+  }
+  return registry.get(handle);
+}
+
+static XCAFDimTolObjects_DatumSingleModif mapDatumModifier(const std::string& mod) {
+  if (mod == "MMB") return XCAFDimTolObjects_DatumSingleModif_MaximumMaterialRequirement;
+  if (mod == "LMB") return XCAFDimTolObjects_DatumSingleModif_LeastMaterialRequirement;
+  return XCAFDimTolObjects_DatumSingleModif_Basic;
+}
+
+static std::optional<XCAFDimTolObjects_GeomToleranceModif> mapTolModifier(const std::string& mod) {
+  if (mod == "MMC") return XCAFDimTolObjects_GeomToleranceModif_Maximum_Material_Requirement;
+  if (mod == "LMC") return XCAFDimTolObjects_GeomToleranceModif_Least_Material_Requirement;
+  if (mod == "FREE_STATE") return XCAFDimTolObjects_GeomToleranceModif_Free_State;
+  if (mod == "TANGENT_PLANE") return XCAFDimTolObjects_GeomToleranceModif_Tangent_Plane;
+  if (mod == "STATISTICAL") return XCAFDimTolObjects_GeomToleranceModif_Statistical_Tolerance;
+  return std::nullopt;
+}
+
+static XCAFDimTolObjects_GeomToleranceType mapToleranceType(const std::string& kind) {
+  if (kind == "constraint.surfaceProfile") return XCAFDimTolObjects_GeomToleranceType_ProfileOfSurface;
+  if (kind == "constraint.flatness") return XCAFDimTolObjects_GeomToleranceType_Flatness;
+  if (kind == "constraint.parallelism") return XCAFDimTolObjects_GeomToleranceType_Parallelism;
+  if (kind == "constraint.perpendicularity") return XCAFDimTolObjects_GeomToleranceType_Perpendicularity;
+  if (kind == "constraint.position") return XCAFDimTolObjects_GeomToleranceType_Position;
+  return XCAFDimTolObjects_GeomToleranceType_None;
+}
+
+// Area and volume summed over the faces' triangulations (volume by the
+// divergence theorem, so only meaningful for closed shells). nullopt when a
+// face has no triangulation, i.e. the shape was never meshed.
+struct TriangulationMass {
+  ShapeMass surface;
+  ShapeMass volume;
+};
+
+static std::optional<TriangulationMass> triangulationMass(const TopoDS_Shape& shape) {
+  double area = 0.0;
+  double volume = 0.0;
+  gp_XYZ areaMoment(0, 0, 0);
+  gp_XYZ volumeMoment(0, 0, 0);
+  bool anyFace = false;
+  for (TopExp_Explorer explorer(shape, TopAbs_FACE); explorer.More(); explorer.Next()) {
+    const TopoDS_Face face = TopoDS::Face(explorer.Current());
+    TopLoc_Location loc;
+    Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+    if (triangulation.IsNull()) return std::nullopt;
+    anyFace = true;
+    const gp_Trsf& trsf = loc.Transformation();
+    const bool reversed = face.Orientation() == TopAbs_REVERSED;
+    for (int i = 1; i <= triangulation->NbTriangles(); ++i) {
+      int n1, n2, n3;
+      triangulation->Triangle(i).Get(n1, n2, n3);
+      if (reversed) std::swap(n2, n3);
+      const gp_XYZ a = triangulation->Node(n1).Transformed(trsf).XYZ();
+      const gp_XYZ b = triangulation->Node(n2).Transformed(trsf).XYZ();
+      const gp_XYZ c = triangulation->Node(n3).Transformed(trsf).XYZ();
+      const double triangleArea = 0.5 * (b - a).Crossed(c - a).Modulus();
+      area += triangleArea;
+      areaMoment += (a + b + c) * (triangleArea / 3.0);
+      const double tetraVolume = a.Dot(b.Crossed(c)) / 6.0;
+      volume += tetraVolume;
+      volumeMoment += (a + b + c) * (tetraVolume / 4.0);
+    }
+  }
+  if (!anyFace) return std::nullopt;
+  TriangulationMass mass;
+  mass.surface = {area, area > 0 ? gp_Pnt(areaMoment / area) : gp_Pnt(0, 0, 0)};
+  mass.volume = {volume, volume != 0 ? gp_Pnt(volumeMoment / volume) : gp_Pnt(0, 0, 0)};
+  return mass;
+}
+
+struct QueryRequest {
+  bool bounds = false;
+  bool orientedBox = false;
+  bool area = false;
+  bool volume = false;
+  bool centroid = false;
+  bool fast = false;
+  double tolerance = 0.0;
+};
+
+static json queryHandle(const ShapeRegistry& registry,
+                        const std::string& handle,
+                        const QueryRequest& query) {
+  json item;
+  item["handle"] = handle;
+  const TopoDS_Shape shape = registry.get(handle);
+  const bool hasSolid = TopExp_Explorer(shape, TopAbs_SOLID).More();
+  const bool hasFace = TopExp_Explorer(shape, TopAbs_FACE).More();
+
+  std::optional<TriangulationMass> meshMass;
+  if (query.fast && (query.area || query.volume || query.centroid)) {
+    meshMass = triangulationMass(shape);
+  }
+  // Exact values go through the registry cache unless a tolerance asks for
+  // BRepGProp's adaptive integration, which is computed per request.
+  auto exactSurface = [&]() {
+    if (query.tolerance <= 0) return registry.surfaceProperties(handle);
+    GProp_GProps props;
+    BRepGProp::SurfaceProperties(shape, props, query.tolerance);
+    return ShapeMass{props.Mass(), props.CentreOfMass()};
+  };
+  auto exactVolume = [&]() {
+    if (query.tolerance <= 0) return registry.volumeProperties(handle);
+    GProp_GProps props;
+    BRepGProp::VolumeProperties(shape, props, query.tolerance);
+    return ShapeMass{props.Mass(), props.CentreOfMass()};
+  };
+  auto surface = [&]() { return meshMass ? meshMass->surface : exactSurface(); };
+  auto solid = [&]() { return meshMass ? meshMass->volume : exactVolume(); };
+  item["precision"] = meshMass ? "fast" : "exact";
+
+  if (query.bounds) item["bounds"] = boundsToJson(registry.boundingBox(handle));
+  if (query.orientedBox) {
+    const Bnd_OBB box = registry.orientedBox(handle);
+    if (box.IsVoid()) {
+      item["obb"] = nullptr;
+    } else {
+      item["obb"] = {
+          {"center", pointToJson(gp_Pnt(box.Center()))},
+          {"axes", json::array({pointToJson(gp_Pnt(box.XDirection())),
+                                pointToJson(gp_Pnt(box.YDirection())),
+                                pointToJson(gp_Pnt(box.ZDirection()))})},
+          {"halfSizes", json::array({box.XHSize(), box.YHSize(), box.ZHSize()})},
+      };
+    }
+  }
+  if (query.area) item["area"] = hasFace ? surface().value : 0.0;
+  if (query.volume) item["volume"] = hasSolid ? solid().value : 0.0;
+  if (query.centroid) {
+    // Centre of the highest-dimension mass: volume for solids, area for
+    // faces and shells, length for wires and edges.
+    gp_Pnt centroid;
+    if (hasSolid) {
+      centroid = solid().centroid;
+    } else if (hasFace) {
+      centroid = surface().centroid;
+    } else {
+      GProp_GProps props;
+      BRepGProp::LinearProperties(shape, props);
+      centroid = props.CentreOfMass();
+    }
+    item["centroid"] = pointToJson(centroid);
+  }
+  return item;
+}
+
+json queryShapes(const ShapeRegistry& registry, const RequestJson& request) {
+  ScopedPhase phase("query");
+  TraceSpan span("query");
+  const json handles = request.value("handles", json::array());
+  if (!handles.is_array() || handles.empty()) {
+    throw std::runtime_error("query handles must be a non-empty array");
+  }
+  QueryRequest query;
+  const json quantities = request.value(
+      "quantities", json::array({"bounds", "area", "volume", "centroid"}));
+  if (!quantities.is_array()) {
+    throw std::runtime_error("query quantities must be an array");
+  }
+  for (const auto& quantity : quantities) {
+    const std::string name = quantity.is_string() ? quantity.get<std::string>() : "";
+    if (name == "bounds") {
+      query.bounds = true;
+    } else if (name == "obb") {
+      query.orientedBox = true;
+    } else if (name == "area") {
+      query.area = true;
+    } else if (name == "volume") {
+      query.volume = true;
+    } else if (name == "centroid") {
+      query.centroid = true;
+    } else {
+      throw std::runtime_error("Unknown query quantity: " + quantity.dump());
+    }
+  }
+  const std::string precision = request.value("precision", std::string("exact"));
+  if (precision != "exact" && precision != "fast") {
+    throw std::runtime_error("query precision must be exact or fast");
+  }
+  query.fast = precision == "fast";
+  query.tolerance = request.contains("tolerance") ? parseScalar(request["tolerance"]) : 0.0;
+  if (!std::isfinite(query.tolerance) || query.tolerance < 0) {
+    throw std::runtime_error("query tolerance must be non-negative");
+  }
+  span.setAttribute("query.handles", static_cast<std::int64_t>(handles.size()));
+
+  // One failing handle (unknown, or a degenerate shape) reports its error in
+  // place instead of failing the batch.
+  std::vector<json> results(handles.size());
+  OSD_Parallel::For(0, static_cast<int>(handles.size()), [&](int index) {
+    const json& entry = handles[static_cast<std::size_t>(index)];
+    const std::string handle = entry.is_string() ? entry.get<std::string>() : "";
+    try {
+      results[index] = queryHandle(registry, handle, query);
+    } catch (const std::exception& ex) {
+      results[index] = {{"handle", handle}, {"error", ex.what()}};
+    } catch (...) {
+      results[index] = {{"handle", handle}, {"error", "geometry query failed"}};
+    }
+  }, !request.value("parallel", true));
+  return {{"results", std::move(results)}};
+}
+
+struct PickIndex {
+  PickMesh mesh;
+  std::vector<TopoDS_Face> faces;
+  // The triangulation each face had when the index was built: a re-mesh
+  // replaces it, and the index is rebuilt to match what the viewer shows.
+  // Held by handle so a replaced one stays alive and its address cannot be
+  // reused by its successor.
+  std::vector<Handle(Poly_Triangulation)> triangulations;
+  std::vector<std::string> faceHandles;  // "" for faces without a selection
+  std::vector<std::string> edgeHandles;
+};
+
+// Meshes the shape unless every face already has a triangulation (from
+// /v1/mesh or an earlier call), so picking and slicing see what the viewer
+// shows.
+static void ensureTriangulated(const TopoDS_Shape& shape, double linearDeflection, double angularDeflection) {
+  for (TopExp_Explorer explorer(shape, TopAbs_FACE); explorer.More(); explorer.Next()) {
+    TopLoc_Location loc;
+    if (BRep_Tool::Triangulation(TopoDS::Face(explorer.Current()), loc).IsNull()) {
+      BRepMesh_IncrementalMesh mesher(shape, linearDeflection, false, angularDeflection, true);
+      mesher.Perform();
+      return;
+    }
+  }
+}
+
+// Appends a face's triangulation, in world coordinates, to flat position and
+// index arrays. Returns the number of triangles added.
+static std::size_t appendFaceTriangles(const TopoDS_Face& face,
+                                       std::vector<double>& positions,
+                                       std::vector<std::uint32_t>& triangles) {
+  TopLoc_Location loc;
+  Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+  if (triangulation.IsNull()) return 0;
+  const std::uint32_t offset = static_cast<std::uint32_t>(positions.size() / 3);
+  for (int node = 1; node <= triangulation->NbNodes(); ++node) {
+    const gp_Pnt p = triangulation->Node(node).Transformed(loc.Transformation());
+    positions.insert(positions.end(), {p.X(), p.Y(), p.Z()});
+  }
+  for (int triangle = 1; triangle <= triangulation->NbTriangles(); ++triangle) {
+    int n1, n2, n3;
+    triangulation->Triangle(triangle).Get(n1, n2, n3);
+    triangles.insert(triangles.end(), {offset + n1 - 1, offset + n2 - 1, offset + n3 - 1});
+  }
+  return static_cast<std::size_t>(triangulation->NbTriangles());
+}
+
+// Segments (two xyz points each) along an edge's curve within the given
+// deflections; nothing for degenerated edges or edges without a curve.
+static void appendEdgeSegments(const TopoDS_Edge& edge,
+                               double linearDeflection,
+                               double angularDeflection,
+                               std::vector<double>& segments) {
+  if (BRep_Tool::Degenerated(edge)) return;
+  try {
+    BRepAdaptor_Curve curve(edge);
+    GCPnts_TangentialDeflection points(curve, angularDeflection, linearDeflection);
+    for (int point = 1; point < points.NbPoints(); ++point) {
+      const gp_Pnt a = points.Value(point);
+      const gp_Pnt b = points.Value(point + 1);
+      segments.insert(segments.end(), {a.X(), a.Y(), a.Z(), b.X(), b.Y(), b.Z()});
+    }
+  } catch (...) {
+  }
+}
+
+static bool pickIndexCurrent(const PickIndex& index) {
+  for (std::size_t face = 0; face < index.faces.size(); ++face) {
+    TopLoc_Location loc;
+    if (BRep_Tool::Triangulation(index.faces[face], loc) != index.triangulations[face]) return false;
+  }
+  return true;
+}
+
+static std::shared_ptr<const PickIndex> buildPickIndex(const TopoDS_Shape& shape,
+                                                       const std::string& ownerHandle,
+                                                       const KernelResult& current,
+                                                       const ShapeRegistry& registry,
+                                                       double linearDeflection,
+                                                       double angularDeflection) {
+  ScopedPhase phase("pick.build");
+  auto index = std::make_shared<PickIndex>();
+  TopTools_IndexedMapOfShape faceMap;
+  TopTools_IndexedMapOfShape edgeMap;
+  TopExp::MapShapes(shape, TopAbs_FACE, faceMap);
+  TopExp::MapShapes(shape, TopAbs_EDGE, edgeMap);
+
+  ensureTriangulated(shape, linearDeflection, angularDeflection);
+
+  // Face and edge handles come from the owner's selections; the index maps
+  // key on TShape and location, which the registered sub-shapes share.
+  index->faceHandles.resize(faceMap.Extent());
+  index->edgeHandles.resize(edgeMap.Extent());
+  for (const auto& sel : current.selections) {
+    if (sel.meta.value("ownerHandle", "") != ownerHandle) continue;
+    const std::string handle = sel.meta.value("handle", "");
+    if (handle.empty() || handle == ownerHandle) continue;
+    if (sel.kind == "face") {
+      const int position = faceMap.FindIndex(registry.get(handle));
+      if (position > 0) index->faceHandles[position - 1] = handle;
+    } else if (sel.kind == "edge") {
+      const int position = edgeMap.FindIndex(registry.get(handle));
+      if (position > 0) index->edgeHandles[position - 1] = handle;
+    }
+  }
+
+  PickMesh& mesh = index->mesh;
+  for (int face = 1; face <= faceMap.Extent(); ++face) {
+    const TopoDS_Face topoFace = TopoDS::Face(faceMap(face));
+    TopLoc_Location loc;
+    index->faces.push_back(topoFace);
+    index->triangulations.push_back(BRep_Tool::Triangulation(topoFace, loc));
+    const std::size_t added = appendFaceTriangles(topoFace, mesh.positions, mesh.triangles);
+    mesh.triangleFace.insert(mesh.triangleFace.end(), added, static_cast<std::uint32_t>(face - 1));
+  }
+  for (int edge = 1; edge <= edgeMap.Extent(); ++edge) {
+    const std::size_t before = mesh.segments.size() / 6;
+    appendEdgeSegments(TopoDS::Edge(edgeMap(edge)), linearDeflection, angularDeflection, mesh.segments);
+    mesh.segmentEdge.insert(mesh.segmentEdge.end(), mesh.segments.size() / 6 - before,
+                            static_cast<std::uint32_t>(edge - 1));
+  }
+  mesh.build();
+  return index;
+}
+
+json pickShapes(const ShapeRegistry& registry, const KernelResult& current, const RequestJson& request) {
+  ScopedPhase phase("pick");
+  TraceSpan span("pick");
+  json handles = request.value("handles", json::array());
+  if (request.contains("handle")) handles.push_back(copyOut(request["handle"]));
+  if (!handles.is_array() || handles.empty()) {
+    throw std::runtime_error("pick requires handle or handles");
+  }
+  const json rays = request.value("rays", json::array());
+  if (!rays.is_array() || rays.empty()) {
+    throw std::runtime_error("pick rays must be a non-empty array");
+  }
+  const double maxDistance = request.contains("maxDistance")
+      ? parseScalar(request["maxDistance"])
+      : std::numeric_limits<double>::infinity();
+  const double edgeTolerance = request.contains("edgeTolerance") ? parseScalar(request["edgeTolerance"]) : 0.0;
+  if (!(maxDistance > 0) || !(edgeTolerance >= 0)) {
+    throw std::runtime_error("pick maxDistance must be positive and edgeTolerance non-negative");
+  }
+  const json meshOptions = request.value("mesh", json::object());
+  const double linearDeflection = meshOptions.value("linearDeflection", 0.1);
+  const double angularDeflection = meshOptions.value("angularDeflection", 0.5);
+
+  std::vector<std::string> bodies;
+  std::vector<std::shared_ptr<const PickIndex>> indices;
+  for (const auto& entry : handles) {
+    if (!entry.is_string()) throw std::runtime_error("pick handles must be strings");
+    const std::string handle = entry.get<std::string>();
+    std::shared_ptr<const PickIndex> index = registry.pickIndex(handle);
+    if (!index || !pickIndexCurrent(*index)) {
+      index = buildPickIndex(registry.get(handle), handle, current, registry,
+                             linearDeflection, angularDeflection);
+      registry.setPickIndex(handle, index);
+    }
+    bodies.push_back(handle);
+    indices.push_back(std::move(index));
+  }
+
+  std::vector<std::array<double, 6>> parsed(rays.size());
+  for (std::size_t ray = 0; ray < rays.size(); ++ray) {
+    const gp_Pnt origin = parsePoint3D(rays[ray].value("origin", json::array({0, 0, 0})));
+    const gp_Pnt direction = parsePoint3D(rays[ray].value("direction", json::array({0, 0, 0})));
+    parsed[ray] = {origin.X(), origin.Y(), origin.Z(), direction.X(), direction.Y(), direction.Z()};
+  }
+  span.setAttribute("pick.rays", static_cast<std::int64_t>(rays.size()));
+
+  std::vector<json> hits(rays.size());
+  OSD_Parallel::For(0, static_cast<int>(rays.size()), [&](int ray) {
+    const double* origin = parsed[ray].data();
+    const double* direction = origin + 3;
+    PickHit best;
+    std::size_t bestBody = 0;
+    for (std::size_t body = 0; body < indices.size(); ++body) {
+      const PickHit hit = pickRay(indices[body]->mesh, origin, direction,
+                                  best.hit ? best.distance : maxDistance, edgeTolerance);
+      if (hit.hit && (!best.hit || hit.distance <= best.distance)) {
+        best = hit;
+        bestBody = body;
+      }
+    }
+    if (!best.hit) {
+      hits[ray] = {{"hit", false}};
+      return;
+    }
+    const PickIndex& index = *indices[bestBody];
+    json hit = {
+        {"hit", true},
+        {"handle", bodies[bestBody]},
+        {"point", json::array({best.point[0], best.point[1], best.point[2]})},
+        {"distance", best.distance},
+    };
+    hit["face"] = best.face >= 0 && !index.faceHandles[best.face].empty()
+        ? json(index.faceHandles[best.face]) : json(nullptr);
+    hit["edge"] = best.edge >= 0 && !index.edgeHandles[best.edge].empty()
+        ? json(index.edgeHandles[best.edge]) : json(nullptr);
+    hits[ray] = std::move(hit);
+  }, !request.value("parallel", true));
+  return {{"hits", std::move(hits)}};
+}
+
+static json contoursToJson(const SliceContours& contours) {
+  json polylines = json::array();
+  for (const auto& polyline : contours) {
+    polylines.push_back({{"closed", polyline.closed}, {"points", polyline.points}});
+  }
+  return polylines;
+}
+
+json sliceShape(const ShapeRegistry& registry, const RequestJson& request) {
+  ScopedPhase phase("slice");
+  TraceSpan span("slice");
+  const std::string handle = request.value("handle", "");
+  if (handle.empty()) throw std::runtime_error("Missing shape handle");
+  const TopoDS_Shape shape = registry.get(handle);
+
+  const json normalJson = request.value("normal", json("+Z"));
+  gp_Vec normal = normalJson.is_array() ? gp_Vec(parsePoint3D(normalJson).XYZ()) : parseAxis(normalJson);
+  if (!(normal.Magnitude() > 0)) throw std::runtime_error("slice normal is invalid");
+  normal.Normalize();
+  const gp_Pnt origin = parsePoint3D(request.value("origin", json::array({0, 0, 0})));
+  const double spacing = request.contains("spacing") ? parseScalar(request["spacing"]) : 0.0;
+  const int count = parseCount(request.value("count", json(1)), "slice count", kMaxSliceCount);
+  if (count > 1 && !(spacing > 0)) {
+    throw std::runtime_error("slice spacing must be positive for more than one plane");
+  }
+  const std::string mode = request.value("mode", std::string("exact"));
+  if (mode != "exact" && mode != "fast") {
+    throw std::runtime_error("slice mode must be exact or fast");
+  }
+  const double tolerance = request.contains("tolerance") ? parseScalar(request["tolerance"]) : 1e-6;
+  const json meshOptions = request.value("mesh", json::object());
+  const double linearDeflection = meshOptions.value("linearDeflection", 0.1);
+  const double angularDeflection = meshOptions.value("angularDeflection", 0.5);
+  span.setAttribute("slice.mode", mode);
+  span.setAttribute("slice.count", static_cast<std::int64_t>(count));
+
+  SlicePlanes planes;
+  planes.origin[0] = origin.X();
+  planes.origin[1] = origin.Y();
+  planes.origin[2] = origin.Z();
+  planes.normal[0] = normal.X();
+  planes.normal[1] = normal.Y();
+  planes.normal[2] = normal.Z();
+  planes.spacing = spacing;
+  planes.count = count;
+
+  std::vector<json> slices(static_cast<std::size_t>(count));
+  const bool parallel = request.value("parallel", true);
+  if (mode == "fast") {
+    // One pass over the triangles for every plane, then chaining per slice.
+    ensureTriangulated(shape, linearDeflection, angularDeflection);
+    std::vector<double> positions;
+    std::vector<std::uint32_t> triangles;
+    for (TopExp_Explorer explorer(shape, TopAbs_FACE); explorer.More(); explorer.Next()) {
+      appendFaceTriangles(TopoDS::Face(explorer.Current()), positions, triangles);
+    }
+    const std::vector<std::vector<double>> segments = sliceTriangles(positions, triangles, planes);
+    OSD_Parallel::For(0, count, [&](int index) {
+      slices[index] = {{"polylines", contoursToJson(chainSegments(segments[index], tolerance))}};
+    }, !parallel);
+  } else {
+    // One BRepAlgoAPI_Section per plane, in parallel. Non-destructive, so the
+    // concurrent sections never touch the shared input.
+    OSD_Parallel::For(0, count, [&](int index) {
+      try {
+        const gp_Pln plane(origin.Translated(normal * (spacing * index)), gp_Dir(normal));
+        BRepAlgoAPI_Section section(shape, plane, false);
+        section.ComputePCurveOn1(false);
+        section.Approximation(false);
+        section.SetNonDestructive(true);
+        section.SetRunParallel(false);
+        section.Build();
+        if (!section.IsDone() || section.HasErrors()) {
+          throw std::runtime_error("section failed");
+        }
+        std::vector<double> segments;
+        for (TopExp_Explorer explorer(section.Shape(), TopAbs_EDGE); explorer.More(); explorer.Next()) {
+          appendEdgeSegments(TopoDS::Edge(explorer.Current()), linearDeflection, angularDeflection, segments);
+        }
+        slices[index] = {{"polylines", contoursToJson(chainSegments(segments, tolerance))}};
+      } catch (const std::exception& ex) {
+        slices[index] = {{"polylines", json::array()}, {"error", ex.what()}};
+      } catch (...) {
+        slices[index] = {{"polylines", json::array()}, {"error", "section failed"}};
+      }
+    }, !parallel);
+  }
+  for (int index = 0; index < count; ++index) {
+    slices[index]["index"] = index;
+    slices[index]["offset"] = spacing * index;
+  }
+  return {{"mode", mode}, {"slices", std::move(slices)}};
+}
+
+// A /v1/measure operand: a registry handle, {handle}, or a geometry ref
+// resolved against the session's current selections.
+static TopoDS_Shape resolveMeasureOperand(const json& operand,
+                                          const KernelResult& current,
+                                          const ShapeRegistry& registry) {
+  if (operand.is_string()) return registry.get(operand.get<std::string>());
+  if (operand.is_object() && operand.contains("handle")) {
+    return registry.get(operand.value("handle", ""));
+  }
+  return resolveGeometryRef(operand, current, registry);
+}
+
+struct MeasureDirection {
+  gp_Dir dir;
+  bool axis = false;  // a line or axis has no sense, so only its acute angle counts
+};
+
+// Direction an angle is measured from: the oriented normal of a planar face,
+// the axis of a cylindrical or conical face, the direction of a straight
+// edge or the axis of a circular one.
+static MeasureDirection measureDirection(const TopoDS_Shape& shape) {
+  if (shape.ShapeType() == TopAbs_FACE) {
+    const TopoDS_Face face = TopoDS::Face(shape);
+    BRepAdaptor_Surface adaptor(face, true);
+    switch (adaptor.GetType()) {
+      case GeomAbs_Plane: {
+        gp_Dir normal = adaptor.Plane().Axis().Direction();
+        if (face.Orientation() == TopAbs_REVERSED) normal.Reverse();
+        return {normal, false};
+      }
+      case GeomAbs_Cylinder:
+        return {adaptor.Cylinder().Axis().Direction(), true};
+      case GeomAbs_Cone:
+        return {adaptor.Cone().Axis().Direction(), true};
+      default:
+        throw std::runtime_error("angle needs a planar, cylindrical or conical face");
+    }
+  }
+  if (shape.ShapeType() == TopAbs_EDGE) {
+    BRepAdaptor_Curve adaptor(TopoDS::Edge(shape));
+    if (adaptor.GetType() == GeomAbs_Line) return {adaptor.Line().Direction(), true};
+    if (adaptor.GetType() == GeomAbs_Circle) return {adaptor.Circle().Axis().Direction(), true};
+    throw std::runtime_error("angle needs a straight or circular edge");
+  }
+  throw std::runtime_error("angle needs a face or an edge");
+}
+
+static json measureRadius(const TopoDS_Shape& shape) {
+  std::optional<double> radius;
+  json result = {{"kind", "radius"}};
+  if (shape.ShapeType() == TopAbs_FACE) {
+    BRepAdaptor_Surface adaptor(TopoDS::Face(shape), true);
+    if (adaptor.GetType() == GeomAbs_Cylinder) {
+      radius = adaptor.Cylinder().Radius();
+      result["center"] = pointToJson(adaptor.Cylinder().Axis().Location());
+      result["axis"] = vecToJson(gp_Vec(adaptor.Cylinder().Axis().Direction()));
+    } else if (adaptor.GetType() == GeomAbs_Sphere) {
+      radius = adaptor.Sphere().Radius();
+      result["center"] = pointToJson(adaptor.Sphere().Location());
+    }
+  } else if (shape.ShapeType() == TopAbs_EDGE) {
+    BRepAdaptor_Curve adaptor(TopoDS::Edge(shape));
+    if (adaptor.GetType() == GeomAbs_Circle) {
+      radius = adaptor.Circle().Radius();
+      result["center"] = pointToJson(adaptor.Circle().Location());
+      result["axis"] = vecToJson(gp_Vec(adaptor.Circle().Axis().Direction()));
+    }
+  }
+  if (!radius) throw std::runtime_error("radius needs a cylindrical or spherical face or a circular edge");
+  result["value"] = *radius;
+  result["diameter"] = *radius * 2.0;
+  return result;
+}
+
+json measureShapes(const ShapeRegistry& registry, const KernelResult& current, const RequestJson& request) {
+  ScopedPhase phase("measure");
+  TraceSpan span("measure");
+  const json measurements = request.value("measurements", json::array());
+  if (!measurements.is_array() || measurements.empty()) {
+    throw std::runtime_error("measure measurements must be a non-empty array");
+  }
+  const bool parallel = request.value("parallel", true);
+  // Spread the batch over the pool; a lone distance instead lets
+  // BRepExtrema split its own sub-shape pairs across the threads.
+  const bool multiThreadExtrema = parallel && measurements.size() == 1;
+  span.setAttribute("measure.count", static_cast<std::int64_t>(measurements.size()));
+
+  // Operands are resolved up front: selector resolution reads `current`
+  // and is cheap next to the measurements themselves.
+  struct Measurement {
+    std::string kind;
+    TopoDS_Shape a;
+    TopoDS_Shape b;
+    std::string error;
+  };
+  std::vector<Measurement> parsed(measurements.size());
+  for (std::size_t index = 0; index < measurements.size(); ++index) {
+    const json& entry = measurements[index];
+    Measurement& measurement = parsed[index];
+    try {
+      measurement.kind = entry.value("kind", "");
+      if (measurement.kind != "distance" && measurement.kind != "angle" && measurement.kind != "radius") {
+        throw std::runtime_error("Unknown measurement kind: " + measurement.kind);
+      }
+      measurement.a = resolveMeasureOperand(entry.value("a", json()), current, registry);
+      if (measurement.kind != "radius") {
+        measurement.b = resolveMeasureOperand(entry.value("b", json()), current, registry);
+      }
+    } catch (const std::exception& ex) {
+      measurement.error = ex.what();
+    }
+  }
+
+  // One failing measurement reports its error in place, as in /v1/query.
+  std::vector<json> results(parsed.size());
+  OSD_Parallel::For(0, static_cast<int>(parsed.size()), [&](int index) {
+    const Measurement& measurement = parsed[index];
+    try {
+      if (!measurement.error.empty()) throw std::runtime_error(measurement.error);
+      if (measurement.kind == "distance") {
+        BRepExtrema_DistShapeShape extrema;
+        extrema.SetMultiThread(multiThreadExtrema);
+        extrema.LoadS1(measurement.a);
+        extrema.LoadS2(measurement.b);
+        extrema.Perform();
+        if (!extrema.IsDone() || extrema.NbSolution() < 1) {
+          throw std::runtime_error("distance computation failed");
+        }
+        results[index] = {
+            {"kind", "distance"},
+            {"value", extrema.Value()},
+            {"pointA", pointToJson(extrema.PointOnShape1(1))},
+            {"pointB", pointToJson(extrema.PointOnShape2(1))},
+        };
+      } else if (measurement.kind == "angle") {
+        const MeasureDirection a = measureDirection(measurement.a);
+        const MeasureDirection b = measureDirection(measurement.b);
+        double angle = a.dir.Angle(b.dir);
+        if ((a.axis || b.axis) && angle > M_PI / 2.0) angle = M_PI - angle;
+        results[index] = {{"kind", "angle"}, {"value", angle * 180.0 / M_PI}};
+      } else {
+        results[index] = measureRadius(measurement.a);
+      }
+    } catch (const std::exception& ex) {
+      results[index] = {{"kind", measurement.kind}, {"error", ex.what()}};
+    } catch (...) {
+      results[index] = {{"kind", measurement.kind}, {"error", "measurement failed"}};
+    }
+  }, !parallel);
+  return {{"results", std::move(results)}};
+}
+
+struct SweepPlan {
+  // The session's shapes plus those of the shared features; each variant
+  // starts from a copy of this map, so variants never register into one
+  // registry concurrently.
+  ShapeRegistry registry;
+  KernelResult base;
+  std::size_t sharedFeatures = 0;
+  std::vector<json> variantFeatures;
+  std::string parameter;
+  std::vector<double> values;
+  std::vector<std::string> outputs;
+  bool volume = false;
+  bool bounds = false;
+  bool mesh = false;
+  bool step = false;
+  json meshOptions;
+  std::string stepSchema;
+  bool parallel = true;
+};
+
+// Whether expr.param `name` occurs anywhere in `node`.
+static bool usesParameter(const json& node, const std::string& name) {
+  if (node.is_object()) {
+    const json kind = node.value("kind", json());
+    if (kind == "expr.param" && node.value("id", json()) == name) return true;
+  } else if (!node.is_array()) {
+    return false;
+  }
+  for (const auto& entry : node) {
+    if (usesParameter(entry, name)) return true;
+  }
+  return false;
+}
+
+// The value of an expression that reads parameter `name`, as evalExpr in
+// src/params.ts computes it. Literals must be unitless, since the value is
+// already in model units; anything else throws rather than leaving a node
+// that parseScalar would read as 0.
+static double evaluateSweepExpr(const json& node, const std::string& name, double value) {
+  if (node.is_number()) return node.get<double>();
+  const json kindJson = node.is_object() ? node.value("kind", json()) : json();
+  const std::string kind = kindJson.is_string() ? kindJson.get<std::string>() : "";
+  if (kind == "expr.param") {
+    const json id = node.value("id", json());
+    if (id != name) throw std::runtime_error("sweep expression uses unevaluated parameter " + id.dump());
+    return value;
+  }
+  if (kind == "expr.literal") {
+    const json literal = node.value("value", json());
+    if (!literal.is_number()) throw std::runtime_error("sweep expression literal must be a number");
+    if (node.contains("unit")) throw std::runtime_error("sweep expression literals must be unitless");
+    return literal.get<double>();
+  }
+  if (kind == "expr.neg") return -evaluateSweepExpr(node.value("value", json()), name, value);
+  if (kind == "expr.binary") {
+    const double left = evaluateSweepExpr(node.value("left", json()), name, value);
+    const double right = evaluateSweepExpr(node.value("right", json()), name, value);
+    const json op = node.value("op", json());
+    if (op == "+") return left + right;
+    if (op == "-") return left - right;
+    if (op == "*") return left * right;
+    if (op == "/") {
+      if (right == 0) throw std::runtime_error("Division by zero in sweep expression");
+      return left / right;
+    }
+    throw std::runtime_error("Unsupported sweep expression operator: " + op.dump());
+  }
+  throw std::runtime_error("Unsupported sweep expression: " + node.dump());
+}
+
+// Replaces each expression that reads parameter `name` with its value for
+// `value`, so parseScalar sees plain numbers.
+static json bindParameter(const json& node, const std::string& name, double value) {
+  if (node.is_array()) {
+    json out = json::array();
+    for (const auto& entry : node) out.push_back(bindParameter(entry, name, value));
+    return out;
+  }
+  if (!node.is_object()) return node;
+  const json kind = node.value("kind", json());
+  if (kind.is_string() && kind.get_ref<const std::string&>().rfind("expr.", 0) == 0 &&
+      usesParameter(node, name)) {
+    return evaluateSweepExpr(node, name, value);
+  }
+  json out = json::object();
+  for (auto it = node.begin(); it != node.end(); ++it) {
+    out[it.key()] = bindParameter(it.value(), name, value);
+  }
+  return out;
+}
+
+static std::string base64Encode(const std::vector<unsigned char>& bytes) {
+  static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((bytes.size() + 2) / 3 * 4);
+  for (std::size_t index = 0; index < bytes.size(); index += 3) {
+    const std::size_t left = bytes.size() - index;
+    const std::uint32_t chunk = (bytes[index] << 16) |
+                                (left > 1 ? bytes[index + 1] << 8 : 0) |
+                                (left > 2 ? bytes[index + 2] : 0);
+    out.push_back(kAlphabet[(chunk >> 18) & 63]);
+    out.push_back(kAlphabet[(chunk >> 12) & 63]);
+    out.push_back(left > 1 ? kAlphabet[(chunk >> 6) & 63] : '=');
+    out.push_back(left > 2 ? kAlphabet[chunk & 63] : '=');
+  }
+  return out;
+}
+
+// Most variants one /v1/sweep request may build.
+constexpr int kMaxSweepVariants = 10000;
+
+std::shared_ptr<SweepPlan> prepareSweep(const ShapeRegistry& registry,
+                                        const KernelResult& upstream,
+                                        const json& request) {
+  ScopedPhase phase("sweep.prepare");
+  TraceSpan span("sweep.prepare");
+  auto plan = std::make_shared<SweepPlan>();
+  plan->parameter = request.value("parameter", "");
+  if (plan->parameter.empty()) throw std::runtime_error("sweep requires parameter");
+  const json features = request.value("features", json::array());
+  if (!features.is_array() || features.empty()) {
+    throw std::runtime_error("sweep features must be a non-empty array");
+  }
+
+  if (request.contains("values")) {
+    const json& values = request["values"];
+    if (!values.is_array()) throw std::runtime_error("sweep values must be an array");
+    if (values.size() > static_cast<std::size_t>(kMaxSweepVariants)) {
+      throw std::runtime_error("sweep values must have at most " + std::to_string(kMaxSweepVariants) + " entries");
+    }
+    for (const auto& value : values) {
+      if (!value.is_number()) throw std::runtime_error("sweep values must be numbers");
+      plan->values.push_back(value.get<double>());
+    }
+  } else if (request.contains("range")) {
+    const json& range = request["range"];
+    const double from = parseScalar(range.value("from", json()));
+    const double to = parseScalar(range.value("to", json()));
+    const int count = parseCount(range.value("count", json(2)), "sweep range count", kMaxSweepVariants);
+    for (int index = 0; index < count; ++index) {
+      plan->values.push_back(count == 1 ? from : from + (to - from) * index / (count - 1));
+    }
+  }
+  if (plan->values.empty()) throw std::runtime_error("sweep requires values or range");
+
+  const json quantities = request.value("quantities", json::array({"volume", "bounds"}));
+  if (!quantities.is_array()) throw std::runtime_error("sweep quantities must be an array");
+  for (const auto& quantity : quantities) {
+    const std::string name = quantity.is_string() ? quantity.get<std::string>() : "";
+    if (name == "volume") {
+      plan->volume = true;
+    } else if (name == "bounds") {
+      plan->bounds = true;
+    } else if (name == "mesh") {
+      plan->mesh = true;
+    } else if (name == "step") {
+      plan->step = true;
+    } else {
+      throw std::runtime_error("Unknown sweep quantity: " + quantity.dump());
+    }
+  }
+  for (const auto& output : request.value("outputs", json::array())) {
+    if (!output.is_string()) throw std::runtime_error("sweep outputs must be output keys");
+    plan->outputs.push_back(output.get<std::string>());
+  }
+  plan->meshOptions = request.value("mesh", json::object());
+  plan->stepSchema = request.value("schema", std::string("AP242"));
+  plan->parallel = request.value("parallel", true);
+
+  // Everything before the first feature that reads the parameter is the same
+  // in every variant: build it once here.
+  std::size_t first = features.size();
+  for (std::size_t index = 0; index < features.size() && first == features.size(); ++index) {
+    if (usesParameter(features[index], plan->parameter)) first = index;
+  }
+  if (first == features.size()) {
+    throw std::runtime_error("sweep parameter is not used by any feature: " + plan->parameter);
+  }
+  plan->registry.restore(registry.shapes(), registry.nextHandleId());
+  plan->base = upstream;
+  for (std::size_t index = 0; index < first; ++index) {
+    plan->base = mergeResults(plan->base, executeFeature(features[index], plan->base, plan->registry));
+  }
+  plan->sharedFeatures = first;
+  plan->variantFeatures.assign(features.begin() + static_cast<std::ptrdiff_t>(first), features.end());
+  span.setAttribute("sweep.variants", static_cast<std::int64_t>(plan->values.size()));
+  span.setAttribute("sweep.shared", static_cast<std::int64_t>(first));
+  return plan;
+}
+
+static json sweepVariant(const SweepPlan& plan, double value) {
+  ShapeRegistry registry;
+  registry.restore(plan.registry.shapes(), plan.registry.nextHandleId());
+  KernelResult current = plan.base;
+  KernelResult built;
+  for (const auto& feature : plan.variantFeatures) {
+    const KernelResult next = executeFeature(bindParameter(feature, plan.parameter, value), current, registry);
+    current = mergeResults(current, next);
+    built = mergeResults(built, next);
+  }
+
+  std::vector<std::string> keys = plan.outputs;
+  if (keys.empty()) {
+    for (const auto& entry : built.outputs) keys.push_back(entry.first);
+    std::sort(keys.begin(), keys.end());
+  }
+  json outputs = json::object();
+  for (const auto& key : keys) {
+    auto it = current.outputs.find(key);
+    if (it == current.outputs.end()) throw std::runtime_error("Missing output: " + key);
+    const std::string handle = it->second.meta.value("handle", "");
+    if (handle.empty()) throw std::runtime_error("Output has no shape: " + key);
+    const TopoDS_Shape shape = registry.get(handle);
+    json item = {{"kind", it->second.kind}};
+    if (plan.volume) item["volume"] = registry.volumeProperties(handle).value;
+    if (plan.bounds) item["bounds"] = boundsToJson(registry.boundingBox(handle));
+    if (plan.mesh) {
+      // Unchanged faces are shared with the other variants and the session:
+      // mesh a copy so concurrent meshers never write the same face.
+      BRepBuilderAPI_Copy copy(shape, false, false);
+      item["mesh"] = copyOut(meshShape(copy.Shape(), plan.meshOptions));
+    }
+    if (plan.step) {
+      item["step"] = base64Encode(exportStep(shape, plan.stepSchema));
+    }
+    outputs[key] = std::move(item);
+  }
+  return {{"outputs", std::move(outputs)}};
+}
+
+json runSweep(const SweepPlan& plan, const std::function<bool(const json&)>& emit) {
+  TraceSpan span("sweep.run");
+  std::mutex emitMutex;
+  std::atomic<bool> cancelled{false};
+  std::atomic<int> failed{0};
+  OSD_Parallel::For(0, static_cast<int>(plan.values.size()), [&](int index) {
+    if (cancelled.load()) return;
+    const double value = plan.values[index];
+    json record;
+    try {
+      record = sweepVariant(plan, value);
+    } catch (const std::exception& ex) {
+      record = {{"error", ex.what()}};
+      ++failed;
+    } catch (...) {
+      record = {{"error", "variant failed"}};
+      ++failed;
+    }
+    record["index"] = index;
+    record["value"] = value;
+    std::lock_guard<std::mutex> lock(emitMutex);
+    // A closed connection stops the variants not yet started.
+    if (!cancelled.load() && !emit(record)) cancelled = true;
+  }, !plan.parallel);
+  span.setAttribute("sweep.failed", static_cast<std::int64_t>(failed.load()));
+  return {
+      {"done", !cancelled.load()},
+      {"variants", plan.values.size()},
+      {"failed", failed.load()},
+      {"sharedFeatures", plan.sharedFeatures},
+  };
+}
+
+void ensureStepControllersReady() {
+  static bool initialized = false;
+  if (initialized) return;
+  STEPControl_Controller::Init();
+  STEPCAFControl_Controller::Init();
+  initialized = true;
+}
+
+static std::string toUpperCopy(const std::string& value) {
+  std::string out = value;
+  for (char& ch : out) {
+    if (ch >= 'a' && ch <= 'z') {
+      ch = static_cast<char>(ch - 'a' + 'A');
+    }
+  }
+  return out;
+}
+
+static std::string findSchemaEnumMatch(const std::string& token) {
+  const int start = Interface_Static::IDef("write.step.schema", "estart");
+  const int count = Interface_Static::IDef("write.step.schema", "ecount");
+  if (count <= 0) return "";
+  const std::string tokenUpper = toUpperCopy(token);
+  for (int i = 0; i < count; ++i) {
+    const int idx = start + i;
+    const std::string key = std::string("enum ") + std::to_string(idx);
+    const char* value = Interface_Static::CDef("write.step.schema", key.c_str());
+    if (!value || value[0] == '\0') continue;
+    const std::string valueStr(value);
+    if (toUpperCopy(valueStr).find(tokenUpper) != std::string::npos) {
+      return valueStr;
+    }
+  }
+  return "";
+}
+
+// The STEP writer configures itself through process-wide statics (the schema
+// among them), so each export holds this from setting the schema to writing
+// the file.
+static std::mutex stepWriterMutex;
+
+static void writeStepSchema(const std::string& schema) {
+  if (schema.empty()) return;
+  ensureStepControllersReady();
+  std::string target = schema;
+  if (schema == "AP242") {
+    const std::string mapped = findSchemaEnumMatch("AP242");
+    if (!mapped.empty()) target = mapped;
+  } else {
+    const std::string mapped = findSchemaEnumMatch(schema);
+    if (!mapped.empty()) target = mapped;
+  }
+  Interface_Static::SetCVal("write.step.schema", target.c_str());
+}
+
+static std::vector<unsigned char> readFileBytes(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) return {};
+  input.seekg(0, std::ios::end);
+  std::size_t size = static_cast<std::size_t>(input.tellg());
+  input.seekg(0, std::ios::beg);
+  std::vector<unsigned char> data(size);
+  input.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size));
+  return data;
+}
+
+// STEP writers only write to files; the scratch file is unique per process and
+// thread so concurrent exports (and pool workers) do not overwrite each other.
+static std::string scratchStepPath(const char* stem) {
+  const std::size_t thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+  return "/tmp/" + std::string(stem) + "-" + std::to_string(getpid()) + "-" +
+         std::to_string(thread) + ".step";
+}
+
+static std::vector<unsigned char> takeFileBytes(const std::string& path) {
+  std::vector<unsigned char> data = readFileBytes(path);
+  std::remove(path.c_str());
+  return data;
+}
+
+std::optional<MeshParameters> meshProfileParameters(const std::string& name) {
+  MeshParameters parameters;
+  parameters.relative = true;
+  if (name == "interactive") {
+    parameters.linearDeflection = 0.5;
+    parameters.angularDeflection = 0.5;
+  } else if (name == "preview") {
+    parameters.linearDeflection = 0.2;
+    parameters.angularDeflection = 0.3;
+  } else if (name == "export") {
+    parameters.linearDeflection = 0.02;
+    parameters.angularDeflection = 0.1;
+  } else {
+    return std::nullopt;
+  }
+  return parameters;
+}
+
+MeshParameters parseMeshParameters(const json& options, MeshParameters parameters) {
+  parameters.linearDeflection = options.value("linearDeflection", parameters.linearDeflection);
+  parameters.angularDeflection = options.value("angularDeflection", parameters.angularDeflection);
+  parameters.relative = options.value("relative", parameters.relative);
+  parameters.parallel = options.value("parallel", parameters.parallel);
+  return parameters;
+}
+
+RequestJson meshShape(const TopoDS_Shape& shape, const json& options) {
+  return meshShape(shape, parseMeshParameters(options));
+}
+
+MeshBuffers tessellateShape(const TopoDS_Shape& shape,
+                            const MeshParameters& parameters,
+                            const Message_ProgressRange& progress) {
+  ScopedPhase phase("mesh");
+  TraceSpan span("mesh");
+  span.setAttribute("mesh.linear_deflection", parameters.linearDeflection);
+  span.setAttribute("mesh.angular_deflection", parameters.angularDeflection);
+
+  IMeshTools_Parameters meshParameters;
+  meshParameters.Deflection = parameters.linearDeflection;
+  meshParameters.Angle = parameters.angularDeflection;
+  meshParameters.Relative = parameters.relative;
+  meshParameters.InParallel = parameters.parallel;
+  BRepMesh_IncrementalMesh mesher(shape, meshParameters, progress);
+  if (progress.UserBreak()) throw std::runtime_error("meshing cancelled");
+
+  MeshBuffers mesh;
+  std::vector<double>& positions = mesh.positions;
+  std::vector<int>& indices = mesh.indices;
+  int vertexOffset = 0;
+
+  TopExp_Explorer explorer(shape, TopAbs_FACE);
+  for (; explorer.More(); explorer.Next()) {
+    TopoDS_Face face = TopoDS::Face(explorer.Current());
+    TopLoc_Location loc;
+    Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+    if (triangulation.IsNull()) continue;
+    const int nodeCount = triangulation->NbNodes();
+    for (int i = 1; i <= nodeCount; ++i) {
+      gp_Pnt p = triangulation->Node(i).Transformed(loc.Transformation());
+      positions.push_back(p.X());
+      positions.push_back(p.Y());
+      positions.push_back(p.Z());
+    }
+    const int triCount = triangulation->NbTriangles();
+    for (int i = 1; i <= triCount; ++i) {
+      int n1, n2, n3;
+      triangulation->Triangle(i).Get(n1, n2, n3);
+      indices.push_back(vertexOffset + n1 - 1);
+      indices.push_back(vertexOffset + n2 - 1);
+      indices.push_back(vertexOffset + n3 - 1);
+    }
+    vertexOffset += nodeCount;
+  }
+
+  span.setAttribute("mesh.vertices", static_cast<std::int64_t>(positions.size() / 3));
+  span.setAttribute("mesh.triangles", static_cast<std::int64_t>(indices.size() / 3));
+  return mesh;
+}
+
+RequestJson meshShape(const TopoDS_Shape& shape,
+                      const MeshParameters& parameters,
+                      const Message_ProgressRange& progress) {
+  const MeshBuffers mesh = tessellateShape(shape, parameters, progress);
+  RequestJson out;
+  out["positions"] = mesh.positions;
+  out["indices"] = mesh.indices;
+  return out;
+}
+
+std::vector<unsigned char> exportStep(const TopoDS_Shape& shape,
+                                      const std::string& schema) {
+  std::lock_guard<std::mutex> lock(stepWriterMutex);
+  writeStepSchema(schema);
+  STEPControl_Writer writer;
+  {
+    ScopedPhase phase("step.transfer");
+    TraceSpan span("step.transfer");
+    span.setAttribute("step.schema", schema);
+    writer.Transfer(shape, STEPControl_AsIs);
+  }
+  const std::string path = scratchStepPath("trueform-native");
+  IFSelect_ReturnStatus status;
+  {
+    ScopedPhase phase("step.write");
+    TraceSpan span("step.write");
+    status = writer.Write(path.c_str());
+  }
+  if (status != IFSelect_RetDone) {
+    throw std::runtime_error("Failed to write STEP");
+  }
+  return takeFileBytes(path);
+}
+
+std::vector<unsigned char> exportStepWithPmi(const TopoDS_Shape& shape,
+                                             const KernelResult& current,
+                                             const ShapeRegistry& registry,
+                                             const json& pmiPayload,
+                                             const std::string& schema) {
+  std::lock_guard<std::mutex> lock(stepWriterMutex);
+  writeStepSchema(schema);
+  Handle(TDocStd_Document) doc = new TDocStd_Document("MDTV-XCAF");
+  Handle(XCAFDoc_ShapeTool) shapeTool = XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+  Handle(XCAFDoc_DimTolTool) dimTolTool = XCAFDoc_DocumentTool::DimTolTool(doc->Main());
+
+  TDF_Label shapeLabel = shapeTool->AddShape(shape);
+
+  std::unordered_map<std::string, TDF_Label> datumLabels;
+  if (pmiPayload.contains("datums")) {
+    for (const auto& datum : pmiPayload["datums"]) {
+      const std::string datumId = datum.value("id", "");
+      const std::string label = datum.value("label", datumId);
+      const json target = datum.value("target", json::object());
+      TopoDS_Shape targetShape = resolveGeometryRef(target, current, registry);
+      TDF_Label targetLabel = shapeTool->AddSubShape(shapeLabel, targetShape);
+
+      TDF_Label datumLabel = dimTolTool->AddDatum();
+      Handle(TCollection_HAsciiString) name = new TCollection_HAsciiString(label.c_str());
+      Handle(TCollection_HAsciiString) empty = new TCollection_HAsciiString("");
+      XCAFDoc_Datum::Set(datumLabel, name, empty, name);
+      {
+        TDF_LabelSequence seq;
+        seq.Append(targetLabel);
+        dimTolTool->SetDatum(seq, datumLabel);
+      }
+
+      if (datum.contains("modifiers") && datum["modifiers"].is_array()) {
+        Handle(XCAFDoc_Datum) datumAttr = XCAFDoc_Datum::Set(datumLabel);
+        Handle(XCAFDimTolObjects_DatumObject) datumObj = datumAttr->GetObject();
+        if (datumObj.IsNull()) {
+          datumObj = new XCAFDimTolObjects_DatumObject();
+        }
+        for (const auto& mod : datum["modifiers"]) {
+          datumObj->AddModifier(mapDatumModifier(mod.get<std::string>()));
+        }
+        datumAttr->SetObject(datumObj);
+      }
+
+      if (!datumId.empty()) {
+        datumLabels[datumId] = datumLabel;
+      }
+    }
+  }
+
+  if (pmiPayload.contains("constraints")) {
+    for (const auto& constraint : pmiPayload["constraints"]) {
+      const std::string kind = constraint.value("kind", "");
+      XCAFDimTolObjects_GeomToleranceType tolType = mapToleranceType(kind);
+      if (tolType == XCAFDimTolObjects_GeomToleranceType_None) {
+        continue;
+      }
+      const json targetRef = constraint.value("target", json::object());
+      TopoDS_Shape targetShape = resolveGeometryRef(targetRef, current, registry);
+      TDF_Label targetLabel = shapeTool->AddSubShape(shapeLabel, targetShape);
+
+      TDF_Label tolLabel = dimTolTool->AddGeomTolerance();
+      Handle(XCAFDoc_GeomTolerance) tolAttr = XCAFDoc_GeomTolerance::Set(tolLabel);
+      Handle(XCAFDimTolObjects_GeomToleranceObject) tolObj = new XCAFDimTolObjects_GeomToleranceObject();
+      tolObj->SetType(tolType);
+      tolObj->SetValue(parseScalar(constraint.value("tolerance", 0.0)));
+
+      if (kind == "constraint.position") {
+        const std::string zone = constraint.value("zone", "");
+        if (zone == "diameter") {
+          tolObj->SetTypeOfValue(XCAFDimTolObjects_GeomToleranceTypeValue_Diameter);
+        }
+      }
+
+      if (constraint.contains("modifiers") && constraint["modifiers"].is_array()) {
+        for (const auto& mod : constraint["modifiers"]) {
+          auto mapped = mapTolModifier(mod.get<std::string>());
+          if (mapped) tolObj->AddModifier(*mapped);
+        }
+      }
+
+      tolAttr->SetObject(tolObj);
+      dimTolTool->SetGeomTolerance(targetLabel, tolLabel);
+
+      if (constraint.contains("datum") && constraint["datum"].is_array()) {
+        for (const auto& datumRef : constraint["datum"]) {
+          const std::string refId = datumRef.value("datum", "");
+          auto it = datumLabels.find(refId);
+          if (it != datumLabels.end()) {
+            dimTolTool->SetDatumToGeomTol(it->second, tolLabel);
+          }
+        }
+      }
+    }
+  }
+
+  STEPCAFControl_Writer writer;
+  writer.SetDimTolMode(true);
+  writer.SetNameMode(true);
+  writer.SetPropsMode(true);
+  {
+    ScopedPhase phase("step.transfer");
+    TraceSpan span("step.transfer");
+    span.setAttribute("step.schema", schema);
+    span.setAttribute("step.pmi", true);
+    writer.Transfer(doc, STEPControl_AsIs);
+  }
+  const std::string path = scratchStepPath("trueform-native-pmi");
+  IFSelect_ReturnStatus status;
+  {
+    ScopedPhase phase("step.write");
+    TraceSpan span("step.write");
+    status = writer.Write(path.c_str());
+  }
+  if (status != IFSelect_RetDone) {
+    throw std::runtime_error("Failed to write STEP with PMI");
+  }
+  return takeFileBytes(path);
+}
+
+struct BooleanOptions {
+  bool parallel = true;
+  double fuzzy = 0.0;
+  BOPAlgo_GlueEnum glue = BOPAlgo_GlueOff;
+};
+
+static BooleanOptions parseBooleanOptions(const json& feature) {
+  BooleanOptions options;
+  options.parallel = feature.value("parallel", true);
+  if (feature.contains("fuzzy")) {
+    options.fuzzy = parseScalar(feature["fuzzy"]);
+    if (!(options.fuzzy >= 0)) {
+      throw std::runtime_error("feature.boolean fuzzy tolerance must be non-negative");
+    }
+  }
+  const std::string glue = feature.value("glue", "off");
+  if (glue == "shift") {
+    options.glue = BOPAlgo_GlueShift;
+  } else if (glue == "full") {
+    options.glue = BOPAlgo_GlueFull;
+  } else if (glue != "off") {
+    throw std::runtime_error("feature.boolean glue must be off, shift or full");
+  }
+  return options;
+}
+
+// One General Fuse pass of `op` ("union", "subtract" or "intersect") over all
+// arguments and tools. Non-destructive, since the inputs are registry shapes
+// that upstream selections still point at. `history`, when given, receives
+// the builder's history of the inputs' subshapes.
+static TopoDS_Shape runBoolean(const std::string& op,
+                               const TopTools_ListOfShape& arguments,
+                               const TopTools_ListOfShape& tools,
+                               const BooleanOptions& options,
+                               Handle(BRepTools_History)* history = nullptr) {
+  ScopedPhase phase("boolean");
+  TraceSpan span("boolean");
+  span.setAttribute("boolean.op", op);
+  span.setAttribute("boolean.arguments", static_cast<std::int64_t>(arguments.Extent()));
+  span.setAttribute("boolean.tools", static_cast<std::int64_t>(tools.Extent()));
+  span.setAttribute("boolean.parallel", options.parallel);
+  span.setAttribute("boolean.fuzzy", options.fuzzy);
+  std::unique_ptr<BRepAlgoAPI_BooleanOperation> builder;
+  if (op == "union") {
+    builder = std::make_unique<BRepAlgoAPI_Fuse>();
+  } else if (op == "subtract") {
+    builder = std::make_unique<BRepAlgoAPI_Cut>();
+  } else if (op == "intersect") {
+    builder = std::make_unique<BRepAlgoAPI_Common>();
+  } else {
+    throw std::runtime_error("Unknown boolean op " + op);
+  }
+  builder->SetArguments(arguments);
+  builder->SetTools(tools);
+  builder->SetRunParallel(options.parallel);
+  builder->SetNonDestructive(true);
+  if (options.fuzzy > 0) builder->SetFuzzyValue(options.fuzzy);
+  builder->SetGlue(options.glue);
+  builder->Build();
+  if (!builder->IsDone() || builder->HasErrors()) {
+    std::ostringstream errors;
+    builder->DumpErrors(errors);
+    std::string detail = errors.str();
+    while (!detail.empty() && std::isspace(static_cast<unsigned char>(detail.back()))) detail.pop_back();
+    throw std::runtime_error("feature.boolean " + op + " failed" + (detail.empty() ? "" : ": " + detail));
+  }
+  if (history) *history = builder->History();
+  return builder->Shape();
+}
+
+// Placement of an assembly instance: a 4x4 column-major matrix (as in
+// src/transform.ts) or {translation, rotation} with rotation in degrees
+// applied X, then Y, then Z. Must be rigid.
+static gp_Trsf parsePlacement(const json& value) {
+  gp_Trsf placement;
+  if (value.is_null()) return placement;
+  const json matrix = value.is_array() ? value : value.value("matrix", json());
+  try {
+    if (!matrix.is_null()) {
+      if (!matrix.is_array() || matrix.size() != 16) {
+        throw std::runtime_error("placement matrix must have 16 entries");
+      }
+      auto at = [&](int row, int column) { return parseScalar(matrix[column * 4 + row]); };
+      placement.SetValues(at(0, 0), at(0, 1), at(0, 2), at(0, 3),
+                          at(1, 0), at(1, 1), at(1, 2), at(1, 3),
+                          at(2, 0), at(2, 1), at(2, 2), at(2, 3));
+      return placement;
+    }
+    const json rotation = value.value("rotation", json::array({0, 0, 0}));
+    const gp_Pnt translation = parsePoint3D(value.value("translation", json::array({0, 0, 0})));
+    const gp_Pnt degrees = parsePoint3D(rotation);
+    const gp_Pnt origin(0, 0, 0);
+    gp_Trsf rx, ry, rz, move;
+    rx.SetRotation(gp_Ax1(origin, gp_Dir(1, 0, 0)), degrees.X() * M_PI / 180.0);
+    ry.SetRotation(gp_Ax1(origin, gp_Dir(0, 1, 0)), degrees.Y() * M_PI / 180.0);
+    rz.SetRotation(gp_Ax1(origin, gp_Dir(0, 0, 1)), degrees.Z() * M_PI / 180.0);
+    move.SetTranslation(gp_Vec(translation.XYZ()));
+    placement = move.Multiplied(rz).Multiplied(ry).Multiplied(rx);
+  } catch (const std::exception&) {
+    throw;
+  } catch (...) {
+    throw std::runtime_error("placement must be a rigid transform");
+  }
+  return placement;
+}
+
+static Bnd_OBB transformedOrientedBox(const Bnd_OBB& box, const gp_Trsf& placement) {
+  if (box.IsVoid()) return box;
+  return Bnd_OBB(gp_Pnt(box.Center()).Transformed(placement),
+                 gp_Dir(box.XDirection()).Transformed(placement),
+                 gp_Dir(box.YDirection()).Transformed(placement),
+                 gp_Dir(box.ZDirection()).Transformed(placement),
+                 box.XHSize(), box.YHSize(), box.ZHSize());
+}
+
+struct InterferenceInstance {
+  std::string id;
+  TopoDS_Shape shape;
+  Bnd_Box box;
+  Bnd_OBB orientedBox;
+};
+
+json checkInterference(const ShapeRegistry& registry, const RequestJson& request) {
+  ScopedPhase phase("interference");
+  TraceSpan span("interference");
+  const json instancesJson = request.value("instances", json::array());
+  if (!instancesJson.is_array() || instancesJson.size() < 2) {
+    throw std::runtime_error("interference needs at least two instances");
+  }
+  const double clearance = request.contains("clearance") ? parseScalar(request["clearance"]) : 0.0;
+  const double tolerance = request.contains("tolerance") ? parseScalar(request["tolerance"]) : 1e-6;
+  if (!(clearance >= 0) || !(tolerance >= 0)) {
+    throw std::runtime_error("interference clearance and tolerance must be non-negative");
+  }
+  // Boxes grow by half the reach on each side, so two boxes overlap exactly
+  // when the shapes could be within `reach` of each other.
+  const double reach = std::max(clearance, tolerance);
+
+  std::vector<InterferenceInstance> instances;
+  instances.reserve(instancesJson.size());
+  for (std::size_t index = 0; index < instancesJson.size(); ++index) {
+    const json& entry = instancesJson[index];
+    const std::string handle = entry.is_string() ? entry.get<std::string>() : entry.value("handle", "");
+    if (handle.empty()) throw std::runtime_error("interference instance missing handle");
+    const gp_Trsf placement = entry.is_object() ? parsePlacement(entry.value("transform", json())) : gp_Trsf();
+    InterferenceInstance instance;
+    instance.id = entry.is_object() ? entry.value("id", std::to_string(index)) : std::to_string(index);
+    instance.shape = registry.get(handle).Moved(TopLoc_Location(placement));
+    // Cached on the prototype handle, then moved: instances of one part share it.
+    instance.box = registry.boundingBox(handle).Transformed(placement);
+    instance.box.Enlarge(reach / 2.0);
+    instance.orientedBox = transformedOrientedBox(registry.orientedBox(handle), placement);
+    instance.orientedBox.Enlarge(reach / 2.0);
+    instances.push_back(std::move(instance));
+  }
+
+  // Broad phase: sweep and prune along X over the boxes, then the oriented
+  // boxes, which reject most pairs of long diagonal parts the AABBs accept.
+  std::vector<std::pair<std::size_t, std::size_t>> candidates;
+  std::size_t boxPairs = 0;
+  {
+    ScopedPhase broad("interference.broad");
+    std::vector<std::size_t> order(instances.size());
+    std::vector<std::array<double, 6>> bounds(instances.size());
+    for (std::size_t index = 0; index < instances.size(); ++index) {
+      order[index] = index;
+      if (instances[index].box.IsVoid()) {
+        bounds[index] = {1, 1, 1, 0, 0, 0};  // never overlaps anything
+        continue;
+      }
+      auto& b = bounds[index];
+      instances[index].box.Get(b[0], b[1], b[2], b[3], b[4], b[5]);
+    }
+    std::sort(order.begin(), order.end(),
+              [&](std::size_t lhs, std::size_t rhs) { return bounds[lhs][0] < bounds[rhs][0]; });
+    std::vector<std::size_t> active;
+    for (std::size_t current : order) {
+      const auto& b = bounds[current];
+      if (b[0] > b[3]) continue;
+      active.erase(std::remove_if(active.begin(), active.end(),
+                                  [&](std::size_t other) { return bounds[other][3] < b[0]; }),
+                   active.end());
+      for (std::size_t other : active) {
+        const auto& o = bounds[other];
+        if (o[1] > b[4] || b[1] > o[4] || o[2] > b[5] || b[2] > o[5]) continue;
+        ++boxPairs;
+        if (instances[current].orientedBox.IsOut(instances[other].orientedBox)) continue;
+        candidates.emplace_back(std::min(current, other), std::max(current, other));
+      }
+      active.push_back(current);
+    }
+    std::sort(candidates.begin(), candidates.end());
+  }
+  span.setAttribute("interference.instances", static_cast<std::int64_t>(instances.size()));
+  span.setAttribute("interference.candidates", static_cast<std::int64_t>(candidates.size()));
+
+  // Narrow phase, one pair per task: the boundary distance first, then the
+  // common volume only for pairs that touch or nest.
+  std::vector<json> results(candidates.size());
+  OSD_Parallel::For(0, static_cast<int>(candidates.size()), [&](int index) {
+    const InterferenceInstance& a = instances[candidates[index].first];
+    const InterferenceInstance& b = instances[candidates[index].second];
+    try {
+      BRepExtrema_DistShapeShape distance(a.shape, b.shape);
+      if (!distance.IsDone()) throw std::runtime_error("distance computation failed");
+      const double gap = distance.InnerSolution() ? 0.0 : distance.Value();
+      if (gap > tolerance) {
+        if (gap <= clearance) {
+          results[index] = {{"a", a.id}, {"b", b.id}, {"status", "clearance"}, {"distance", gap}};
+        }
+        return;
+      }
+      TopTools_ListOfShape arguments;
+      TopTools_ListOfShape tools;
+      arguments.Append(a.shape);
+      tools.Append(b.shape);
+      BooleanOptions options;
+      options.parallel = false;  // already one task per pair
+      GProp_GProps props;
+      BRepGProp::VolumeProperties(runBoolean("intersect", arguments, tools, options), props);
+      const double volume = props.Mass();
+      results[index] = {
+          {"a", a.id},
+          {"b", b.id},
+          {"status", volume > tolerance * tolerance * tolerance ? "interference" : "contact"},
+          {"distance", 0.0},
+          {"volume", volume},
+      };
+    } catch (const std::exception& ex) {
+      results[index] = {{"a", a.id}, {"b", b.id}, {"status", "error"}, {"error", ex.what()}};
+    } catch (...) {
+      results[index] = {{"a", a.id}, {"b", b.id}, {"status", "error"}, {"error", "interference check failed"}};
+    }
+  }, !request.value("parallel", true));
+
+  json pairs = json::array();
+  for (auto& result : results) {
+    if (!result.is_null()) pairs.push_back(std::move(result));
+  }
+  return {
+      {"pairs", std::move(pairs)},
+      {"stats",
+       {{"instances", instances.size()},
+        {"boxPairs", boxPairs},
+        {"candidatePairs", candidates.size()}}},
+  };
+}
+
+// One boolean operand: the shape and the owner whose face selections it
+// carries.
+struct BooleanOperand {
+  TopoDS_Shape shape;
+  std::string ownerKey;
+};
+
+static BooleanOperand resolveBooleanOperand(const json& selector,
+                                            const KernelResult& upstream,
+                                            const ShapeRegistry& registry,
+                                            const char* role) {
+  std::string error;
+  auto selection = resolveSelector(selector, upstream, error);
+  if (!selection) {
+    throw std::runtime_error(std::string("feature.boolean ") + role + ": " +
+                             (error.empty() ? "selector failed" : error));
+  }
+  const std::string handle = selection->meta.value("ownerHandle", selection->meta.value("handle", ""));
+  if (handle.empty()) {
+    throw std::runtime_error(std::string("feature.boolean ") + role + " must resolve to a solid");
+  }
+  return {registry.get(handle), selection->meta.value("ownerKey", "")};
+}
+
+// Pattern frame: the planar origin face's plane basis, anchored at the face's
+// centre of mass (matching the WASM backend's pattern meta).
+struct PatternFrame {
+  gp_Pnt origin;
+  gp_Dir xDir;
+  gp_Dir yDir;
+  gp_Dir normal;
+};
+
+static PatternFrame resolvePatternFrame(const json& feature,
+                                        const KernelResult& upstream,
+                                        const ShapeRegistry& registry,
+                                        const std::string& kind) {
+  std::string error;
+  auto selection = resolveSelector(feature.value("origin", json::object()), upstream, error);
+  if (!selection) {
+    throw std::runtime_error(error.empty() ? kind + " origin selector failed" : error);
+  }
+  if (selection->kind != "face") {
+    throw std::runtime_error(kind + " origin must resolve to a face");
+  }
+  const std::string handle = selection->meta.value("handle", "");
+  if (handle.empty()) {
+    throw std::runtime_error(kind + " origin face selection missing handle");
+  }
+  TopoDS_Face face = TopoDS::Face(registry.get(handle));
+  BRepAdaptor_Surface adaptor(face, true);
+  if (adaptor.GetType() != GeomAbs_Plane) {
+    throw std::runtime_error(kind + " origin face is not planar");
+  }
+  const gp_Ax3 ax3 = adaptor.Plane().Position();
+  PatternFrame frame;
+  frame.origin = selection->meta.contains("center")
+      ? parsePoint3D(selection->meta["center"])
+      : boxCenter(registry.boundingBox(handle));
+  frame.xDir = ax3.XDirection();
+  frame.yDir = ax3.YDirection();
+  frame.normal = ax3.Direction();
+  return frame;
+}
+
+static json dirToJson(const gp_Dir& dir) {
+  return json::array({dir.X(), dir.Y(), dir.Z()});
+}
+
+// Instances of a feature pattern are the prototype solid moved by a location,
+// so they all share its TShape: no copy, no boolean, and meshing triangulates
+// each prototype face once. Selections are collected on the prototype only;
+// every instance gets the same sub-shapes moved by its location and the
+// prototype metadata transformed by its placement. Centres and normals are
+// the only location-dependent fields (area, radius, surface and curve types
+// are invariant under a rigid motion).
+static KernelResult instancePattern(const TopoDS_Shape& prototype,
+                                    const std::vector<gp_Trsf>& placements,
+                                    ShapeRegistry& registry,
+                                    const std::string& featureId,
+                                    const std::string& ownerKey,
+                                    const json& tags) {
+  ScopedPhase phase("collect");
+  ShapeRegistry scratch;
+  const KernelResult base = collectSelections(prototype, scratch, featureId, ownerKey, "solid", tags);
+
+  TopoDS_Compound compound;
+  BRep_Builder builder;
+  builder.MakeCompound(compound);
+  std::vector<TopLoc_Location> locations;
+  locations.reserve(placements.size());
+  for (const auto& placement : placements) {
+    locations.emplace_back(placement);
+    builder.Add(compound, prototype.Moved(locations.back()));
+  }
+  const std::string ownerHandle = registry.registerShape(compound);
+
+  KernelResult result;
+  result.selections.reserve(base.selections.size() * placements.size());
+  KernelSelection solid = base.selections.front();
+  solid.meta = makeSolidMeta(ownerHandle, ownerKey, featureId, boxCenter(registry.boundingBox(ownerHandle)), tags);
+  result.selections.push_back(solid);
+  for (std::size_t index = 0; index < placements.size(); ++index) {
+    const gp_Trsf& placement = placements[index];
+    for (const auto& sel : base.selections) {
+      if (sel.kind == "solid") continue;
+      KernelSelection moved = sel;
+      const TopoDS_Shape sub = scratch.get(sel.meta.value("handle", "")).Moved(locations[index]);
+      moved.meta["handle"] = registry.registerShape(sub);
+      moved.meta["ownerHandle"] = ownerHandle;
+      moved.meta["instance"] = index;
+      if (sel.meta.contains("center")) {
+        const gp_Pnt center = parsePoint3D(sel.meta["center"]).Transformed(placement);
+        moved.meta["center"] = pointToJson(center);
+        moved.meta["centerZ"] = center.Z();
+      }
+      if (sel.meta.contains("normalVec")) {
+        const gp_Vec normal = gp_Vec(parsePoint3D(sel.meta["normalVec"]).XYZ()).Transformed(placement);
+        moved.meta["normalVec"] = vecToJson(normal);
+        const std::string label = axisDirectionFromVector(normal);
+        if (label.empty()) {
+          moved.meta.erase("normal");
+        } else {
+          moved.meta["normal"] = label;
+        }
+      }
+      result.selections.push_back(std::move(moved));
+    }
+  }
+
+  KernelObject output;
+  output.id = featureId + ":solid";
+  output.kind = "solid";
+  output.meta = json::object();
+  output.meta["handle"] = ownerHandle;
+  output.meta["ownerKey"] = ownerKey;
+  output.meta["createdBy"] = featureId;
+  output.meta["role"] = "body";
+  output.meta["instances"] = placements.size();
+  result.outputs[ownerKey] = output;
+  return result;
+}
+
+static KernelResult executePattern(const json& feature,
+                                   const KernelResult& upstream,
+                                   ShapeRegistry& registry,
+                                   const std::string& kind,
+                                   const std::string& featureId,
+                                   const json& tags) {
+  const PatternFrame frame = resolvePatternFrame(feature, upstream, registry, kind);
+  json meta;
+  meta["type"] = kind;
+  meta["origin"] = pointToJson(frame.origin);
+  meta["xDir"] = dirToJson(frame.xDir);
+  meta["yDir"] = dirToJson(frame.yDir);
+  meta["normal"] = dirToJson(frame.normal);
+
+  std::vector<gp_Trsf> placements;
+  if (kind == "pattern.linear") {
+    const json spacing = feature.value("spacing", json::array());
+    const json count = feature.value("count", json::array());
+    if (!spacing.is_array() || spacing.size() != 2 || !count.is_array() || count.size() != 2) {
+      throw std::runtime_error("pattern.linear spacing and count must be [x, y] pairs");
+    }
+    const double spacingX = parseScalar(spacing[0]);
+    const double spacingY = parseScalar(spacing[1]);
+    const int countX = parseCount(count[0], "pattern.linear count X");
+    const int countY = parseCount(count[1], "pattern.linear count Y");
+    meta["spacing"] = json::array({spacingX, spacingY});
+    meta["count"] = json::array({countX, countY});
+    placements.reserve(static_cast<std::size_t>(countX) * countY);
+    for (int i = 0; i < countX; ++i) {
+      for (int j = 0; j < countY; ++j) {
+        gp_Trsf placement;
+        placement.SetTranslation(gp_Vec(frame.xDir) * (spacingX * i) + gp_Vec(frame.yDir) * (spacingY * j));
+        placements.push_back(placement);
+      }
+    }
+  } else {
+    gp_Vec axis = parseAxis(feature.value("axis", json("+Z")));
+    if (axis.Magnitude() == 0) {
+      throw std::runtime_error("pattern.circular axis is invalid");
+    }
+    axis.Normalize();
+    const int count = parseCount(feature.value("count", json(1)), "pattern.circular count");
+    meta["axis"] = vecToJson(axis);
+    meta["count"] = count;
+    placements.reserve(count);
+    for (int i = 0; i < count; ++i) {
+      gp_Trsf placement;
+      placement.SetRotation(gp_Ax1(frame.origin, gp_Dir(axis)), 2.0 * M_PI * i / count);
+      placements.push_back(placement);
+    }
+  }
+
+  KernelObject pattern;
+  pattern.id = featureId + ":pattern";
+  pattern.kind = "pattern";
+  pattern.meta = meta;
+  if (!feature.contains("source")) {
+    KernelResult built;
+    built.outputs["pattern:" + featureId] = pattern;
+    return built;
+  }
+  const std::string resultKey = feature.value("result", "");
+  if (resultKey.empty()) {
+    throw std::runtime_error(kind + " result is required when source is set");
+  }
+  std::string error;
+  auto source = resolveSelector(feature["source"], upstream, error);
+  if (!source) {
+    throw std::runtime_error(error.empty() ? kind + " source selector failed" : error);
+  }
+  if (source->kind != "solid") {
+    throw std::runtime_error(kind + " source must resolve to a solid");
+  }
+  const std::string sourceHandle = source->meta.value("ownerHandle", source->meta.value("handle", ""));
+  if (sourceHandle.empty()) {
+    throw std::runtime_error(kind + " source missing owner shape");
+  }
+  KernelResult instanced = instancePattern(
+      registry.get(sourceHandle), placements, registry, featureId, resultKey, tags);
+  instanced.outputs["pattern:" + featureId] = pattern;
+  return instanced;
+}
+
+// A selection ledger hint, applied to the meta as applySelectionLedgerHint in
+// src/occt/selection_ids.ts does; assignSelectionIds turns it into the id
+// and record.
+struct SelectionHint {
+  std::string slot;
+  std::string role;
+  json lineage;
+};
+
+static bool isBlank(const std::string& value) {
+  return value.find_first_not_of(" \t\r\n") == std::string::npos;
+}
+
+static void applySelectionHint(KernelSelection& selection, const SelectionHint& hint) {
+  json& meta = selection.meta;
+  if (!hint.role.empty()) {
+    auto role = meta.find("role");
+    if (!meta.contains("selectionLegacyRole") && role != meta.end() && role->is_string() &&
+        !isBlank(role->get_ref<const std::string&>())) {
+      meta["selectionLegacyRole"] = *role;
+    }
+    meta["role"] = hint.role;
+  }
+  if (!hint.slot.empty()) meta["selectionSlot"] = hint.slot;
+  if (!hint.lineage.is_null()) meta["selectionLineage"] = hint.lineage;
+}
+
+// The slot and role an upstream selection passes on, from its record first
+// (selectionSlotForLineage and selectionRoleForLineage on the client).
+static std::string inheritedSelectionField(const KernelSelection& selection,
+                                           const char* recordKey,
+                                           const char* metaKey) {
+  for (const json* source : {&selection.record, &selection.meta}) {
+    if (!source->is_object()) continue;
+    auto value = source->find(source == &selection.record ? recordKey : metaKey);
+    if (value != source->end() && value->is_string() && !isBlank(value->get_ref<const std::string&>())) {
+      std::string text = value->get<std::string>();
+      text.erase(0, text.find_first_not_of(" \t\r\n"));
+      text.erase(text.find_last_not_of(" \t\r\n") + 1);
+      return text;
+    }
+  }
+  return "";
+}
+
+// The face selections of a built result by subshape. The map hashes by
+// TShape and location, so a history image finds its selection whatever its
+// orientation.
+class FaceSelections {
+ public:
+  FaceSelections(KernelResult& result, const ShapeRegistry& registry) : result_(result) {
+    for (std::size_t index = 0; index < result.selections.size(); ++index) {
+      const KernelSelection& selection = result.selections[index];
+      if (selection.kind != "face") continue;
+      const std::string handle = selection.meta.value("handle", "");
+      if (!handle.empty()) index_.Bind(registry.get(handle), static_cast<Standard_Integer>(index));
+    }
+  }
+
+  KernelSelection* find(const TopoDS_Shape& shape) const {
+    const Standard_Integer* index = index_.Seek(shape);
+    return index ? &result_.selections[static_cast<std::size_t>(*index)] : nullptr;
+  }
+
+  std::vector<KernelSelection*> all() const {
+    std::vector<KernelSelection*> faces;
+    for (auto& selection : result_.selections) {
+      if (selection.kind == "face" && selection.meta.contains("handle")) faces.push_back(&selection);
+    }
+    return faces;
+  }
+
+ private:
+  KernelResult& result_;
+  TopTools_DataMapOfShapeInteger index_;
+};
+
+// The profile output's wireSegmentSlots, which the client uses to slot the
+// lateral faces of a prism or revolution (resolveProfile in
+// src/occt/profile_resolution.ts). Only sketch profiles carry them.
+static std::vector<std::string> resolveProfileSegmentSlots(const json& profileRef,
+                                                           const KernelResult& upstream) {
+  std::vector<std::string> slots;
+  if (profileRef.value("kind", "") != "profile.ref") return slots;
+  auto output = upstream.outputs.find(profileRef.value("name", ""));
+  if (output == upstream.outputs.end()) return slots;
+  auto value = output->second.meta.find("wireSegmentSlots");
+  if (value == output->second.meta.end() || !value->is_array()) return slots;
+  for (const json& entry : *value) {
+    if (!entry.is_string() || isBlank(entry.get_ref<const std::string&>())) continue;
+    std::string slot = entry.get<std::string>();
+    slot.erase(0, slot.find_first_not_of(" \t\r\n"));
+    slot.erase(slot.find_last_not_of(" \t\r\n") + 1);
+    slots.push_back(std::move(slot));
+  }
+  return slots;
+}
+
+// applyGeneratedDerivedFaceSlots (src/occt/selection_ledger_common.ts): each
+// edge of the profile's outer wire names the first of `faces` it generates
+// `<prefix>.<segment slot>`, and the faces no edge reached get fallback
+// slots. Returns false, slotting nothing, when the wire and the slots do not
+// line up or no edge generated one of the faces.
+static bool applyGeneratedFaceSlots(const std::vector<KernelSelection*>& faces,
+                                    const ShapeRegistry& registry,
+                                    BRepBuilderAPI_MakeShape& builder,
+                                    const TopoDS_Face& profile,
+                                    const std::vector<std::string>& segmentSlots,
+                                    const std::string& prefix) {
+  std::vector<TopoDS_Shape> edges;
+  for (TopExp_Explorer explorer(BRepTools::OuterWire(profile), TopAbs_EDGE); explorer.More(); explorer.Next()) {
+    edges.push_back(explorer.Current());
+  }
+  if (edges.empty() || edges.size() != segmentSlots.size()) return false;
+
+  std::vector<std::pair<KernelSelection*, TopoDS_Shape>> remaining;
+  for (KernelSelection* face : faces) remaining.emplace_back(face, registry.get(face->meta.value("handle", "")));
+  const json created = {{"kind", "created"}};
+  int assigned = 0;
+  for (std::size_t index = 0; index < edges.size(); ++index) {
+    std::vector<TopoDS_Shape> candidates;
+    for (TopTools_ListIteratorOfListOfShape image(builder.Generated(edges[index])); image.More(); image.Next()) {
+      const std::size_t before = candidates.size();
+      for (TopExp_Explorer explorer(image.Value(), TopAbs_FACE); explorer.More(); explorer.Next()) {
+        candidates.push_back(explorer.Current());
+      }
+      if (candidates.size() == before) candidates.push_back(image.Value());
+    }
+    for (const TopoDS_Shape& candidate : candidates) {
+      auto match = std::find_if(remaining.begin(), remaining.end(),
+                                [&](const auto& entry) { return entry.second.IsSame(candidate); });
+      if (match == remaining.end()) continue;
+      applySelectionHint(*match->first, {prefix + "." + segmentSlots[index], prefix, created});
+      remaining.erase(match);
+      ++assigned;
+      break;
+    }
+  }
+  if (assigned == 0) return false;
+  int fallback = 0;
+  for (const auto& entry : remaining) {
+    applySelectionHint(*entry.first, {prefix + ".fallback." + std::to_string(++fallback), prefix, created});
+  }
+  return true;
+}
+
+// A face meta vector as the client's vectorFingerprint reads it.
+static std::optional<gp_Vec> metaVector(const json& meta, const char* key) {
+  auto value = meta.find(key);
+  if (value == meta.end() || !value->is_array() || value->size() != 3) return std::nullopt;
+  double coords[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    const json& entry = (*value)[axis];
+    if (!entry.is_number() || !std::isfinite(entry.get<double>())) return std::nullopt;
+    coords[axis] = roundToFixed6(entry.get<double>());
+  }
+  return gp_Vec(coords[0], coords[1], coords[2]);
+}
+
+// annotatePrismFaceSelections (src/occt/selection_ledger_primitives.ts),
+// with the same rounding and tie-breaks so both backends slot a prism alike:
+//
+//   - faces whose normal lies along the axis are caps, `bottom` and `top` by
+//     their offset along it from the faces' mean center;
+//   - the lateral faces take the profile's segment slots when it has them;
+//   - otherwise they are ranked by angle around the axis, then height, then
+//     area (largest first), as `side.<n>`.
+static void annotatePrismFaceSlots(KernelResult& built,
+                                   const ShapeRegistry& registry,
+                                   BRepBuilderAPI_MakeShape& prism,
+                                   const TopoDS_Face& profile,
+                                   const std::vector<std::string>& segmentSlots,
+                                   const gp_Vec& axis) {
+  ScopedPhase phase("selection-history");
+  const std::vector<KernelSelection*> faces = FaceSelections(built, registry).all();
+  if (faces.empty()) return;
+  double sum[3] = {0, 0, 0};
+  int centers = 0;
+  for (const KernelSelection* face : faces) {
+    if (auto center = metaVector(face->meta, "center")) {
+      sum[0] += center->X();
+      sum[1] += center->Y();
+      sum[2] += center->Z();
+      ++centers;
+    }
+  }
+  const gp_Vec centroid = centers > 0 ? gp_Vec(sum[0] / centers, sum[1] / centers, sum[2] / centers) : gp_Vec(0, 0, 0);
+  auto relativeCenter = [&](const KernelSelection& face) {
+    return metaVector(face.meta, "center").value_or(centroid) - centroid;
+  };
+
+  const json created = {{"kind", "created"}};
+  std::vector<std::pair<KernelSelection*, double>> caps;
+  std::vector<KernelSelection*> sides;
+  for (KernelSelection* face : faces) {
+    const std::optional<gp_Vec> normal = metaVector(face->meta, "normalVec");
+    const double alignment =
+        normal && normal->Magnitude() > 0 ? std::abs(normal->Normalized().Dot(axis)) : 0.0;
+    if (alignment > 0.98) {
+      caps.emplace_back(face, relativeCenter(*face).Dot(axis));
+    } else {
+      sides.push_back(face);
+    }
+  }
+  std::stable_sort(caps.begin(), caps.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+  if (!caps.empty()) {
+    applySelectionHint(*caps.front().first, {"bottom", "bottom", created});
+    if (caps.size() > 1) applySelectionHint(*caps.back().first, {"top", "top", created});
+  }
+
+  if (sides.empty()) return;
+  if (applyGeneratedFaceSlots(sides, registry, prism, profile, segmentSlots, "side")) return;
+
+  // basisFromNormal (src/occt/datum_pattern_ops.ts) with no x hint.
+  const gp_Vec hint = std::abs(axis.X()) < 0.9 ? gp_Vec(1, 0, 0) : gp_Vec(0, 1, 0);
+  const gp_Vec xDir = (hint - axis * hint.Dot(axis)).Normalized();
+  const gp_Vec yDir = axis.Crossed(xDir).Normalized();
+  struct RankedSide {
+    KernelSelection* face;
+    double angle;
+    double height;
+    double area;
+  };
+  std::vector<RankedSide> ranked;
+  for (KernelSelection* face : sides) {
+    const gp_Vec relative = relativeCenter(*face);
+    const double height = relative.Dot(axis);
+    const gp_Vec radial = relative - axis * height;
+    auto area = face->meta.find("area");
+    ranked.push_back({face,
+                      std::atan2(radial.Dot(yDir), radial.Dot(xDir)),
+                      height,
+                      area != face->meta.end() && area->is_number() && std::isfinite(area->get<double>())
+                          ? roundToFixed6(area->get<double>())
+                          : 0.0});
+  }
+  std::stable_sort(ranked.begin(), ranked.end(), [](const RankedSide& a, const RankedSide& b) {
+    if (a.angle != b.angle) return a.angle < b.angle;
+    if (a.height != b.height) return a.height < b.height;
+    return a.area > b.area;
+  });
+  for (std::size_t index = 0; index < ranked.size(); ++index) {
+    applySelectionHint(*ranked[index].face, {"side." + std::to_string(index + 1), "side", created});
+  }
+}
+
+// annotateRevolveFaceSelections: a revolution's faces are slotted only from
+// the profile's segment slots, as `profile.<slot>`.
+static void annotateRevolveFaceSlots(KernelResult& built,
+                                     const ShapeRegistry& registry,
+                                     BRepBuilderAPI_MakeShape& revol,
+                                     const TopoDS_Face& profile,
+                                     const std::vector<std::string>& segmentSlots) {
+  if (segmentSlots.empty()) return;
+  ScopedPhase phase("selection-history");
+  applyGeneratedFaceSlots(FaceSelections(built, registry).all(), registry, revol, profile, segmentSlots, "profile");
+}
+
+// Carries the operands' upstream face selections onto a boolean's result
+// through the builder history, as src/occt/selection_ledger_boolean.ts does
+// by matching candidates:
+//
+//   - a face the history removes is gone;
+//   - a face with one image keeps its source's slot and role with
+//     `modified` lineage, and one with several gets `split` branches;
+//   - the faces of a subtracted tool become `cut` faces;
+//   - a union or intersect tool's slot that an argument face already holds
+//     moves under `right.`;
+//   - a face several sources land on is `merged`.
+//
+// Only faces the history does not reach are new, keep `created` lineage and
+// are told apart by their fingerprints.
+static void annotateBooleanHistory(KernelResult& built,
+                                   const ShapeRegistry& registry,
+                                   const KernelResult& upstream,
+                                   const std::string& op,
+                                   const std::vector<BooleanOperand>& arguments,
+                                   const std::vector<BooleanOperand>& tools,
+                                   const Handle(BRepTools_History)& history) {
+  ScopedPhase phase("selection-history");
+  if (history.IsNull()) return;
+  const FaceSelections faces(built, registry);
+  struct Claim {
+    const KernelSelection* source;
+    bool tool;
+    std::size_t toolFace;  // among all tool faces, for cut.seed slots
+    std::size_t branch;
+    std::size_t branches;
+  };
+  std::map<KernelSelection*, std::vector<Claim>> claims;
+  std::vector<KernelSelection*> order;
+  std::size_t toolFaces = 0;
+  auto collect = [&](const std::vector<BooleanOperand>& operands, bool tool) {
+    for (const BooleanOperand& operand : operands) {
+      for (const auto& source : upstream.selections) {
+        if (source.kind != "face" || source.meta.value("ownerKey", "") != operand.ownerKey) continue;
+        const std::string handle = source.meta.value("handle", "");
+        if (handle.empty()) continue;
+        const std::size_t toolFace = tool ? toolFaces++ : 0;
+        const TopoDS_Shape shape = registry.get(handle);
+        if (history->IsRemoved(shape)) continue;
+        std::vector<KernelSelection*> images;
+        const TopTools_ListOfShape& modified = history->Modified(shape);
+        if (modified.Extent() == 0) {
+          if (KernelSelection* image = faces.find(shape)) images.push_back(image);
+        }
+        for (TopTools_ListIteratorOfListOfShape image(modified); image.More(); image.Next()) {
+          KernelSelection* selection = faces.find(image.Value());
+          if (selection && std::find(images.begin(), images.end(), selection) == images.end()) {
+            images.push_back(selection);
+          }
+        }
+        for (std::size_t branch = 0; branch < images.size(); ++branch) {
+          std::vector<Claim>& onto = claims[images[branch]];
+          if (onto.empty()) order.push_back(images[branch]);
+          onto.push_back({&source, tool, toolFace, branch, images.size()});
+        }
+      }
+    }
+  };
+  collect(arguments, false);
+  collect(tools, true);
+
+  // Arguments first, so a tool knows which slots they took.
+  std::stable_partition(order.begin(), order.end(), [&](KernelSelection* face) {
+    return !claims[face].front().tool;
+  });
+  std::vector<std::string> argumentSlots;
+  for (KernelSelection* face : order) {
+    const std::vector<Claim>& onto = claims[face];
+    if (onto.size() > 1) {
+      json from = json::array();
+      for (const Claim& claim : onto) from.push_back(claim.source->id);
+      applySelectionHint(*face, {"", "", {{"kind", "merged"}, {"from", from}}});
+      continue;
+    }
+    const Claim& claim = onto.front();
+    const std::string slot = inheritedSelectionField(*claim.source, "slot", "selectionSlot");
+    const std::string role = inheritedSelectionField(*claim.source, "role", "role");
+    const std::string branch = std::to_string(claim.branch + 1);
+    SelectionHint hint{"", role, {{"kind", "modified"}, {"from", claim.source->id}}};
+    if (claim.tool && op == "subtract") {
+      const std::string root = slot.empty() ? "cut.seed." + std::to_string(claim.toolFace + 1) : "cut." + slot;
+      hint.slot = claim.branch == 0 ? root : root + ".part." + branch;
+      hint.role = "cut";
+      applySelectionHint(*face, hint);
+      continue;
+    }
+    std::string base = slot;
+    if (claim.tool && !slot.empty() &&
+        std::find(argumentSlots.begin(), argumentSlots.end(), slot) != argumentSlots.end()) {
+      base = "right." + slot;
+    }
+    if (claim.branches == 1) {
+      hint.slot = base;
+    } else {
+      const std::string root = !base.empty() ? "split." + base : claim.tool ? "split.right.seed" : "split.seed";
+      hint.slot = root + ".branch." + branch;
+      hint.lineage = {{"kind", "split"}, {"from", claim.source->id}, {"branch", branch}};
+    }
+    if (!claim.tool && !hint.slot.empty()) argumentSlots.push_back(hint.slot);
+    applySelectionHint(*face, hint);
+  }
+}
+
+// Gives the faces and edges collectSelections left with a generic id the
+// stable id and record the TypeScript client would compute for them.
+static void assignSelectionIds(KernelResult& result) {
+  ScopedPhase phase("selection-ids");
+  for (const char* kind : {"face", "edge"}) {
+    std::vector<KernelSelection*> generic;
+    std::vector<const json*> metas;
+    for (auto& selection : result.selections) {
+      if (selection.kind == kind && selection.id == kind) {
+        generic.push_back(&selection);
+        metas.push_back(&selection.meta);
+      }
+    }
+    if (generic.empty()) continue;
+    std::vector<SelectionIdAssignment> assignments = assignStableSelectionIds(kind, metas);
+    for (std::size_t index = 0; index < generic.size(); ++index) {
+      generic[index]->id = std::move(assignments[index].id);
+      generic[index]->record = std::move(assignments[index].record);
+      generic[index]->meta.erase("selectionAliases");
+    }
+  }
+}
+
+static KernelResult buildFeature(const json& feature, const KernelResult& upstream, ShapeRegistry& registry);
+
+KernelResult executeFeature(const json& feature,
+                            const KernelResult& upstream,
+                            ShapeRegistry& registry) {
+  KernelResult built = buildFeature(feature, upstream, registry);
+  assignSelectionIds(built);
+  return built;
+}
+
+static KernelResult buildFeature(const json& feature,
+                                 const KernelResult& upstream,
+                                 ShapeRegistry& registry) {
+  const std::string kind = feature.value("kind", "");
+  const std::string featureId = feature.value("id", "feature");
+  const json tags = feature.value("tags", json::array());
+  TraceSpan featureSpan("feature.execute");
+  featureSpan.setAttribute("feature.kind", kind);
+  featureSpan.setAttribute("feature.id", featureId);
+
+  if (kind == "datum.plane") {
+    gp_Vec normal = parseAxis(feature.value("normal", json("+Z")));
+    if (normal.Magnitude() == 0) {
+      throw std::runtime_error("datum.plane normal is invalid");
+    }
+    normal.Normalize();
+    gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
+    gp_Vec xAxis(0, 0, 0);
+    if (feature.contains("xAxis")) {
+      xAxis = parseAxis(feature["xAxis"]);
+      if (xAxis.Magnitude() != 0) {
+        xAxis.Normalize();
+      }
+    }
+    json meta;
+    meta["type"] = "plane";
+    meta["origin"] = pointToJson(origin);
+    meta["normal"] = vecToJson(normal);
+    if (xAxis.Magnitude() != 0) meta["xDir"] = vecToJson(xAxis);
+    KernelResult built = makeDatumResult("datum:" + featureId, featureId + ":datum", meta);
+    return built;
+  }
+
+  if (kind == "datum.axis") {
+    gp_Vec direction = parseAxis(feature.value("direction", json("+Z")));
+    if (direction.Magnitude() == 0) {
+      throw std::runtime_error("datum.axis direction is invalid");
+    }
+    direction.Normalize();
+    gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
+    json meta;
+    meta["type"] = "axis";
+    meta["origin"] = pointToJson(origin);
+    meta["direction"] = vecToJson(direction);
+    KernelResult built = makeDatumResult("datum:" + featureId, featureId + ":datum", meta);
+    return built;
+  }
+
+  if (kind == "datum.frame") {
+    std::string error;
+    auto selection = resolveSelector(feature.value("on", json::object()), upstream, error);
+    if (!selection) {
+      throw std::runtime_error(error.empty() ? "datum.frame selector failed" : error);
+    }
+    if (selection->kind != "face") {
+      throw std::runtime_error("datum.frame must resolve to a face");
+    }
+    const std::string handle = selection->meta.value("handle", "");
+    if (handle.empty()) {
+      throw std::runtime_error("datum.frame face selection missing handle");
+    }
+    TopoDS_Shape shape = registry.get(handle);
+    TopoDS_Face face = TopoDS::Face(shape);
+    BRepAdaptor_Surface adaptor(face, true);
+    if (adaptor.GetType() != GeomAbs_Plane) {
+      throw std::runtime_error("datum.frame currently requires a planar face");
+    }
+    gp_Pln plane = adaptor.Plane();
+    gp_Ax3 ax3 = plane.Position();
+    gp_Pnt origin = ax3.Location();
+    gp_Dir xDir = ax3.XDirection();
+    gp_Dir yDir = ax3.YDirection();
+    gp_Dir normal = ax3.Direction();
+    json meta;
+    meta["type"] = "frame";
+    meta["origin"] = pointToJson(origin);
+    meta["xDir"] = json::array({xDir.X(), xDir.Y(), xDir.Z()});
+    meta["yDir"] = json::array({yDir.X(), yDir.Y(), yDir.Z()});
+    meta["normal"] = json::array({normal.X(), normal.Y(), normal.Z()});
+    KernelResult built = makeDatumResult("datum:" + featureId, featureId + ":datum", meta);
+    return built;
+  }
+
+  if (kind == "feature.sketch2d") {
+    KernelResult built = makeSketchProfileResult(feature);
+    return built;
+  }
+
+  if (kind == "feature.surface") {
+    const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
+    TopoDS_Face face = buildProfileFace(profile);
+    const std::string resultKey = feature.value("result", "surface:main");
+    KernelResult built = collectSelections(
+        face, registry, featureId, resultKey, "surface", tags);
+    return built;
+  }
+
+  if (kind == "feature.plane") {
+    const double width = parseScalar(feature.value("width", 0.0));
+    const double height = parseScalar(feature.value("height", 0.0));
+    if (!(width > 0) || !(height > 0)) {
+      throw std::runtime_error("feature.plane requires positive width and height");
+    }
+    const json basis = feature.contains("plane")
+        ? resolvePlaneBasisJson(feature["plane"], upstream)
+        : json{
+              {"origin", json::array({0, 0, 0})},
+              {"xDir", json::array({1, 0, 0})},
+              {"yDir", json::array({0, 1, 0})},
+              {"normal", json::array({0, 0, 1})},
+          };
+    const json originOffset = feature.value("origin", json::array({0, 0, 0}));
+    TopoDS_Face face = makePlaneFaceFromBasis(basis, width, height, originOffset);
+    const std::string resultKey = feature.value("result", "surface:main");
+    KernelResult built = collectSelections(
+        face, registry, featureId, resultKey, "surface", tags);
+    return built;
+  }
+
+  if (kind == "feature.revolve") {
+    const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
+    TopoDS_Face face = buildProfileFace(profile);
+    gp_Vec axisVec = parseAxis(feature.value("axis", json("+Z")));
+    if (axisVec.Magnitude() == 0) {
+      throw std::runtime_error("feature.revolve axis is invalid");
+    }
+    axisVec.Normalize();
+    gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
+    gp_Ax1 axis(origin, gp_Dir(axisVec));
+    json angleJson = feature.value("angle", "full");
+    double angleRad = 2.0 * M_PI;
+    if (angleJson.is_number()) {
+      angleRad = parseScalar(angleJson);
+    } else if (angleJson.is_string() && angleJson.get<std::string>() != "full") {
+      throw std::runtime_error("feature.revolve angle must be numeric or 'full'");
+    }
+    BRepPrimAPI_MakeRevol revol(face, axis, angleRad);
+    const std::string resultKey = feature.value("result", "body:main");
+    KernelResult built = collectSelections(
+        revol.Shape(), registry, featureId, resultKey, "solid", tags);
+    annotateRevolveFaceSlots(built, registry, revol, face,
+                             resolveProfileSegmentSlots(feature.value("profile", json::object()), upstream));
+    return built;
+  }
+
+  if (kind == "feature.pipe") {
+    gp_Vec axisVec = parseAxis(feature.value("axis", json("+Z")));
+    if (axisVec.Magnitude() == 0) {
+      throw std::runtime_error("feature.pipe axis is invalid");
+    }
+    axisVec.Normalize();
+    const double length = parseScalar(feature.value("length", 0.0));
+    const double outerDia = parseScalar(feature.value("outerDiameter", 0.0));
+    const double innerDia = feature.contains("innerDiameter")
+        ? parseScalar(feature["innerDiameter"])
+        : 0.0;
+    if (!(length > 0)) {
+      throw std::runtime_error("feature.pipe length must be positive");
+    }
+    if (!(outerDia > 0)) {
+      throw std::runtime_error("feature.pipe outer diameter must be positive");
+    }
+    if (innerDia < 0) {
+      throw std::runtime_error("feature.pipe inner diameter must be non-negative");
+    }
+    if (innerDia > 0 && innerDia >= outerDia) {
+      throw std::runtime_error("feature.pipe inner diameter must be smaller than outer diameter");
+    }
+    gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
+    gp_Ax2 axis(origin, gp_Dir(axisVec));
+    TopoDS_Shape outer = BRepPrimAPI_MakeCylinder(axis, outerDia / 2.0, length);
+    TopoDS_Shape shape = outer;
+    if (innerDia > 0) {
+      TopoDS_Shape inner = BRepPrimAPI_MakeCylinder(axis, innerDia / 2.0, length);
+      TopTools_ListOfShape arguments;
+      TopTools_ListOfShape tools;
+      arguments.Append(outer);
+      tools.Append(inner);
+      shape = runBoolean("subtract", arguments, tools, BooleanOptions());
+    }
+    const std::string resultKey = feature.value("result", "body:main");
+    KernelResult built = collectSelections(
+        shape, registry, featureId, resultKey, "solid", tags);
+    return built;
+  }
+
+  if (kind == "feature.boolean") {
+    const std::string op = feature.value("op", "");
+    if (op != "union" && op != "subtract" && op != "intersect") {
+      throw std::runtime_error("Unknown boolean op " + op);
+    }
+    std::vector<BooleanOperand> left;
+    std::vector<BooleanOperand> right;
+    left.push_back(resolveBooleanOperand(feature.value("left", json::object()), upstream, registry, "left"));
+    right.push_back(resolveBooleanOperand(feature.value("right", json::object()), upstream, registry, "right"));
+    // Extra tools (e.g. every hole of a pattern) go into the same operation,
+    // so N cuts cost one intersection pass over the body instead of N.
+    for (const auto& tool : feature.value("tools", json::array())) {
+      right.push_back(resolveBooleanOperand(tool, upstream, registry, "tool"));
+    }
+    TopTools_ListOfShape arguments;
+    TopTools_ListOfShape tools;
+    for (const BooleanOperand& operand : left) arguments.Append(operand.shape);
+    for (const BooleanOperand& operand : right) tools.Append(operand.shape);
+    Handle(BRepTools_History) history;
+    TopoDS_Shape shape = runBoolean(op, arguments, tools, parseBooleanOptions(feature), &history);
+    const std::string resultKey = feature.value("result", "body:" + featureId);
+    KernelResult built = collectSelections(
+        shape, registry, featureId, resultKey, "solid", tags);
+    annotateBooleanHistory(built, registry, upstream, op, left, right, history);
+    return built;
+  }
+
+  if (kind == "pattern.linear" || kind == "pattern.circular") {
+    KernelResult built = executePattern(feature, upstream, registry, kind, featureId, tags);
+    return built;
+  }
+
+  if (kind == "feature.loft") {
+    const json profiles = feature.value("profiles", json::array());
+    if (!profiles.is_array() || profiles.size() < 2) {
+      throw std::runtime_error("feature.loft requires at least two profiles");
+    }
+    const bool makeSolid = feature.value("mode", std::string("solid")) != "surface";
+    BRepOffsetAPI_ThruSections loftBuilder(makeSolid, false, Precision::Confusion());
+    for (const auto& profileRef : profiles) {
+      const json profile = resolveProfileJson(profileRef, upstream);
+      loftBuilder.AddWire(buildProfileWire(profile));
+    }
+    loftBuilder.Build();
+    if (!loftBuilder.IsDone()) {
+      throw std::runtime_error("feature.loft failed to build");
+    }
+    TopoDS_Shape shape = loftBuilder.Shape();
+    const std::string resultKey = feature.value(
+        "result", makeSolid ? "body:main" : "surface:main");
+    KernelResult built = collectSelections(
+        shape, registry, featureId, resultKey, makeSolid ? "solid" : "surface", tags);
+    return built;
+  }
+
+  if (kind == "feature.sweep") {
+    if (feature.contains("frame")) {
+      throw std::runtime_error("Native backend sweep does not support custom frame references yet");
+    }
+    if (feature.contains("orientation") &&
+        feature["orientation"].is_string() &&
+        feature["orientation"].get<std::string>() != "frenet") {
+      throw std::runtime_error("Native backend sweep currently supports only frenet orientation");
+    }
+    const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
+    TopoDS_Wire pathWire = buildPathWire(feature.value("path", json::object()));
+    const bool makeSolid = feature.value("mode", std::string("solid")) != "surface";
+    TopoDS_Shape section = makeSolid
+        ? TopoDS_Shape(buildProfileFace(profile))
+        : TopoDS_Shape(buildProfileWire(profile));
+    BRepOffsetAPI_MakePipe sweepBuilder(pathWire, section);
+    sweepBuilder.Build();
+    if (!sweepBuilder.IsDone()) {
+      throw std::runtime_error("feature.sweep failed to build");
+    }
+    TopoDS_Shape shape = sweepBuilder.Shape();
+    const std::string resultKey = feature.value(
+        "result", makeSolid ? "body:main" : "surface:main");
+    KernelResult built = collectSelections(
+        shape, registry, featureId, resultKey, makeSolid ? "solid" : "surface", tags);
+    return built;
+  }
+
+  if (kind != "feature.extrude") {
+    throw std::runtime_error("Unsupported feature kind: " + kind);
+  }
+  const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
+  TopoDS_Face face = buildProfileFace(profile);
+  json depthJson = feature.value("depth", 0.0);
+  if (depthJson.is_string() && depthJson.get<std::string>() == "throughAll") {
+    throw std::runtime_error("throughAll not supported in native backend yet");
+  }
+  double depth = parseScalar(depthJson);
+  gp_Vec axis = parseAxis(feature.value("axis", json::object()));
+  if (axis.Magnitude() == 0) axis = gp_Vec(0, 0, 1);
+  axis.Normalize();
+  gp_Vec vec = axis.Multiplied(depth);
+  BRepPrimAPI_MakePrism prism(face, vec);
+
+  const std::string resultKey = feature.value("result", "body:main");
+  KernelResult built = collectSelections(
+      prism.Shape(), registry, featureId, resultKey, "solid", tags);
+  annotatePrismFaceSlots(built, registry, prism, face,
+                         resolveProfileSegmentSlots(feature.value("profile", json::object()), upstream), axis);
+  return built;
+}
+
+void warmKernel() {
+  ShapeRegistry registry;
+  const json feature = {
+      {"kind", "feature.extrude"},
+      {"id", "warmup"},
+      {"profile", {{"kind", "profile.rectangle"}, {"width", 10}, {"height", 10}}},
+      {"depth", 10},
+      {"result", "body:warmup"},
+  };
+  const KernelResult built = executeFeature(feature, KernelResult(), registry);
+  const TopoDS_Shape shape = registry.get(built.outputs.at("body:warmup").meta.value("handle", ""));
+  // Serial on purpose: threads of OCCT's default pool would not survive fork().
+  meshShape(shape, {{"parallel", false}});
+  exportStep(shape, "AP242");
+}
+
+json metricsPayload(const SessionManager& sessions) {
+  const SessionStats stats = sessions.stats();
+  OSD_MemInfo memInfo;
+  // Counters the platform cannot report come back as Standard_Size(-1).
+  const auto counter = [&](OSD_MemInfo::Counter which) -> json {
+    const std::size_t value = memInfo.Value(which);
+    return value == static_cast<std::size_t>(-1) ? json(nullptr) : json(value);
+  };
+  json payload;
+  payload["sessions"] = {
+      {"count", stats.sessions},
+      {"shapes", stats.shapes},
+      {"maxSessionShapes", stats.maxSessionShapes},
+  };
+  payload["memory"] = {
+      {"rssBytes", counter(OSD_MemInfo::MemWorkingSet)},
+      {"rssPeakBytes", counter(OSD_MemInfo::MemWorkingSetPeak)},
+      {"privateBytes", counter(OSD_MemInfo::MemPrivate)},
+      {"virtualBytes", counter(OSD_MemInfo::MemVirtual)},
+      {"heapUsedBytes", counter(OSD_MemInfo::MemHeapUsage)},
+  };
+  const HeapStats heap = heapStats();
+  if (heap.available) {
+    payload["heap"] = {
+        {"arenaBytes", heap.arenaBytes},
+        {"inUseBytes", heap.inUseBytes},
+        {"freeBytes", heap.freeBytes},
+        {"mmapBytes", heap.mmapBytes},
+    };
+  }
+  if (allocationCountingEnabled()) {
+    const AllocTally totals = requestAllocationTotals();
+    payload["allocations"] = {
+        {"count", totals.allocations},
+        {"bytes", totals.bytes},
+        {"frees", totals.frees},
+    };
+  }
+  if (MeshPrefetcher::instance().enabled()) {
+    const MeshPrefetchStats prefetch = MeshPrefetcher::instance().stats();
+    payload["meshPrefetch"] = {
+        {"scheduled", prefetch.scheduled},
+        {"hits", prefetch.hits},
+        {"cancelled", prefetch.cancelled},
+        {"failed", prefetch.failed},
+    };
+  }
+  return payload;
+}
+
+static constexpr char kSnapshotMagic[8] = {'T', 'F', 'S', 'N', 'A', 'P', '0', '1'};
+static constexpr std::size_t kSnapshotPrefixSize = sizeof(kSnapshotMagic) + 8;
+
+std::string snapshotSession(const Session& session) {
+  ScopedPhase phase("snapshot");
+  TraceSpan span("session.snapshot");
+  TopoDS_Compound compound;
+  BRep_Builder builder;
+  builder.MakeCompound(compound);
+  json handles = json::array();
+  json emptyHandles = json::array();
+  for (const auto& entry : session.registry.shapes()) {
+    if (entry.second.IsNull()) {
+      emptyHandles.push_back(entry.first);
+      continue;
+    }
+    handles.push_back(entry.first);
+    builder.Add(compound, entry.second);
+  }
+  const json header = {
+      {"version", 1},
+      {"nextHandle", session.registry.nextHandleId()},
+      {"handles", std::move(handles)},
+      {"emptyHandles", std::move(emptyHandles)},
+      {"current", copyOut(serializeKernelResult(session.current))},
+  };
+  const std::vector<std::uint8_t> cbor = json::to_cbor(header);
+
+  std::ostringstream out(std::ios::binary);
+  out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+  for (int byte = 0; byte < 8; ++byte) {
+    out.put(static_cast<char>((static_cast<std::uint64_t>(cbor.size()) >> (8 * byte)) & 0xff));
+  }
+  out.write(reinterpret_cast<const char*>(cbor.data()), static_cast<std::streamsize>(cbor.size()));
+  if (!BinTools::Write(compound, out)) throw std::runtime_error("Failed to write session shapes");
+  std::string snapshot = out.str();
+  span.setAttribute("snapshot.shapes", static_cast<std::int64_t>(session.registry.size()));
+  span.setAttribute("snapshot.bytes", static_cast<std::int64_t>(snapshot.size()));
+  return snapshot;
+}
+
+void restoreSession(Session& session, const std::string& snapshot) {
+  ScopedPhase phase("restore");
+  TraceSpan span("session.restore");
+  if (snapshot.size() < kSnapshotPrefixSize ||
+      std::memcmp(snapshot.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+    throw std::runtime_error("Not a session snapshot");
+  }
+  std::uint64_t headerSize = 0;
+  for (int byte = 0; byte < 8; ++byte) {
+    headerSize |= static_cast<std::uint64_t>(static_cast<unsigned char>(snapshot[sizeof(kSnapshotMagic) + byte]))
+                  << (8 * byte);
+  }
+  if (headerSize > snapshot.size() - kSnapshotPrefixSize) {
+    throw std::runtime_error("Truncated session snapshot");
+  }
+  const auto headerBegin = snapshot.begin() + static_cast<std::ptrdiff_t>(kSnapshotPrefixSize);
+  const auto headerEnd = headerBegin + static_cast<std::ptrdiff_t>(headerSize);
+  const json header = json::from_cbor(headerBegin, headerEnd);
+  if (header.value("version", 0) != 1) {
+    throw std::runtime_error("Unsupported session snapshot version");
+  }
+
+  // Parse everything before touching the session, so a bad snapshot leaves
+  // it as it was.
+  TopoDS_Shape compound;
+  std::istringstream in(std::string(headerEnd, snapshot.end()), std::ios::binary);
+  if (!BinTools::Read(compound, in) || compound.IsNull()) {
+    throw std::runtime_error("Failed to read session shapes");
+  }
+  const json& handles = header.at("handles");
+  std::unordered_map<std::string, TopoDS_Shape> shapes;
+  shapes.reserve(handles.size());
+  std::size_t index = 0;
+  for (TopoDS_Iterator it(compound); it.More(); it.Next(), ++index) {
+    if (index >= handles.size()) break;
+    shapes.emplace(handles[index].get<std::string>(), it.Value());
+  }
+  if (index != handles.size() || shapes.size() != handles.size()) {
+    throw std::runtime_error("Session snapshot handle table does not match its shapes");
+  }
+  for (const auto& handle : header.value("emptyHandles", json::array())) {
+    shapes.emplace(handle.get<std::string>(), TopoDS_Shape());
+  }
+  KernelResult current = parseKernelResult(header.at("current"));
+
+  span.setAttribute("snapshot.shapes", static_cast<std::int64_t>(shapes.size()));
+  span.setAttribute("snapshot.bytes", static_cast<std::int64_t>(snapshot.size()));
+  session.registry.restore(std::move(shapes), header.at("nextHandle").get<std::size_t>());
+  session.current = std::move(current);
+}
+
+json capabilitiesPayload() {
+  json payload;
+  payload["name"] = "opencascade.native";
+  payload["featureKinds"] = json::array({"datum.plane", "datum.axis", "datum.frame", "feature.sketch2d", "feature.extrude", "feature.plane", "feature.surface", "feature.revolve", "feature.pipe", "feature.loft", "feature.sweep", "feature.boolean", "pattern.linear", "pattern.circular"});
+  payload["featureStages"] = {
+      {"datum.plane", {{"stage", "stable"}}},
+      {"datum.axis", {{"stage", "stable"}}},
+      {"datum.frame", {{"stage", "stable"}}},
+      {"feature.sketch2d", {{"stage", "stable"}}},
+      {"feature.extrude", {{"stage", "stable"}}},
+      {"feature.plane", {{"stage", "stable"}}},
+      {"feature.surface", {{"stage", "stable"}}},
+      {"feature.revolve", {{"stage", "stable"}}},
+      {"feature.pipe", {{"stage", "stable"}}},
+      {"feature.loft", {{"stage", "stable"}}},
+      {"feature.sweep", {{"stage", "experimental"}}},
+      {"feature.boolean", {{"stage", "stable"}}},
+      {"pattern.linear", {{"stage", "stable"}}},
+      {"pattern.circular", {{"stage", "stable"}}},
+  };
+  payload["mesh"] = true;
+  payload["meshOnBuild"] = json::array({"json", "binary"});
+  payload["selectionIds"] = kSelectionIdVersion;
+  payload["execFeatures"] = {{"stream", "ndjson"}};
+  payload["query"] = {
+      {"quantities", json::array({"bounds", "obb", "area", "volume", "centroid"})},
+      {"precisions", json::array({"exact", "fast"})},
+  };
+  payload["pick"] = true;
+  payload["interference"] = true;
+  payload["measure"] = json::array({"distance", "angle", "radius"});
+  payload["sweep"] = json::array({"volume", "bounds", "mesh", "step"});
+  payload["slice"] = {
+      {"modes", json::array({"exact", "fast"})},
+  };
+  payload["exports"] = {
+      {"step", true},
+      {"stl", false},
+  };
+  payload["assertions"] = json::array();
+  payload["sessions"] = {
+      {"snapshot", true},
+  };
+  return payload;
+}
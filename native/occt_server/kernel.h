@@ -0,0 +1,359 @@
+#pragma once
+
+#include "json.hpp"
+#include "request_arena.h"
+
+#include <Bnd_Box.hxx>
+#include <Bnd_OBB.hxx>
+#include <Message_ProgressRange.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopoDS_Shape.hxx>
+#include <TopoDS_Wire.hxx>
+#include <gp_Pnt.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+
+struct KernelObject {
+  std::string id;
+  std::string kind;
+  json meta;
+};
+
+struct KernelSelection {
+  std::string id;
+  std::string kind;
+  json meta;
+  json record;  // KernelSelectionRecord, or null; see selection_ids.h
+};
+
+// The containers are pmr so the per-request upstream can live in the request
+// arena. Copies always use the default heap resource, which is how results
+// are copied out into the session.
+struct KernelResult {
+  KernelResult() = default;
+  explicit KernelResult(std::pmr::memory_resource* resource) : outputs(resource), selections(resource) {}
+
+  std::pmr::unordered_map<std::string, KernelObject> outputs;
+  std::pmr::vector<KernelSelection> selections;
+};
+
+struct PickIndex;
+
+// Mass of a registered shape in one dimension (area or volume) and the centre
+// of that mass.
+struct ShapeMass {
+  double value = 0.0;
+  gp_Pnt centroid;
+};
+
+// Geometry derived from a registered shape. Each part is computed the first
+// time it is asked for and then kept until the registry is cleared or
+// restored. It is kept per shape (TShape and location) rather than per
+// handle: every feature registers fresh handles for the faces and bodies it
+// passes through unchanged, and those find what earlier features computed.
+// The box is built from the triangulation when the shape is already meshed
+// and from the exact geometry otherwise.
+struct ShapeProperties {
+  std::optional<Bnd_Box> box;
+  std::optional<Bnd_OBB> orientedBox;
+  std::optional<ShapeMass> surface;
+  std::optional<ShapeMass> volume;
+};
+
+// Identity of TopTools_ShapeMapHasher (TShape and location, orientation
+// ignored) for std containers.
+struct SameShapeHash {
+  std::size_t operator()(const TopoDS_Shape& shape) const {
+    return std::hash<const void*>()(shape.TShape().get());
+  }
+};
+
+struct SameShape {
+  bool operator()(const TopoDS_Shape& a, const TopoDS_Shape& b) const { return a.IsSame(b); }
+};
+
+class ShapeRegistry {
+ public:
+  std::string registerShape(const TopoDS_Shape& shape) {
+    const std::string handle = "shape:" + std::to_string(counter_++);
+    shapes_[handle] = shape;
+    size_.store(shapes_.size(), std::memory_order_relaxed);
+    return handle;
+  }
+
+  TopoDS_Shape get(const std::string& handle) const {
+    auto it = shapes_.find(handle);
+    if (it == shapes_.end()) {
+      throw std::runtime_error("Unknown shape handle: " + handle);
+    }
+    return it->second;
+  }
+
+  void clear() {
+    shapes_.clear();
+    {
+      std::lock_guard<std::mutex> lock(propertiesMutex_);
+      properties_.clear();
+      pickIndices_.clear();
+    }
+    size_.store(0, std::memory_order_relaxed);
+  }
+
+  // Cached derived geometry (see ShapeProperties). Safe to call from several
+  // threads at once for existing handles; a failed computation throws and is
+  // not cached.
+  Bnd_Box boundingBox(const std::string& handle) const;
+  Bnd_OBB orientedBox(const std::string& handle) const;
+  ShapeMass surfaceProperties(const std::string& handle) const;
+  ShapeMass volumeProperties(const std::string& handle) const;
+
+  // Ray-picking hierarchy over the triangulation, built on the first pick
+  // (see pickShapes). Unlike the values above, it depends on the
+  // triangulation it was built from, so callers check it and store a rebuilt
+  // one; and it names the handles of the owner's selections, so it is kept
+  // per handle.
+  std::shared_ptr<const PickIndex> pickIndex(const std::string& handle) const {
+    std::lock_guard<std::mutex> lock(propertiesMutex_);
+    auto it = pickIndices_.find(handle);
+    return it == pickIndices_.end() ? nullptr : it->second;
+  }
+  void setPickIndex(const std::string& handle, std::shared_ptr<const PickIndex> index) const {
+    std::lock_guard<std::mutex> lock(propertiesMutex_);
+    pickIndices_[handle] = std::move(index);
+  }
+
+  // Safe to read from another thread (e.g. the metrics endpoint).
+  std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  const std::unordered_map<std::string, TopoDS_Shape>& shapes() const { return shapes_; }
+  std::size_t nextHandleId() const { return counter_; }
+
+  // Replaces the contents with a snapshot's shapes. New handles continue from
+  // nextHandleId, exactly as they would have in the snapshotted session.
+  void restore(std::unordered_map<std::string, TopoDS_Shape> shapes, std::size_t nextHandleId) {
+    shapes_ = std::move(shapes);
+    {
+      std::lock_guard<std::mutex> lock(propertiesMutex_);
+      properties_.clear();
+      pickIndices_.clear();
+    }
+    counter_ = nextHandleId;
+    size_.store(shapes_.size(), std::memory_order_relaxed);
+  }
+
+ private:
+  template <typename Value, typename Compute>
+  Value cachedProperty(const std::string& handle,
+                       std::optional<Value> ShapeProperties::*slot,
+                       Compute compute) const;
+
+  std::unordered_map<std::string, TopoDS_Shape> shapes_;
+  mutable std::mutex propertiesMutex_;
+  mutable std::unordered_map<TopoDS_Shape, ShapeProperties, SameShapeHash, SameShape> properties_;
+  mutable std::unordered_map<std::string, std::shared_ptr<const PickIndex>> pickIndices_;
+  std::size_t counter_ = 0;
+  std::atomic<std::size_t> size_{0};
+};
+
+struct Session {
+  ShapeRegistry registry;
+  KernelResult current;
+};
+
+struct SessionStats {
+  std::size_t sessions = 0;
+  std::size_t shapes = 0;
+  std::size_t maxSessionShapes = 0;
+};
+
+class SessionManager {
+ public:
+  Session& get(const std::string& sessionId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(sessionId);
+    if (it == sessions_.end()) {
+      auto created = std::make_unique<Session>();
+      Session* ptr = created.get();
+      sessions_[sessionId] = std::move(created);
+      return *ptr;
+    }
+    return *it->second;
+  }
+
+  Session* find(const std::string& sessionId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(sessionId);
+    return it == sessions_.end() ? nullptr : it->second.get();
+  }
+
+  SessionStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SessionStats stats;
+    stats.sessions = sessions_.size();
+    for (const auto& entry : sessions_) {
+      const std::size_t shapes = entry.second->registry.size();
+      stats.shapes += shapes;
+      stats.maxSessionShapes = std::max(stats.maxSessionShapes, shapes);
+    }
+    return stats;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::unique_ptr<Session>> sessions_;
+};
+
+TopoDS_Face buildProfileFace(const json& profile);
+TopoDS_Wire buildProfileWire(const json& profile);
+
+KernelResult collectSelections(const TopoDS_Shape& shape,
+                               ShapeRegistry& registry,
+                               const std::string& featureId,
+                               const std::string& ownerKey,
+                               const std::string& outputKind,
+                               const json& tags);
+KernelResult mergeResults(const KernelResult& upstream, const KernelResult& next);
+KernelResult parseKernelResult(const json& value);
+// Parses a request's upstream with its containers in `resource` (usually the
+// request arena); selection metadata is copied out to the heap.
+KernelResult parseKernelResult(const RequestJson& value, std::pmr::memory_resource* resource);
+RequestJson serializeKernelResult(const KernelResult& result);
+
+std::optional<KernelSelection> resolveSelector(const json& selector,
+                                               const KernelResult& current,
+                                               std::string& error);
+TopoDS_Shape resolveGeometryRef(const json& ref,
+                                const KernelResult& current,
+                                const ShapeRegistry& registry);
+
+// Builds one feature against `upstream` and returns only what it produced;
+// callers merge the result into the session state themselves.
+KernelResult executeFeature(const json& feature,
+                            const KernelResult& upstream,
+                            ShapeRegistry& registry);
+
+// The /v1/mesh options that change the tessellation, plus whether
+// BRepMesh may use the thread pool.
+struct MeshParameters {
+  double linearDeflection = 0.1;
+  double angularDeflection = 0.5;
+  bool relative = false;
+  bool parallel = true;
+
+  bool sameTessellation(const MeshParameters& other) const {
+    return linearDeflection == other.linearDeflection &&
+           angularDeflection == other.angularDeflection && relative == other.relative;
+  }
+};
+
+// The tessellation of a src/mesh_profiles.ts profile ("interactive",
+// "preview" or "export"), or nullopt for an unknown name.
+std::optional<MeshParameters> meshProfileParameters(const std::string& name);
+// Applies /v1/mesh options on top of `parameters`.
+MeshParameters parseMeshParameters(const json& options, MeshParameters parameters = MeshParameters());
+
+// Triangles of every face, flattened: xyz per node and three node indices per
+// triangle.
+struct MeshBuffers {
+  std::vector<double> positions;
+  std::vector<int> indices;
+};
+
+// Both throw if `progress` is cancelled while meshing; the faces meshed by
+// then keep their triangulations.
+MeshBuffers tessellateShape(const TopoDS_Shape& shape,
+                            const MeshParameters& parameters,
+                            const Message_ProgressRange& progress = Message_ProgressRange());
+RequestJson meshShape(const TopoDS_Shape& shape, const json& options);
+RequestJson meshShape(const TopoDS_Shape& shape,
+                      const MeshParameters& parameters,
+                      const Message_ProgressRange& progress = Message_ProgressRange());
+
+// Batch geometry query (/v1/query): bounds, oriented box, area, volume and
+// centroid for many handles, evaluated in parallel. "exact" uses BRepGProp
+// (cached per handle, or adaptive with "tolerance"); "fast" integrates the
+// existing triangulation and falls back to exact for unmeshed shapes. Each
+// result reports the precision actually used, or an error for that handle.
+json queryShapes(const ShapeRegistry& registry, const RequestJson& request);
+
+// Ray picking (/v1/pick): nearest hit of each ray against the given bodies,
+// with the face (or, within edgeTolerance, edge) handle from `current`, the
+// hit point and distance. Each body's BVH is built lazily over its
+// triangulation (meshing it first if needed) and cached on the handle until
+// the body is re-meshed.
+json pickShapes(const ShapeRegistry& registry, const KernelResult& current, const RequestJson& request);
+
+// Planar slices (/v1/slice) of one shape by the family origin + normal *
+// spacing * k, k < count, as polylines per plane. "exact" runs one
+// BRepAlgoAPI_Section per plane in parallel; "fast" cuts the triangulation
+// with every plane in a single pass, for previews.
+json sliceShape(const ShapeRegistry& registry, const RequestJson& request);
+
+// Clash check (/v1/interference) over placed instances of registered shapes:
+// sweep and prune on the cached boxes, an oriented-box filter, then exact
+// BRepExtrema distance and BRepAlgoAPI_Common volume on the surviving pairs
+// in parallel. Reports interfering, touching and (with "clearance") too
+// close pairs.
+json checkInterference(const ShapeRegistry& registry, const RequestJson& request);
+
+// Batch measurement (/v1/measure) between handles or geometry refs: exact
+// minimum distance (BRepExtrema), angles between planar normals, cylinder
+// and cone axes and straight edges (degrees; acute when an axis is
+// involved), and radii of cylinders, spheres and circular edges. Evaluated
+// in parallel with per-measurement errors.
+json measureShapes(const ShapeRegistry& registry, const KernelResult& current, const RequestJson& request);
+
+// Parameter sweep (/v1/sweep). prepareSweep builds the features before the
+// first one that reads the parameter once, on a copy of the session's shapes
+// (the session itself is untouched). runSweep then rebuilds the remaining
+// features for every value in parallel, each variant in its own registry,
+// and calls emit with each variant's record as it completes (one call at a
+// time, from pool threads). emit returning false cancels the variants not
+// yet started. Returns the summary record.
+struct SweepPlan;
+std::shared_ptr<SweepPlan> prepareSweep(const ShapeRegistry& registry,
+                                        const KernelResult& upstream,
+                                        const json& request);
+json runSweep(const SweepPlan& plan, const std::function<bool(const json&)>& emit);
+
+void ensureStepControllersReady();
+std::vector<unsigned char> exportStep(const TopoDS_Shape& shape, const std::string& schema);
+std::vector<unsigned char> exportStepWithPmi(const TopoDS_Shape& shape,
+                                             const KernelResult& current,
+                                             const ShapeRegistry& registry,
+                                             const json& pmiPayload,
+                                             const std::string& schema);
+
+// Session snapshots, for moving a session to another worker or host: one
+// BinTools stream holding every registry shape (sub-shapes shared between
+// handles stay shared) behind a CBOR header with the handle table and the
+// current KernelResult. Restoring reproduces the same handles.
+std::string snapshotSession(const Session& session);
+void restoreSession(Session& session, const std::string& snapshot);
+
+// {"min": [x, y, z], "max": [x, y, z]}, or null for a void box.
+json boundsToJson(const Bnd_Box& box);
+
+json capabilitiesPayload();
+
+// Runs a small build, mesh and STEP export so OCCT's lazily initialised state
+// (and the pages behind it) exist before pool workers are forked.
+void warmKernel();
+
+// Process-level counters for /v1/metrics: session and registry sizes,
+// OSD_MemInfo memory figures, malloc heap statistics and request allocation
+// totals.
+json metricsPayload(const SessionManager& sessions);
@@ -1,1653 +1,806 @@
+#include "alloc_stats.h"
+#include "env.h"
 #include "httplib.h"
-#include "json.hpp"
-
-#include <BRepAdaptor_Surface.hxx>
-#include <BRepAdaptor_Curve.hxx>
-#include <BRepAlgoAPI_Cut.hxx>
-#include <BRepBndLib.hxx>
-#include <BRepBuilderAPI_MakeEdge.hxx>
-#include <BRepBuilderAPI_MakeFace.hxx>
-#include <BRepBuilderAPI_MakePolygon.hxx>
-#include <BRepBuilderAPI_MakeWire.hxx>
-#include <BRepGProp.hxx>
-#include <BRepOffsetAPI_MakePipe.hxx>
-#include <BRepOffsetAPI_ThruSections.hxx>
-#include <BRepPrimAPI_MakeCylinder.hxx>
-#include <BRepPrimAPI_MakeRevol.hxx>
-#include <BRepPrimAPI_MakePrism.hxx>
-#include <BRep_Tool.hxx>
-#include <BRepMesh_IncrementalMesh.hxx>
-#include <GeomAbs_SurfaceType.hxx>
-#include <GProp_GProps.hxx>
+#include "kernel.h"
+#include "mesh_prefetch.h"
+#include "request_log.h"
+#include "request_phases.h"
+#include "slow_capture.h"
+#include "trace.h"
+#include "worker_pool.h"
+
+#include <BRepTools.hxx>
 #include <Interface_Static.hxx>
-#include <STEPCAFControl_Controller.hxx>
-#include <STEPCAFControl_Writer.hxx>
-#include <STEPControl_Controller.hxx>
-#include <STEPControl_Writer.hxx>
-#include <TCollection_HAsciiString.hxx>
-#include <TDF_Label.hxx>
-#include <TDF_LabelSequence.hxx>
-#include <TDocStd_Document.hxx>
-#include <TopExp_Explorer.hxx>
-#include <TopExp.hxx>
-#include <TopLoc_Location.hxx>
-#include <TopoDS.hxx>
-#include <TopoDS_Edge.hxx>
-#include <TopoDS_Face.hxx>
-#include <TopoDS_Shape.hxx>
-#include <TopTools_IndexedMapOfShape.hxx>
-#include <XCAFDoc_Datum.hxx>
-#include <XCAFDoc_DimTolTool.hxx>
-#include <XCAFDoc_DocumentTool.hxx>
-#include <XCAFDoc_GeomTolerance.hxx>
-#include <XCAFDoc_ShapeTool.hxx>
-#include <XCAFDimTolObjects_DatumObject.hxx>
-#include <XCAFDimTolObjects_DatumSingleModif.hxx>
-#include <XCAFDimTolObjects_GeomToleranceModif.hxx>
-#include <XCAFDimTolObjects_GeomToleranceObject.hxx>
-#include <XCAFDimTolObjects_GeomToleranceType.hxx>
-#include <XCAFDimTolObjects_GeomToleranceTypeValue.hxx>
-#include <gp_Ax1.hxx>
-#include <gp_Dir.hxx>
-#include <gp_Pln.hxx>
-#include <gp_Pnt.hxx>
-#include <gp_Vec.hxx>
 
-#include <cmath>
-#include <fstream>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
 #include <iostream>
-#include <optional>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
 #include <string>
-#include <unordered_map>
-#include <utility>
-#include <vector>
-
-using json = nlohmann::json;
-
-struct KernelObject {
-  std::string id;
-  std::string kind;
-  json meta;
-};
-
-struct KernelSelection {
-  std::string id;
-  std::string kind;
-  json meta;
-};
-
-struct KernelResult {
-  std::unordered_map<std::string, KernelObject> outputs;
-  std::vector<KernelSelection> selections;
-};
-
-class ShapeRegistry {
- public:
-  std::string registerShape(const TopoDS_Shape& shape) {
-    const std::string handle = "shape:" + std::to_string(counter_++);
-    shapes_[handle] = shape;
-    return handle;
-  }
-
-  TopoDS_Shape get(const std::string& handle) const {
-    auto it = shapes_.find(handle);
-    if (it == shapes_.end()) {
-      throw std::runtime_error("Unknown shape handle: " + handle);
-    }
-    return it->second;
-  }
 
-  void clear() { shapes_.clear(); }
-
- private:
-  std::unordered_map<std::string, TopoDS_Shape> shapes_;
-  std::size_t counter_ = 0;
+// Request metadata the wrapper needs after the handler ran; filled in while
+// the handler parses its body.
+struct RequestContext {
+  std::string sessionId;
 };
 
-struct Session {
-  ShapeRegistry registry;
-  KernelResult current;
-};
+static RequestContext*& activeRequestContext() {
+  static thread_local RequestContext* context = nullptr;
+  return context;
+}
 
-class SessionManager {
+class ScopedRequestContext {
  public:
-  Session& get(const std::string& sessionId) {
-    auto it = sessions_.find(sessionId);
-    if (it == sessions_.end()) {
-      auto created = std::make_unique<Session>();
-      Session* ptr = created.get();
-      sessions_[sessionId] = std::move(created);
-      return *ptr;
-    }
-    return *it->second;
-  }
-
- private:
-  std::unordered_map<std::string, std::unique_ptr<Session>> sessions_;
+  explicit ScopedRequestContext(RequestContext& context) { activeRequestContext() = &context; }
+  ~ScopedRequestContext() { activeRequestContext() = nullptr; }
 };
 
-static double parseScalar(const json& value, double fallback = 0.0) {
-  if (value.is_number()) {
-    return value.get<double>();
-  }
-  if (value.is_object()) {
-    const std::string kind = value.value("kind", "");
-    if (kind == "expr.literal") {
-      return value.value("value", fallback);
-    }
-  }
-  return fallback;
-}
-
-static gp_Pnt parsePoint2D(const json& value, double z = 0.0) {
-  if (!value.is_array() || value.size() < 2) {
-    return gp_Pnt(0, 0, z);
-  }
-  const double zValue = value.size() >= 3 ? parseScalar(value[2]) : z;
-  return gp_Pnt(parseScalar(value[0]), parseScalar(value[1]), zValue);
-}
-
-static gp_Pnt parsePoint3D(const json& value) {
-  if (!value.is_array() || value.size() < 3) {
-    return gp_Pnt(0, 0, 0);
+static RequestJson parseRequestBody(const httplib::Request& req) {
+  ScopedPhase phase("parse");
+  RequestJson payload = RequestJson::parse(req.body);
+  if (RequestContext* context = activeRequestContext()) {
+    context->sessionId = payload.value("sessionId", "default");
   }
-  return gp_Pnt(parseScalar(value[0]), parseScalar(value[1]), parseScalar(value[2]));
+  return payload;
 }
 
-static gp_Vec axisVectorFromString(const std::string& dir) {
-  if (dir == "+X") return gp_Vec(1, 0, 0);
-  if (dir == "-X") return gp_Vec(-1, 0, 0);
-  if (dir == "+Y") return gp_Vec(0, 1, 0);
-  if (dir == "-Y") return gp_Vec(0, -1, 0);
-  if (dir == "+Z") return gp_Vec(0, 0, 1);
-  if (dir == "-Z") return gp_Vec(0, 0, -1);
-  return gp_Vec(0, 0, 1);
+// Session id from a /v1/sessions/{id}/... route.
+static std::string pathSessionId(const httplib::Request& req) {
+  const std::string sessionId = req.matches[1];
+  if (RequestContext* context = activeRequestContext()) context->sessionId = sessionId;
+  return sessionId;
 }
 
-static std::string axisDirectionFromVector(const gp_Vec& vec) {
-  const double ax = std::abs(vec.X());
-  const double ay = std::abs(vec.Y());
-  const double az = std::abs(vec.Z());
-  const double maxVal = std::max(ax, std::max(ay, az));
-  if (maxVal < 0.9) return "";
-  if (ax >= ay && ax >= az) return vec.X() >= 0 ? "+X" : "-X";
-  if (ay >= ax && ay >= az) return vec.Y() >= 0 ? "+Y" : "-Y";
-  return vec.Z() >= 0 ? "+Z" : "-Z";
+// `payload[key]` by reference, or null when absent; avoids copying large
+// members such as the upstream.
+static const RequestJson& memberOrNull(const RequestJson& payload, const char* key) {
+  static const RequestJson null;
+  auto it = payload.find(key);
+  return it == payload.end() ? null : *it;
 }
 
-static json vecToJson(const gp_Vec& vec) {
-  return json::array({vec.X(), vec.Y(), vec.Z()});
+// Heap copy of a small member that is handed to the kernel.
+static json copyOutMember(const RequestJson& payload, const char* key) {
+  auto it = payload.find(key);
+  return it == payload.end() ? json::object() : copyOut(*it);
 }
 
-static json pointToJson(const gp_Pnt& pnt) {
-  return json::array({pnt.X(), pnt.Y(), pnt.Z()});
+// The session for a handler that reads its shapes, once no background mesh
+// is writing into them (see mesh_prefetch.h).
+static Session& settledSession(SessionManager& sessions, const std::string& sessionId) {
+  Session& session = sessions.get(sessionId);
+  MeshPrefetcher::instance().settle(session);
+  return session;
 }
 
-static std::string selectionOwnerToken(const std::string& ownerKey) {
-  std::string token = ownerKey;
-  for (char& ch : token) {
-    if (ch == ':') ch = '.';
-  }
-  return token;
-}
+// Bodies an exec-feature meshes inline, from its `mesh` member: `true`, a
+// profile name, or {profile?, options?, format?, outputs?}. Without
+// `outputs`, every solid the feature built is meshed.
+struct InlineMesh {
+  MeshParameters parameters;
+  bool binary = false;
+  std::vector<std::string> keys;
+  std::vector<TopoDS_Shape> shapes;
+  std::vector<json> bounds;
+};
 
-static void annotateExtrudeRectangleFaceIds(KernelResult& result,
-                                            const std::string& featureId,
-                                            const std::string& ownerKey,
-                                            const std::string& axisDir) {
-  if (axisDir != "+Z") return;
-  const std::string ownerToken = selectionOwnerToken(ownerKey);
-  std::vector<KernelSelection*> sideFaces;
-  for (auto& selection : result.selections) {
-    if (selection.kind != "face") continue;
-    const std::string normal = selection.meta.value("normal", "");
-    if (normal == "+Z") {
-      selection.id = "face:" + ownerToken + "~" + featureId + ".top";
-      continue;
-    }
-    if (normal == "-Z") {
-      selection.id = "face:" + ownerToken + "~" + featureId + ".bottom";
+static InlineMesh parseInlineMesh(const json& spec, const KernelResult& built, const ShapeRegistry& registry) {
+  InlineMesh mesh;
+  const json options = spec.is_object() ? spec.value("options", json::object()) : json::object();
+  const std::string profile = spec.is_string() ? spec.get<std::string>()
+                              : spec.is_object() ? spec.value("profile", "")
+                                                 : "";
+  if (!profile.empty()) {
+    std::optional<MeshParameters> parameters = meshProfileParameters(profile);
+    if (!parameters) throw std::runtime_error("Unknown mesh profile: " + profile);
+    mesh.parameters = *parameters;
+  }
+  mesh.parameters = parseMeshParameters(options, mesh.parameters);
+  const std::string format = spec.is_object() ? spec.value("format", "json") : "json";
+  if (format != "json" && format != "binary") throw std::runtime_error("Unknown mesh format: " + format);
+  mesh.binary = format == "binary";
+
+  const bool listed = spec.is_object() && spec.contains("outputs");
+  for (const auto& entry : built.outputs) {
+    const std::string handle = entry.second.meta.value("handle", "");
+    if (handle.empty()) continue;
+    if (listed) {
+      const json& outputs = spec["outputs"];
+      if (std::find(outputs.begin(), outputs.end(), entry.first) == outputs.end()) continue;
+    } else if (entry.second.kind != "solid") {
       continue;
     }
-    sideFaces.push_back(&selection);
-  }
-  std::sort(sideFaces.begin(), sideFaces.end(), [](const KernelSelection* a, const KernelSelection* b) {
-    const json centerA = a->meta.value("center", json::array({0, 0, 0}));
-    const json centerB = b->meta.value("center", json::array({0, 0, 0}));
-    const double ax = centerA.size() >= 1 ? parseScalar(centerA[0]) : 0.0;
-    const double ay = centerA.size() >= 2 ? parseScalar(centerA[1]) : 0.0;
-    const double bx = centerB.size() >= 1 ? parseScalar(centerB[0]) : 0.0;
-    const double by = centerB.size() >= 2 ? parseScalar(centerB[1]) : 0.0;
-    const auto rank = [](double x, double y) {
-      double angle = std::atan2(y, x);
-      double shifted = angle + M_PI_2;
-      if (shifted < 0) shifted += 2.0 * M_PI;
-      return shifted;
-    };
-    const double rankA = rank(ax, ay);
-    const double rankB = rank(bx, by);
-    if (std::abs(rankA - rankB) > 1e-9) return rankA < rankB;
-    if (std::abs(ax - bx) > 1e-9) return ax < bx;
-    return ay < by;
-  });
-  for (std::size_t index = 0; index < sideFaces.size(); ++index) {
-    sideFaces[index]->id =
-        "face:" + ownerToken + "~" + featureId + ".side." + std::to_string(index + 1);
-  }
-}
-
-static TopoDS_Face makeRectangleFace(double width, double height, const gp_Pnt& center) {
-  const double halfW = width / 2.0;
-  const double halfH = height / 2.0;
-  const double cx = center.X();
-  const double cy = center.Y();
-  const double cz = center.Z();
-  BRepBuilderAPI_MakePolygon poly;
-  poly.Add(gp_Pnt(cx - halfW, cy - halfH, cz));
-  poly.Add(gp_Pnt(cx + halfW, cy - halfH, cz));
-  poly.Add(gp_Pnt(cx + halfW, cy + halfH, cz));
-  poly.Add(gp_Pnt(cx - halfW, cy + halfH, cz));
-  poly.Close();
-  TopoDS_Wire wire = poly.Wire();
-  return BRepBuilderAPI_MakeFace(gp_Pln(center, gp_Dir(0, 0, 1)), wire, true);
-}
-
-static TopoDS_Face makeCircleFace(double radius, const gp_Pnt& center) {
-  gp_Circ circ(gp_Ax2(center, gp_Dir(0, 0, 1)), radius);
-  TopoDS_Edge edge = BRepBuilderAPI_MakeEdge(circ);
-  TopoDS_Wire wire = BRepBuilderAPI_MakeWire(edge);
-  return BRepBuilderAPI_MakeFace(gp_Pln(center, gp_Dir(0, 0, 1)), wire, true);
-}
-
-static TopoDS_Face makePolygonFace(int sides, double radius, const gp_Pnt& center, double rotation) {
-  if (sides < 3) {
-    throw std::runtime_error("profile.poly requires sides >= 3");
-  }
-  BRepBuilderAPI_MakePolygon poly;
-  const double step = (2.0 * M_PI) / static_cast<double>(sides);
-  for (int i = 0; i < sides; ++i) {
-    const double angle = rotation + step * static_cast<double>(i);
-    const double x = center.X() + radius * std::cos(angle);
-    const double y = center.Y() + radius * std::sin(angle);
-    poly.Add(gp_Pnt(x, y, center.Z()));
-  }
-  poly.Close();
-  TopoDS_Wire wire = poly.Wire();
-  return BRepBuilderAPI_MakeFace(gp_Pln(center, gp_Dir(0, 0, 1)), wire, true);
-}
-
-static TopoDS_Face buildProfileFace(const json& profile) {
-  const std::string kind = profile.value("kind", "");
-  if (kind == "profile.rectangle") {
-    double width = parseScalar(profile["width"]);
-    double height = parseScalar(profile["height"]);
-    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
-    return makeRectangleFace(width, height, center);
-  }
-  if (kind == "profile.circle") {
-    double radius = parseScalar(profile["radius"]);
-    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
-    return makeCircleFace(radius, center);
-  }
-  if (kind == "profile.poly") {
-    int sides = static_cast<int>(parseScalar(profile["sides"]));
-    double radius = parseScalar(profile["radius"]);
-    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
-    double rotation = parseScalar(profile.value("rotation", 0.0));
-    return makePolygonFace(sides, radius, center, rotation);
-  }
-  throw std::runtime_error("Unsupported profile kind: " + kind);
-}
-
-static TopoDS_Wire buildProfileWire(const json& profile) {
-  const std::string kind = profile.value("kind", "");
-  if (kind == "profile.rectangle") {
-    double width = parseScalar(profile["width"]);
-    double height = parseScalar(profile["height"]);
-    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
-    const double halfW = width / 2.0;
-    const double halfH = height / 2.0;
-    const double cx = center.X();
-    const double cy = center.Y();
-    const double cz = center.Z();
-    BRepBuilderAPI_MakePolygon poly;
-    poly.Add(gp_Pnt(cx - halfW, cy - halfH, cz));
-    poly.Add(gp_Pnt(cx + halfW, cy - halfH, cz));
-    poly.Add(gp_Pnt(cx + halfW, cy + halfH, cz));
-    poly.Add(gp_Pnt(cx - halfW, cy + halfH, cz));
-    poly.Close();
-    return poly.Wire();
-  }
-  if (kind == "profile.circle") {
-    double radius = parseScalar(profile["radius"]);
-    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
-    gp_Circ circ(gp_Ax2(center, gp_Dir(0, 0, 1)), radius);
-    TopoDS_Edge edge = BRepBuilderAPI_MakeEdge(circ);
-    return BRepBuilderAPI_MakeWire(edge);
-  }
-  if (kind == "profile.poly") {
-    int sides = static_cast<int>(parseScalar(profile["sides"]));
-    double radius = parseScalar(profile["radius"]);
-    gp_Pnt center = parsePoint2D(profile.value("center", json::array({0, 0})));
-    double rotation = parseScalar(profile.value("rotation", 0.0));
-    BRepBuilderAPI_MakePolygon poly;
-    const double step = (2.0 * M_PI) / static_cast<double>(sides);
-    for (int i = 0; i < sides; ++i) {
-      const double angle = rotation + step * static_cast<double>(i);
-      const double x = center.X() + radius * std::cos(angle);
-      const double y = center.Y() + radius * std::sin(angle);
-      poly.Add(gp_Pnt(x, y, center.Z()));
-    }
-    poly.Close();
-    return poly.Wire();
-  }
-  throw std::runtime_error("Unsupported profile kind for wire: " + kind);
-}
-
-static TopoDS_Wire buildPathWire(const json& path) {
-  const std::string kind = path.value("kind", "");
-  if (kind == "path.polyline") {
-    const json points = path.value("points", json::array());
-    if (!points.is_array() || points.size() < 2) {
-      throw std::runtime_error("path.polyline requires at least two points");
-    }
-    BRepBuilderAPI_MakePolygon poly;
-    for (const auto& point : points) {
-      poly.Add(parsePoint3D(point));
-    }
-    if (path.value("closed", false)) {
-      poly.Close();
-    }
-    return poly.Wire();
-  }
-  if (kind == "path.segments") {
-    const json segments = path.value("segments", json::array());
-    if (!segments.is_array() || segments.empty()) {
-      throw std::runtime_error("path.segments requires at least one segment");
-    }
-    BRepBuilderAPI_MakeWire wire;
-    for (const auto& segment : segments) {
-      if (segment.value("kind", "") != "path.line") {
-        throw std::runtime_error("Native backend sweep currently supports only line path segments");
-      }
-      wire.Add(BRepBuilderAPI_MakeEdge(
-          parsePoint3D(segment.value("start", json::array({0, 0, 0}))),
-          parsePoint3D(segment.value("end", json::array({0, 0, 0})))));
-    }
-    return wire.Wire();
+    mesh.keys.push_back(entry.first);
+    mesh.shapes.push_back(registry.get(handle));
+    // Cached by collectSelections, and read before the mesher starts writing
+    // triangulations into the shape.
+    mesh.bounds.push_back(boundsToJson(registry.boundingBox(handle)));
   }
-  throw std::runtime_error("Native backend sweep currently supports path.polyline or line-only path.segments");
+  return mesh;
 }
 
-static json resolveProfileJson(const json& profileRef, const KernelResult& upstream) {
-  const std::string kind = profileRef.value("kind", "");
-  if (kind != "profile.ref") return profileRef;
-  const std::string name = profileRef.value("name", "");
-  auto it = upstream.outputs.find(name);
-  if (it == upstream.outputs.end()) {
-    throw std::runtime_error("Missing profile output: " + name);
-  }
-  if (it->second.kind != "profile") {
-    throw std::runtime_error("Output is not a profile: " + name);
-  }
-  if (!it->second.meta.contains("profile") || !it->second.meta["profile"].is_object()) {
-    throw std::runtime_error("Profile output missing profile data: " + name);
+static std::vector<MeshBuffers> tessellateInlineMesh(const InlineMesh& mesh) {
+  std::vector<MeshBuffers> buffers;
+  buffers.reserve(mesh.shapes.size());
+  for (const TopoDS_Shape& shape : mesh.shapes) {
+    buffers.push_back(tessellateShape(shape, mesh.parameters));
   }
-  return it->second.meta["profile"];
+  return buffers;
 }
 
-static json resolvePlaneBasisJson(const json& planeRef, const KernelResult& upstream) {
-  if (!planeRef.is_object()) {
-    return {
-        {"origin", json::array({0, 0, 0})},
-        {"xDir", json::array({1, 0, 0})},
-        {"yDir", json::array({0, 1, 0})},
-        {"normal", json::array({0, 0, 1})},
+// {<output key>: {positions, indices, bounds}}
+static RequestJson inlineMeshesJson(const InlineMesh& mesh, const std::vector<MeshBuffers>& buffers) {
+  RequestJson meshes = RequestJson::object();
+  for (std::size_t index = 0; index < buffers.size(); ++index) {
+    meshes[mesh.keys[index]] = {
+        {"positions", buffers[index].positions},
+        {"indices", buffers[index].indices},
+        {"bounds", mesh.bounds[index]},
     };
   }
-  if (planeRef.value("kind", "") == "plane.datum") {
-    const std::string ref = planeRef.value("ref", "");
-    auto it = upstream.outputs.find("datum:" + ref);
-    if (it == upstream.outputs.end()) {
-      throw std::runtime_error("Missing plane datum: " + ref);
-    }
-    if (it->second.kind != "datum") {
-      throw std::runtime_error("Referenced plane datum is not a datum: " + ref);
-    }
-    const json meta = it->second.meta;
-    if (meta.value("type", "") != "plane") {
-      throw std::runtime_error("Referenced datum is not a plane: " + ref);
-    }
-    return {
-        {"origin", meta.value("origin", json::array({0, 0, 0}))},
-        {"xDir", meta.value("xDir", json::array({1, 0, 0}))},
-        {"yDir", meta.value("yDir", json::array({0, 1, 0}))},
-        {"normal", meta.value("normal", json::array({0, 0, 1}))},
-    };
-  }
-  throw std::runtime_error("Native backend plane feature currently supports default or plane.datum references only");
-}
-
-static gp_Vec parseAxis(const json& axis) {
-  if (axis.is_string()) {
-    return axisVectorFromString(axis.get<std::string>());
-  }
-  if (axis.is_object()) {
-    const std::string kind = axis.value("kind", "");
-    if (kind == "axis.vector") {
-      auto direction = axis.value("direction", json::array({0, 0, 1}));
-      if (!direction.is_array() || direction.size() < 3) return gp_Vec(0, 0, 1);
-      return gp_Vec(parseScalar(direction[0]), parseScalar(direction[1]), parseScalar(direction[2]));
-    }
-    if (kind == "axis.sketch.normal") {
-      return gp_Vec(0, 0, 1);
-    }
-  }
-  return gp_Vec(0, 0, 1);
-}
-
-static json makeSolidMeta(const std::string& handle,
-                          const std::string& ownerKey,
-                          const std::string& featureId,
-                          const gp_Pnt& center,
-                          const json& tags) {
-  json meta;
-  meta["handle"] = handle;
-  meta["ownerHandle"] = handle;
-  meta["ownerKey"] = ownerKey;
-  meta["createdBy"] = featureId;
-  meta["role"] = "body";
-  meta["center"] = pointToJson(center);
-  meta["centerZ"] = center.Z();
-  if (!tags.is_null()) meta["featureTags"] = tags;
-  return meta;
-}
-
-static json makeFaceMeta(const std::string& handle,
-                         const std::string& ownerHandle,
-                         const std::string& ownerKey,
-                         const std::string& featureId,
-                         const gp_Pnt& center,
-                         double area,
-                         bool planar,
-                         const std::string& normal,
-                         const std::optional<gp_Vec>& normalVec,
-                         const json& tags) {
-  json meta;
-  meta["handle"] = handle;
-  meta["ownerHandle"] = ownerHandle;
-  meta["ownerKey"] = ownerKey;
-  meta["createdBy"] = featureId;
-  meta["planar"] = planar;
-  meta["area"] = area;
-  meta["center"] = pointToJson(center);
-  meta["centerZ"] = center.Z();
-  if (!normal.empty()) meta["normal"] = normal;
-  if (normalVec) meta["normalVec"] = vecToJson(*normalVec);
-  if (!tags.is_null()) meta["featureTags"] = tags;
-  return meta;
-}
-
-static json makeEdgeMeta(const std::string& handle,
-                         const std::string& ownerHandle,
-                         const std::string& ownerKey,
-                         const std::string& featureId,
-                         const gp_Pnt& center,
-                         const json& tags) {
-  json meta;
-  meta["handle"] = handle;
-  meta["ownerHandle"] = ownerHandle;
-  meta["ownerKey"] = ownerKey;
-  meta["createdBy"] = featureId;
-  meta["role"] = "edge";
-  meta["center"] = pointToJson(center);
-  meta["centerZ"] = center.Z();
-  if (!tags.is_null()) meta["featureTags"] = tags;
-  return meta;
-}
-
-static KernelResult makeDatumResult(const std::string& key,
-                                    const std::string& id,
-                                    const json& meta) {
-  KernelResult result;
-  KernelObject output;
-  output.id = id;
-  output.kind = "datum";
-  output.meta = meta;
-  result.outputs[key] = output;
-  return result;
-}
-
-static KernelResult makeSketchProfileResult(const json& feature) {
-  KernelResult result;
-  const std::string featureId = feature.value("id", "sketch");
-  const json profiles = feature.value("profiles", json::array());
-  for (const auto& entry : profiles) {
-    const std::string name = entry.value("name", "");
-    if (name.empty()) {
-      throw std::runtime_error("feature.sketch2d profile entry missing name");
-    }
-    const json profile = entry.value("profile", json::object());
-    const std::string profileKind = profile.value("kind", "");
-    if (profileKind != "profile.rectangle" &&
-        profileKind != "profile.circle" &&
-        profileKind != "profile.poly") {
-      throw std::runtime_error("Native backend sketch2d currently supports only primitive profile outputs");
-    }
-    KernelObject output;
-    output.id = featureId + ":" + name;
-    output.kind = "profile";
-    output.meta = {
-        {"profile", profile},
-        {"createdBy", featureId},
+  return meshes;
+}
+
+// multipart/mixed: the JSON response, then one part per mesh holding its
+// float32 positions followed by its uint32 indices, in host byte order
+// (little-endian on every platform the server ships for).
+static void setMultipartMeshResponse(httplib::Response& res,
+                                     RequestJson& response,
+                                     const InlineMesh& mesh,
+                                     const std::vector<MeshBuffers>& buffers) {
+  static thread_local std::mt19937_64 random{std::random_device{}()};
+  const std::string boundary = "tf-mesh-" + std::to_string(random());
+  RequestJson parts = RequestJson::object();
+  for (std::size_t index = 0; index < buffers.size(); ++index) {
+    parts[mesh.keys[index]] = {
+        {"part", index + 1},
+        {"positions", buffers[index].positions.size()},
+        {"indices", buffers[index].indices.size()},
+        {"bounds", mesh.bounds[index]},
     };
-    result.outputs[name] = output;
-  }
-  return result;
-}
-
-static TopoDS_Face makePlaneFaceFromBasis(const json& basis,
-                                          double width,
-                                          double height,
-                                          const json& originOffset) {
-  gp_Pnt origin = parsePoint3D(basis.value("origin", json::array({0, 0, 0})));
-  json xDirJson = basis.value("xDir", json::array({1, 0, 0}));
-  json yDirJson = basis.value("yDir", json::array({0, 1, 0}));
-  gp_Vec xDir(parseScalar(xDirJson[0]), parseScalar(xDirJson[1]), parseScalar(xDirJson[2]));
-  gp_Vec yDir(parseScalar(yDirJson[0]), parseScalar(yDirJson[1]), parseScalar(yDirJson[2]));
-  if (xDir.Magnitude() == 0 || yDir.Magnitude() == 0) {
-    throw std::runtime_error("Invalid plane basis");
-  }
-  xDir.Normalize();
-  yDir.Normalize();
-
-  gp_Vec offset(
-      parseScalar(originOffset[0]),
-      parseScalar(originOffset[1]),
-      parseScalar(originOffset[2]));
-  gp_Pnt center(
-      origin.X() + offset.X(),
-      origin.Y() + offset.Y(),
-      origin.Z() + offset.Z());
-
-  const double halfW = width / 2.0;
-  const double halfH = height / 2.0;
-  auto addVec = [](const gp_Pnt& p, const gp_Vec& v) {
-    return gp_Pnt(p.X() + v.X(), p.Y() + v.Y(), p.Z() + v.Z());
-  };
-  gp_Vec xOff = xDir.Multiplied(halfW);
-  gp_Vec yOff = yDir.Multiplied(halfH);
-  BRepBuilderAPI_MakePolygon poly;
-  poly.Add(addVec(addVec(center, xOff), yOff));
-  poly.Add(addVec(addVec(center, xOff.Reversed()), yOff));
-  poly.Add(addVec(addVec(center, xOff.Reversed()), yOff.Reversed()));
-  poly.Add(addVec(addVec(center, xOff), yOff.Reversed()));
-  poly.Close();
-  return BRepBuilderAPI_MakeFace(poly.Wire());
-}
-
-static gp_Pnt shapeCenter(const TopoDS_Shape& shape) {
-  Bnd_Box box;
-  BRepBndLib::Add(shape, box);
-  gp_Pnt minPnt = box.CornerMin();
-  gp_Pnt maxPnt = box.CornerMax();
-  return gp_Pnt((minPnt.X() + maxPnt.X()) / 2.0,
-                (minPnt.Y() + maxPnt.Y()) / 2.0,
-                (minPnt.Z() + maxPnt.Z()) / 2.0);
-}
-
-static KernelResult collectSelections(const TopoDS_Shape& shape,
-                                      ShapeRegistry& registry,
-                                      const std::string& featureId,
-                                      const std::string& ownerKey,
-                                      const std::string& outputKind,
-                                      const json& tags) {
-  KernelResult result;
-  const std::string ownerHandle = registry.registerShape(shape);
-  const std::string ownerToken = selectionOwnerToken(ownerKey);
-
-  if (outputKind == "solid") {
-    gp_Pnt solidCenter = shapeCenter(shape);
-    KernelSelection solidSelection;
-    solidSelection.id = "solid:" + ownerToken + "~" + featureId + ".body";
-    solidSelection.kind = "solid";
-    solidSelection.meta = makeSolidMeta(ownerHandle, ownerKey, featureId, solidCenter, tags);
-    result.selections.push_back(solidSelection);
   }
+  response["meshes"] = std::move(parts);
+
+  std::string body;
+  body += "--" + boundary + "\r\nContent-Type: application/json\r\n\r\n";
+  body += response.dump();
+  for (std::size_t index = 0; index < buffers.size(); ++index) {
+    const MeshBuffers& buffer = buffers[index];
+    body += "\r\n--" + boundary + "\r\nContent-Type: application/octet-stream\r\n";
+    body += "Content-Disposition: inline; name=\"" + mesh.keys[index] + "\"\r\n\r\n";
+    const std::size_t offset = body.size();
+    body.resize(offset + buffer.positions.size() * sizeof(float) + buffer.indices.size() * sizeof(std::uint32_t));
+    char* out = &body[offset];
+    for (double value : buffer.positions) {
+      const float narrowed = static_cast<float>(value);
+      std::memcpy(out, &narrowed, sizeof(float));
+      out += sizeof(float);
+    }
+    for (int value : buffer.indices) {
+      const std::uint32_t index32 = static_cast<std::uint32_t>(value);
+      std::memcpy(out, &index32, sizeof(std::uint32_t));
+      out += sizeof(std::uint32_t);
+    }
+  }
+  body += "\r\n--" + boundary + "--\r\n";
+  res.set_content(std::move(body), "multipart/mixed; boundary=" + boundary);
+}
+
+// A /v1/exec-features build, run from the content provider once the handler
+// has returned; everything it needs lives here, off the arena.
+struct FeatureStream {
+  Session* session = nullptr;
+  KernelResult current;
+  std::vector<json> features;
+  bool mesh = false;
+  json meshSpec;
+};
 
-  TopTools_IndexedMapOfShape faceMap;
-  TopExp::MapShapes(shape, TopAbs_FACE, faceMap);
-  for (int index = 1; index <= faceMap.Extent(); ++index) {
-    TopoDS_Face face = TopoDS::Face(faceMap(index));
-    std::string faceHandle = registry.registerShape(face);
-
-    GProp_GProps props;
-    double area = 0.0;
-    gp_Pnt center = gp_Pnt(0, 0, 0);
-    try {
-      BRepGProp::SurfaceProperties(face, props);
-      area = props.Mass();
-      center = props.CentreOfMass();
-    } catch (...) {
-      center = shapeCenter(face);
-    }
-
-    bool planar = false;
-    std::string normalDir;
-    std::optional<gp_Vec> normalVec;
-    std::string surfaceType;
+// Executes the features in order, emitting one record per feature as soon as
+// it is built, and returns the summary. The first failure ends the build;
+// the session keeps everything built before it.
+static json runFeatureStream(FeatureStream& stream, const std::function<bool(const json&)>& emit) {
+  TraceSpan span("exec-features.run");
+  Session& session = *stream.session;
+  std::size_t built = 0;
+  bool cancelled = false;
+  json failed;
+  // Outputs built here and not meshed inline, for speculative meshing.
+  std::set<std::string> unmeshed;
+  for (std::size_t index = 0; index < stream.features.size(); ++index) {
+    const json& feature = stream.features[index];
+    const auto start = std::chrono::steady_clock::now();
+    json record = {{"index", index}, {"featureId", feature.value("id", "")}};
     try {
-      BRepAdaptor_Surface adaptor(face, true);
-      const auto type = adaptor.GetType();
-      if (type == GeomAbs_Plane) {
-        planar = true;
-        surfaceType = "plane";
-        gp_Pln plane = adaptor.Plane();
-        gp_Dir dir = plane.Axis().Direction();
-        gp_Vec vec(dir.X(), dir.Y(), dir.Z());
-        if (face.Orientation() == TopAbs_REVERSED) {
-          vec.Reverse();
-        }
-        normalVec = vec;
-        normalDir = axisDirectionFromVector(vec);
-      } else if (type == GeomAbs_Cylinder) {
-        surfaceType = "cylinder";
-      } else if (type == GeomAbs_Cone) {
-        surfaceType = "cone";
-      } else if (type == GeomAbs_Sphere) {
-        surfaceType = "sphere";
-      } else if (type == GeomAbs_Torus) {
-        surfaceType = "torus";
-      } else if (type == GeomAbs_BSplineSurface) {
-        surfaceType = "bspline";
-      } else if (type == GeomAbs_BezierSurface) {
-        surfaceType = "bezier";
-      } else if (type == GeomAbs_SurfaceOfExtrusion) {
-        surfaceType = "extrusion";
-      } else if (type == GeomAbs_SurfaceOfRevolution) {
-        surfaceType = "revolution";
-      } else if (type == GeomAbs_OffsetSurface) {
-        surfaceType = "offset";
-      } else {
-        surfaceType = "other";
-      }
+      KernelResult result = executeFeature(feature, stream.current, session.registry);
+      stream.current = mergeResults(stream.current, result);
+      session.current = stream.current;
+      record["result"] = copyOut(serializeKernelResult(result));
+      for (const auto& entry : result.outputs) unmeshed.insert(entry.first);
+      if (stream.mesh) {
+        // Meshed before the next feature runs: it may read these shapes.
+        const InlineMesh mesh = parseInlineMesh(stream.meshSpec, result, session.registry);
+        record["meshes"] = copyOut(inlineMeshesJson(mesh, tessellateInlineMesh(mesh)));
+        for (const std::string& key : mesh.keys) unmeshed.erase(key);
+      }
+      ++built;
+    } catch (const std::exception& ex) {
+      record["error"] = ex.what();
+      failed = index;
     } catch (...) {
+      record["error"] = "feature failed";
+      failed = index;
     }
-
-    KernelSelection sel;
-    if (outputKind == "surface" && faceMap.Extent() == 1) {
-      sel.id = "face:" + ownerToken + "~" + featureId + ".seed";
-    } else {
-      sel.id = "face";
-    }
-    sel.kind = "face";
-    sel.meta = makeFaceMeta(faceHandle, ownerHandle, ownerKey, featureId, center, area,
-                            planar, normalDir, normalVec, tags);
-    if (!surfaceType.empty()) {
-      sel.meta["surfaceType"] = surfaceType;
+    record["ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    // A closed connection stops the build after the current feature.
+    if (!emit(record)) {
+      cancelled = true;
+      break;
     }
-    result.selections.push_back(sel);
+    if (!failed.is_null()) break;
   }
 
-  TopTools_IndexedMapOfShape edgeMap;
-  TopExp::MapShapes(shape, TopAbs_EDGE, edgeMap);
-  for (int index = 1; index <= edgeMap.Extent(); ++index) {
-    TopoDS_Edge edge = TopoDS::Edge(edgeMap(index));
-    std::string edgeHandle = registry.registerShape(edge);
-    gp_Pnt center = shapeCenter(edge);
-    std::string curveType;
-    std::optional<double> radius;
-    try {
-      BRepAdaptor_Curve adaptor(edge);
-      const auto type = adaptor.GetType();
-      if (type == GeomAbs_Line) {
-        curveType = "line";
-      } else if (type == GeomAbs_Circle) {
-        curveType = "circle";
-        radius = adaptor.Circle().Radius();
-      } else if (type == GeomAbs_Ellipse) {
-        curveType = "ellipse";
-      } else if (type == GeomAbs_Hyperbola) {
-        curveType = "hyperbola";
-      } else if (type == GeomAbs_Parabola) {
-        curveType = "parabola";
-      } else if (type == GeomAbs_BezierCurve) {
-        curveType = "bezier";
-      } else if (type == GeomAbs_BSplineCurve) {
-        curveType = "bspline";
-      } else {
-        curveType = "other";
+  if (MeshPrefetcher::instance().enabled()) {
+    std::vector<std::pair<std::string, TopoDS_Shape>> bodies;
+    for (const auto& entry : stream.current.outputs) {
+      const std::string handle = entry.second.meta.value("handle", "");
+      if (entry.second.kind == "solid" && !handle.empty() && unmeshed.count(entry.first)) {
+        bodies.emplace_back(handle, session.registry.get(handle));
       }
-    } catch (...) {
-    }
-    KernelSelection sel;
-    sel.id = "edge";
-    sel.kind = "edge";
-    sel.meta = makeEdgeMeta(edgeHandle, ownerHandle, ownerKey, featureId, center, tags);
-    if (!curveType.empty()) {
-      sel.meta["curveType"] = curveType;
     }
-    if (radius && std::isfinite(*radius) && *radius > 0) {
-      sel.meta["radius"] = *radius;
-    }
-    result.selections.push_back(sel);
+    MeshPrefetcher::instance().schedule(session, bodies);
   }
 
-  KernelObject output;
-  output.id = featureId + ":" + (outputKind == "solid" ? "solid" : "face");
-  output.kind = outputKind == "solid" ? "solid" : "face";
-  output.meta = json::object();
-  output.meta["handle"] = ownerHandle;
-  output.meta["ownerKey"] = ownerKey;
-  output.meta["createdBy"] = featureId;
-  output.meta["role"] = outputKind == "solid" ? "body" : "surface";
-  result.outputs[ownerKey] = output;
-  return result;
-}
-
-static KernelResult mergeResults(const KernelResult& upstream, const KernelResult& next) {
-  KernelResult merged;
-  merged.outputs = upstream.outputs;
-  for (const auto& entry : next.outputs) {
-    merged.outputs[entry.first] = entry.second;
-  }
-  std::vector<std::string> ownerKeys;
-  for (const auto& sel : next.selections) {
-    if (sel.meta.contains("ownerKey") && sel.meta["ownerKey"].is_string()) {
-      ownerKeys.push_back(sel.meta["ownerKey"].get<std::string>());
-    }
-  }
-  for (const auto& sel : upstream.selections) {
-    bool skip = false;
-    if (sel.meta.contains("ownerKey") && sel.meta["ownerKey"].is_string()) {
-      const std::string owner = sel.meta["ownerKey"].get<std::string>();
-      for (const auto& key : ownerKeys) {
-        if (key == owner) {
-          skip = true;
-          break;
+  span.setAttribute("exec-features.built", static_cast<std::int64_t>(built));
+  json summary = {
+      {"done", !cancelled && failed.is_null()},
+      {"features", stream.features.size()},
+      {"built", built},
+  };
+  if (!failed.is_null()) summary["failed"] = failed;
+  return summary;
+}
+
+static void captureSlowRequest(const httplib::Request& req,
+                               int status,
+                               double durationMs,
+                               const RequestPhases& phases,
+                               SessionManager& sessions) {
+  SlowRequestSample sample;
+  sample.method = req.method;
+  sample.path = req.path;
+  sample.status = status;
+  sample.durationMs = durationMs;
+  sample.body = req.body;
+  sample.traceparent = req.get_header_value("traceparent");
+  sample.phases = phases.phases();
+  try {
+    const json payload = json::parse(req.body, nullptr, false);
+    if (payload.is_object()) {
+      sample.sessionId = payload.value("sessionId", "default");
+      if (Session* session = sessions.find(sample.sessionId)) {
+        sample.sessionState = serializeKernelResult(session->current).dump();
+        const std::string handle = payload.value("handle", "");
+        if (!handle.empty()) {
+          std::ostringstream brep;
+          BRepTools::Write(session->registry.get(handle), brep);
+          sample.attachments.emplace_back("shape.brep", brep.str());
         }
       }
     }
-    if (!skip) merged.selections.push_back(sel);
-  }
-  for (const auto& sel : next.selections) {
-    merged.selections.push_back(sel);
-  }
-  return merged;
-}
-
-static KernelResult parseKernelResult(const json& value) {
-  KernelResult result;
-  if (!value.is_object()) return result;
-  if (value.contains("outputs")) {
-    for (const auto& entry : value["outputs"]) {
-      KernelObject obj;
-      obj.id = entry["object"].value("id", "");
-      obj.kind = entry["object"].value("kind", "");
-      obj.meta = entry["object"].value("meta", json::object());
-      const std::string key = entry.value("key", obj.id);
-      result.outputs[key] = obj;
-    }
-  }
-  if (value.contains("selections")) {
-    for (const auto& entry : value["selections"]) {
-      KernelSelection sel;
-      sel.id = entry.value("id", "");
-      sel.kind = entry.value("kind", "");
-      sel.meta = entry.value("meta", json::object());
-      result.selections.push_back(sel);
-    }
-  }
-  return result;
-}
-
-static json serializeKernelResult(const KernelResult& result) {
-  json outputs = json::array();
-  for (const auto& entry : result.outputs) {
-    json obj;
-    obj["key"] = entry.first;
-    obj["object"] = {{"id", entry.second.id}, {"kind", entry.second.kind}, {"meta", entry.second.meta}};
-    outputs.push_back(obj);
-  }
-  json selections = json::array();
-  for (const auto& sel : result.selections) {
-    selections.push_back({{"id", sel.id}, {"kind", sel.kind}, {"meta", sel.meta}});
-  }
-  return {{"outputs", outputs}, {"selections", selections}};
-}
-
-static std::optional<KernelSelection> resolveSelector(const json& selector,
-                                                      const KernelResult& current,
-                                                      std::string& error) {
-  const std::string kind = selector.value("kind", "");
-  if (kind == "selector.named") {
-    const std::string name = selector.value("name", "");
-    auto it = current.outputs.find(name);
-    if (it == current.outputs.end()) {
-      error = "Missing named output: " + name;
-      return std::nullopt;
-    }
-    KernelSelection sel;
-    sel.id = it->second.id;
-    sel.kind = it->second.kind;
-    sel.meta = it->second.meta;
-    return sel;
-  }
-
-  std::vector<KernelSelection> candidates;
-  for (const auto& sel : current.selections) {
-    if (kind == "selector.face" && sel.kind != "face") continue;
-    if (kind == "selector.edge" && sel.kind != "edge") continue;
-    if (kind == "selector.solid" && sel.kind != "solid") continue;
-    bool matches = true;
-    for (const auto& pred : selector.value("predicates", json::array())) {
-      const std::string predKind = pred.value("kind", "");
-      if (predKind == "pred.planar") {
-        if (!sel.meta.value("planar", false)) matches = false;
-      } else if (predKind == "pred.normal") {
-        if (sel.meta.value("normal", "") != pred.value("value", "")) matches = false;
-      } else if (predKind == "pred.createdBy") {
-        if (sel.meta.value("createdBy", "") != pred.value("featureId", "")) matches = false;
-      } else if (predKind == "pred.role") {
-        if (sel.meta.value("role", "") != pred.value("value", "")) matches = false;
-      }
-      if (!matches) break;
-    }
-    if (matches) candidates.push_back(sel);
-  }
-
-  if (candidates.empty()) {
-    error = "Selector matched 0 candidates";
-    return std::nullopt;
-  }
-
-  auto rankRules = selector.value("rank", json::array());
-  for (const auto& rule : rankRules) {
-    if (candidates.size() <= 1) break;
-    const std::string ruleKind = rule.value("kind", "");
-    if (ruleKind == "rank.maxArea") {
-      double best = -1.0;
-      for (const auto& c : candidates) best = std::max(best, c.meta.value("area", 0.0));
-      std::vector<KernelSelection> filtered;
-      for (const auto& c : candidates) {
-        if (c.meta.value("area", 0.0) == best) filtered.push_back(c);
-      }
-      candidates.swap(filtered);
-    } else if (ruleKind == "rank.minZ") {
-      double best = std::numeric_limits<double>::infinity();
-      for (const auto& c : candidates) best = std::min(best, c.meta.value("centerZ", 0.0));
-      std::vector<KernelSelection> filtered;
-      for (const auto& c : candidates) {
-        if (c.meta.value("centerZ", 0.0) == best) filtered.push_back(c);
-      }
-      candidates.swap(filtered);
-    } else if (ruleKind == "rank.maxZ") {
-      double best = -std::numeric_limits<double>::infinity();
-      for (const auto& c : candidates) best = std::max(best, c.meta.value("centerZ", 0.0));
-      std::vector<KernelSelection> filtered;
-      for (const auto& c : candidates) {
-        if (c.meta.value("centerZ", 0.0) == best) filtered.push_back(c);
-      }
-      candidates.swap(filtered);
-    } else if (ruleKind == "rank.closestTo") {
-      std::string innerErr;
-      auto targetSel = resolveSelector(rule["target"], current, innerErr);
-      if (!targetSel) {
-        error = innerErr;
-        return std::nullopt;
-      }
-      auto center = targetSel->meta.value("center", json::array({0, 0, 0}));
-      if (!center.is_array() || center.size() < 3) {
-        error = "Selector requires center metadata";
-        return std::nullopt;
-      }
-      auto tx = center[0].get<double>();
-      auto ty = center[1].get<double>();
-      auto tz = center[2].get<double>();
-      double bestScore = std::numeric_limits<double>::infinity();
-      for (const auto& c : candidates) {
-        auto cc = c.meta.value("center", json::array({0, 0, 0}));
-        double dx = cc[0].get<double>() - tx;
-        double dy = cc[1].get<double>() - ty;
-        double dz = cc[2].get<double>() - tz;
-        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
-        bestScore = std::min(bestScore, dist);
-      }
-      std::vector<KernelSelection> filtered;
-      for (const auto& c : candidates) {
-        auto cc = c.meta.value("center", json::array({0, 0, 0}));
-        double dx = cc[0].get<double>() - tx;
-        double dy = cc[1].get<double>() - ty;
-        double dz = cc[2].get<double>() - tz;
-        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
-        if (dist == bestScore) filtered.push_back(c);
-      }
-      candidates.swap(filtered);
-    }
-  }
-
-  if (candidates.size() != 1) {
-    error = "Selector ambiguity after ranking";
-    return std::nullopt;
-  }
-  return candidates.front();
-}
-
-static TopoDS_Shape resolveGeometryRef(const json& ref,
-                                       const KernelResult& current,
-                                       const ShapeRegistry& registry) {
-  if (!ref.is_object()) {
-    throw std::runtime_error("Invalid geometry ref");
-  }
-  const std::string kind = ref.value("kind", "");
-  json selector = ref.value("selector", json::object());
-  std::string error;
-  auto selection = resolveSelector(selector, current, error);
-  if (!selection) {
-    throw std::runtime_error(error);
-  }
-  if (kind == "ref.surface" && selection->kind != "face") {
-    throw std::runtime_error("Expected face selection for ref.surface");
-  }
-  if (kind == "ref.edge" && selection->kind != "edge") {
-    throw std::runtime_error("Expected edge selection for ref.edge");
-  }
-  if (kind == "ref.axis" || kind == "ref.point" || kind == "ref.frame") {
-    throw std::runtime_error("Geometry ref kind not supported yet: " + kind);
-  }
-  const std::string handle = selection->meta.value("handle", "");
-  if (handle.empty()) {
-    throw std::runtime_error("Selection missing handle metadata");
-  }
-  return registry.get(handle);
-}
-
-static XCAFDimTolObjects_DatumSingleModif mapDatumModifier(const std::string& mod) {
-  if (mod == "MMB") return XCAFDimTolObjects_DatumSingleModif_MaximumMaterialRequirement;
-  if (mod == "LMB") return XCAFDimTolObjects_DatumSingleModif_LeastMaterialRequirement;
-  return XCAFDimTolObjects_DatumSingleModif_Basic;
-}
-
-static std::optional<XCAFDimTolObjects_GeomToleranceModif> mapTolModifier(const std::string& mod) {
-  if (mod == "MMC") return XCAFDimTolObjects_GeomToleranceModif_Maximum_Material_Requirement;
-  if (mod == "LMC") return XCAFDimTolObjects_GeomToleranceModif_Least_Material_Requirement;
-  if (mod == "FREE_STATE") return XCAFDimTolObjects_GeomToleranceModif_Free_State;
-  if (mod == "TANGENT_PLANE") return XCAFDimTolObjects_GeomToleranceModif_Tangent_Plane;
-  if (mod == "STATISTICAL") return XCAFDimTolObjects_GeomToleranceModif_Statistical_Tolerance;
-  return std::nullopt;
-}
-
-static XCAFDimTolObjects_GeomToleranceType mapToleranceType(const std::string& kind) {
-  if (kind == "constraint.surfaceProfile") return XCAFDimTolObjects_GeomToleranceType_ProfileOfSurface;
-  if (kind == "constraint.flatness") return XCAFDimTolObjects_GeomToleranceType_Flatness;
-  if (kind == "constraint.parallelism") return XCAFDimTolObjects_GeomToleranceType_Parallelism;
-  if (kind == "constraint.perpendicularity") return XCAFDimTolObjects_GeomToleranceType_Perpendicularity;
-  if (kind == "constraint.position") return XCAFDimTolObjects_GeomToleranceType_Position;
-  return XCAFDimTolObjects_GeomToleranceType_None;
-}
-
-static void ensureStepControllersReady() {
-  static bool initialized = false;
-  if (initialized) return;
-  STEPControl_Controller::Init();
-  STEPCAFControl_Controller::Init();
-  initialized = true;
-}
-
-static std::string toUpperCopy(const std::string& value) {
-  std::string out = value;
-  for (char& ch : out) {
-    if (ch >= 'a' && ch <= 'z') {
-      ch = static_cast<char>(ch - 'a' + 'A');
-    }
-  }
-  return out;
-}
-
-static std::string findSchemaEnumMatch(const std::string& token) {
-  const int start = Interface_Static::IDef("write.step.schema", "estart");
-  const int count = Interface_Static::IDef("write.step.schema", "ecount");
-  if (count <= 0) return "";
-  const std::string tokenUpper = toUpperCopy(token);
-  for (int i = 0; i < count; ++i) {
-    const int idx = start + i;
-    const std::string key = std::string("enum ") + std::to_string(idx);
-    const char* value = Interface_Static::CDef("write.step.schema", key.c_str());
-    if (!value || value[0] == '\0') continue;
-    const std::string valueStr(value);
-    if (toUpperCopy(valueStr).find(tokenUpper) != std::string::npos) {
-      return valueStr;
-    }
+  } catch (const std::exception& ex) {
+    std::cerr << "occt_server slow capture: " << ex.what() << std::endl;
   }
-  return "";
-}
-
-static void writeStepSchema(const std::string& schema) {
-  if (schema.empty()) return;
-  ensureStepControllersReady();
-  std::string target = schema;
-  if (schema == "AP242") {
-    const std::string mapped = findSchemaEnumMatch("AP242");
-    if (!mapped.empty()) target = mapped;
-  } else {
-    const std::string mapped = findSchemaEnumMatch(schema);
-    if (!mapped.empty()) target = mapped;
+  const std::string entry = SlowRequestCapture::instance().write(sample);
+  if (!entry.empty()) {
+    std::cerr << "occt_server slow request " << req.method << " " << req.path << " took "
+              << durationMs << " ms, captured to " << entry << std::endl;
   }
-  Interface_Static::SetCVal("write.step.schema", target.c_str());
 }
 
-static std::vector<unsigned char> readFileBytes(const std::string& path) {
-  std::ifstream input(path, std::ios::binary);
-  if (!input) return {};
-  input.seekg(0, std::ios::end);
-  std::size_t size = static_cast<std::size_t>(input.tellg());
-  input.seekg(0, std::ios::beg);
-  std::vector<unsigned char> data(size);
-  input.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size));
-  return data;
-}
-
-static json meshShape(const TopoDS_Shape& shape, const json& options) {
-  const double linDeflection = options.value("linearDeflection", 0.1);
-  const double angDeflection = options.value("angularDeflection", 0.5);
-  const bool relative = options.value("relative", false);
-
-  BRepMesh_IncrementalMesh mesher(shape, linDeflection, relative, angDeflection, true);
-  mesher.Perform();
-
-  std::vector<double> positions;
-  std::vector<int> indices;
-  int vertexOffset = 0;
+// The instrumentation of one request: its server span, phases and context,
+// and the clocks and tallies reported when it finishes. A streamed response
+// keeps it alive past the handler, on the same connection thread, until
+// httplib releases the content provider (see streamNdjson).
+struct RequestInstrumentation {
+  RequestInstrumentation(const std::string& route, const httplib::Request& req, SessionManager& sessions)
+      : span(route.c_str(), req.get_header_value("traceparent")), sessions(sessions) {}
 
-  TopExp_Explorer explorer(shape, TopAbs_FACE);
-  for (; explorer.More(); explorer.Next()) {
-    TopoDS_Face face = TopoDS::Face(explorer.Current());
-    TopLoc_Location loc;
-    Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
-    if (triangulation.IsNull()) continue;
-    const int nodeCount = triangulation->NbNodes();
-    for (int i = 1; i <= nodeCount; ++i) {
-      gp_Pnt p = triangulation->Node(i).Transformed(loc.Transformation());
-      positions.push_back(p.X());
-      positions.push_back(p.Y());
-      positions.push_back(p.Z());
-    }
-    const int triCount = triangulation->NbTriangles();
-    for (int i = 1; i <= triCount; ++i) {
-      int n1, n2, n3;
-      triangulation->Triangle(i).Get(n1, n2, n3);
-      indices.push_back(vertexOffset + n1 - 1);
-      indices.push_back(vertexOffset + n2 - 1);
-      indices.push_back(vertexOffset + n3 - 1);
-    }
-    vertexOffset += nodeCount;
-  }
-
-  json out;
-  out["positions"] = positions;
-  out["indices"] = indices;
-  return out;
-}
+  ServerTraceSpan span;
+  SessionManager& sessions;
+  RequestPhases phases;
+  RequestContext context;
+  const std::chrono::system_clock::time_point startedAt = std::chrono::system_clock::now();
+  const AllocTally allocsBefore = threadAllocTally();
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::size_t arenaBytes = 0;
+  bool streamed = false;
+};
 
-static std::vector<unsigned char> exportStep(const TopoDS_Shape& shape,
-                                             const std::string& schema) {
-  writeStepSchema(schema);
-  STEPControl_Writer writer;
-  writer.Transfer(shape, STEPControl_AsIs);
-  const std::string path = "/tmp/trueform-native.step";
-  IFSelect_ReturnStatus status = writer.Write(path.c_str());
-  if (status != IFSelect_RetDone) {
-    throw std::runtime_error("Failed to write STEP");
-  }
-  return readFileBytes(path);
+static std::shared_ptr<RequestInstrumentation>& activeInstrumentation() {
+  static thread_local std::shared_ptr<RequestInstrumentation> current;
+  return current;
 }
 
-static std::vector<unsigned char> exportStepWithPmi(const TopoDS_Shape& shape,
-                                                    const KernelResult& current,
-                                                    const ShapeRegistry& registry,
-                                                    const json& pmiPayload,
-                                                    const std::string& schema) {
-  writeStepSchema(schema);
-  Handle(TDocStd_Document) doc = new TDocStd_Document("MDTV-XCAF");
-  Handle(XCAFDoc_ShapeTool) shapeTool = XCAFDoc_DocumentTool::ShapeTool(doc->Main());
-  Handle(XCAFDoc_DimTolTool) dimTolTool = XCAFDoc_DocumentTool::DimTolTool(doc->Main());
-
-  TDF_Label shapeLabel = shapeTool->AddShape(shape);
-
-  std::unordered_map<std::string, TDF_Label> datumLabels;
-  if (pmiPayload.contains("datums")) {
-    for (const auto& datum : pmiPayload["datums"]) {
-      const std::string datumId = datum.value("id", "");
-      const std::string label = datum.value("label", datumId);
-      const json target = datum.value("target", json::object());
-      TopoDS_Shape targetShape = resolveGeometryRef(target, current, registry);
-      TDF_Label targetLabel = shapeTool->AddSubShape(shapeLabel, targetShape);
-
-      TDF_Label datumLabel = dimTolTool->AddDatum();
-      Handle(TCollection_HAsciiString) name = new TCollection_HAsciiString(label.c_str());
-      Handle(TCollection_HAsciiString) empty = new TCollection_HAsciiString("");
-      XCAFDoc_Datum::Set(datumLabel, name, empty, name);
-      {
-        TDF_LabelSequence seq;
-        seq.Append(targetLabel);
-        dimTolTool->SetDatum(seq, datumLabel);
-      }
-
-      if (datum.contains("modifiers") && datum["modifiers"].is_array()) {
-        Handle(XCAFDoc_Datum) datumAttr = XCAFDoc_Datum::Set(datumLabel);
-        Handle(XCAFDimTolObjects_DatumObject) datumObj = datumAttr->GetObject();
-        if (datumObj.IsNull()) {
-          datumObj = new XCAFDimTolObjects_DatumObject();
-        }
-        for (const auto& mod : datum["modifiers"]) {
-          datumObj->AddModifier(mapDatumModifier(mod.get<std::string>()));
-        }
-        datumAttr->SetObject(datumObj);
-      }
-
-      if (!datumId.empty()) {
-        datumLabels[datumId] = datumLabel;
-      }
-    }
-  }
-
-  if (pmiPayload.contains("constraints")) {
-    for (const auto& constraint : pmiPayload["constraints"]) {
-      const std::string kind = constraint.value("kind", "");
-      XCAFDimTolObjects_GeomToleranceType tolType = mapToleranceType(kind);
-      if (tolType == XCAFDimTolObjects_GeomToleranceType_None) {
-        continue;
-      }
-      const json targetRef = constraint.value("target", json::object());
-      TopoDS_Shape targetShape = resolveGeometryRef(targetRef, current, registry);
-      TDF_Label targetLabel = shapeTool->AddSubShape(shapeLabel, targetShape);
-
-      TDF_Label tolLabel = dimTolTool->AddGeomTolerance();
-      Handle(XCAFDoc_GeomTolerance) tolAttr = XCAFDoc_GeomTolerance::Set(tolLabel);
-      Handle(XCAFDimTolObjects_GeomToleranceObject) tolObj = new XCAFDimTolObjects_GeomToleranceObject();
-      tolObj->SetType(tolType);
-      tolObj->SetValue(parseScalar(constraint.value("tolerance", 0.0)));
-
-      if (kind == "constraint.position") {
-        const std::string zone = constraint.value("zone", "");
-        if (zone == "diameter") {
-          tolObj->SetTypeOfValue(XCAFDimTolObjects_GeomToleranceTypeValue_Diameter);
-        }
-      }
-
-      if (constraint.contains("modifiers") && constraint["modifiers"].is_array()) {
-        for (const auto& mod : constraint["modifiers"]) {
-          auto mapped = mapTolModifier(mod.get<std::string>());
-          if (mapped) tolObj->AddModifier(*mapped);
-        }
-      }
-
-      tolAttr->SetObject(tolObj);
-      dimTolTool->SetGeomTolerance(targetLabel, tolLabel);
-
-      if (constraint.contains("datum") && constraint["datum"].is_array()) {
-        for (const auto& datumRef : constraint["datum"]) {
-          const std::string refId = datumRef.value("datum", "");
-          auto it = datumLabels.find(refId);
-          if (it != datumLabels.end()) {
-            dimTolTool->SetDatumToGeomTol(it->second, tolLabel);
-          }
-        }
-      }
-    }
-  }
-
-  STEPCAFControl_Writer writer;
-  writer.SetDimTolMode(true);
-  writer.SetNameMode(true);
-  writer.SetPropsMode(true);
-  writer.Transfer(doc, STEPControl_AsIs);
-  const std::string path = "/tmp/trueform-native-pmi.step";
-  IFSelect_ReturnStatus status = writer.Write(path.c_str());
-  if (status != IFSelect_RetDone) {
-    throw std::runtime_error("Failed to write STEP with PMI");
+class ScopedInstrumentation {
+ public:
+  explicit ScopedInstrumentation(std::shared_ptr<RequestInstrumentation> state) {
+    activeInstrumentation() = std::move(state);
   }
-  return readFileBytes(path);
-}
+  ~ScopedInstrumentation() { activeInstrumentation().reset(); }
+};
 
-static json capabilitiesPayload() {
-  json payload;
-  payload["name"] = "opencascade.native";
-  payload["featureKinds"] = json::array({"datum.plane", "datum.axis", "datum.frame", "feature.sketch2d", "feature.extrude", "feature.plane", "feature.surface", "feature.revolve", "feature.pipe", "feature.loft", "feature.sweep"});
-  payload["featureStages"] = {
-      {"datum.plane", {{"stage", "stable"}}},
-      {"datum.axis", {{"stage", "stable"}}},
-      {"datum.frame", {{"stage", "stable"}}},
-      {"feature.sketch2d", {{"stage", "stable"}}},
-      {"feature.extrude", {{"stage", "stable"}}},
-      {"feature.plane", {{"stage", "stable"}}},
-      {"feature.surface", {{"stage", "stable"}}},
-      {"feature.revolve", {{"stage", "stable"}}},
-      {"feature.pipe", {{"stage", "stable"}}},
-      {"feature.loft", {{"stage", "stable"}}},
-      {"feature.sweep", {{"stage", "experimental"}}},
+static double elapsedMs(const RequestInstrumentation& state) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - state.start).count();
+}
+
+// Ends the span and records the request, once it is fully answered.
+static void finishRequest(RequestInstrumentation& state,
+                          const httplib::Request& req,
+                          int status,
+                          const std::string& error,
+                          double durationMs,
+                          const AllocTally& allocs) {
+  addRequestAllocations(allocs);
+  ServerTraceSpan& span = state.span;
+  span.setAttribute("http.response.status_code", status);
+  if (allocationCountingEnabled()) {
+    span.setAttribute("alloc.count", static_cast<std::int64_t>(allocs.allocations));
+    span.setAttribute("alloc.bytes", static_cast<std::int64_t>(allocs.bytes));
+  }
+  span.setAttribute("arena.bytes", static_cast<std::int64_t>(state.arenaBytes));
+  if (!error.empty()) span.setError(error);
+  if (RequestRecorder::instance().enabled()) {
+    RecordedRequest record;
+    record.startMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        state.startedAt.time_since_epoch()).count();
+    record.method = req.method;
+    record.path = req.path;
+    record.sessionId = state.context.sessionId;
+    record.durationMs = durationMs;
+    record.status = status;
+    if (req.has_header("Content-Type")) record.contentType = req.get_header_value("Content-Type");
+    record.body = req.body;
+    RequestRecorder::instance().append(record);
+  }
+  if (SlowRequestCapture::instance().exceeds(durationMs)) {
+    captureSlowRequest(req, status, durationMs, state.phases, state.sessions);
+  }
+}
+
+static httplib::Server::Handler instrumented(const std::string& route,
+                                             SessionManager& sessions,
+                                             httplib::Server::Handler handler) {
+  // The template, not the path: session ids would make it unbounded.
+  const std::string httpRoute = route.substr(route.find(' ') + 1);
+  return [route, httpRoute, &sessions, handler](const httplib::Request& req, httplib::Response& res) {
+    auto state = std::make_shared<RequestInstrumentation>(route, req, sessions);
+    state->span.setAttribute("http.request.method", req.method);
+    state->span.setAttribute("http.route", httpRoute);
+    {
+      ScopedRequestPhases scope(state->phases);
+      ScopedRequestContext contextScope(state->context);
+      ScopedRequestArena arena;
+      ScopedInstrumentation instrumentation(state);
+      handler(req, res);
+      state->arenaBytes += arena.bytesAllocated();
+    }
+    // A streamed response finishes from its content provider.
+    if (state->streamed) return;
+    const double durationMs = elapsedMs(*state);
+    const AllocTally allocs = threadAllocTally() - state->allocsBefore;
+    res.set_header("Server-Timing", state->phases.serverTiming(durationMs, allocs));
+    const int status = res.status == -1 ? 200 : res.status;
+    finishRequest(*state, req, status, status >= 400 ? res.body : std::string(), durationMs, allocs);
   };
-  payload["mesh"] = true;
-  payload["exports"] = {
-      {"step", true},
-      {"stl", false},
-  };
-  payload["assertions"] = json::array();
-  return payload;
 }
 
-int main(int argc, char** argv) {
-  std::string host = "127.0.0.1";
-  int port = 8081;
-  if (argc >= 2) host = argv[1];
-  if (argc >= 3) port = std::stoi(argv[2]);
-
-  {
-    ensureStepControllersReady();
-    const int start = Interface_Static::IDef("write.step.schema", "estart");
-    const int count = Interface_Static::IDef("write.step.schema", "ecount");
-    if (count > 0) {
-      std::cout << "write.step.schema options:";
-      for (int i = 0; i < count; ++i) {
-        const int idx = start + i;
-        const std::string key = std::string("enum ") + std::to_string(idx);
-        const char* value = Interface_Static::CDef("write.step.schema", key.c_str());
-        if (value && value[0] != '\0') {
-          std::cout << " [" << idx << "]=" << value;
+// Answers the current request with NDJSON: the records `run` emits, then the
+// one it returns. `run` is called from httplib's content provider after the
+// handler has returned, so it must not touch the handler's arena. It still
+// runs under the request's span, phases and context (and an arena of its
+// own); Server-Timing follows as a trailer, and the request is recorded and
+// slow-captured when the provider is released, so all of them cover the
+// streamed work.
+static void streamNdjson(const httplib::Request& req,
+                         httplib::Response& res,
+                         std::function<json(const std::function<bool(const json&)>&)> run) {
+  std::shared_ptr<RequestInstrumentation> state = activeInstrumentation();
+  if (state) state->streamed = true;
+  res.set_header("Trailer", "Server-Timing");
+  res.set_chunked_content_provider(
+      "application/x-ndjson",
+      [state, run](std::size_t, httplib::DataSink& sink) {
+        auto emit = [&](const json& record) {
+          const std::string line = record.dump() + "\n";
+          return sink.write(line.data(), line.size());
+        };
+        if (!state) {
+          emit(run(emit));
+          sink.done();
+          return true;
         }
-      }
-      std::cout << " current=" << Interface_Static::CVal("write.step.schema");
-      std::cout << std::endl;
-    }
-  }
-
-  SessionManager sessions;
-  httplib::Server server;
-
-  server.Get("/v1/capabilities", [&](const httplib::Request&, httplib::Response& res) {
+        {
+          ScopedRequestPhases scope(state->phases);
+          ScopedRequestContext contextScope(state->context);
+          ScopedRequestArena arena;
+          emit(run(emit));
+          state->arenaBytes += arena.bytesAllocated();
+        }
+        const AllocTally allocs = threadAllocTally() - state->allocsBefore;
+        sink.done_with_trailer({{"Server-Timing", state->phases.serverTiming(elapsedMs(*state), allocs)}});
+        return true;
+      },
+      // httplib destroys the response, and so releases the provider, while
+      // the request is still alive; the copy keeps this independent of that.
+      [state, request = req](bool success) {
+        if (!state) return;
+        finishRequest(*state, request, 200, success ? std::string() : "stream aborted", elapsedMs(*state),
+                      threadAllocTally() - state->allocsBefore);
+      });
+}
+
+static void registerRoutes(httplib::Server& server, SessionManager& sessions) {
+  server.Get("/v1/capabilities", instrumented("GET /v1/capabilities", sessions, [&](const httplib::Request&, httplib::Response& res) {
     res.set_content(capabilitiesPayload().dump(), "application/json");
-  });
+  }));
 
-  server.Post("/v1/exec-feature", [&](const httplib::Request& req, httplib::Response& res) {
+  server.Get("/v1/metrics", instrumented("GET /v1/metrics", sessions, [&](const httplib::Request&, httplib::Response& res) {
+    res.set_content(metricsPayload(sessions).dump(), "application/json");
+  }));
+
+  server.Post("/v1/exec-feature", instrumented("POST /v1/exec-feature", sessions, [&](const httplib::Request& req, httplib::Response& res) {
     try {
-      json payload = json::parse(req.body);
+      RequestJson payload = parseRequestBody(req);
       const std::string sessionId = payload.value("sessionId", "default");
       Session& session = sessions.get(sessionId);
-
-      KernelResult upstream = parseKernelResult(payload.value("upstream", json::object()));
-      const json feature = payload.value("feature", json::object());
-      const std::string kind = feature.value("kind", "");
-      const std::string featureId = feature.value("id", "feature");
-      const json tags = feature.value("tags", json::array());
-
-      if (kind == "datum.plane") {
-        gp_Vec normal = parseAxis(feature.value("normal", json("+Z")));
-        if (normal.Magnitude() == 0) {
-          throw std::runtime_error("datum.plane normal is invalid");
+      // The new feature supersedes whatever is still being meshed.
+      MeshPrefetcher::instance().cancel(session);
+
+      KernelResult upstream = parseKernelResult(memberOrNull(payload, "upstream"), requestResource());
+      const json feature = copyOutMember(payload, "feature");
+      KernelResult built = executeFeature(feature, upstream, session.registry);
+      // mergeResults builds on the heap, so this is the copy out of the arena.
+      session.current = mergeResults(upstream, built);
+
+      // Meshing runs on its own thread while the result serializes; the
+      // buffers are plain heap vectors since that thread has no arena.
+      const json meshSpec = copyOutMember(payload, "mesh");
+      const bool meshInline = payload.contains("mesh") && meshSpec != false;
+      // The request's phases belong to this thread, so the meshing thread
+      // times itself and its duration is added as `mesh` once it is joined.
+      struct TimedMesh {
+        std::vector<MeshBuffers> buffers;
+        double ms = 0.0;
+        AllocTally allocs;
+      };
+      InlineMesh mesh;
+      std::future<TimedMesh> meshed;
+      if (meshInline) {
+        mesh = parseInlineMesh(meshSpec, built, session.registry);
+        meshed = std::async(std::launch::async, [&mesh] {
+          const AllocTally allocsBefore = threadAllocTally();
+          const auto start = std::chrono::steady_clock::now();
+          TimedMesh timed;
+          timed.buffers = tessellateInlineMesh(mesh);
+          timed.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+          timed.allocs = threadAllocTally() - allocsBefore;
+          return timed;
+        });
+      }
+
+      RequestJson response;
+      response["result"] = serializeKernelResult(built);
+      std::vector<MeshBuffers> buffers;
+      if (meshInline) {
+        TimedMesh timed;
+        {
+          ScopedPhase phase("mesh.wait");
+          timed = meshed.get();
         }
-        normal.Normalize();
-        gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
-        gp_Vec xAxis(0, 0, 0);
-        if (feature.contains("xAxis")) {
-          xAxis = parseAxis(feature["xAxis"]);
-          if (xAxis.Magnitude() != 0) {
-            xAxis.Normalize();
+        if (RequestPhases* phases = RequestPhases::active()) phases->add("mesh", timed.ms, timed.allocs);
+        buffers = std::move(timed.buffers);
+      }
+
+      if (MeshPrefetcher::instance().enabled()) {
+        // Scheduled only once the inline meshing is done: the prefetcher
+        // writes triangulations too, and outputs may share faces.
+        std::vector<std::pair<std::string, TopoDS_Shape>> bodies;
+        for (const auto& entry : built.outputs) {
+          const std::string handle = entry.second.meta.value("handle", "");
+          const bool meshedInline =
+              std::find(mesh.keys.begin(), mesh.keys.end(), entry.first) != mesh.keys.end();
+          if (entry.second.kind == "solid" && !handle.empty() && !meshedInline) {
+            bodies.emplace_back(handle, session.registry.get(handle));
           }
         }
-        json meta;
-        meta["type"] = "plane";
-        meta["origin"] = pointToJson(origin);
-        meta["normal"] = vecToJson(normal);
-        if (xAxis.Magnitude() != 0) meta["xDir"] = vecToJson(xAxis);
-        KernelResult built = makeDatumResult("datum:" + featureId, featureId + ":datum", meta);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
-
-      if (kind == "datum.axis") {
-        gp_Vec direction = parseAxis(feature.value("direction", json("+Z")));
-        if (direction.Magnitude() == 0) {
-          throw std::runtime_error("datum.axis direction is invalid");
-        }
-        direction.Normalize();
-        gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
-        json meta;
-        meta["type"] = "axis";
-        meta["origin"] = pointToJson(origin);
-        meta["direction"] = vecToJson(direction);
-        KernelResult built = makeDatumResult("datum:" + featureId, featureId + ":datum", meta);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
-
-      if (kind == "datum.frame") {
-        std::string error;
-        auto selection = resolveSelector(feature.value("on", json::object()), upstream, error);
-        if (!selection) {
-          throw std::runtime_error(error.empty() ? "datum.frame selector failed" : error);
-        }
-        if (selection->kind != "face") {
-          throw std::runtime_error("datum.frame must resolve to a face");
-        }
-        const std::string handle = selection->meta.value("handle", "");
-        if (handle.empty()) {
-          throw std::runtime_error("datum.frame face selection missing handle");
-        }
-        TopoDS_Shape shape = session.registry.get(handle);
-        TopoDS_Face face = TopoDS::Face(shape);
-        BRepAdaptor_Surface adaptor(face, true);
-        if (adaptor.GetType() != GeomAbs_Plane) {
-          throw std::runtime_error("datum.frame currently requires a planar face");
-        }
-        gp_Pln plane = adaptor.Plane();
-        gp_Ax3 ax3 = plane.Position();
-        gp_Pnt origin = ax3.Location();
-        gp_Dir xDir = ax3.XDirection();
-        gp_Dir yDir = ax3.YDirection();
-        gp_Dir normal = ax3.Direction();
-        json meta;
-        meta["type"] = "frame";
-        meta["origin"] = pointToJson(origin);
-        meta["xDir"] = json::array({xDir.X(), xDir.Y(), xDir.Z()});
-        meta["yDir"] = json::array({yDir.X(), yDir.Y(), yDir.Z()});
-        meta["normal"] = json::array({normal.X(), normal.Y(), normal.Z()});
-        KernelResult built = makeDatumResult("datum:" + featureId, featureId + ":datum", meta);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
-
-      if (kind == "feature.sketch2d") {
-        KernelResult built = makeSketchProfileResult(feature);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
-
-      if (kind == "feature.surface") {
-        const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
-        TopoDS_Face face = buildProfileFace(profile);
-        const std::string resultKey = feature.value("result", "surface:main");
-        KernelResult built = collectSelections(
-            face, session.registry, featureId, resultKey, "surface", tags);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
-
-      if (kind == "feature.plane") {
-        const double width = parseScalar(feature.value("width", 0.0));
-        const double height = parseScalar(feature.value("height", 0.0));
-        if (!(width > 0) || !(height > 0)) {
-          throw std::runtime_error("feature.plane requires positive width and height");
-        }
-        const json basis = feature.contains("plane")
-            ? resolvePlaneBasisJson(feature["plane"], upstream)
-            : json{
-                  {"origin", json::array({0, 0, 0})},
-                  {"xDir", json::array({1, 0, 0})},
-                  {"yDir", json::array({0, 1, 0})},
-                  {"normal", json::array({0, 0, 1})},
-              };
-        const json originOffset = feature.value("origin", json::array({0, 0, 0}));
-        TopoDS_Face face = makePlaneFaceFromBasis(basis, width, height, originOffset);
-        const std::string resultKey = feature.value("result", "surface:main");
-        KernelResult built = collectSelections(
-            face, session.registry, featureId, resultKey, "surface", tags);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
-
-      if (kind == "feature.revolve") {
-        const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
-        TopoDS_Face face = buildProfileFace(profile);
-        gp_Vec axisVec = parseAxis(feature.value("axis", json("+Z")));
-        if (axisVec.Magnitude() == 0) {
-          throw std::runtime_error("feature.revolve axis is invalid");
-        }
-        axisVec.Normalize();
-        gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
-        gp_Ax1 axis(origin, gp_Dir(axisVec));
-        json angleJson = feature.value("angle", "full");
-        double angleRad = 2.0 * M_PI;
-        if (angleJson.is_number()) {
-          angleRad = parseScalar(angleJson);
-        } else if (angleJson.is_string() && angleJson.get<std::string>() != "full") {
-          throw std::runtime_error("feature.revolve angle must be numeric or 'full'");
-        }
-        TopoDS_Shape shape = BRepPrimAPI_MakeRevol(face, axis, angleRad);
-        const std::string resultKey = feature.value("result", "body:main");
-        KernelResult built = collectSelections(
-            shape, session.registry, featureId, resultKey, "solid", tags);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
+        MeshPrefetcher::instance().schedule(session, bodies);
       }
 
-      if (kind == "feature.pipe") {
-        gp_Vec axisVec = parseAxis(feature.value("axis", json("+Z")));
-        if (axisVec.Magnitude() == 0) {
-          throw std::runtime_error("feature.pipe axis is invalid");
-        }
-        axisVec.Normalize();
-        const double length = parseScalar(feature.value("length", 0.0));
-        const double outerDia = parseScalar(feature.value("outerDiameter", 0.0));
-        const double innerDia = feature.contains("innerDiameter")
-            ? parseScalar(feature["innerDiameter"])
-            : 0.0;
-        if (!(length > 0)) {
-          throw std::runtime_error("feature.pipe length must be positive");
-        }
-        if (!(outerDia > 0)) {
-          throw std::runtime_error("feature.pipe outer diameter must be positive");
-        }
-        if (innerDia < 0) {
-          throw std::runtime_error("feature.pipe inner diameter must be non-negative");
-        }
-        if (innerDia > 0 && innerDia >= outerDia) {
-          throw std::runtime_error("feature.pipe inner diameter must be smaller than outer diameter");
-        }
-        gp_Pnt origin = parsePoint3D(feature.value("origin", json::array({0, 0, 0})));
-        gp_Ax2 axis(origin, gp_Dir(axisVec));
-        TopoDS_Shape outer = BRepPrimAPI_MakeCylinder(axis, outerDia / 2.0, length);
-        TopoDS_Shape shape = outer;
-        if (innerDia > 0) {
-          TopoDS_Shape inner = BRepPrimAPI_MakeCylinder(axis, innerDia / 2.0, length);
-          shape = BRepAlgoAPI_Cut(outer, inner);
-        }
-        const std::string resultKey = feature.value("result", "body:main");
-        KernelResult built = collectSelections(
-            shape, session.registry, featureId, resultKey, "solid", tags);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
+      if (meshInline && mesh.binary) {
+        setMultipartMeshResponse(res, response, mesh, buffers);
         return;
       }
+      if (meshInline) response["meshes"] = inlineMeshesJson(mesh, buffers);
+      res.set_content(response.dump(), "application/json");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
 
-      if (kind == "feature.loft") {
-        const json profiles = feature.value("profiles", json::array());
-        if (!profiles.is_array() || profiles.size() < 2) {
-          throw std::runtime_error("feature.loft requires at least two profiles");
-        }
-        const bool makeSolid = feature.value("mode", std::string("solid")) != "surface";
-        BRepOffsetAPI_ThruSections loftBuilder(makeSolid, false, Precision::Confusion());
-        for (const auto& profileRef : profiles) {
-          const json profile = resolveProfileJson(profileRef, upstream);
-          loftBuilder.AddWire(buildProfileWire(profile));
-        }
-        loftBuilder.Build();
-        if (!loftBuilder.IsDone()) {
-          throw std::runtime_error("feature.loft failed to build");
-        }
-        TopoDS_Shape shape = loftBuilder.Shape();
-        const std::string resultKey = feature.value(
-            "result", makeSolid ? "body:main" : "surface:main");
-        KernelResult built = collectSelections(
-            shape, session.registry, featureId, resultKey, makeSolid ? "solid" : "surface", tags);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
+  // NDJSON: one record per feature as it is built, then a summary, from the
+  // content provider after the handler has returned (see FeatureStream).
+  server.Post("/v1/exec-features", instrumented("POST /v1/exec-features", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = sessions.get(sessionId);
+      MeshPrefetcher::instance().cancel(session);
+
+      auto stream = std::make_shared<FeatureStream>();
+      stream->session = &session;
+      stream->current = parseKernelResult(copyOutMember(payload, "upstream"));
+      const json features = copyOutMember(payload, "features");
+      if (!features.is_array() || features.empty()) {
+        throw std::runtime_error("features must be a non-empty array");
+      }
+      stream->features.assign(features.begin(), features.end());
+      stream->meshSpec = copyOutMember(payload, "mesh");
+      stream->mesh = payload.contains("mesh") && stream->meshSpec != false;
+      if (stream->mesh) {
+        // Rejects a bad profile or format now, while a 400 is still possible.
+        const InlineMesh mesh = parseInlineMesh(stream->meshSpec, KernelResult(), session.registry);
+        if (mesh.binary) throw std::runtime_error("exec-features meshes are JSON only");
+      }
+      streamNdjson(req, res, [stream](const std::function<bool(const json&)>& emit) {
+        return runFeatureStream(*stream, emit);
+      });
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
 
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
+  server.Post("/v1/mesh", instrumented("POST /v1/mesh", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = sessions.get(sessionId);
+      const std::string handle = payload.value("handle", "");
+      if (handle.empty()) throw std::runtime_error("Missing shape handle");
+      TopoDS_Shape shape = session.registry.get(handle);
+      const MeshParameters parameters = parseMeshParameters(copyOutMember(payload, "options"));
+      // take() settles the session whether or not it has the mesh, so the
+      // bounds below never read triangulations the prefetcher is writing.
+      std::optional<json> prefetched = MeshPrefetcher::instance().take(session, handle, parameters);
+      // For viewer framing; collectSelections has usually cached it already.
+      const json bounds = boundsToJson(session.registry.boundingBox(handle));
+      if (prefetched) {
+        ScopedPhase phase("mesh.prefetched");
+        (*prefetched)["bounds"] = bounds;
+        res.set_content(prefetched->dump(), "application/json");
         return;
       }
+      RequestJson result = meshShape(shape, parameters);
+      result["bounds"] = bounds;
+      res.set_content(result.dump(), "application/json");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
 
-      if (kind == "feature.sweep") {
-        if (feature.contains("frame")) {
-          throw std::runtime_error("Native backend sweep does not support custom frame references yet");
-        }
-        if (feature.contains("orientation") &&
-            feature["orientation"].is_string() &&
-            feature["orientation"].get<std::string>() != "frenet") {
-          throw std::runtime_error("Native backend sweep currently supports only frenet orientation");
-        }
-        const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
-        TopoDS_Wire pathWire = buildPathWire(feature.value("path", json::object()));
-        const bool makeSolid = feature.value("mode", std::string("solid")) != "surface";
-        TopoDS_Shape section = makeSolid
-            ? TopoDS_Shape(buildProfileFace(profile))
-            : TopoDS_Shape(buildProfileWire(profile));
-        BRepOffsetAPI_MakePipe sweepBuilder(pathWire, section);
-        sweepBuilder.Build();
-        if (!sweepBuilder.IsDone()) {
-          throw std::runtime_error("feature.sweep failed to build");
-        }
-        TopoDS_Shape shape = sweepBuilder.Shape();
-        const std::string resultKey = feature.value(
-            "result", makeSolid ? "body:main" : "surface:main");
-        KernelResult built = collectSelections(
-            shape, session.registry, featureId, resultKey, makeSolid ? "solid" : "surface", tags);
-        KernelResult merged = mergeResults(upstream, built);
-        session.current = merged;
-
-        json response;
-        response["result"] = serializeKernelResult(built);
-        res.set_content(response.dump(), "application/json");
-        return;
-      }
+  server.Post("/v1/query", instrumented("POST /v1/query", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = settledSession(sessions, sessionId);
+      const json result = queryShapes(session.registry, payload);
+      res.set_content(result.dump(), "application/json");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
 
-      if (kind != "feature.extrude") {
-        throw std::runtime_error("Unsupported feature kind: " + kind);
-      }
-      const json profile = resolveProfileJson(feature.value("profile", json::object()), upstream);
-      TopoDS_Face face = buildProfileFace(profile);
-      json depthJson = feature.value("depth", 0.0);
-      if (depthJson.is_string() && depthJson.get<std::string>() == "throughAll") {
-        throw std::runtime_error("throughAll not supported in native backend yet");
-      }
-      double depth = parseScalar(depthJson);
-      gp_Vec axis = parseAxis(feature.value("axis", json::object()));
-      if (axis.Magnitude() == 0) axis = gp_Vec(0, 0, 1);
-      axis.Normalize();
-      gp_Vec vec = axis.Multiplied(depth);
-      TopoDS_Shape solid = BRepPrimAPI_MakePrism(face, vec);
+  server.Post("/v1/pick", instrumented("POST /v1/pick", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = settledSession(sessions, sessionId);
+      const json result = pickShapes(session.registry, session.current, payload);
+      res.set_content(result.dump(), "application/json");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
 
-      const std::string resultKey = feature.value("result", "body:main");
-      KernelResult built = collectSelections(
-          solid, session.registry, featureId, resultKey, "solid", tags);
-      if (profile.value("kind", "") == "profile.rectangle") {
-        annotateExtrudeRectangleFaceIds(
-            built, featureId, resultKey, axisDirectionFromVector(axis));
-      }
-      KernelResult merged = mergeResults(upstream, built);
-      session.current = merged;
+  server.Post("/v1/slice", instrumented("POST /v1/slice", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = settledSession(sessions, sessionId);
+      const json result = sliceShape(session.registry, payload);
+      res.set_content(result.dump(), "application/json");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
 
-      json response;
-      response["result"] = serializeKernelResult(built);
-      res.set_content(response.dump(), "application/json");
+  server.Post("/v1/interference", instrumented("POST /v1/interference", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = settledSession(sessions, sessionId);
+      const json result = checkInterference(session.registry, payload);
+      res.set_content(result.dump(), "application/json");
     } catch (const std::exception& ex) {
       res.status = 400;
       res.set_content(std::string("error: ") + ex.what(), "text/plain");
     }
-  });
+  }));
 
-  server.Post("/v1/mesh", [&](const httplib::Request& req, httplib::Response& res) {
+  server.Post("/v1/measure", instrumented("POST /v1/measure", sessions, [&](const httplib::Request& req, httplib::Response& res) {
     try {
-      json payload = json::parse(req.body);
+      RequestJson payload = parseRequestBody(req);
       const std::string sessionId = payload.value("sessionId", "default");
-      Session& session = sessions.get(sessionId);
-      const std::string handle = payload.value("handle", "");
-      if (handle.empty()) throw std::runtime_error("Missing shape handle");
-      TopoDS_Shape shape = session.registry.get(handle);
-      json result = meshShape(shape, payload.value("options", json::object()));
+      Session& session = settledSession(sessions, sessionId);
+      const json result = measureShapes(session.registry, session.current, payload);
       res.set_content(result.dump(), "application/json");
     } catch (const std::exception& ex) {
       res.status = 400;
       res.set_content(std::string("error: ") + ex.what(), "text/plain");
     }
-  });
+  }));
 
-  server.Post("/v1/export-step", [&](const httplib::Request& req, httplib::Response& res) {
+  // The shared features build inside the handler, so their errors are a 400.
+  // The variants then stream as NDJSON, one record per variant in completion
+  // order and a summary last, from the content provider after the handler
+  // has returned: the plan keeps everything they need off the arena.
+  server.Post("/v1/sweep", instrumented("POST /v1/sweep", sessions, [&](const httplib::Request& req, httplib::Response& res) {
     try {
-      json payload = json::parse(req.body);
+      RequestJson payload = parseRequestBody(req);
       const std::string sessionId = payload.value("sessionId", "default");
-      Session& session = sessions.get(sessionId);
+      Session& session = settledSession(sessions, sessionId);
+      const json request = copyOut(payload);
+      const KernelResult upstream = parseKernelResult(request.value("upstream", json()));
+      std::shared_ptr<SweepPlan> plan = prepareSweep(session.registry, upstream, request);
+      streamNdjson(req, res, [plan](const std::function<bool(const json&)>& emit) {
+        return runSweep(*plan, emit);
+      });
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
+
+  server.Post("/v1/export-step", instrumented("POST /v1/export-step", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      RequestJson payload = parseRequestBody(req);
+      const std::string sessionId = payload.value("sessionId", "default");
+      Session& session = settledSession(sessions, sessionId);
       const std::string handle = payload.value("handle", "");
       if (handle.empty()) throw std::runtime_error("Missing shape handle");
       TopoDS_Shape shape = session.registry.get(handle);
-      const std::string schema = payload.value("options", json::object()).value("schema", "AP242");
+      const std::string schema = copyOutMember(payload, "options").value("schema", "AP242");
       auto bytes = exportStep(shape, schema);
       res.set_content(reinterpret_cast<const char*>(bytes.data()), bytes.size(), "application/octet-stream");
     } catch (const std::exception& ex) {
       res.status = 400;
       res.set_content(std::string("error: ") + ex.what(), "text/plain");
     }
-  });
+  }));
 
-  server.Post("/v1/export-step-pmi", [&](const httplib::Request& req, httplib::Response& res) {
+  server.Post("/v1/export-step-pmi", instrumented("POST /v1/export-step-pmi", sessions, [&](const httplib::Request& req, httplib::Response& res) {
     try {
-      json payload = json::parse(req.body);
+      RequestJson payload = parseRequestBody(req);
       const std::string sessionId = payload.value("sessionId", "default");
-      Session& session = sessions.get(sessionId);
+      Session& session = settledSession(sessions, sessionId);
       const std::string handle = payload.value("handle", "");
       if (handle.empty()) throw std::runtime_error("Missing shape handle");
       TopoDS_Shape shape = session.registry.get(handle);
-      const json pmiPayload = payload.value("pmi", json::object());
-      const std::string schema = payload.value("options", json::object()).value("schema", "AP242");
+      const json pmiPayload = copyOutMember(payload, "pmi");
+      const std::string schema = copyOutMember(payload, "options").value("schema", "AP242");
       auto bytes = exportStepWithPmi(shape, session.current, session.registry, pmiPayload, schema);
       res.set_content(reinterpret_cast<const char*>(bytes.data()), bytes.size(), "application/octet-stream");
     } catch (const std::exception& ex) {
       res.status = 400;
       res.set_content(std::string("error: ") + ex.what(), "text/plain");
     }
-  });
+  }));
+
+
+  server.Post(R"(/v1/sessions/([^/]+)/snapshot)", instrumented("POST /v1/sessions/{id}/snapshot", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      Session* session = sessions.find(pathSessionId(req));
+      if (!session) throw std::runtime_error("Unknown session: " + std::string(req.matches[1]));
+      MeshPrefetcher::instance().settle(*session);
+      const std::string snapshot = snapshotSession(*session);
+      res.set_content(snapshot, "application/octet-stream");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
+
+  server.Post(R"(/v1/sessions/([^/]+)/restore)", instrumented("POST /v1/sessions/{id}/restore", sessions, [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+      const std::string sessionId = pathSessionId(req);
+      Session& session = sessions.get(sessionId);
+      MeshPrefetcher::instance().cancel(session);
+      restoreSession(session, req.body);
+      const json response = {
+          {"sessionId", sessionId},
+          {"shapes", session.registry.size()},
+          {"bytes", req.body.size()},
+      };
+      res.set_content(response.dump(), "application/json");
+    } catch (const std::exception& ex) {
+      res.status = 400;
+      res.set_content(std::string("error: ") + ex.what(), "text/plain");
+    }
+  }));
+}
+
+int main(int argc, char** argv) {
+  WorkerPoolOptions pool;
+  if (argc >= 2) pool.host = argv[1];
+  if (argc >= 3) pool.port = std::stoi(argv[2]);
+  pool.workers = static_cast<int>(envDouble("TF_NATIVE_WORKERS", 0));
+  pool.socketDir = envString("TF_NATIVE_WORKER_SOCKET_DIR", "");
+
+  {
+    ensureStepControllersReady();
+    const int start = Interface_Static::IDef("write.step.schema", "estart");
+    const int count = Interface_Static::IDef("write.step.schema", "ecount");
+    if (count > 0) {
+      std::cout << "write.step.schema options:";
+      for (int i = 0; i < count; ++i) {
+        const int idx = start + i;
+        const std::string key = std::string("enum ") + std::to_string(idx);
+        const char* value = Interface_Static::CDef("write.step.schema", key.c_str());
+        if (value && value[0] != '\0') {
+          std::cout << " [" << idx << "]=" << value;
+        }
+      }
+      std::cout << " current=" << Interface_Static::CVal("write.step.schema");
+      std::cout << std::endl;
+    }
+  }
+
+  if (pool.workers > 0) {
+    warmKernel();
+    return runWorkerPool(pool, [](int slot, const std::string& socketPath) {
+      SessionManager sessions;
+      httplib::Server server;
+      registerRoutes(server, sessions);
+      server.set_address_family(AF_UNIX);
+      std::cout << "occt_server worker " << slot << " (pid " << getpid() << ") listening on "
+                << socketPath << std::endl;
+      return server.listen(socketPath.c_str(), 80) ? 0 : 1;
+    });
+  }
+
+  SessionManager sessions;
+  httplib::Server server;
+  // Without TCP_NODELAY, keep-alive clients see ~40 ms delayed-ACK stalls per
+  // response.
+  server.set_tcp_nodelay(true);
+  registerRoutes(server, sessions);
 
-  std::cout << "occt_server listening on " << host << ":" << port << std::endl;
-  server.listen(host.c_str(), port);
+  std::cout << "occt_server listening on " << pool.host << ":" << pool.port << std::endl;
+  server.listen(pool.host.c_str(), pool.port);
   return 0;
 }
@@ -0,0 +1,203 @@
+#include "mesh_prefetch.h"
+
+#include "env.h"
+
+#include <Message_ProgressIndicator.hxx>
+#include <Message_ProgressScope.hxx>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+struct MeshPrefetchJob {
+  enum class State { Queued, Running, Done, Cancelled };
+
+  const Session* session = nullptr;
+  std::string handle;
+  TopoDS_Shape shape;
+  State state = State::Queued;
+  std::atomic<bool> interrupt{false};
+  std::optional<json> mesh;
+};
+
+namespace {
+
+// Lets BRepMesh poll a job's interrupt flag.
+class JobProgress : public Message_ProgressIndicator {
+ public:
+  explicit JobProgress(const MeshPrefetchJob& job) : job_(job) {}
+
+  Standard_Boolean UserBreak() override { return job_.interrupt.load(); }
+  void Show(const Message_ProgressScope&, const Standard_Boolean) override {}
+
+ private:
+  const MeshPrefetchJob& job_;
+};
+
+}  // namespace
+
+MeshPrefetcher& MeshPrefetcher::instance() {
+  static MeshPrefetcher prefetcher;
+  return prefetcher;
+}
+
+MeshPrefetcher::MeshPrefetcher() {
+  const std::string setting = envString("TF_NATIVE_MESH_PREFETCH", "");
+  if (setting.empty()) return;
+  if (std::optional<MeshParameters> profile = meshProfileParameters(setting)) {
+    parameters_ = *profile;
+  } else {
+    const json options = json::parse(setting, nullptr, false);
+    if (!options.is_object()) {
+      std::cerr << "occt_server mesh prefetch: TF_NATIVE_MESH_PREFETCH must be a profile name or JSON mesh "
+                   "options, ignoring "
+                << setting << std::endl;
+      return;
+    }
+    parameters_ = parseMeshParameters(options);
+  }
+  // One background thread already; BRepMesh's own pool would compete with
+  // the requests.
+  parameters_.parallel = false;
+  enabled_ = true;
+}
+
+MeshPrefetcher::~MeshPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    for (auto& job : queue_) job->interrupt = true;
+    for (auto& entry : jobs_) {
+      for (auto& job : entry.second) job->interrupt = true;
+    }
+  }
+  wake_.notify_all();
+  if (worker_.joinable()) worker_.join();
+}
+
+void MeshPrefetcher::schedule(const Session& session,
+                              const std::vector<std::pair<std::string, TopoDS_Shape>>& bodies) {
+  if (!enabled_) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  quiesce(lock, session, true);
+  std::vector<std::shared_ptr<MeshPrefetchJob>>& jobs = jobs_[&session];
+  jobs.clear();
+  for (const auto& body : bodies) {
+    auto job = std::make_shared<MeshPrefetchJob>();
+    job->session = &session;
+    job->handle = body.first;
+    job->shape = body.second;
+    jobs.push_back(job);
+    queue_.push_back(std::move(job));
+    ++stats_.scheduled;
+  }
+  if (!worker_.joinable()) worker_ = std::thread([this] { run(); });
+  lock.unlock();
+  wake_.notify_one();
+}
+
+void MeshPrefetcher::cancel(const Session& session) {
+  if (!enabled_) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  quiesce(lock, session, true);
+  jobs_.erase(&session);
+}
+
+void MeshPrefetcher::settle(const Session& session) {
+  if (!enabled_) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  quiesce(lock, session, false);
+}
+
+std::optional<json> MeshPrefetcher::take(const Session& session,
+                                         const std::string& handle,
+                                         const MeshParameters& parameters) {
+  if (!enabled_) return std::nullopt;
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::shared_ptr<MeshPrefetchJob> match;
+  auto it = jobs_.find(&session);
+  if (it != jobs_.end() && parameters.sameTessellation(parameters_)) {
+    for (const auto& job : it->second) {
+      if (job->handle == handle) match = job;
+    }
+  }
+  // A queued job has not started: the caller meshes just as fast itself.
+  if (match && match->state == MeshPrefetchJob::State::Running) {
+    changed_.wait(lock, [&] { return match->state != MeshPrefetchJob::State::Running; });
+  }
+  if (match && match->state == MeshPrefetchJob::State::Done && match->mesh) {
+    ++stats_.hits;
+    std::optional<json> mesh = match->mesh;
+    quiesce(lock, session, false);
+    return mesh;
+  }
+  quiesce(lock, session, false);
+  return std::nullopt;
+}
+
+MeshPrefetchStats MeshPrefetcher::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void MeshPrefetcher::quiesce(std::unique_lock<std::mutex>& lock, const Session& session, bool interrupt) {
+  auto it = jobs_.find(&session);
+  if (it == jobs_.end()) return;
+  const std::vector<std::shared_ptr<MeshPrefetchJob>> jobs = it->second;
+  for (const auto& job : jobs) {
+    if (job->state == MeshPrefetchJob::State::Queued) {
+      job->state = MeshPrefetchJob::State::Cancelled;
+      ++stats_.cancelled;
+    } else if (job->state == MeshPrefetchJob::State::Running && interrupt) {
+      job->interrupt = true;
+    }
+  }
+  changed_.wait(lock, [&] {
+    return std::none_of(jobs.begin(), jobs.end(), [](const std::shared_ptr<MeshPrefetchJob>& job) {
+      return job->state == MeshPrefetchJob::State::Running;
+    });
+  });
+}
+
+void MeshPrefetcher::run() {
+  // Linux applies the nice value per thread; lose to the request threads.
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (stopping_) return;
+    std::shared_ptr<MeshPrefetchJob> job = std::move(queue_.front());
+    queue_.pop_front();
+    if (job->state != MeshPrefetchJob::State::Queued) continue;
+    job->state = MeshPrefetchJob::State::Running;
+    lock.unlock();
+
+    // Built on the heap: this thread has no request arena, and the mesh
+    // outlives the exec-feature request that scheduled it.
+    std::optional<json> mesh;
+    bool failed = false;
+    try {
+      Handle(JobProgress) progress = new JobProgress(*job);
+      mesh = copyOut(meshShape(job->shape, parameters_, progress->Start()));
+    } catch (const std::exception& ex) {
+      failed = !job->interrupt.load();
+      if (failed) std::cerr << "occt_server mesh prefetch: " << job->handle << ": " << ex.what() << std::endl;
+    } catch (...) {
+      failed = !job->interrupt.load();
+    }
+
+    lock.lock();
+    if (mesh && !job->interrupt.load()) {
+      job->mesh = std::move(mesh);
+      job->state = MeshPrefetchJob::State::Done;
+    } else {
+      job->state = MeshPrefetchJob::State::Cancelled;
+      ++(failed ? stats_.failed : stats_.cancelled);
+    }
+    changed_.notify_all();
+  }
+}
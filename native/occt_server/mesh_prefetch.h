@@ -0,0 +1,87 @@
+#pragma once
+
+#include "kernel.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Speculative meshing. With TF_NATIVE_MESH_PREFETCH set to a profile name
+// ("interactive", "preview" or "export", as in src/mesh_profiles.ts) or to
+// JSON mesh options, every body /v1/exec-feature builds is queued for
+// meshing on one low-priority background thread, so the /v1/mesh that
+// usually follows finds its mesh ready.
+//
+// The mesher writes triangulations into the session's shapes, so jobs are
+// kept in step with the session's requests:
+//
+//   - the session's next exec-feature, or a restore, supersedes its jobs:
+//     queued ones are dropped and a running one stops at its next progress
+//     check (cancel);
+//   - /v1/mesh for a prefetched handle at the same tessellation takes the
+//     mesh, waiting for it if it is being built (take);
+//   - any other request that reads the session's shapes first drops its
+//     queued jobs and waits for a running one (settle).
+
+struct MeshPrefetchJob;
+
+struct MeshPrefetchStats {
+  std::uint64_t scheduled = 0;
+  std::uint64_t hits = 0;
+  std::uint64_t cancelled = 0;
+  std::uint64_t failed = 0;
+};
+
+class MeshPrefetcher {
+ public:
+  static MeshPrefetcher& instance();
+
+  bool enabled() const { return enabled_; }
+
+  // Queues the bodies a feature just built (handle and shape), superseding
+  // the session's earlier jobs. No-op when disabled.
+  void schedule(const Session& session, const std::vector<std::pair<std::string, TopoDS_Shape>>& bodies);
+
+  void cancel(const Session& session);
+  void settle(const Session& session);
+
+  // The prefetched mesh of `handle` if it was built at the same
+  // tessellation as `parameters`; otherwise settles and returns nullopt.
+  std::optional<json> take(const Session& session, const std::string& handle, const MeshParameters& parameters);
+
+  MeshPrefetchStats stats() const;
+
+ private:
+  MeshPrefetcher();
+  ~MeshPrefetcher();
+
+  void run();
+  // Drops the session's queued jobs and waits until none of them runs;
+  // with `interrupt`, a running job is cancelled instead of finished.
+  void quiesce(std::unique_lock<std::mutex>& lock, const Session& session, bool interrupt);
+
+  bool enabled_ = false;
+  MeshParameters parameters_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable changed_;
+  std::deque<std::shared_ptr<MeshPrefetchJob>> queue_;
+  // The latest feature's jobs per session, kept after they finish so the
+  // mesh can be taken.
+  std::unordered_map<const Session*, std::vector<std::shared_ptr<MeshPrefetchJob>>> jobs_;
+  MeshPrefetchStats stats_;
+  bool stopping_ = false;
+  // Started on the first job rather than at construction: worker-pool
+  // processes fork after the kernel warms up, and threads do not survive a
+  // fork.
+  std::thread worker_;
+};
@@ -0,0 +1,259 @@
+#include "pick_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr std::uint32_t kLeafSize = 4;
+
+BvhBox emptyBox() {
+  const double inf = std::numeric_limits<double>::infinity();
+  return {{inf, inf, inf}, {-inf, -inf, -inf}};
+}
+
+void growBox(BvhBox& box, const BvhBox& other) {
+  for (int axis = 0; axis < 3; ++axis) {
+    box.min[axis] = std::min(box.min[axis], other.min[axis]);
+    box.max[axis] = std::max(box.max[axis], other.max[axis]);
+  }
+}
+
+void growBox(BvhBox& box, const double* point) {
+  for (int axis = 0; axis < 3; ++axis) {
+    box.min[axis] = std::min(box.min[axis], point[axis]);
+    box.max[axis] = std::max(box.max[axis], point[axis]);
+  }
+}
+
+double dot(const double* a, const double* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void cross(const double* a, const double* b, double* out) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void subtract(const double* a, const double* b, double* out) {
+  out[0] = a[0] - b[0];
+  out[1] = a[1] - b[1];
+  out[2] = a[2] - b[2];
+}
+
+// Moller-Trumbore, two-sided: picking should hit faces seen from inside too.
+bool intersectTriangle(const double* origin, const double* direction,
+                       const double* a, const double* b, const double* c, double& t) {
+  double edge1[3];
+  double edge2[3];
+  subtract(b, a, edge1);
+  subtract(c, a, edge2);
+  double p[3];
+  cross(direction, edge2, p);
+  const double det = dot(edge1, p);
+  if (std::abs(det) < 1e-300) return false;
+  const double inverse = 1.0 / det;
+  double s[3];
+  subtract(origin, a, s);
+  const double u = dot(s, p) * inverse;
+  if (u < 0.0 || u > 1.0) return false;
+  double q[3];
+  cross(s, edge1, q);
+  const double v = dot(direction, q) * inverse;
+  if (v < 0.0 || u + v > 1.0) return false;
+  t = dot(edge2, q) * inverse;
+  return t >= 0.0;
+}
+
+// Closest approach between the ray and segment [a, b] (unit direction):
+// returns the squared distance and the ray parameter at that point.
+double raySegmentDistance2(const double* origin, const double* direction,
+                           const double* a, const double* b, double& t) {
+  double segment[3];
+  double offset[3];
+  subtract(b, a, segment);
+  subtract(origin, a, offset);
+  const double segmentLength2 = dot(segment, segment);
+  const double along = dot(direction, segment);
+  const double rayOffset = dot(direction, offset);
+  const double segmentOffset = dot(segment, offset);
+  const double denom = segmentLength2 - along * along;
+  double s = 0.0;
+  if (segmentLength2 > 0.0) {
+    // Parallel: any s is as close; take the one facing the ray origin.
+    s = denom > 1e-12 * segmentLength2
+        ? (segmentOffset - along * rayOffset) / denom
+        : segmentOffset / segmentLength2;
+    s = std::clamp(s, 0.0, 1.0);
+  }
+  t = along * s - rayOffset;
+  if (t < 0.0) {
+    // The segment is closest behind the origin: use the point of the
+    // segment nearest the origin itself.
+    t = 0.0;
+    if (segmentLength2 > 0.0) s = std::clamp(segmentOffset / segmentLength2, 0.0, 1.0);
+  }
+  double delta[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    delta[axis] = origin[axis] + direction[axis] * t - (a[axis] + segment[axis] * s);
+  }
+  return dot(delta, delta);
+}
+
+}  // namespace
+
+void Bvh::build(const std::vector<BvhBox>& boxes) {
+  nodes_.clear();
+  order_.resize(boxes.size());
+  if (boxes.empty()) return;
+  std::vector<double> centroids(boxes.size() * 3);
+  for (std::size_t index = 0; index < boxes.size(); ++index) {
+    order_[index] = static_cast<std::uint32_t>(index);
+    for (int axis = 0; axis < 3; ++axis) {
+      centroids[index * 3 + axis] = 0.5 * (boxes[index].min[axis] + boxes[index].max[axis]);
+    }
+  }
+  nodes_.reserve(2 * (boxes.size() / kLeafSize + 1));
+  nodes_.emplace_back();
+  buildNode(boxes, centroids, 0, 0, static_cast<std::uint32_t>(boxes.size()));
+}
+
+void Bvh::buildNode(const std::vector<BvhBox>& boxes,
+                    const std::vector<double>& centroids,
+                    std::uint32_t nodeIndex,
+                    std::uint32_t first,
+                    std::uint32_t count) {
+  BvhBox box = emptyBox();
+  BvhBox centroidBox = emptyBox();
+  for (std::uint32_t index = first; index < first + count; ++index) {
+    growBox(box, boxes[order_[index]]);
+    growBox(centroidBox, &centroids[order_[index] * 3]);
+  }
+  int axis = 0;
+  double widest = -1.0;
+  for (int candidate = 0; candidate < 3; ++candidate) {
+    const double extent = centroidBox.max[candidate] - centroidBox.min[candidate];
+    if (extent > widest) {
+      widest = extent;
+      axis = candidate;
+    }
+  }
+  // Nodes are addressed by index throughout: the recursion appends to nodes_.
+  nodes_[nodeIndex].box = box;
+  if (count <= kLeafSize || widest <= 0.0) {
+    nodes_[nodeIndex].first = first;
+    nodes_[nodeIndex].count = count;
+    return;
+  }
+  const std::uint32_t half = count / 2;
+  std::nth_element(order_.begin() + first, order_.begin() + first + half, order_.begin() + first + count,
+                   [&](std::uint32_t lhs, std::uint32_t rhs) {
+                     return centroids[lhs * 3 + axis] < centroids[rhs * 3 + axis];
+                   });
+  // Children are appended as a pair, so an inner node only stores the left.
+  const std::uint32_t left = static_cast<std::uint32_t>(nodes_.size());
+  nodes_[nodeIndex].first = left;
+  nodes_[nodeIndex].count = 0;
+  nodes_.emplace_back();
+  nodes_.emplace_back();
+  buildNode(boxes, centroids, left, first, half);
+  buildNode(boxes, centroids, left + 1, first + half, count - half);
+}
+
+bool Bvh::enter(const BvhBox& box, const double origin[3], const double inverse[3],
+                double inflate, double maxT, double& tEnter) {
+  double tMin = 0.0;
+  double tMax = maxT;
+  for (int axis = 0; axis < 3; ++axis) {
+    double t0 = (box.min[axis] - inflate - origin[axis]) * inverse[axis];
+    double t1 = (box.max[axis] + inflate - origin[axis]) * inverse[axis];
+    if (std::isnan(t0) || std::isnan(t1)) {
+      // Axis-parallel ray starting on a slab plane: inside iff within it.
+      if (origin[axis] < box.min[axis] - inflate || origin[axis] > box.max[axis] + inflate) return false;
+      continue;
+    }
+    if (t0 > t1) std::swap(t0, t1);
+    tMin = std::max(tMin, t0);
+    tMax = std::min(tMax, t1);
+    if (tMin > tMax) return false;
+  }
+  tEnter = tMin;
+  return true;
+}
+
+void PickMesh::build() {
+  std::vector<BvhBox> boxes(triangles.size() / 3);
+  for (std::size_t index = 0; index < boxes.size(); ++index) {
+    boxes[index] = emptyBox();
+    for (int corner = 0; corner < 3; ++corner) {
+      growBox(boxes[index], &positions[triangles[index * 3 + corner] * 3]);
+    }
+  }
+  triangleBvh.build(boxes);
+  boxes.resize(segments.size() / 6);
+  for (std::size_t index = 0; index < boxes.size(); ++index) {
+    boxes[index] = emptyBox();
+    growBox(boxes[index], &segments[index * 6]);
+    growBox(boxes[index], &segments[index * 6 + 3]);
+  }
+  segmentBvh.build(boxes);
+}
+
+PickHit pickRay(const PickMesh& mesh,
+                const double origin[3],
+                const double direction[3],
+                double maxDistance,
+                double edgeTolerance) {
+  PickHit result;
+  const double length = std::sqrt(dot(direction, direction));
+  if (!(length > 0.0) || !std::isfinite(length)) return result;
+  const double unit[3] = {direction[0] / length, direction[1] / length, direction[2] / length};
+
+  double nearest = maxDistance;
+  mesh.triangleBvh.traverse(origin, unit, nearest, 0.0, [&](std::uint32_t triangle) {
+    const std::uint32_t* corners = &mesh.triangles[triangle * 3];
+    double t = 0.0;
+    if (intersectTriangle(origin, unit, &mesh.positions[corners[0] * 3], &mesh.positions[corners[1] * 3],
+                          &mesh.positions[corners[2] * 3], t) &&
+        t <= nearest) {
+      nearest = t;
+      result.hit = true;
+      result.face = static_cast<int>(mesh.triangleFace[triangle]);
+    }
+    return nearest;
+  });
+
+  if (edgeTolerance > 0.0 && !mesh.segmentEdge.empty()) {
+    // An edge on the silhouette of the hit face lies slightly behind the hit
+    // point, so edges count up to one tolerance past it.
+    const double edgeLimit = result.hit ? nearest + edgeTolerance : maxDistance;
+    const double tolerance2 = edgeTolerance * edgeTolerance;
+    double bestDistance2 = tolerance2;
+    double edgeT = 0.0;
+    mesh.segmentBvh.traverse(origin, unit, edgeLimit, edgeTolerance, [&](std::uint32_t segment) {
+      double t = 0.0;
+      const double distance2 = raySegmentDistance2(origin, unit, &mesh.segments[segment * 6],
+                                                   &mesh.segments[segment * 6 + 3], t);
+      if (distance2 <= bestDistance2 && t <= edgeLimit) {
+        bestDistance2 = distance2;
+        result.edge = static_cast<int>(mesh.segmentEdge[segment]);
+        edgeT = t;
+      }
+      return edgeLimit;
+    });
+    if (result.edge >= 0 && !result.hit) {
+      result.hit = true;
+      nearest = edgeT;
+    }
+  }
+
+  if (result.hit) {
+    result.distance = nearest;
+    for (int axis = 0; axis < 3; ++axis) {
+      result.point[axis] = origin[axis] + unit[axis] * nearest;
+    }
+  }
+  return result;
+}
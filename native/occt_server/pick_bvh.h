@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Ray picking over a shape's triangulation, independent of OCCT: kernel.cpp
+// flattens the faces' triangles and the edges' polylines into a PickMesh
+// once, and every /v1/pick ray then walks a bounding volume hierarchy
+// instead of testing each triangle.
+
+struct BvhBox {
+  double min[3];
+  double max[3];
+};
+
+// Binary AABB hierarchy over primitive boxes, split at the median of the
+// centroids along the widest axis (cheap to build, good enough for the
+// near-uniform triangles a mesher produces).
+class Bvh {
+ public:
+  void build(const std::vector<BvhBox>& boxes);
+
+  // Calls visit(primitive) for every primitive whose box (grown by `inflate`
+  // on each side) the ray enters at t <= maxT, visiting the nearer child
+  // first. visit returns the new maxT, so subtrees behind a closer hit are
+  // skipped. `direction` need not be normalised; t is in its units.
+  template <typename Visit>
+  void traverse(const double origin[3], const double direction[3], double maxT, double inflate,
+                Visit visit) const;
+
+  std::size_t nodeCount() const { return nodes_.size(); }
+
+ private:
+  struct Node {
+    BvhBox box;
+    std::uint32_t first = 0;  // leaf: first index into order_; inner: left child
+    std::uint32_t count = 0;  // leaf primitive count, 0 for inner nodes
+  };
+
+  void buildNode(const std::vector<BvhBox>& boxes,
+                 const std::vector<double>& centroids,
+                 std::uint32_t nodeIndex,
+                 std::uint32_t first,
+                 std::uint32_t count);
+  static bool enter(const BvhBox& box, const double origin[3], const double inverse[3],
+                    double inflate, double maxT, double& tEnter);
+
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> order_;
+};
+
+struct PickMesh {
+  std::vector<double> positions;        // xyz per node
+  std::vector<std::uint32_t> triangles;  // three node indices per triangle
+  std::vector<std::uint32_t> triangleFace;
+  std::vector<double> segments;         // two xyz points per edge segment
+  std::vector<std::uint32_t> segmentEdge;
+  Bvh triangleBvh;
+  Bvh segmentBvh;
+
+  // Builds both hierarchies; call once the arrays are filled.
+  void build();
+};
+
+struct PickHit {
+  bool hit = false;
+  int face = -1;  // index into the caller's face list
+  int edge = -1;  // set when an edge passes within the edge tolerance
+  double distance = 0.0;
+  double point[3] = {0.0, 0.0, 0.0};
+};
+
+// Nearest triangle along the ray within maxDistance (`direction` is
+// normalised here). With edgeTolerance > 0, an edge segment passing within
+// that distance of the ray, and not behind the hit face, wins over the face;
+// an edge alone (e.g. a wire with no faces) is also a hit.
+PickHit pickRay(const PickMesh& mesh,
+                const double origin[3],
+                const double direction[3],
+                double maxDistance,
+                double edgeTolerance);
+
+template <typename Visit>
+void Bvh::traverse(const double origin[3], const double direction[3], double maxT, double inflate,
+                   Visit visit) const {
+  if (nodes_.empty()) return;
+  double inverse[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    inverse[axis] = 1.0 / direction[axis];  // +-inf for axis-parallel rays is what the slab test wants
+  }
+  std::uint32_t stack[64];
+  int top = 0;
+  double tEnter = 0.0;
+  if (!enter(nodes_[0].box, origin, inverse, inflate, maxT, tEnter)) return;
+  stack[top++] = 0;
+  while (top > 0) {
+    const Node& node = nodes_[stack[--top]];
+    if (!enter(node.box, origin, inverse, inflate, maxT, tEnter)) continue;
+    if (node.count > 0) {
+      for (std::uint32_t index = node.first; index < node.first + node.count; ++index) {
+        maxT = visit(order_[index]);
+      }
+      continue;
+    }
+    double tLeft = 0.0;
+    double tRight = 0.0;
+    const bool left = enter(nodes_[node.first].box, origin, inverse, inflate, maxT, tLeft);
+    const bool right = enter(nodes_[node.first + 1].box, origin, inverse, inflate, maxT, tRight);
+    // Push the farther child first so the nearer one is visited next.
+    if (left && right) {
+      const bool leftFirst = tLeft <= tRight;
+      stack[top++] = leftFirst ? node.first + 1 : node.first;
+      stack[top++] = leftFirst ? node.first : node.first + 1;
+    } else if (left) {
+      stack[top++] = node.first;
+    } else if (right) {
+      stack[top++] = node.first + 1;
+    }
+  }
+}
@@ -0,0 +1,259 @@
+#include "httplib.h"
+#include "json.hpp"
+#include "request_log.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Replays a request log recorded with TF_NATIVE_RECORD_FILE against a running
+// occt_server and reports throughput and latency percentiles per route.
+//
+// Requests of one session are always sent in log order by the same worker, so
+// session state builds up exactly as it did when recorded; different sessions
+// run in parallel across --concurrency workers.
+
+using json = nlohmann::json;
+
+namespace {
+
+struct ReplayOptions {
+  std::string logPath;
+  std::string url = "http://127.0.0.1:8081";
+  int concurrency = 4;
+  double speed = 1.0;
+  int copies = 1;
+  std::string sessionPrefix;
+  std::unordered_map<std::string, std::string> sessionMap;
+  std::string jsonOut;
+};
+
+struct ReplayTask {
+  const RecordedRequest* record = nullptr;
+  std::string sessionId;
+  std::string path;
+  std::string body;
+  double offsetMs = 0.0;
+};
+
+struct RouteStats {
+  std::vector<double> latenciesMs;
+  std::size_t errors = 0;
+  std::size_t statusMismatches = 0;
+};
+
+void usage() {
+  std::cerr << "usage: occt_replay <log> [--url <base-url>] [--concurrency <n>] [--speed <factor>]\n"
+               "                   [--copies <n>] [--session-prefix <prefix>] [--session-map <old>=<new>]\n"
+               "                   [--json <file>]\n"
+               "  --speed 0 sends requests back to back; 2 replays at twice the recorded rate.\n"
+               "  --copies runs n concurrent copies of the log, each in its own session namespace."
+            << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, ReplayOptions& options) {
+  for (int index = 1; index < argc; ++index) {
+    const std::string arg = argv[index];
+    const bool hasValue = index + 1 < argc;
+    if (arg == "--url" && hasValue) {
+      options.url = argv[++index];
+    } else if (arg == "--concurrency" && hasValue) {
+      options.concurrency = std::max(1, std::stoi(argv[++index]));
+    } else if (arg == "--speed" && hasValue) {
+      options.speed = std::max(0.0, std::stod(argv[++index]));
+    } else if (arg == "--copies" && hasValue) {
+      options.copies = std::max(1, std::stoi(argv[++index]));
+    } else if (arg == "--session-prefix" && hasValue) {
+      options.sessionPrefix = argv[++index];
+    } else if (arg == "--session-map" && hasValue) {
+      const std::string mapping = argv[++index];
+      const std::size_t split = mapping.find('=');
+      if (split == std::string::npos) return false;
+      options.sessionMap[mapping.substr(0, split)] = mapping.substr(split + 1);
+    } else if (arg == "--json" && hasValue) {
+      options.jsonOut = argv[++index];
+    } else if (!arg.empty() && arg[0] != '-' && options.logPath.empty()) {
+      options.logPath = arg;
+    } else {
+      return false;
+    }
+  }
+  return !options.logPath.empty();
+}
+
+std::string remapSession(const ReplayOptions& options, const std::string& sessionId, int copy) {
+  auto it = options.sessionMap.find(sessionId);
+  std::string mapped = it != options.sessionMap.end() ? it->second : options.sessionPrefix + sessionId;
+  if (options.copies > 1) mapped = "copy" + std::to_string(copy) + "-" + mapped;
+  return mapped;
+}
+
+// /v1/sessions/{id}/... carries the session in the path and a binary body;
+// everything else carries it in the JSON body.
+std::string rewritePath(const std::string& path, const std::string& to) {
+  const std::string from = sessionIdFromPath(path);
+  if (from.empty() || from == to) return path;
+  static const std::string kPrefix = "/v1/sessions/";
+  return kPrefix + to + path.substr(kPrefix.size() + from.size());
+}
+
+std::string rewriteBody(const std::string& path, const std::string& body, const std::string& from,
+                        const std::string& to) {
+  if (from == to || body.empty() || !sessionIdFromPath(path).empty()) return body;
+  json payload = json::parse(body, nullptr, false);
+  if (!payload.is_object()) return body;
+  payload["sessionId"] = to;
+  return payload.dump();
+}
+
+double percentile(std::vector<double> values, double pct) {
+  if (values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  const double rank = pct / 100.0 * static_cast<double>(values.size());
+  std::size_t index = rank <= 1.0 ? 0 : static_cast<std::size_t>(std::ceil(rank)) - 1;
+  return values[std::min(index, values.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ReplayOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage();
+    return 2;
+  }
+
+  std::vector<RecordedRequest> records;
+  {
+    std::ifstream input(options.logPath, std::ios::binary);
+    if (!input) {
+      std::cerr << "cannot open " << options.logPath << std::endl;
+      return 1;
+    }
+    RecordedRequest record;
+    while (readRecordedRequest(input, record)) records.push_back(record);
+  }
+  if (records.empty()) {
+    std::cerr << "no requests in " << options.logPath << std::endl;
+    return 1;
+  }
+  const std::int64_t firstMs = records.front().startMs;
+
+  std::vector<std::vector<ReplayTask>> queues(static_cast<std::size_t>(options.concurrency));
+  for (int copy = 0; copy < options.copies; ++copy) {
+    for (const auto& record : records) {
+      ReplayTask task;
+      task.record = &record;
+      task.sessionId = remapSession(options, record.sessionId, copy);
+      task.path = rewritePath(record.path, task.sessionId);
+      task.body = rewriteBody(record.path, record.body, record.sessionId, task.sessionId);
+      task.offsetMs = options.speed > 0.0
+          ? static_cast<double>(record.startMs - firstMs) / options.speed
+          : 0.0;
+      const std::size_t worker = std::hash<std::string>{}(task.sessionId) % queues.size();
+      queues[worker].push_back(std::move(task));
+    }
+  }
+  for (auto& queue : queues) {
+    std::stable_sort(queue.begin(), queue.end(), [](const ReplayTask& a, const ReplayTask& b) {
+      return a.offsetMs < b.offsetMs;
+    });
+  }
+
+  std::mutex statsMutex;
+  std::map<std::string, RouteStats> stats;
+  std::vector<double> lagsMs;
+  std::atomic<std::size_t> sent{0};
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (auto& queue : queues) {
+    workers.emplace_back([&, queuePtr = &queue] {
+      httplib::Client client(options.url);
+      client.set_keep_alive(true);
+      client.set_tcp_nodelay(true);
+      client.set_connection_timeout(10, 0);
+      client.set_read_timeout(600, 0);
+      client.set_write_timeout(600, 0);
+      for (const auto& task : *queuePtr) {
+        const auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                     std::chrono::duration<double, std::milli>(task.offsetMs));
+        if (options.speed > 0.0) std::this_thread::sleep_until(due);
+        const auto sendAt = std::chrono::steady_clock::now();
+        const RecordedRequest& record = *task.record;
+        httplib::Result result = record.method == "GET"
+            ? client.Get(task.path)
+            : client.Post(task.path, task.body, record.contentType);
+        const auto doneAt = std::chrono::steady_clock::now();
+        const double latencyMs = std::chrono::duration<double, std::milli>(doneAt - sendAt).count();
+        const double lagMs = std::chrono::duration<double, std::milli>(sendAt - due).count();
+        const int status = result ? result->status : 0;
+        ++sent;
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        RouteStats& route = stats[record.method + " " + record.path];
+        route.latenciesMs.push_back(latencyMs);
+        if (status < 200 || status >= 300) ++route.errors;
+        if (record.status != 0 && status != record.status) ++route.statusMismatches;
+        if (options.speed > 0.0) lagsMs.push_back(std::max(0.0, lagMs));
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  const double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  json report;
+  report["requests"] = sent.load();
+  report["elapsedSeconds"] = elapsedS;
+  report["throughputRps"] = elapsedS > 0 ? static_cast<double>(sent.load()) / elapsedS : 0.0;
+  report["scheduleLagP99Ms"] = percentile(lagsMs, 99);
+  report["routes"] = json::object();
+
+  std::printf("%-32s %8s %8s %9s %9s %9s %9s %7s %9s\n",
+              "route", "count", "rps", "p50 ms", "p95 ms", "p99 ms", "max ms", "errors", "mismatch");
+  for (const auto& entry : stats) {
+    const RouteStats& route = entry.second;
+    const double p50 = percentile(route.latenciesMs, 50);
+    const double p95 = percentile(route.latenciesMs, 95);
+    const double p99 = percentile(route.latenciesMs, 99);
+    const double max = percentile(route.latenciesMs, 100);
+    const double rps = elapsedS > 0 ? static_cast<double>(route.latenciesMs.size()) / elapsedS : 0.0;
+    std::printf("%-32s %8zu %8.1f %9.2f %9.2f %9.2f %9.2f %7zu %9zu\n",
+                entry.first.c_str(), route.latenciesMs.size(), rps, p50, p95, p99, max,
+                route.errors, route.statusMismatches);
+    report["routes"][entry.first] = {
+        {"count", route.latenciesMs.size()},
+        {"throughputRps", rps},
+        {"p50Ms", p50},
+        {"p95Ms", p95},
+        {"p99Ms", p99},
+        {"maxMs", max},
+        {"errors", route.errors},
+        {"statusMismatches", route.statusMismatches},
+    };
+  }
+  std::printf("total %zu requests in %.2f s (%.1f req/s)\n",
+              sent.load(), elapsedS, report["throughputRps"].get<double>());
+  if (options.speed > 0.0) {
+    std::printf("schedule lag p99 %.2f ms (high lag means --concurrency is too low to keep pace)\n",
+                report["scheduleLagP99Ms"].get<double>());
+  }
+
+  if (!options.jsonOut.empty()) {
+    std::ofstream out(options.jsonOut, std::ios::binary | std::ios::trunc);
+    out << report.dump(2) << "\n";
+  }
+  return 0;
+}
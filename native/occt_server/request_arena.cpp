@@ -0,0 +1,106 @@
+#include "request_arena.h"
+
+#include "env.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+constexpr std::size_t kInitialBlockBytes = 64 * 1024;
+constexpr std::size_t kMaxBlockBytes = 8 * 1024 * 1024;
+// Largest block a thread keeps between requests.
+constexpr std::size_t kRetainedBlockBytes = 4 * 1024 * 1024;
+
+thread_local RequestArena* tlActiveArena = nullptr;
+
+bool arenasEnabled() {
+  static const bool enabled = envString("TF_NATIVE_REQUEST_ARENA", "1") != "0";
+  return enabled;
+}
+
+RequestArena& threadArena() {
+  static thread_local RequestArena arena;
+  return arena;
+}
+
+}  // namespace
+
+RequestArena::~RequestArena() {
+  for (const Block& block : blocks_) ::operator delete(block.begin);
+}
+
+RequestArena* RequestArena::active() { return tlActiveArena; }
+
+bool RequestArena::owns(const void* ptr) const {
+  const char* address = static_cast<const char*>(ptr);
+  for (const Block& block : blocks_) {
+    if (address >= block.begin && address < block.end) return true;
+  }
+  return false;
+}
+
+void RequestArena::addBlock(std::size_t minBytes) {
+  if (nextBlockBytes_ == 0) nextBlockBytes_ = kInitialBlockBytes;
+  const std::size_t size = std::max(minBytes, nextBlockBytes_);
+  nextBlockBytes_ = std::min(kMaxBlockBytes, nextBlockBytes_ * 2);
+  char* data = static_cast<char*>(::operator new(size));
+  blocks_.push_back({data, data + size});
+  cursor_ = data;
+  limit_ = data + size;
+}
+
+void* RequestArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  if (bytes == 0) bytes = 1;
+  const auto aligned = [&](char* at) {
+    const std::uintptr_t value = reinterpret_cast<std::uintptr_t>(at);
+    return at + ((alignment - value % alignment) % alignment);
+  };
+  char* start = cursor_ ? aligned(cursor_) : nullptr;
+  if (!start || start + bytes > limit_) {
+    addBlock(bytes + alignment);
+    start = aligned(cursor_);
+  }
+  cursor_ = start + bytes;
+  allocated_ += bytes;
+  return start;
+}
+
+void RequestArena::do_deallocate(void* ptr, std::size_t bytes, std::size_t) {
+  // Undo the most recent allocation so a growing vector can reuse its space.
+  if (static_cast<char*>(ptr) + bytes == cursor_) cursor_ = static_cast<char*>(ptr);
+}
+
+void RequestArena::release() {
+  Block keep = {nullptr, nullptr};
+  for (const Block& block : blocks_) {
+    const std::size_t size = static_cast<std::size_t>(block.end - block.begin);
+    if (size <= kRetainedBlockBytes && size > static_cast<std::size_t>(keep.end - keep.begin)) keep = block;
+  }
+  for (const Block& block : blocks_) {
+    if (block.begin != keep.begin) ::operator delete(block.begin);
+  }
+  blocks_.clear();
+  if (keep.begin) blocks_.push_back(keep);
+  cursor_ = keep.begin;
+  limit_ = keep.end;
+  allocated_ = 0;
+  nextBlockBytes_ = std::max(kInitialBlockBytes, static_cast<std::size_t>(keep.end - keep.begin));
+}
+
+ScopedRequestArena::ScopedRequestArena() {
+  if (!arenasEnabled() || tlActiveArena) return;
+  arena_ = &threadArena();
+  tlActiveArena = arena_;
+}
+
+ScopedRequestArena::~ScopedRequestArena() {
+  if (!arena_) return;
+  tlActiveArena = nullptr;
+  arena_->release();
+}
+
+std::pmr::memory_resource* requestResource() {
+  if (RequestArena* arena = RequestArena::active()) return arena;
+  return std::pmr::get_default_resource();
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "json.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Request-scoped monotonic arena. While a ScopedRequestArena is alive on a
+// thread, RequestJson values and KernelResult containers built with the arena
+// as their memory resource bump-allocate from it; individual frees are no-ops
+// (except undoing the most recent allocation) and everything is released at
+// once when the request ends. Each thread keeps one block between requests so
+// steady-state requests do not touch malloc for their transient DOMs.
+//
+// Nothing allocated from the arena may outlive the request: data that goes
+// into the session is copied out first (`copyOut`, or copy-constructing a
+// KernelResult, which always lands on the default heap resource).
+
+class RequestArena : public std::pmr::memory_resource {
+ public:
+  RequestArena() = default;
+  ~RequestArena() override;
+
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
+
+  // The arena of the request running on this thread, if any.
+  static RequestArena* active();
+
+  bool owns(const void* ptr) const;
+  std::size_t bytesAllocated() const { return allocated_; }
+
+  // Frees every block except one to reuse for the next request.
+  void release();
+
+ protected:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ private:
+  struct Block {
+    char* begin;
+    char* end;
+  };
+
+  void addBlock(std::size_t minBytes);
+
+  std::vector<Block> blocks_;
+  char* cursor_ = nullptr;
+  char* limit_ = nullptr;
+  std::size_t allocated_ = 0;
+  std::size_t nextBlockBytes_ = 0;
+
+  friend class ScopedRequestArena;
+};
+
+// Activates the calling thread's arena for one request. Disabled with
+// TF_NATIVE_REQUEST_ARENA=0; nested scopes reuse the outer arena.
+class ScopedRequestArena {
+ public:
+  ScopedRequestArena();
+  ~ScopedRequestArena();
+
+  ScopedRequestArena(const ScopedRequestArena&) = delete;
+  ScopedRequestArena& operator=(const ScopedRequestArena&) = delete;
+
+  std::size_t bytesAllocated() const { return arena_ ? arena_->bytesAllocated() : 0; }
+
+ private:
+  RequestArena* arena_ = nullptr;
+};
+
+// Memory resource for transient pmr containers: the active arena, or the
+// default heap resource outside a request or when arenas are disabled.
+std::pmr::memory_resource* requestResource();
+
+// Stateless allocator for RequestJson: allocates from the active arena, or
+// from the heap when no request is running.
+template <class T>
+struct ArenaAllocator {
+  using value_type = T;
+
+  ArenaAllocator() noexcept = default;
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t count) {
+    if (RequestArena* arena = RequestArena::active()) {
+      return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+    return std::allocator<T>().allocate(count);
+  }
+
+  void deallocate(T* ptr, std::size_t count) noexcept {
+    RequestArena* arena = RequestArena::active();
+    if (arena && arena->owns(ptr)) {
+      arena->deallocate(ptr, count * sizeof(T), alignof(T));
+      return;
+    }
+    std::allocator<T>().deallocate(ptr, count);
+  }
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) noexcept { return true; }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) noexcept { return false; }
+
+// JSON DOM for request bodies and responses. Object and array storage lives in
+// the request arena; strings longer than the SSO buffer still use the heap.
+using RequestJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t,
+                                         std::uint64_t, double, ArenaAllocator>;
+
+// Deep copy onto the heap for values that outlive the request.
+inline nlohmann::json copyOut(const RequestJson& value) { return nlohmann::json(value); }
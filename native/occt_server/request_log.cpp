@@ -0,0 +1,67 @@
+#include "request_log.h"
+
+#include "env.h"
+#include "json.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+bool readRecordedRequest(std::istream& input, RecordedRequest& record) {
+  std::string header;
+  while (header.empty()) {
+    if (!std::getline(input, header)) return false;
+  }
+  const json meta = json::parse(header);
+  record.startMs = meta.value("ts", static_cast<std::int64_t>(0));
+  record.method = meta.value("m", "POST");
+  record.path = meta.value("p", "");
+  record.sessionId = meta.value("s", "");
+  record.durationMs = meta.value("d", 0.0);
+  record.status = meta.value("st", 0);
+  record.contentType = meta.value("c", "application/json");
+  const std::size_t size = meta.value("n", static_cast<std::size_t>(0));
+  record.body.assign(size, '\0');
+  if (size > 0 && !input.read(&record.body[0], static_cast<std::streamsize>(size))) {
+    throw std::runtime_error("Truncated request log record for " + record.path);
+  }
+  if (input.peek() == '\n') input.get();
+  return true;
+}
+
+RequestRecorder& RequestRecorder::instance() {
+  static RequestRecorder recorder;
+  return recorder;
+}
+
+RequestRecorder::RequestRecorder() {
+  const std::string path = envString("TF_NATIVE_RECORD_FILE", "");
+  if (path.empty()) return;
+  out_.open(path, std::ios::binary | std::ios::app);
+  if (!out_) {
+    std::cerr << "occt_server record: cannot open " << path << std::endl;
+    return;
+  }
+  enabled_ = true;
+}
+
+void RequestRecorder::append(const RecordedRequest& record) {
+  if (!enabled_) return;
+  json meta = {
+      {"ts", record.startMs},
+      {"m", record.method},
+      {"p", record.path},
+      {"s", record.sessionId},
+      {"d", record.durationMs},
+      {"st", record.status},
+      {"n", record.body.size()},
+  };
+  if (!record.contentType.empty() && record.contentType != "application/json") meta["c"] = record.contentType;
+  const std::string header = meta.dump();
+  std::lock_guard<std::mutex> lock(mutex_);
+  out_ << header << '\n';
+  out_.write(record.body.data(), static_cast<std::streamsize>(record.body.size()));
+  out_ << '\n';
+  out_.flush();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+
+// Request recording. With TF_NATIVE_RECORD_FILE set, occt_server appends every
+// request to a compact log that occt_replay can play back. Each record is a
+// one-line JSON header followed by the raw body and a newline:
+//
+//   {"ts":1760000000123,"m":"POST","p":"/v1/mesh","s":"abc","d":12.5,"st":200,"n":57}
+//   <57 body bytes>
+//
+// `ts` is the unix start time in ms, `d` the handling time in ms, `st` the
+// response status and `n` the body length in bytes. `c`, the request's
+// Content-Type, is left out for JSON bodies.
+
+struct RecordedRequest {
+  std::int64_t startMs = 0;
+  std::string method;
+  std::string path;
+  std::string sessionId;
+  double durationMs = 0.0;
+  int status = 0;
+  std::string contentType = "application/json";
+  std::string body;
+};
+
+// Reads the next record; returns false at end of input. Throws on a corrupt log.
+bool readRecordedRequest(std::istream& input, RecordedRequest& record);
+
+class RequestRecorder {
+ public:
+  static RequestRecorder& instance();
+
+  bool enabled() const { return enabled_; }
+  void append(const RecordedRequest& record);
+
+ private:
+  RequestRecorder();
+
+  bool enabled_ = false;
+  std::mutex mutex_;
+  std::ofstream out_;
+};
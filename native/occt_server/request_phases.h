@@ -0,0 +1,132 @@
+#pragma once
+
+#include "alloc_stats.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Per-request phase timings. A handler activates a RequestPhases for the
+// duration of the request; ScopedPhase blocks anywhere below it add their
+// elapsed time under a phase name. Repeated phases (e.g. several selector
+// resolutions) are summed, and a phase nested inside itself is counted once.
+// When no request is active the scopes do nothing. Each phase also records
+// the allocations made on the handling thread while it was open.
+
+struct RequestPhase {
+  const char* name = "";
+  double ms = 0.0;
+  int count = 0;
+  AllocTally allocs;
+};
+
+class RequestPhases {
+ public:
+  static RequestPhases*& active() {
+    static thread_local RequestPhases* current = nullptr;
+    return current;
+  }
+
+  void add(const char* name, double ms, const AllocTally& allocs = {}) {
+    for (auto& phase : phases_) {
+      if (std::strcmp(phase.name, name) == 0) {
+        phase.ms += ms;
+        phase.count += 1;
+        phase.allocs.allocations += allocs.allocations;
+        phase.allocs.bytes += allocs.bytes;
+        phase.allocs.frees += allocs.frees;
+        return;
+      }
+    }
+    phases_.push_back({name, ms, 1, allocs});
+  }
+
+  bool isOpen(const char* name) const {
+    for (const char* open : open_) {
+      if (std::strcmp(open, name) == 0) return true;
+    }
+    return false;
+  }
+
+  void open(const char* name) { open_.push_back(name); }
+  void close() { open_.pop_back(); }
+
+  const std::vector<RequestPhase>& phases() const { return phases_; }
+
+  // Server-Timing header value, e.g. `parse;dur=0.41, mesh;dur=12.3, total;dur=13.0`.
+  // With allocation counting each entry also carries
+  // `desc="allocs=<n> bytes=<n>"`.
+  std::string serverTiming(double totalMs, const AllocTally& totalAllocs = {}) const {
+    std::string out;
+    for (const auto& phase : phases_) {
+      appendTiming(out, phase.name, phase.ms, phase.allocs);
+      out += ", ";
+    }
+    appendTiming(out, "total", totalMs, totalAllocs);
+    return out;
+  }
+
+ private:
+  static void appendTiming(std::string& out, const char* name, double ms, const AllocTally& allocs) {
+    char buffer[96];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", ms);
+    out += name;
+    out += ";dur=";
+    out += buffer;
+    if (allocationCountingEnabled()) {
+      std::snprintf(buffer, sizeof(buffer), ";desc=\"allocs=%llu bytes=%llu\"",
+                    static_cast<unsigned long long>(allocs.allocations),
+                    static_cast<unsigned long long>(allocs.bytes));
+      out += buffer;
+    }
+  }
+
+  std::vector<RequestPhase> phases_;
+  std::vector<const char*> open_;
+};
+
+class ScopedRequestPhases {
+ public:
+  explicit ScopedRequestPhases(RequestPhases& phases)
+      : previous_(RequestPhases::active()) {
+    RequestPhases::active() = &phases;
+  }
+  ~ScopedRequestPhases() { RequestPhases::active() = previous_; }
+
+  ScopedRequestPhases(const ScopedRequestPhases&) = delete;
+  ScopedRequestPhases& operator=(const ScopedRequestPhases&) = delete;
+
+ private:
+  RequestPhases* previous_;
+};
+
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const char* name) : name_(name) {
+    RequestPhases* phases = RequestPhases::active();
+    if (!phases || phases->isOpen(name)) return;
+    phases_ = phases;
+    phases_->open(name);
+    allocs_ = threadAllocTally();
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  ~ScopedPhase() {
+    if (!phases_) return;
+    phases_->close();
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    phases_->add(name_, std::chrono::duration<double, std::milli>(elapsed).count(),
+                 threadAllocTally() - allocs_);
+  }
+
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+ private:
+  const char* name_;
+  RequestPhases* phases_ = nullptr;
+  AllocTally allocs_;
+  std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,450 @@
+#include "selection_ids.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+using json = nlohmann::json;
+
+// Number(value.toFixed(6)). printf rounds exact ties to even where toFixed
+// rounds them away from zero; a tie at six decimals means an odd multiple of
+// 1/128, so those are rounded by hand.
+double roundToFixed6(double value) {
+  const double magnitude = std::fabs(value);
+  if (magnitude >= 1e21) return value;
+  char buffer[64];
+  const double scaled = magnitude * 128.0;
+  double rounded = 0.0;
+  if (scaled == std::floor(scaled) && std::fmod(scaled, 2.0) == 1.0) {
+    std::snprintf(buffer, sizeof(buffer), "%.7f", magnitude);  // exact, ends in 5
+    std::string text(buffer);
+    text.pop_back();
+    int index = static_cast<int>(text.size()) - 1;
+    for (; index >= 0; --index) {
+      if (text[index] == '.') continue;
+      if (text[index] != '9') {
+        ++text[index];
+        break;
+      }
+      text[index] = '0';
+    }
+    if (index < 0) text.insert(0, "1");
+    rounded = std::strtod(text.c_str(), nullptr);
+  } else {
+    std::snprintf(buffer, sizeof(buffer), "%.6f", magnitude);
+    rounded = std::strtod(buffer, nullptr);
+  }
+  return value < 0.0 ? -rounded : rounded;
+}
+
+namespace {
+
+const json& undefinedValue() {
+  static const json value(json::value_t::discarded);
+  return value;
+}
+
+const json& member(const json& meta, const char* key) {
+  if (!meta.is_object()) return undefinedValue();
+  auto it = meta.find(key);
+  return it == meta.end() ? undefinedValue() : *it;
+}
+
+// Decodes the UTF-8 code point at `offset`; a malformed byte decodes as
+// U+FFFD on its own.
+char32_t decodeUtf8(const std::string& text, std::size_t offset, std::size_t& length) {
+  const unsigned char lead = static_cast<unsigned char>(text[offset]);
+  std::size_t count = 0;
+  char32_t point = 0;
+  if (lead < 0x80) {
+    length = 1;
+    return lead;
+  } else if ((lead & 0xE0) == 0xC0) {
+    count = 1;
+    point = lead & 0x1F;
+  } else if ((lead & 0xF0) == 0xE0) {
+    count = 2;
+    point = lead & 0x0F;
+  } else if ((lead & 0xF8) == 0xF0) {
+    count = 3;
+    point = lead & 0x07;
+  } else {
+    length = 1;
+    return 0xFFFD;
+  }
+  if (offset + count >= text.size()) {
+    length = 1;
+    return 0xFFFD;
+  }
+  for (std::size_t index = 1; index <= count; ++index) {
+    const unsigned char next = static_cast<unsigned char>(text[offset + index]);
+    if ((next & 0xC0) != 0x80) {
+      length = 1;
+      return 0xFFFD;
+    }
+    point = (point << 6) | (next & 0x3F);
+  }
+  length = count + 1;
+  return point;
+}
+
+std::u16string toUtf16(const std::string& text) {
+  std::u16string units;
+  units.reserve(text.size());
+  for (std::size_t offset = 0; offset < text.size();) {
+    std::size_t length = 1;
+    const char32_t point = decodeUtf8(text, offset, length);
+    offset += length;
+    if (point < 0x10000) {
+      units.push_back(static_cast<char16_t>(point));
+    } else {
+      units.push_back(static_cast<char16_t>(0xD800 + ((point - 0x10000) >> 10)));
+      units.push_back(static_cast<char16_t>(0xDC00 + ((point - 0x10000) & 0x3FF)));
+    }
+  }
+  return units;
+}
+
+// Array#sort without a comparator orders by UTF-16 code units.
+bool utf16Less(const std::string& lhs, const std::string& rhs) {
+  return toUtf16(lhs) < toUtf16(rhs);
+}
+
+// String#trim's WhiteSpace and LineTerminator code points.
+bool isJsWhitespace(char32_t point) {
+  switch (point) {
+    case 0x09: case 0x0A: case 0x0B: case 0x0C: case 0x0D: case 0x20:
+    case 0xA0: case 0x1680: case 0x2028: case 0x2029: case 0x202F:
+    case 0x205F: case 0x3000: case 0xFEFF:
+      return true;
+    default:
+      return point >= 0x2000 && point <= 0x200A;
+  }
+}
+
+std::string jsTrim(const std::string& text) {
+  std::size_t begin = 0;
+  while (begin < text.size()) {
+    std::size_t length = 1;
+    if (!isJsWhitespace(decodeUtf8(text, begin, length))) break;
+    begin += length;
+  }
+  std::size_t end = text.size();
+  while (end > begin) {
+    std::size_t start = end - 1;
+    while (start > begin && (static_cast<unsigned char>(text[start]) & 0xC0) == 0x80) --start;
+    std::size_t length = 1;
+    const char32_t point = decodeUtf8(text, start, length);
+    if (start + length != end || !isJsWhitespace(point)) break;
+    end = start;
+  }
+  return text.substr(begin, end - begin);
+}
+
+// JSON.stringify of a string.
+std::string quoteString(const std::string& text) {
+  static const char* hex = "0123456789abcdef";
+  std::string out = "\"";
+  for (const char ch : text) {
+    const unsigned char byte = static_cast<unsigned char>(ch);
+    switch (ch) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (byte < 0x20) {
+          out += "\\u00";
+          out += hex[byte >> 4];
+          out += hex[byte & 0x0F];
+        } else {
+          out += ch;
+        }
+    }
+  }
+  out += '"';
+  return out;
+}
+
+// Number#toString: the shortest digits that read back as `value`, laid out
+// per ECMA-262 Number::toString.
+std::string jsNumber(double value) {
+  if (!std::isfinite(value)) return "null";
+  if (value == 0.0) return "0";
+  char buffer[40];
+  for (int precision = 1; precision <= 17; ++precision) {
+    std::snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+    if (std::strtod(buffer, nullptr) == value) break;
+  }
+  const std::string text(buffer);
+  const std::size_t exponentAt = text.find('e');
+  std::string digits;
+  for (std::size_t index = 0; index < exponentAt; ++index) {
+    if (text[index] >= '0' && text[index] <= '9') digits += text[index];
+  }
+  while (digits.size() > 1 && digits.back() == '0') digits.pop_back();
+  const int k = static_cast<int>(digits.size());
+  const int n = std::atoi(text.c_str() + exponentAt + 1) + 1;
+  std::string out = value < 0.0 ? "-" : "";
+  if (k <= n && n <= 21) {
+    out += digits + std::string(static_cast<std::size_t>(n - k), '0');
+  } else if (0 < n && n <= 21) {
+    out += digits.substr(0, static_cast<std::size_t>(n)) + "." + digits.substr(static_cast<std::size_t>(n));
+  } else if (-6 < n && n <= 0) {
+    out += "0." + std::string(static_cast<std::size_t>(-n), '0') + digits;
+  } else {
+    out += digits.substr(0, 1);
+    if (k > 1) out += "." + digits.substr(1);
+    out += n - 1 >= 0 ? "e+" : "e-";
+    out += std::to_string(std::abs(n - 1));
+  }
+  return out;
+}
+
+bool isFiniteNumber(const json& value) {
+  return value.is_number() && std::isfinite(value.get<double>());
+}
+
+json stringFingerprint(const json& value) {
+  if (!value.is_string()) return undefinedValue();
+  std::string trimmed = jsTrim(value.get_ref<const std::string&>());
+  return trimmed.empty() ? undefinedValue() : json(std::move(trimmed));
+}
+
+json stringArrayFingerprint(const json& value) {
+  if (!value.is_array()) return undefinedValue();
+  std::vector<std::string> entries;
+  for (const json& entry : value) {
+    if (!entry.is_string()) continue;
+    std::string trimmed = jsTrim(entry.get_ref<const std::string&>());
+    if (!trimmed.empty()) entries.push_back(std::move(trimmed));
+  }
+  if (entries.empty()) return undefinedValue();
+  std::stable_sort(entries.begin(), entries.end(), utf16Less);
+  return entries;
+}
+
+json numberFingerprint(const json& value) {
+  if (!isFiniteNumber(value)) return undefinedValue();
+  return roundToFixed6(value.get<double>());
+}
+
+json vectorFingerprint(const json& value) {
+  if (!value.is_array() || value.size() != 3) return undefinedValue();
+  json out = json::array();
+  for (const json& entry : value) {
+    if (!isFiniteNumber(entry)) return undefinedValue();
+    out.push_back(roundToFixed6(entry.get<double>()));
+  }
+  return out;
+}
+
+// The trimmed string, or `fallback` when it is not a non-blank string.
+std::string trimmedOr(const json& value, const char* fallback) {
+  if (value.is_string()) {
+    std::string trimmed = jsTrim(value.get_ref<const std::string&>());
+    if (!trimmed.empty()) return trimmed;
+  }
+  return fallback;
+}
+
+bool isNonBlankString(const json& value) {
+  return value.is_string() && !jsTrim(value.get_ref<const std::string&>()).empty();
+}
+
+json buildSelectionRecord(const json& meta) {
+  json record = {
+      {"ownerKey", trimmedOr(member(meta, "ownerKey"), "unowned")},
+      {"createdBy", trimmedOr(member(meta, "createdBy"), "unknown")},
+  };
+  // The client's ledger hint keeps role and slot untrimmed.
+  const json& role = member(meta, "role");
+  if (isNonBlankString(role)) record["role"] = role;
+  const json& slot = member(meta, "selectionSlot");
+  if (isNonBlankString(slot)) record["slot"] = slot;
+  const json& lineage = member(meta, "selectionLineage");
+  record["lineage"] = lineage.is_object() || lineage.is_array() ? lineage : json{{"kind", "created"}};
+  return record;
+}
+
+json selectionSemanticFingerprint(const std::string& kind, const json& meta) {
+  // legacySelectionSemanticMeta: the pre-ledger role when there is one, and
+  // no role at all for slotted selections.
+  json role = member(meta, "role");
+  const json& legacyRole = member(meta, "selectionLegacyRole");
+  const json& slot = member(meta, "selectionSlot");
+  if (isNonBlankString(legacyRole)) {
+    role = legacyRole;
+  } else if (slot.is_string() && !slot.get_ref<const std::string&>().empty()) {
+    role = undefinedValue();
+  }
+  std::vector<std::string> featureTags;
+  const json& tags = member(meta, "featureTags");
+  if (tags.is_array()) {
+    for (const json& tag : tags) {
+      if (tag.is_string() && !tag.get_ref<const std::string&>().empty()) featureTags.push_back(tag.get<std::string>());
+    }
+    std::stable_sort(featureTags.begin(), featureTags.end(), utf16Less);
+  }
+  const json& planar = member(meta, "planar");
+  return {
+      {"version", kSelectionIdVersion},
+      {"kind", kind},
+      {"ownerKey", stringFingerprint(member(meta, "ownerKey"))},
+      {"createdBy", stringFingerprint(member(meta, "createdBy"))},
+      {"role", stringFingerprint(role)},
+      {"planar", planar.is_boolean() ? planar : undefinedValue()},
+      {"normal", stringFingerprint(member(meta, "normal"))},
+      {"surfaceType", stringFingerprint(member(meta, "surfaceType"))},
+      {"curveType", stringFingerprint(member(meta, "curveType"))},
+      {"featureTags", featureTags},
+  };
+}
+
+json selectionTieBreakerFingerprint(const std::string& kind, const json& meta) {
+  return {
+      {"version", kSelectionIdVersion},
+      {"kind", kind},
+      {"selectionSignature", stringFingerprint(member(meta, "selectionSignature"))},
+      {"adjacentFaceSlots", stringArrayFingerprint(member(meta, "adjacentFaceSlots"))},
+      {"center", vectorFingerprint(member(meta, "center"))},
+      {"centerZ", numberFingerprint(member(meta, "centerZ"))},
+      {"area", numberFingerprint(member(meta, "area"))},
+      {"length", numberFingerprint(member(meta, "length"))},
+      {"radius", numberFingerprint(member(meta, "radius"))},
+      {"normalVec", vectorFingerprint(member(meta, "normalVec"))},
+      {"planeOrigin", vectorFingerprint(member(meta, "planeOrigin"))},
+      {"planeNormal", vectorFingerprint(member(meta, "planeNormal"))},
+      {"planeXDir", vectorFingerprint(member(meta, "planeXDir"))},
+      {"planeYDir", vectorFingerprint(member(meta, "planeYDir"))},
+  };
+}
+
+std::string buildStableSelectionBaseId(const std::string& kind, const json& meta, const json& record) {
+  const std::string prefix = kind + ":" + normalizeSelectionToken(record["ownerKey"].get<std::string>()) + "~" +
+                             normalizeSelectionToken(record["createdBy"].get<std::string>()) + ".";
+  auto slot = record.find("slot");
+  if (slot != record.end()) {
+    const std::string slotToken = normalizeSelectionToken(slot->get<std::string>());
+    if (!slotToken.empty()) return prefix + slotToken;
+  }
+  return prefix + hashValue(selectionSemanticFingerprint(kind, meta));
+}
+
+}  // namespace
+
+std::string normalizeSelectionToken(const std::string& value) {
+  // Every non-ASCII code point is outside [A-Za-z0-9_-], so working on bytes
+  // gives the same runs as the regex on UTF-16.
+  const std::string trimmed = jsTrim(value);
+  std::string out;
+  for (const char ch : trimmed) {
+    const bool allowed = (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') ||
+                         ch == '_' || ch == '-';
+    if (allowed) {
+      out += ch;
+    } else if (out.empty() || out.back() != '.') {
+      out += '.';
+    }
+  }
+  if (!out.empty() && out.front() == '.') out.erase(0, 1);
+  if (!out.empty() && out.back() == '.') out.pop_back();
+  if (out.size() > 96) out.resize(96);
+  return out;
+}
+
+std::string stableStringify(const json& value) {
+  switch (value.type()) {
+    case json::value_t::discarded:
+      return "undefined";
+    case json::value_t::null:
+      return "null";
+    case json::value_t::boolean:
+      return value.get<bool>() ? "true" : "false";
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+    case json::value_t::number_float:
+      return jsNumber(value.get<double>());
+    case json::value_t::string:
+      return quoteString(value.get_ref<const std::string&>());
+    case json::value_t::array: {
+      std::string out = "[";
+      for (std::size_t index = 0; index < value.size(); ++index) {
+        if (index > 0) out += ',';
+        out += stableStringify(value[index]);
+      }
+      return out + "]";
+    }
+    case json::value_t::object: {
+      std::vector<std::string> keys;
+      keys.reserve(value.size());
+      for (auto it = value.begin(); it != value.end(); ++it) keys.push_back(it.key());
+      std::sort(keys.begin(), keys.end(), utf16Less);
+      std::string out = "{";
+      for (std::size_t index = 0; index < keys.size(); ++index) {
+        if (index > 0) out += ',';
+        out += quoteString(keys[index]) + ":" + stableStringify(value[keys[index]]);
+      }
+      return out + "}";
+    }
+    default:
+      return "null";
+  }
+}
+
+std::string hashValue(const json& value) {
+  // 64-bit FNV-1a over the UTF-16 code units, as charCodeAt sees them.
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  for (const char16_t unit : toUtf16(stableStringify(value))) {
+    hash ^= static_cast<std::uint64_t>(unit);
+    hash *= 0x100000001b3ull;
+  }
+  char buffer[20];
+  std::snprintf(buffer, sizeof(buffer), "h%016llx", static_cast<unsigned long long>(hash));
+  return buffer;
+}
+
+std::vector<SelectionIdAssignment> assignStableSelectionIds(const std::string& kind,
+                                                            const std::vector<const json*>& metas) {
+  struct Decorated {
+    std::size_t index;
+    std::string baseId;
+    std::string tieHash;
+  };
+  std::vector<SelectionIdAssignment> assignments(metas.size());
+  std::map<std::string, std::vector<Decorated>> groups;
+  for (std::size_t index = 0; index < metas.size(); ++index) {
+    const json& meta = *metas[index];
+    assignments[index].record = buildSelectionRecord(meta);
+    const std::string baseId = buildStableSelectionBaseId(kind, meta, assignments[index].record);
+    groups[baseId].push_back({index, baseId, std::string()});
+  }
+  for (auto& group : groups) {
+    std::vector<Decorated>& bucket = group.second;
+    // Only a shared base id needs the tie breaker; slotted selections almost
+    // never do, so most of them skip the geometric fingerprint.
+    if (bucket.size() == 1) {
+      assignments[bucket.front().index].id = bucket.front().baseId;
+      continue;
+    }
+    for (Decorated& entry : bucket) {
+      entry.tieHash = hashValue(selectionTieBreakerFingerprint(kind, *metas[entry.index]));
+    }
+    // Tie hashes are "h" plus 16 hex digits, so localeCompare is plain
+    // string order.
+    std::sort(bucket.begin(), bucket.end(), [](const Decorated& a, const Decorated& b) {
+      if (a.tieHash != b.tieHash) return a.tieHash < b.tieHash;
+      return a.index < b.index;
+    });
+    for (std::size_t rank = 0; rank < bucket.size(); ++rank) {
+      assignments[bucket[rank].index].id = bucket[rank].baseId + "." + std::to_string(rank + 1);
+    }
+  }
+  return assignments;
+}
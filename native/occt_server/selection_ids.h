@@ -0,0 +1,42 @@
+#pragma once
+
+#include "json.hpp"
+
+#include <string>
+#include <vector>
+
+// Stable face and edge selection ids, independent of OCCT: a port of
+// assignStableSelectionIds in src/occt/selection_ids.ts (with the
+// fingerprints of src/occt/selection_fingerprint.ts and hashValue of
+// src/hash.ts) that produces the same ids and records bit for bit, so the
+// native client can skip its own pass.
+//
+// JavaScript semantics are reproduced where they reach the hashed text:
+// absent fingerprint fields stringify as `undefined`, numbers go through
+// toFixed(6) and Number#toString, and FNV-1a runs over UTF-16 code units.
+
+// Bumped together with the `version` of the TypeScript fingerprints.
+constexpr int kSelectionIdVersion = 1;
+
+struct SelectionIdAssignment {
+  std::string id;
+  nlohmann::json record;  // KernelSelectionRecord
+};
+
+// One assignment per meta, in order, for selections of `kind` ("face" or
+// "edge"). The slot, role and lineage hints come from the meta itself
+// (selectionSlot, role, selectionLineage), as nativeSelectionEntry reads
+// them on the client.
+std::vector<SelectionIdAssignment> assignStableSelectionIds(const std::string& kind,
+                                                            const std::vector<const nlohmann::json*>& metas);
+
+// stableStringify and hashValue of src/hash.ts. A discarded json value
+// stands for `undefined`.
+std::string stableStringify(const nlohmann::json& value);
+std::string hashValue(const nlohmann::json& value);
+
+std::string normalizeSelectionToken(const std::string& value);
+
+// Number(value.toFixed(6)), the rounding of the client's number and vector
+// fingerprints.
+double roundToFixed6(double value);
@@ -0,0 +1,187 @@
+#include "slice.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <unordered_map>
+
+namespace {
+
+struct Cell {
+  std::int64_t x;
+  std::int64_t y;
+  std::int64_t z;
+  bool operator==(const Cell& other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct CellHash {
+  std::size_t operator()(const Cell& cell) const {
+    std::uint64_t hash = 1469598103934665603ull;
+    for (std::int64_t value : {cell.x, cell.y, cell.z}) {
+      hash ^= static_cast<std::uint64_t>(value);
+      hash *= 1099511628211ull;
+    }
+    return static_cast<std::size_t>(hash);
+  }
+};
+
+// Merges points closer than the tolerance into one vertex, looking in the
+// neighbouring grid cells as well so points either side of a cell boundary
+// still weld.
+class Welder {
+ public:
+  explicit Welder(double tolerance)
+      : cellSize_(tolerance > 0.0 ? tolerance : 1e-9), tolerance2_(tolerance * tolerance) {}
+
+  std::uint32_t add(const double* point) {
+    const Cell cell = cellOf(point);
+    for (std::int64_t dx = -1; dx <= 1; ++dx) {
+      for (std::int64_t dy = -1; dy <= 1; ++dy) {
+        for (std::int64_t dz = -1; dz <= 1; ++dz) {
+          auto it = grid_.find({cell.x + dx, cell.y + dy, cell.z + dz});
+          if (it == grid_.end()) continue;
+          for (std::uint32_t vertex : it->second) {
+            const double* existing = &points_[vertex * 3];
+            double distance2 = 0.0;
+            for (int axis = 0; axis < 3; ++axis) {
+              const double delta = existing[axis] - point[axis];
+              distance2 += delta * delta;
+            }
+            if (distance2 <= tolerance2_) return vertex;
+          }
+        }
+      }
+    }
+    const std::uint32_t vertex = static_cast<std::uint32_t>(points_.size() / 3);
+    points_.insert(points_.end(), point, point + 3);
+    grid_[cell].push_back(vertex);
+    return vertex;
+  }
+
+  const double* point(std::uint32_t vertex) const { return &points_[vertex * 3]; }
+  std::size_t size() const { return points_.size() / 3; }
+
+ private:
+  Cell cellOf(const double* point) const {
+    return {static_cast<std::int64_t>(std::floor(point[0] / cellSize_)),
+            static_cast<std::int64_t>(std::floor(point[1] / cellSize_)),
+            static_cast<std::int64_t>(std::floor(point[2] / cellSize_))};
+  }
+
+  double cellSize_;
+  double tolerance2_;
+  std::vector<double> points_;
+  std::unordered_map<Cell, std::vector<std::uint32_t>, CellHash> grid_;
+};
+
+}  // namespace
+
+SliceContours chainSegments(const std::vector<double>& segments, double tolerance) {
+  const std::size_t segmentCount = segments.size() / 6;
+  Welder welder(tolerance);
+  std::vector<std::array<std::uint32_t, 2>> ends(segmentCount);
+  for (std::size_t segment = 0; segment < segmentCount; ++segment) {
+    ends[segment] = {welder.add(&segments[segment * 6]), welder.add(&segments[segment * 6 + 3])};
+  }
+  std::vector<std::vector<std::uint32_t>> incident(welder.size());
+  std::vector<bool> used(segmentCount, false);
+  for (std::size_t segment = 0; segment < segmentCount; ++segment) {
+    if (ends[segment][0] == ends[segment][1]) {
+      used[segment] = true;  // shorter than the tolerance
+      continue;
+    }
+    incident[ends[segment][0]].push_back(static_cast<std::uint32_t>(segment));
+    incident[ends[segment][1]].push_back(static_cast<std::uint32_t>(segment));
+  }
+
+  SliceContours contours;
+  auto walk = [&](std::uint32_t start) {
+    SlicePolyline polyline;
+    polyline.points.insert(polyline.points.end(), welder.point(start), welder.point(start) + 3);
+    std::uint32_t vertex = start;
+    while (true) {
+      std::uint32_t next = 0;
+      bool found = false;
+      for (std::uint32_t segment : incident[vertex]) {
+        if (used[segment]) continue;
+        used[segment] = true;
+        next = ends[segment][0] == vertex ? ends[segment][1] : ends[segment][0];
+        found = true;
+        break;
+      }
+      if (!found) break;
+      vertex = next;
+      if (vertex == start) {
+        polyline.closed = true;
+        break;
+      }
+      polyline.points.insert(polyline.points.end(), welder.point(vertex), welder.point(vertex) + 3);
+    }
+    if (polyline.points.size() >= 6) contours.push_back(std::move(polyline));
+  };
+  // Open chains first, from their free ends, so they are not split in two;
+  // whatever remains is closed loops.
+  for (std::uint32_t vertex = 0; vertex < incident.size(); ++vertex) {
+    if (incident[vertex].size() % 2 == 1) walk(vertex);
+  }
+  for (std::uint32_t vertex = 0; vertex < incident.size(); ++vertex) {
+    while (std::any_of(incident[vertex].begin(), incident[vertex].end(),
+                       [&](std::uint32_t segment) { return !used[segment]; })) {
+      walk(vertex);
+    }
+  }
+  return contours;
+}
+
+std::vector<std::vector<double>> sliceTriangles(const std::vector<double>& positions,
+                                                const std::vector<std::uint32_t>& triangles,
+                                                const SlicePlanes& planes) {
+  std::vector<std::vector<double>> slices(static_cast<std::size_t>(std::max(planes.count, 0)));
+  if (slices.empty()) return slices;
+  const std::size_t nodeCount = positions.size() / 3;
+  std::vector<double> heights(nodeCount);
+  for (std::size_t node = 0; node < nodeCount; ++node) {
+    double height = 0.0;
+    for (int axis = 0; axis < 3; ++axis) {
+      height += (positions[node * 3 + axis] - planes.origin[axis]) * planes.normal[axis];
+    }
+    heights[node] = height;
+  }
+
+  const int lastPlane = planes.count - 1;
+  for (std::size_t triangle = 0; triangle + 2 < triangles.size(); triangle += 3) {
+    const std::uint32_t* nodes = &triangles[triangle];
+    const double low = std::min({heights[nodes[0]], heights[nodes[1]], heights[nodes[2]]});
+    const double high = std::max({heights[nodes[0]], heights[nodes[1]], heights[nodes[2]]});
+    int first = 0;
+    int last = 0;
+    if (planes.spacing > 0.0) {
+      first = std::max(0, static_cast<int>(std::ceil(low / planes.spacing)));
+      last = std::min(lastPlane, static_cast<int>(std::floor(high / planes.spacing)));
+    } else if (low > 0.0 || high < 0.0) {
+      continue;
+    }
+    for (int plane = first; plane <= last; ++plane) {
+      const double level = planes.spacing * plane;
+      double crossing[6];
+      int found = 0;
+      for (int corner = 0; corner < 3 && found < 2; ++corner) {
+        std::uint32_t a = nodes[corner];
+        std::uint32_t b = nodes[(corner + 1) % 3];
+        // A node exactly on the plane counts as above it, so every crossing
+        // triangle has exactly two crossing edges.
+        if ((heights[a] >= level) == (heights[b] >= level)) continue;
+        if (a > b) std::swap(a, b);
+        const double t = (level - heights[a]) / (heights[b] - heights[a]);
+        for (int axis = 0; axis < 3; ++axis) {
+          const double from = positions[a * 3 + axis];
+          crossing[found * 3 + axis] = from + (positions[b * 3 + axis] - from) * t;
+        }
+        ++found;
+      }
+      if (found == 2) slices[plane].insert(slices[plane].end(), crossing, crossing + 6);
+    }
+  }
+  return slices;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Planar slicing helpers for /v1/slice, independent of OCCT: the fast mode
+// cuts a flattened triangulation with a whole family of parallel planes in
+// one pass over the triangles, and both modes join the resulting segments
+// into polylines.
+
+// Planes origin + normal * spacing * k for k in [0, count); normal is unit.
+struct SlicePlanes {
+  double origin[3] = {0.0, 0.0, 0.0};
+  double normal[3] = {0.0, 0.0, 1.0};
+  double spacing = 0.0;
+  int count = 1;
+};
+
+struct SlicePolyline {
+  bool closed = false;
+  std::vector<double> points;  // xyz per point; a closed loop does not repeat its first point
+};
+
+using SliceContours = std::vector<SlicePolyline>;
+
+// Joins segments (two xyz points each) into polylines, welding endpoints
+// closer than `tolerance`. Where more than two segments meet, chains end
+// arbitrarily at the junction.
+SliceContours chainSegments(const std::vector<double>& segments, double tolerance);
+
+// Segments of the triangle mesh on every plane of the family, indexed by
+// plane. Each triangle is visited once and only cut by the planes its height
+// range spans. A crossing on an edge shared by two triangles is computed from
+// the same ordered endpoints, so their segments meet exactly.
+std::vector<std::vector<double>> sliceTriangles(const std::vector<double>& positions,
+                                                const std::vector<std::uint32_t>& triangles,
+                                                const SlicePlanes& planes);
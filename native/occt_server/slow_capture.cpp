@@ -0,0 +1,148 @@
+#include "slow_capture.h"
+
+#include "env.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string routeToken(const std::string& path) {
+  std::string token;
+  for (char ch : path) {
+    const bool keep = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9');
+    if (keep) {
+      token += ch;
+    } else if (!token.empty() && token.back() != '-') {
+      token += '-';
+    }
+  }
+  while (!token.empty() && token.back() == '-') token.pop_back();
+  return token.empty() ? "root" : token;
+}
+
+bool writeFile(const fs::path& path, const std::string& content) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) return false;
+  out.write(content.data(), static_cast<std::streamsize>(content.size()));
+  return static_cast<bool>(out);
+}
+
+std::string replayScript(const SlowRequestSample& sample) {
+  std::string script;
+  script += "#!/bin/sh\n";
+  script += "# Replays a captured occt_server request (" + sample.method + " " + sample.path + ").\n";
+  script += "# Requests that reference shape handles need the same session state on the\n";
+  script += "# target server; shape.brep, when present, holds the input shape for offline\n";
+  script += "# kernel reproduction.\n";
+  script += "set -e\n";
+  script += "DIR=\"$(cd \"$(dirname \"$0\")\" && pwd)\"\n";
+  script += "URL=\"${OCCT_SERVER_URL:-http://127.0.0.1:8081}\"\n";
+  script += "curl -sS -X " + sample.method + " -H 'content-type: application/json'";
+  if (sample.method != "GET") script += " --data-binary @\"$DIR/body.json\"";
+  script += " -o \"$DIR/replay-response.out\" -w '%{http_code} %{time_total}s\\n' \"$URL" + sample.path + "\"\n";
+  return script;
+}
+
+}  // namespace
+
+SlowRequestCapture& SlowRequestCapture::instance() {
+  static SlowRequestCapture capture;
+  return capture;
+}
+
+SlowRequestCapture::SlowRequestCapture() {
+  thresholdMs_ = envDouble("TF_NATIVE_SLOW_REQUEST_MS", 0.0);
+  if (!(thresholdMs_ > 0.0)) return;
+  dir_ = envString("TF_NATIVE_SLOW_REQUEST_DIR", "/tmp/occt-slow-requests");
+  maxEntries_ = static_cast<std::size_t>(std::max(1.0, envDouble("TF_NATIVE_SLOW_REQUEST_MAX", 32)));
+  enabled_ = true;
+}
+
+std::string SlowRequestCapture::write(const SlowRequestSample& sample) {
+  if (!enabled_) return "";
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const auto nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  char name[64];
+  std::snprintf(name, sizeof(name), "%013lld-%06llu-",
+                static_cast<long long>(nowMs),
+                static_cast<unsigned long long>(sequence_++ % 1000000));
+  const fs::path entry = fs::path(dir_) / (std::string(name) + routeToken(sample.path));
+
+  std::error_code ec;
+  fs::create_directories(entry, ec);
+  if (ec) {
+    std::cerr << "occt_server slow capture: cannot create " << entry << ": " << ec.message() << std::endl;
+    return "";
+  }
+
+  json phases = json::array();
+  for (const auto& phase : sample.phases) {
+    phases.push_back({
+        {"name", phase.name},
+        {"ms", phase.ms},
+        {"count", phase.count},
+        {"allocations", phase.allocs.allocations},
+        {"allocatedBytes", phase.allocs.bytes},
+    });
+  }
+  json attachments = json::array();
+  for (const auto& attachment : sample.attachments) attachments.push_back(attachment.first);
+  const json summary = {
+      {"method", sample.method},
+      {"path", sample.path},
+      {"status", sample.status},
+      {"durationMs", sample.durationMs},
+      {"thresholdMs", thresholdMs_},
+      {"capturedAtMs", nowMs},
+      {"sessionId", sample.sessionId},
+      {"traceparent", sample.traceparent},
+      {"phases", phases},
+      {"attachments", attachments},
+  };
+
+  bool ok = writeFile(entry / "capture.json", summary.dump(2) + "\n");
+  ok = writeFile(entry / "body.json", sample.body) && ok;
+  if (!sample.sessionState.empty()) {
+    ok = writeFile(entry / "session.json", sample.sessionState) && ok;
+  }
+  for (const auto& attachment : sample.attachments) {
+    ok = writeFile(entry / attachment.first, attachment.second) && ok;
+  }
+  const fs::path script = entry / "replay.sh";
+  ok = writeFile(script, replayScript(sample)) && ok;
+  fs::permissions(script, fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec,
+                  fs::perm_options::add, ec);
+  if (!ok) {
+    std::cerr << "occt_server slow capture: incomplete entry " << entry << std::endl;
+  }
+
+  prune();
+  return entry.string();
+}
+
+void SlowRequestCapture::prune() {
+  std::error_code ec;
+  std::vector<fs::path> entries;
+  for (const auto& item : fs::directory_iterator(dir_, ec)) {
+    if (item.is_directory()) entries.push_back(item.path());
+  }
+  if (entries.size() <= maxEntries_) return;
+  // Entry names start with a zero-padded timestamp, so name order is age order.
+  std::sort(entries.begin(), entries.end());
+  const std::size_t excess = entries.size() - maxEntries_;
+  for (std::size_t index = 0; index < excess; ++index) {
+    fs::remove_all(entries[index], ec);
+  }
+}
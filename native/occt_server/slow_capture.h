@@ -0,0 +1,51 @@
+#pragma once
+
+#include "request_phases.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Slow-request capture. Requests slower than TF_NATIVE_SLOW_REQUEST_MS are
+// written to a bounded ring of directories under TF_NATIVE_SLOW_REQUEST_DIR
+// (default /tmp/occt-slow-requests, newest TF_NATIVE_SLOW_REQUEST_MAX entries
+// kept, default 32). Each entry holds the request body, the session's upstream
+// state, phase timings, optional attachments (e.g. the BRep of the target
+// shape) and a replay.sh that re-posts the body to a running server.
+
+struct SlowRequestSample {
+  std::string method;
+  std::string path;
+  int status = 0;
+  double durationMs = 0.0;
+  std::string body;
+  std::string traceparent;
+  std::string sessionId;
+  std::string sessionState;
+  std::vector<RequestPhase> phases;
+  std::vector<std::pair<std::string, std::string>> attachments;
+};
+
+class SlowRequestCapture {
+ public:
+  static SlowRequestCapture& instance();
+
+  bool enabled() const { return enabled_; }
+  bool exceeds(double durationMs) const { return enabled_ && durationMs >= thresholdMs_; }
+
+  // Writes one capture entry and returns its directory, or "" on failure.
+  std::string write(const SlowRequestSample& sample);
+
+ private:
+  SlowRequestCapture();
+  void prune();
+
+  bool enabled_ = false;
+  double thresholdMs_ = 0.0;
+  std::string dir_;
+  std::size_t maxEntries_ = 32;
+  std::uint64_t sequence_ = 0;
+  std::mutex mutex_;
+};
@@ -0,0 +1,315 @@
+#include "trace.h"
+
+#include "env.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr std::size_t kMaxQueuedSpans = 8192;
+constexpr std::size_t kBatchSize = 256;
+constexpr auto kFlushInterval = std::chrono::milliseconds(1000);
+
+thread_local TraceSpan* tlActiveSpan = nullptr;
+
+std::uint64_t nowUnixNanos() {
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::uint64_t randomWord() {
+  thread_local std::mt19937_64 engine([] {
+    std::random_device device;
+    const std::uint64_t threadSalt = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return (static_cast<std::uint64_t>(device()) << 32) ^ device() ^ threadSalt ^ nowUnixNanos();
+  }());
+  std::uint64_t value = 0;
+  while (value == 0) value = engine();
+  return value;
+}
+
+std::string toHex(std::uint64_t value) {
+  static const char* digits = "0123456789abcdef";
+  std::string out(16, '0');
+  for (int i = 15; i >= 0; --i) {
+    out[static_cast<std::size_t>(i)] = digits[value & 0xF];
+    value >>= 4;
+  }
+  return out;
+}
+
+bool isLowerHex(const std::string& value) {
+  for (char ch : value) {
+    if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f'))) return false;
+  }
+  return true;
+}
+
+bool isAllZero(const std::string& value) {
+  return value.find_first_not_of('0') == std::string::npos;
+}
+
+json otlpValue(const json& value) {
+  if (value.is_boolean()) return {{"boolValue", value.get<bool>()}};
+  if (value.is_number_integer()) return {{"intValue", std::to_string(value.get<std::int64_t>())}};
+  if (value.is_number()) return {{"doubleValue", value.get<double>()}};
+  if (value.is_string()) return {{"stringValue", value.get<std::string>()}};
+  return {{"stringValue", value.dump()}};
+}
+
+json otlpSpan(const TraceSpanRecord& record) {
+  json attributes = json::array();
+  for (const auto& entry : record.attributes) {
+    attributes.push_back({{"key", entry.first}, {"value", otlpValue(entry.second)}});
+  }
+  json span = {
+      {"traceId", record.traceId},
+      {"spanId", record.spanId},
+      {"name", record.name},
+      {"kind", record.kind},
+      {"startTimeUnixNano", std::to_string(record.startNanos)},
+      {"endTimeUnixNano", std::to_string(record.endNanos)},
+      {"attributes", attributes},
+  };
+  if (!record.parentSpanId.empty()) span["parentSpanId"] = record.parentSpanId;
+  if (record.error) {
+    span["status"] = {{"code", 2}, {"message", record.statusMessage}};
+  }
+  return span;
+}
+
+}  // namespace
+
+std::optional<TraceContext> parseTraceparent(const std::string& header) {
+  // version "-" trace-id "-" parent-id "-" trace-flags, e.g.
+  // 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01
+  if (header.size() < 55) return std::nullopt;
+  if (header[2] != '-' || header[35] != '-' || header[52] != '-') return std::nullopt;
+  const std::string version = header.substr(0, 2);
+  if (version == "ff" || !isLowerHex(version)) return std::nullopt;
+  if (version == "00" && header.size() != 55) return std::nullopt;
+  TraceContext context;
+  context.traceId = header.substr(3, 32);
+  context.spanId = header.substr(36, 16);
+  const std::string flags = header.substr(53, 2);
+  if (!isLowerHex(context.traceId) || !isLowerHex(context.spanId) || !isLowerHex(flags)) {
+    return std::nullopt;
+  }
+  if (isAllZero(context.traceId) || isAllZero(context.spanId)) return std::nullopt;
+  context.sampled = (std::stoi(flags, nullptr, 16) & 0x01) != 0;
+  return context;
+}
+
+std::string formatTraceparent(const TraceContext& context) {
+  return "00-" + context.traceId + "-" + context.spanId + (context.sampled ? "-01" : "-00");
+}
+
+struct Tracer::Exporter {
+  std::string path;
+  std::uint64_t maxBytes = 0;
+  int maxFiles = 0;
+
+  std::mutex queueMutex;
+  std::condition_variable wake;
+  std::vector<TraceSpanRecord> queue;
+  std::uint64_t dropped = 0;
+  bool stopping = false;
+
+  std::mutex writeMutex;
+  std::thread worker;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (!stopping) {
+      wake.wait_for(lock, kFlushInterval, [this] { return stopping || queue.size() >= kBatchSize; });
+      std::vector<TraceSpanRecord> batch;
+      batch.swap(queue);
+      const std::uint64_t droppedNow = dropped;
+      dropped = 0;
+      lock.unlock();
+      write(batch, droppedNow);
+      lock.lock();
+    }
+  }
+
+  void drain() {
+    std::vector<TraceSpanRecord> batch;
+    std::uint64_t droppedNow = 0;
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      batch.swap(queue);
+      droppedNow = dropped;
+      dropped = 0;
+    }
+    write(batch, droppedNow);
+  }
+
+  void write(const std::vector<TraceSpanRecord>& batch, std::uint64_t droppedNow) {
+    if (droppedNow > 0) {
+      std::cerr << "occt_server trace: dropped " << droppedNow << " spans (queue full)" << std::endl;
+    }
+    if (batch.empty()) return;
+    json spans = json::array();
+    for (const auto& record : batch) spans.push_back(otlpSpan(record));
+    const json request = {
+        {"resourceSpans", json::array({{
+            {"resource", {{"attributes", json::array({
+                {{"key", "service.name"}, {"value", {{"stringValue", "occt_server"}}}},
+            })}}},
+            {"scopeSpans", json::array({{
+                {"scope", {{"name", "occt_server"}}},
+                {"spans", spans},
+            }})},
+        }})},
+    };
+    const std::string line = request.dump() + "\n";
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    rotateIfNeeded(line.size());
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    if (!out) {
+      std::cerr << "occt_server trace: cannot open " << path << std::endl;
+      return;
+    }
+    out << line;
+  }
+
+  void rotateIfNeeded(std::size_t incoming) {
+    std::ifstream existing(path, std::ios::binary | std::ios::ate);
+    if (!existing) return;
+    const std::uint64_t size = static_cast<std::uint64_t>(existing.tellg());
+    existing.close();
+    if (size == 0 || size + incoming <= maxBytes) return;
+    if (maxFiles <= 0) {
+      std::remove(path.c_str());
+      return;
+    }
+    std::remove((path + "." + std::to_string(maxFiles)).c_str());
+    for (int index = maxFiles - 1; index >= 1; --index) {
+      std::rename((path + "." + std::to_string(index)).c_str(),
+                  (path + "." + std::to_string(index + 1)).c_str());
+    }
+    std::rename(path.c_str(), (path + ".1").c_str());
+  }
+};
+
+Tracer& Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::Tracer() {
+  const std::string path = envString("TF_NATIVE_TRACE_FILE", "");
+  if (path.empty()) return;
+  sampleRatio_ = std::min(1.0, std::max(0.0, envDouble("TF_NATIVE_TRACE_SAMPLE_RATIO", 1.0)));
+  exporter_ = new Exporter();
+  exporter_->path = path;
+  exporter_->maxBytes = static_cast<std::uint64_t>(
+      std::max(1.0, envDouble("TF_NATIVE_TRACE_MAX_BYTES", 16.0 * 1024.0 * 1024.0)));
+  exporter_->maxFiles = static_cast<int>(std::max(0.0, envDouble("TF_NATIVE_TRACE_MAX_FILES", 4)));
+  exporter_->worker = std::thread([this] { exporter_->run(); });
+  enabled_ = true;
+}
+
+Tracer::~Tracer() {
+  if (!exporter_) return;
+  {
+    std::lock_guard<std::mutex> lock(exporter_->queueMutex);
+    exporter_->stopping = true;
+  }
+  exporter_->wake.notify_all();
+  exporter_->worker.join();
+  exporter_->drain();
+  delete exporter_;
+}
+
+bool Tracer::sampleRoot(std::uint64_t low) const {
+  if (!enabled_ || sampleRatio_ <= 0.0) return false;
+  if (sampleRatio_ >= 1.0) return true;
+  // Ratio sampling keyed on the low 64 bits of the trace id, so every service
+  // that sees this trace id makes the same decision.
+  const double bound = sampleRatio_ * 18446744073709551616.0;
+  return static_cast<double>(low) < bound;
+}
+
+void Tracer::submit(TraceSpanRecord&& record) {
+  if (!exporter_) return;
+  bool wakeWorker = false;
+  {
+    std::lock_guard<std::mutex> lock(exporter_->queueMutex);
+    if (exporter_->queue.size() >= kMaxQueuedSpans) {
+      ++exporter_->dropped;
+      return;
+    }
+    exporter_->queue.push_back(std::move(record));
+    wakeWorker = exporter_->queue.size() >= kBatchSize;
+  }
+  if (wakeWorker) exporter_->wake.notify_one();
+}
+
+void Tracer::flush() {
+  if (exporter_) exporter_->drain();
+}
+
+TraceSpan::TraceSpan(const char* name) {
+  if (!tlActiveSpan || !tlActiveSpan->recording_) return;
+  begin(name, &tlActiveSpan->context_);
+}
+
+TraceSpan::TraceSpan(ServerTag, const char* name, const std::string& traceparent) {
+  Tracer& tracer = Tracer::instance();
+  if (!tracer.enabled()) return;
+  const std::optional<TraceContext> parent = parseTraceparent(traceparent);
+  if (parent) {
+    if (!parent->sampled) return;
+    begin(name, &*parent);
+  } else {
+    // Decided on the raw words, so an unsampled root formats no ids.
+    const std::uint64_t high = randomWord();
+    const std::uint64_t low = randomWord();
+    if (!tracer.sampleRoot(low)) return;
+    TraceContext root;
+    root.traceId = toHex(high) + toHex(low);
+    root.sampled = true;
+    begin(name, &root);
+  }
+  record_.kind = 2;
+}
+
+void TraceSpan::begin(const char* name, const TraceContext* parent) {
+  recording_ = true;
+  context_.traceId = parent->traceId;
+  context_.spanId = toHex(randomWord());
+  context_.sampled = true;
+  record_.traceId = context_.traceId;
+  record_.spanId = context_.spanId;
+  record_.parentSpanId = parent->spanId;
+  record_.name = name;
+  record_.startNanos = nowUnixNanos();
+  previous_ = tlActiveSpan;
+  tlActiveSpan = this;
+}
+
+void TraceSpan::setError(const std::string& message) {
+  if (!recording_) return;
+  record_.error = true;
+  record_.statusMessage = message;
+}
+
+TraceSpan::~TraceSpan() {
+  if (!recording_) return;
+  tlActiveSpan = previous_;
+  record_.endNanos = nowUnixNanos();
+  Tracer::instance().submit(std::move(record_));
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "json.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Span tracing for occt_server.
+//
+// Spans are exported asynchronously as OTLP-JSON (one ExportTraceServiceRequest
+// per line) to a size-rotated local file, so no collector is required. Tracing
+// is configured from the environment:
+//
+//   TF_NATIVE_TRACE_FILE          output path; tracing is disabled when unset
+//   TF_NATIVE_TRACE_SAMPLE_RATIO  ratio for root spans without a sampled parent (default 1.0)
+//   TF_NATIVE_TRACE_MAX_BYTES     rotate once the file exceeds this size (default 16 MiB)
+//   TF_NATIVE_TRACE_MAX_FILES     rotated files to keep, path.1 .. path.N (default 4)
+//
+// Unsampled spans never read the clock or allocate, so instrumentation is safe
+// to leave on hot paths. The one exception is a request span with an incoming
+// `traceparent`, which is parsed before its sampled flag can be read.
+
+struct TraceContext {
+  std::string traceId;
+  std::string spanId;
+  bool sampled = false;
+};
+
+struct TraceSpanRecord {
+  std::string traceId;
+  std::string spanId;
+  std::string parentSpanId;
+  std::string name;
+  int kind = 1;
+  std::uint64_t startNanos = 0;
+  std::uint64_t endNanos = 0;
+  bool error = false;
+  std::string statusMessage;
+  std::vector<std::pair<std::string, nlohmann::json>> attributes;
+};
+
+std::optional<TraceContext> parseTraceparent(const std::string& header);
+std::string formatTraceparent(const TraceContext& context);
+
+class Tracer {
+ public:
+  static Tracer& instance();
+
+  bool enabled() const { return enabled_; }
+  // Whether a new root trace is sampled, from the low 64 bits of its id.
+  bool sampleRoot(std::uint64_t traceIdLow) const;
+  void submit(TraceSpanRecord&& record);
+  void flush();
+
+  ~Tracer();
+
+ private:
+  Tracer();
+  struct Exporter;
+
+  bool enabled_ = false;
+  double sampleRatio_ = 1.0;
+  Exporter* exporter_ = nullptr;
+};
+
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name);
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  bool recording() const { return recording_; }
+  const TraceContext& context() const { return context_; }
+
+  template <typename T>
+  void setAttribute(const char* key, T&& value) {
+    if (!recording_) return;
+    record_.attributes.emplace_back(key, nlohmann::json(std::forward<T>(value)));
+  }
+
+  void setError(const std::string& message);
+
+ protected:
+  struct ServerTag {};
+  TraceSpan(ServerTag, const char* name, const std::string& traceparent);
+
+ private:
+  void begin(const char* name, const TraceContext* parent);
+
+  bool recording_ = false;
+  TraceContext context_;
+  TraceSpan* previous_ = nullptr;
+  TraceSpanRecord record_;
+};
+
+// Root span for one HTTP request. Continues the trace in an incoming W3C
+// `traceparent` header when present and honours its sampled flag.
+class ServerTraceSpan : public TraceSpan {
+ public:
+  ServerTraceSpan(const char* name, const std::string& traceparent)
+      : TraceSpan(ServerTag{}, name, traceparent) {}
+};
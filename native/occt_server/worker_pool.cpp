@@ -0,0 +1,625 @@
+#include "worker_pool.h"
+
+#include "env.h"
+#include "httplib.h"
+#include "json.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr int kMaxWorkers = 256;
+// How long the router waits for a restarting worker before answering 503.
+constexpr auto kRestartWait = std::chrono::milliseconds(2000);
+constexpr auto kRetryInterval = std::chrono::milliseconds(20);
+constexpr auto kSupervisorTick = std::chrono::milliseconds(50);
+// A process that dies sooner than this after starting counts as crash-looping
+// and is restarted with exponential backoff.
+constexpr std::int64_t kStableUptimeMs = 10000;
+constexpr std::int64_t kMaxBackoffMs = 5000;
+
+// Slot state shared between the supervisor (writer) and the router (reader)
+// through an anonymous shared mapping created before either is forked.
+struct WorkerSlot {
+  std::atomic<pid_t> pid;  // 0 while the worker is down
+  std::atomic<int> restarts;
+  std::atomic<std::int64_t> startedAtMs;
+  std::atomic<int> lastExitStatus;  // raw wait status of the previous process, -1 if none
+};
+
+struct PoolTable {
+  int workers;
+  WorkerSlot slots[kMaxWorkers];
+};
+
+volatile std::sig_atomic_t gStopSignal = 0;
+
+void onStopSignal(int signal) {
+  gStopSignal = signal;
+}
+
+std::int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::string workerSocketPath(const std::string& socketDir, int slot) {
+  return socketDir + "/worker-" + std::to_string(slot) + ".sock";
+}
+
+std::string describeExit(int status) {
+  if (status < 0) return "";
+  if (WIFEXITED(status)) return "exit " + std::to_string(WEXITSTATUS(status));
+  if (WIFSIGNALED(status)) return "signal " + std::to_string(WTERMSIG(status));
+  return "status " + std::to_string(status);
+}
+
+void appendEnvSuffix(const char* name, const std::string& suffix) {
+  const std::string value = envString(name, "");
+  if (!value.empty()) setenv(name, (value + suffix).c_str(), 1);
+}
+
+// Forks a child that runs body() and exits with its result. Children drop the
+// supervisor's signal handlers and die with it.
+pid_t forkChild(const std::function<int()>& body) {
+  const pid_t supervisor = getpid();
+  const pid_t pid = fork();
+  if (pid != 0) return pid;
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGINT, SIG_DFL);
+#if defined(__linux__)
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (getppid() != supervisor) std::_Exit(1);
+#endif
+  int code = 1;
+  try {
+    code = body();
+  } catch (const std::exception& ex) {
+    std::cerr << "occt_server pool: " << ex.what() << std::endl;
+  }
+  std::exit(code);
+}
+
+std::uint64_t hashKey(const std::string& key) {
+  // FNV-1a, then a splitmix64 finalizer so near-identical ids spread out.
+  std::uint64_t hash = 1469598103934665603ULL;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+std::size_t skipSpace(const std::string& text, std::size_t pos) {
+  while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n')) {
+    ++pos;
+  }
+  return pos;
+}
+
+// Stops the parse at the string value of the top-level "sessionId" member.
+class SessionIdSax : public nlohmann::json_sax<json> {
+ public:
+  bool found = false;
+  std::string value;
+
+  bool null() override { return scalar(); }
+  bool boolean(bool) override { return scalar(); }
+  bool number_integer(number_integer_t) override { return scalar(); }
+  bool number_unsigned(number_unsigned_t) override { return scalar(); }
+  bool number_float(number_float_t, const string_t&) override { return scalar(); }
+  bool binary(binary_t&) override { return scalar(); }
+
+  bool string(string_t& text) override {
+    if (!expectingValue_) return true;
+    found = true;
+    value = text;
+    return false;
+  }
+
+  bool start_object(std::size_t) override {
+    expectingValue_ = false;
+    ++depth_;
+    return true;
+  }
+
+  bool key(string_t& name) override {
+    expectingValue_ = depth_ == 1 && name == "sessionId";
+    return true;
+  }
+
+  bool end_object() override {
+    --depth_;
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    expectingValue_ = false;
+    ++depth_;
+    return true;
+  }
+
+  bool end_array() override {
+    --depth_;
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+    return false;
+  }
+
+ private:
+  bool scalar() {
+    expectingValue_ = false;
+    return true;
+  }
+
+  int depth_ = 0;
+  bool expectingValue_ = false;
+};
+
+// Streamed (NDJSON) routes, relayed chunk by chunk rather than buffered.
+bool streamedRoute(const std::string& path) {
+  return path == "/v1/sweep" || path == "/v1/exec-features";
+}
+
+// Hands a streamed worker response from the thread reading it to the
+// router's content provider.
+struct StreamRelay {
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool started = false;  // status and headers have arrived
+  bool finished = false;
+  bool abandoned = false;  // the client went away
+  int status = 0;
+  std::string contentType;
+  std::string serverTiming;
+  std::string trailerTiming;  // Server-Timing sent after the last chunk
+  std::deque<std::string> chunks;
+  httplib::Error error = httplib::Error::Success;
+  std::thread reader;
+};
+
+class Router {
+ public:
+  Router(const WorkerPoolOptions& options, const PoolTable& table, std::string socketDir)
+      : options_(options), table_(table), socketDir_(std::move(socketDir)), ring_(table.workers) {}
+
+  int run() {
+    httplib::Server server;
+    server.set_tcp_nodelay(true);
+    server.Get("/v1/metrics", [this](const httplib::Request&, httplib::Response& res) {
+      res.set_content(metricsPayload().dump(), "application/json");
+    });
+    server.Get(".*", [this](const httplib::Request& req, httplib::Response& res) {
+      forward(req, res, ring_.slotFor("default"));
+    });
+    server.Post(".*", [this](const httplib::Request& req, httplib::Response& res) {
+      const std::string pathSession = sessionIdFromPath(req.path);
+      forward(req, res, ring_.slotFor(pathSession.empty() ? sessionIdFromBody(req.body) : pathSession));
+    });
+    std::cout << "occt_server router listening on " << options_.host << ":" << options_.port
+              << " (" << table_.workers << " workers)" << std::endl;
+    return server.listen(options_.host.c_str(), options_.port) ? 0 : 1;
+  }
+
+ private:
+  struct CachedClient {
+    pid_t pid = 0;
+    std::unique_ptr<httplib::Client> client;
+  };
+
+  std::unique_ptr<httplib::Client> makeWorkerClient(int slot) const {
+    auto client = std::make_unique<httplib::Client>(workerSocketPath(socketDir_, slot), 80);
+    client->set_address_family(AF_UNIX);
+    client->set_connection_timeout(1, 0);
+    client->set_read_timeout(600, 0);
+    client->set_write_timeout(600, 0);
+    return client;
+  }
+
+  // One keep-alive connection per worker and router thread, reopened when the
+  // slot's worker has been replaced.
+  httplib::Client& workerClient(int slot, pid_t pid) {
+    thread_local std::vector<CachedClient> cache;
+    if (cache.size() < static_cast<std::size_t>(table_.workers)) cache.resize(table_.workers);
+    CachedClient& entry = cache[slot];
+    if (!entry.client || entry.pid != pid) {
+      entry.client = makeWorkerClient(slot);
+      entry.client->set_keep_alive(true);
+      entry.pid = pid;
+    }
+    return *entry.client;
+  }
+
+  // Forwards a streamed route, passing each chunk on as the worker writes it.
+  // The worker request runs on its own thread with its own connection, which
+  // the content provider drains after this handler returns. Returns false
+  // if the worker could not be reached, so the caller retries as for a
+  // buffered request.
+  bool relayStream(const httplib::Request& req,
+                   httplib::Response& res,
+                   int slot,
+                   const httplib::Headers& headers,
+                   const std::string& contentType) {
+    auto relay = std::make_shared<StreamRelay>();
+    httplib::Request upstream;
+    upstream.method = "POST";
+    upstream.path = req.target;
+    upstream.headers = headers;
+    upstream.body = req.body;
+    upstream.set_header("Content-Type", contentType.empty() ? "application/json" : contentType);
+    upstream.response_handler = [relay](const httplib::Response& response) {
+      std::lock_guard<std::mutex> lock(relay->mutex);
+      relay->status = response.status;
+      relay->contentType = response.get_header_value("Content-Type");
+      relay->serverTiming = response.get_header_value("Server-Timing");
+      relay->started = true;
+      relay->changed.notify_all();
+      return true;
+    };
+    upstream.content_receiver = [relay](const char* data, std::size_t length, std::uint64_t, std::uint64_t) {
+      std::lock_guard<std::mutex> lock(relay->mutex);
+      if (relay->abandoned) return false;
+      relay->chunks.emplace_back(data, length);
+      relay->changed.notify_all();
+      return true;
+    };
+    relay->reader = std::thread([relay, client = makeWorkerClient(slot), upstream]() {
+      httplib::Result result = client->send(upstream);
+      std::lock_guard<std::mutex> lock(relay->mutex);
+      relay->error = result ? httplib::Error::Success : result.error();
+      // Chunked trailers are parsed into the response headers, after the one
+      // that arrived with the status line.
+      if (result && result->get_header_value_count("Server-Timing") > 1) {
+        relay->trailerTiming = result->get_header_value("Server-Timing", 1);
+      }
+      relay->finished = true;
+      relay->changed.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(relay->mutex);
+    relay->changed.wait(lock, [&] { return relay->started || relay->finished; });
+    if (!relay->started) {
+      const httplib::Error error = relay->error;
+      lock.unlock();
+      relay->reader.join();
+      if (error == httplib::Error::Connection) return false;
+      res.status = 502;
+      res.set_content("error: worker " + std::to_string(slot) + " failed during the request (" +
+                          httplib::to_string(error) + ")",
+                      "text/plain");
+      return true;
+    }
+    res.status = relay->status;
+    if (!relay->serverTiming.empty()) res.set_header("Server-Timing", relay->serverTiming);
+    res.set_header("X-TF-Worker", std::to_string(slot));
+    if (relay->status != 200) {
+      // Errors are short plain-text bodies; pass them on whole.
+      relay->changed.wait(lock, [&] { return relay->finished; });
+      std::string body;
+      for (const std::string& chunk : relay->chunks) body += chunk;
+      const std::string responseType = relay->contentType;
+      lock.unlock();
+      relay->reader.join();
+      res.set_content(std::move(body), responseType);
+      return true;
+    }
+    const std::string responseType = relay->contentType;
+    lock.unlock();
+    res.set_header("Trailer", "Server-Timing");
+    res.set_chunked_content_provider(
+        responseType,
+        [relay](std::size_t, httplib::DataSink& sink) {
+          std::unique_lock<std::mutex> lock(relay->mutex);
+          relay->changed.wait(lock, [&] { return !relay->chunks.empty() || relay->finished; });
+          if (relay->chunks.empty()) {
+            // A worker that died mid-stream just ends it: the client sees no
+            // summary record.
+            const std::string trailerTiming = relay->trailerTiming;
+            lock.unlock();
+            if (trailerTiming.empty()) {
+              sink.done();
+            } else {
+              sink.done_with_trailer({{"Server-Timing", trailerTiming}});
+            }
+            return true;
+          }
+          std::deque<std::string> chunks;
+          chunks.swap(relay->chunks);
+          lock.unlock();
+          for (const std::string& chunk : chunks) {
+            if (!sink.write(chunk.data(), chunk.size())) return false;
+          }
+          return true;
+        },
+        [relay](bool) {
+          {
+            std::lock_guard<std::mutex> lock(relay->mutex);
+            relay->abandoned = true;
+          }
+          relay->reader.join();
+        });
+    return true;
+  }
+
+  void forward(const httplib::Request& req, httplib::Response& res, int slot) {
+    httplib::Headers headers;
+    for (const char* name : {"traceparent", "tracestate"}) {
+      if (req.has_header(name)) headers.emplace(name, req.get_header_value(name));
+    }
+    const std::string contentType = req.get_header_value("Content-Type");
+    const auto deadline = std::chrono::steady_clock::now() + kRestartWait;
+    while (true) {
+      const pid_t pid = table_.slots[slot].pid.load();
+      if (pid > 0 && req.method == "POST" && streamedRoute(req.path)) {
+        if (relayStream(req, res, slot, headers, contentType)) return;
+      } else if (pid > 0) {
+        httplib::Client& client = workerClient(slot, pid);
+        httplib::Result result = req.method == "GET"
+            ? client.Get(req.target, headers)
+            : client.Post(req.target, headers, req.body,
+                          contentType.empty() ? "application/json" : contentType);
+        if (result) {
+          res.status = result->status;
+          if (result->has_header("Server-Timing")) {
+            res.set_header("Server-Timing", result->get_header_value("Server-Timing"));
+          }
+          res.set_header("X-TF-Worker", std::to_string(slot));
+          res.set_content(std::move(result->body), result->get_header_value("Content-Type"));
+          return;
+        }
+        // Anything past connecting means the worker died with the request in
+        // flight; its session state is gone, so do not replay it elsewhere.
+        if (result.error() != httplib::Error::Connection) {
+          res.status = 502;
+          res.set_content("error: worker " + std::to_string(slot) + " failed during the request (" +
+                              httplib::to_string(result.error()) + ")",
+                          "text/plain");
+          return;
+        }
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        res.status = 503;
+        res.set_content("error: worker " + std::to_string(slot) + " is unavailable", "text/plain");
+        return;
+      }
+      std::this_thread::sleep_for(kRetryInterval);
+    }
+  }
+
+  json metricsPayload() {
+    json slots = json::array();
+    json workers = json::array();
+    const std::int64_t now = nowMs();
+    for (int slot = 0; slot < table_.workers; ++slot) {
+      const WorkerSlot& state = table_.slots[slot];
+      const pid_t pid = state.pid.load();
+      const std::string lastExit = describeExit(state.lastExitStatus.load());
+      slots.push_back({
+          {"slot", slot},
+          {"pid", pid > 0 ? json(pid) : json(nullptr)},
+          {"up", pid > 0},
+          {"restarts", state.restarts.load()},
+          {"uptimeSeconds", pid > 0 ? json((now - state.startedAtMs.load()) / 1000.0) : json(nullptr)},
+          {"lastExit", lastExit.empty() ? json(nullptr) : json(lastExit)},
+      });
+      json metrics = nullptr;
+      if (pid > 0) {
+        httplib::Result result = workerClient(slot, pid).Get("/v1/metrics");
+        if (result && result->status == 200) metrics = json::parse(result->body, nullptr, false);
+        if (metrics.is_discarded()) metrics = nullptr;
+      }
+      workers.push_back(std::move(metrics));
+    }
+    json payload;
+    payload["pool"] = {{"workers", table_.workers}, {"slots", std::move(slots)}};
+    payload["workers"] = std::move(workers);
+    return payload;
+  }
+
+  const WorkerPoolOptions& options_;
+  const PoolTable& table_;
+  const std::string socketDir_;
+  const SessionRing ring_;
+};
+
+}  // namespace
+
+std::string sessionIdFromPath(const std::string& path) {
+  static const std::string kPrefix = "/v1/sessions/";
+  if (path.compare(0, kPrefix.size(), kPrefix) != 0) return "";
+  return path.substr(kPrefix.size(), path.find('/', kPrefix.size()) - kPrefix.size());
+}
+
+std::string sessionIdFromBody(const std::string& body) {
+  static const std::string kKey = "\"sessionId\"";
+  const std::size_t last = body.find_last_not_of(" \t\r\n");
+  if (last != std::string::npos && body[last] == '}') {
+    const std::size_t keyAt = body.rfind(kKey, last);
+    const std::size_t before = keyAt == std::string::npos || keyAt == 0
+        ? std::string::npos
+        : body.find_last_not_of(" \t\r\n", keyAt - 1);
+    if (before != std::string::npos && (body[before] == ',' || body[before] == '{')) {
+      std::size_t pos = skipSpace(body, keyAt + kKey.size());
+      if (pos < last && body[pos] == ':') {
+        pos = skipSpace(body, pos + 1);
+        if (pos < last && body[pos] == '"') {
+          const std::size_t close = body.find_first_of("\"\\", pos + 1);
+          if (close < last && body[close] == '"' && skipSpace(body, close + 1) == last) {
+            return body.substr(pos + 1, close - pos - 1);
+          }
+        }
+      }
+    }
+  }
+  SessionIdSax sax;
+  json::sax_parse(body, &sax);
+  return sax.found ? sax.value : "default";
+}
+
+SessionRing::SessionRing(int slots, int replicas) {
+  points_.reserve(static_cast<std::size_t>(std::max(0, slots) * replicas));
+  for (int slot = 0; slot < slots; ++slot) {
+    for (int replica = 0; replica < replicas; ++replica) {
+      points_.emplace_back(hashKey("worker-" + std::to_string(slot) + "#" + std::to_string(replica)), slot);
+    }
+  }
+  std::sort(points_.begin(), points_.end());
+}
+
+int SessionRing::slotFor(const std::string& sessionId) const {
+  if (points_.empty()) return 0;
+  const std::uint64_t hash = hashKey(sessionId);
+  auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash, -1));
+  if (it == points_.end()) it = points_.begin();
+  return it->second;
+}
+
+int runWorkerPool(const WorkerPoolOptions& options, const WorkerMain& workerMain) {
+  if (options.workers < 1 || options.workers > kMaxWorkers) {
+    throw std::runtime_error("TF_NATIVE_WORKERS must be between 1 and " + std::to_string(kMaxWorkers));
+  }
+  const std::string socketDir = options.socketDir.empty()
+      ? "/tmp/occt_server-" + std::to_string(getpid())
+      : options.socketDir;
+  if (workerSocketPath(socketDir, options.workers - 1).size() >= sizeof(sockaddr_un::sun_path)) {
+    throw std::runtime_error("Worker socket directory path is too long: " + socketDir);
+  }
+  if (mkdir(socketDir.c_str(), 0700) != 0 && errno != EEXIST) {
+    throw std::runtime_error("Cannot create worker socket directory " + socketDir);
+  }
+
+  void* memory = mmap(nullptr, sizeof(PoolTable), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) throw std::runtime_error("Cannot map the worker pool table");
+  PoolTable* table = new (memory) PoolTable();
+  table->workers = options.workers;
+  for (int slot = 0; slot < options.workers; ++slot) {
+    table->slots[slot].pid.store(0);
+    table->slots[slot].restarts.store(0);
+    table->slots[slot].startedAtMs.store(0);
+    table->slots[slot].lastExitStatus.store(-1);
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = onStopSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGINT, &action, nullptr);
+
+  // The supervisor stays single-threaded so that every fork below starts from
+  // the warmed image without another thread's locks held.
+  std::vector<std::int64_t> restartAtMs(options.workers, 0);
+  std::vector<std::int64_t> backoffMs(options.workers, 0);
+  pid_t routerPid = 0;
+  std::int64_t routerRestartAtMs = 0;
+
+  const auto spawnWorker = [&](int slot) {
+    const std::string socketPath = workerSocketPath(socketDir, slot);
+    const pid_t pid = forkChild([&] {
+      const std::string suffix = ".worker" + std::to_string(slot);
+      appendEnvSuffix("TF_NATIVE_TRACE_FILE", suffix);
+      appendEnvSuffix("TF_NATIVE_RECORD_FILE", suffix);
+      unlink(socketPath.c_str());
+      return workerMain(slot, socketPath);
+    });
+    if (pid < 0) {
+      restartAtMs[slot] = nowMs() + kMaxBackoffMs;
+      return;
+    }
+    table->slots[slot].startedAtMs.store(nowMs());
+    table->slots[slot].pid.store(pid);
+  };
+
+  const auto spawnRouter = [&] {
+    routerPid = forkChild([&] { return Router(options, *table, socketDir).run(); });
+    if (routerPid < 0) {
+      routerPid = 0;
+      routerRestartAtMs = nowMs() + kMaxBackoffMs;
+    }
+  };
+
+  for (int slot = 0; slot < options.workers; ++slot) spawnWorker(slot);
+  spawnRouter();
+
+  while (gStopSignal == 0) {
+    int status = 0;
+    pid_t exited = 0;
+    while ((exited = waitpid(-1, &status, WNOHANG)) > 0) {
+      const std::int64_t now = nowMs();
+      if (exited == routerPid) {
+        std::cerr << "occt_server pool: router (pid " << exited << ") " << describeExit(status)
+                  << ", restarting" << std::endl;
+        routerPid = 0;
+        routerRestartAtMs = now + 100;
+        continue;
+      }
+      for (int slot = 0; slot < options.workers; ++slot) {
+        WorkerSlot& state = table->slots[slot];
+        if (state.pid.load() != exited) continue;
+        state.pid.store(0);
+        state.lastExitStatus.store(status);
+        state.restarts.fetch_add(1);
+        backoffMs[slot] = now - state.startedAtMs.load() < kStableUptimeMs
+            ? std::min(kMaxBackoffMs, std::max<std::int64_t>(100, backoffMs[slot] * 2))
+            : 0;
+        restartAtMs[slot] = now + backoffMs[slot];
+        std::cerr << "occt_server pool: worker " << slot << " (pid " << exited << ") "
+                  << describeExit(status) << ", restarting in " << backoffMs[slot] << " ms" << std::endl;
+        break;
+      }
+    }
+
+    const std::int64_t now = nowMs();
+    for (int slot = 0; slot < options.workers; ++slot) {
+      if (table->slots[slot].pid.load() == 0 && now >= restartAtMs[slot]) spawnWorker(slot);
+    }
+    if (routerPid == 0 && now >= routerRestartAtMs) spawnRouter();
+    std::this_thread::sleep_for(kSupervisorTick);
+  }
+
+  std::cout << "occt_server pool: stopping on signal " << gStopSignal << std::endl;
+  if (routerPid > 0) kill(routerPid, SIGTERM);
+  for (int slot = 0; slot < options.workers; ++slot) {
+    const pid_t pid = table->slots[slot].pid.load();
+    if (pid > 0) kill(pid, SIGTERM);
+  }
+  while (waitpid(-1, nullptr, 0) > 0 || errno == EINTR) {
+  }
+  for (int slot = 0; slot < options.workers; ++slot) {
+    unlink(workerSocketPath(socketDir, slot).c_str());
+  }
+  rmdir(socketDir.c_str());
+  munmap(memory, sizeof(PoolTable));
+  return 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Pre-forked worker pool. With TF_NATIVE_WORKERS=N (N > 0) occt_server warms
+// the kernel once and then forks:
+//
+//   - N workers, each serving the normal routes over a Unix socket
+//     (TF_NATIVE_WORKER_SOCKET_DIR, default /tmp/occt_server-<pid>) with its
+//     own SessionManager;
+//   - one router, listening on host:port, which forwards each request to the
+//     worker that owns its sessionId (consistent hashing, so a session's
+//     registry always lives in the same worker).
+//
+// The parent only supervises: a worker that exits or crashes is re-forked
+// into the same slot (sessions it held are lost, clients re-send upstream),
+// and the router retries for a short while before answering 503. GET
+// /v1/metrics on the router reports the pool and every worker's metrics.
+
+struct WorkerPoolOptions {
+  std::string host = "127.0.0.1";
+  int port = 8081;
+  int workers = 0;
+  std::string socketDir;
+};
+
+// Runs inside a forked worker: serves on the Unix socket at socketPath until
+// stopped and returns the process exit code.
+using WorkerMain = std::function<int(int slot, const std::string& socketPath)>;
+
+// Forks the router and workers and supervises them until SIGTERM or SIGINT.
+int runWorkerPool(const WorkerPoolOptions& options, const WorkerMain& workerMain);
+
+// Session routing, exposed for the benchmarks.
+
+// Returns {id} for /v1/sessions/{id}/... paths (whose bodies are binary
+// snapshots), otherwise "".
+std::string sessionIdFromPath(const std::string& path);
+
+// Returns the top-level "sessionId" of a JSON request body, or "default".
+// Checks the tail first (the JS client appends sessionId last) and otherwise
+// stops a SAX parse at the member instead of building the document.
+std::string sessionIdFromBody(const std::string& body);
+
+class SessionRing {
+ public:
+  explicit SessionRing(int slots, int replicas = 64);
+  int slotFor(const std::string& sessionId) const;
+
+ private:
+  std::vector<std::pair<std::uint64_t, int>> points_;
+};
@@ -1111,6 +1111,7 @@ export class OcctBackend extends OcctBackendMeshSupport implements Backend {
       collectSelections: (shape, featureId, ownerKey, featureTags, opts) =>
         this.collectSelections(shape, featureId, ownerKey, featureTags, opts),
       makeBoolean: (op, left, right) => this.makeBoolean(op, left, right),
+      makeCompoundFromShapes: (shapes) => this.makeCompoundFromShapes(shapes as any[]),
       makeBooleanSelectionLedgerPlan: (op, upstream, left, right, builder) =>
         this.makeBooleanSelectionLedgerPlan(op, upstream, left, right, builder),
       normalizeSolid: (shape) => this.normalizeSolid(shape),
@@ -35,8 +35,15 @@ export type NativeKernelSelection = KernelSelection & {
 export type NativeKernelResult = {
   outputs: Array<{ key: string; object: NativeKernelObject }>;
   selections: NativeKernelSelection[];
+  // Version of the selection id scheme the server already applied; absent
+  // from servers that leave faces and edges with generic ids.
+  selectionIds?: number;
 };
 
+// The src/occt/selection_ids.ts fingerprint version the server must match
+// for its ids to be used as they are.
+const NATIVE_SELECTION_ID_VERSION = 1;
+
 export type NativeExecFeatureRequest = {
   sessionId?: string;
   feature: IntentFeature;
@@ -131,7 +138,11 @@ export class OcctNativeBackend implements BackendAsync {
       upstream: serializeKernelResult(input.upstream),
     });
     const response = await this.transport.execFeature(request);
-    return canonicalizeNativeSelectionIds(deserializeKernelResult(response.result));
+    const result = deserializeKernelResult(response.result);
+    if (response.result.selectionIds === NATIVE_SELECTION_ID_VERSION) return result;
+    // Ids from another version of the scheme are replaced along with the
+    // generic ones.
+    return canonicalizeNativeSelectionIds(result, response.result.selectionIds !== undefined);
   }
 
   async mesh(target: KernelObject, opts?: MeshOptions): Promise<MeshData> {
@@ -202,12 +213,17 @@ function requireHandle(target: KernelObject): NativeShapeHandle {
   return handle;
 }
 
-function canonicalizeNativeSelectionIds(result: KernelResult): KernelResult {
+function canonicalizeNativeSelectionIds(
+  result: KernelResult,
+  replaceAssigned = false
+): KernelResult {
   const selections = result.selections.slice();
   for (const kind of ["face", "edge"] as const) {
     const indexed = selections
       .map((selection, index) => ({ selection, index }))
-      .filter(({ selection }) => selection.kind === kind && selection.id === kind);
+      .filter(
+        ({ selection }) => selection.kind === kind && (replaceAssigned || selection.id === kind)
+      );
     if (indexed.length === 0) continue;
     const assignments = assignStableSelectionIds(
       kind,
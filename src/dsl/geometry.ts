@@ -1153,7 +1153,8 @@ export const booleanOp = (
   left: Selector,
   right: Selector,
   result?: string,
-  deps?: ID[]
+  deps?: ID[],
+  opts?: { tools?: Selector[]; fuzzy?: BooleanOp["fuzzy"]; glue?: BooleanOp["glue"] }
 ): BooleanOp =>
   compact({
     id,
@@ -1163,6 +1164,9 @@ export const booleanOp = (
     right,
     result: result ?? `body:${id}`,
     deps,
+    tools: opts?.tools,
+    fuzzy: opts?.fuzzy,
+    glue: opts?.glue,
   });
 
 export const patternLinear = (
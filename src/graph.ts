@@ -347,7 +347,7 @@ function featureSelectors(feature: IntentFeature): Selector[] {
     case "feature.chamfer":
       return [feature.edges];
     case "feature.boolean":
-      return [feature.left, feature.right];
+      return [feature.left, feature.right, ...(feature.tools ?? [])];
     case "feature.mirror":
       return [feature.source];
     case "feature.delete.face":
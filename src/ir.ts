@@ -798,6 +798,9 @@ export type BooleanOp = FeatureBase & {
   op: "union" | "subtract" | "intersect";
   left: Selector;
   right: Selector;
+  tools?: Selector[];
+  fuzzy?: Scalar;
+  glue?: "off" | "shift" | "full";
   result: string;
 };
 
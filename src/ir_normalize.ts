@@ -317,6 +317,11 @@ function normalizeFeature(
         clone.tolerance = normalizeScalar(clone.tolerance, "length", ctx);
       }
       break;
+    case "feature.boolean":
+      if (clone.fuzzy !== undefined) {
+        clone.fuzzy = normalizeScalar(clone.fuzzy, "length", ctx);
+      }
+      break;
     case "feature.thicken":
       clone.thickness = normalizeScalar(clone.thickness, "length", ctx);
       break;
@@ -2025,6 +2025,9 @@ export const IR_SCHEMA = {
         op: { enum: ["union", "subtract", "intersect"] },
         left: { $ref: "#/$defs/Selector" },
         right: { $ref: "#/$defs/Selector" },
+        tools: { type: "array", items: { $ref: "#/$defs/Selector" } },
+        fuzzy: { $ref: "#/$defs/Scalar" },
+        glue: { enum: ["off", "shift", "full"] },
         result: { type: "string" },
       },
       additionalProperties: false,
@@ -1383,6 +1383,9 @@ function validateFeature(feature: IntentFeature): void {
         op?: string;
         left?: Selector;
         right?: Selector;
+        tools?: Selector[];
+        fuzzy?: Scalar;
+        glue?: unknown;
         result?: string;
       };
       if (boolOp.op !== "union" && boolOp.op !== "subtract" && boolOp.op !== "intersect") {
@@ -1393,6 +1396,30 @@ function validateFeature(feature: IntentFeature): void {
       }
       validateSelector(boolOp.left);
       validateSelector(boolOp.right);
+      if (boolOp.tools !== undefined) {
+        const tools = ensureArray<Selector>(
+          boolOp.tools,
+          "validation_boolean_tools",
+          "Boolean tools must be an array"
+        );
+        for (const tool of tools) {
+          validateSelector(tool);
+        }
+      }
+      if (boolOp.fuzzy !== undefined) {
+        validateScalar(boolOp.fuzzy, "Boolean fuzzy tolerance");
+      }
+      if (
+        boolOp.glue !== undefined &&
+        boolOp.glue !== "off" &&
+        boolOp.glue !== "shift" &&
+        boolOp.glue !== "full"
+      ) {
+        throw new CompileError(
+          "validation_boolean_glue",
+          `Unknown boolean glue mode ${String(boolOp.glue)}`
+        );
+      }
       ensureNonEmptyString(
         boolOp.result,
         "validation_feature_result",
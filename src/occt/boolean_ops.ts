@@ -14,11 +14,20 @@ export function execBoolean(
   if (!left || !right) {
     throw new Error("OCCT backend: boolean inputs must resolve to solids");
   }
+  const extraTools = (feature.tools ?? []).map((selector) =>
+    ctx.resolveOwnerShape(ctx.resolve(selector, upstream), upstream)
+  );
+  if (extraTools.some((tool) => !tool)) {
+    throw new Error("OCCT backend: boolean inputs must resolve to solids");
+  }
+  // Extra tools join `right` in one compound so the whole set is a single
+  // boolean pass rather than one pass per tool.
+  const tool = extraTools.length > 0 ? ctx.makeCompoundFromShapes([right, ...extraTools]) : right;
 
-  const builder = ctx.makeBoolean(feature.op, left, right);
+  const builder = ctx.makeBoolean(feature.op, left, tool);
   let solid = ctx.readShape(builder);
   if (feature.op === "subtract") {
-    solid = ctx.splitByTools(solid, [left, right]);
+    solid = ctx.splitByTools(solid, [left, right, ...extraTools]);
   }
   solid = ctx.normalizeSolid(solid);
 
@@ -33,7 +42,7 @@ export function execBoolean(
     ],
   ]);
   const selections = ctx.collectSelections(solid, feature.id, feature.result, feature.tags, {
-    ledgerPlan: ctx.makeBooleanSelectionLedgerPlan(feature.op, upstream, left, right, builder),
+    ledgerPlan: ctx.makeBooleanSelectionLedgerPlan(feature.op, upstream, left, tool, builder),
   });
   return { outputs, selections };
 }
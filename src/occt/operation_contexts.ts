@@ -474,6 +474,7 @@ export type BooleanContext = {
     opts?: SelectionCollectionOptions
   ) => KernelSelection[];
   makeBoolean: (op: "union" | "subtract" | "intersect", left: unknown, right: unknown) => unknown;
+  makeCompoundFromShapes: (shapes: unknown[]) => unknown;
   makeBooleanSelectionLedgerPlan: (
     op: "union" | "subtract" | "intersect",
     upstream: KernelResult,
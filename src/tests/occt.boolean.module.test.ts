@@ -19,6 +19,7 @@ function makeBooleanContext(
       return [{ id: `${ownerKey}:solid`, kind: "solid", meta: {} }];
     },
     makeBoolean: (op, left, right) => ({ tag: "builder", op, left, right }),
+    makeCompoundFromShapes: (shapes) => ({ tag: "compound", shapes }),
     makeBooleanSelectionLedgerPlan: (op) => ({ solid: { slot: `boolean:${op}` } }),
     normalizeSolid: (shape) => ({ tag: "normalized", shape }),
     readShape: (shape) => ({ tag: "shape", shape }),
@@ -104,6 +105,71 @@ const tests = [
       assert.deepEqual(state.selections, [{ ownerKey: "body:result", hasLedgerPlan: true }]);
     },
   },
+  {
+    name: "boolean module: extra tools run as one boolean against a compound tool",
+    fn: async () => {
+      const leftShape = { tag: "left-shape" };
+      const rightShape = { tag: "right-shape" };
+      const toolShape = { tag: "tool-shape" };
+      const leftSelection: KernelSelection = {
+        id: "body:left",
+        kind: "solid",
+        meta: { shape: leftShape },
+      };
+      const rightSelection: KernelSelection = {
+        id: "body:right",
+        kind: "solid",
+        meta: { shape: rightShape },
+      };
+      const toolSelection: KernelSelection = {
+        id: "body:tool",
+        kind: "solid",
+        meta: { shape: toolShape },
+      };
+      const state = {
+        splitCalls: [] as Array<{ shape: unknown; tools: unknown[] }>,
+        selections: [] as Array<{ ownerKey: string; hasLedgerPlan: boolean }>,
+      };
+      const base = makeBooleanContext(leftSelection, rightSelection, state);
+      const ctx = {
+        ...base,
+        resolve: (selector: unknown, upstream: KernelResult) =>
+          (selector as { name?: string }).name === "body:tool"
+            ? toolSelection
+            : base.resolve(selector, upstream),
+      } satisfies BooleanContext;
+      const upstream: KernelResult = {
+        outputs: new Map(),
+        selections: [leftSelection, rightSelection, toolSelection],
+      };
+
+      execBoolean(
+        ctx,
+        {
+          kind: "feature.boolean",
+          id: "boolean-1",
+          op: "subtract",
+          left: selectors.selectorNamed("body:left"),
+          right: selectors.selectorNamed("body:right"),
+          tools: [selectors.selectorNamed("body:tool")],
+          result: "body:result",
+        },
+        upstream
+      );
+
+      assert.equal(state.splitCalls.length, 1);
+      assert.deepEqual(state.splitCalls[0]?.shape, {
+        tag: "shape",
+        shape: {
+          tag: "builder",
+          op: "subtract",
+          left: leftShape,
+          right: { tag: "compound", shapes: [rightShape, toolShape] },
+        },
+      });
+      assert.deepEqual(state.splitCalls[0]?.tools, [leftShape, rightShape, toolShape]);
+    },
+  },
   {
     name: "boolean module: rejects inputs that do not resolve to owned solids",
     fn: async () => {
@@ -6,7 +6,12 @@ import { buildPartAsync } from "../executor.js";
 import { backendToAsync } from "../backend-spi.js";
 import { OcctBackend } from "../backend_occt.js";
 import { OcctNativeBackend } from "../backend_occt_native.js";
+import type {
+  NativeExecFeatureResponse,
+  NativeOcctTransport,
+} from "../backend_occt_native.js";
 import { HttpOcctTransport } from "../backend_occt_native_http.js";
+import type { KernelSelectionRecord } from "../backend.js";
 import { runTests } from "./occt_test_utils.js";
 
 type ServerHandle = {
@@ -56,6 +61,17 @@ const parityCases = [
       dsl.extrude("base", dsl.profileRect(20, 10), 5, "body:main"),
     ]),
   },
+  {
+    name: "extrude-poly",
+    part: dsl.part("native-parity-extrude-poly", [
+      dsl.extrude(
+        "base",
+        dsl.profilePoly(6, 10, [0, 0, 0], Math.PI / 6),
+        8,
+        "body:main"
+      ),
+    ]),
+  },
   {
     name: "revolve",
     part: dsl.part("native-parity-revolve", [
@@ -126,6 +142,33 @@ function selectionCountByKind(
   return counts;
 }
 
+// Server face and edge selections with their ids reset to the generic
+// `face`/`edge`, so the backend runs assignStableSelectionIds over them as it
+// does for servers that do not assign ids.
+function withGenericSelectionIds(response: NativeExecFeatureResponse): NativeExecFeatureResponse {
+  return {
+    ...response,
+    result: {
+      ...response.result,
+      selectionIds: undefined,
+      selections: response.result.selections.map((selection) =>
+        selection.kind === "face" || selection.kind === "edge"
+          ? { ...selection, id: selection.kind, record: undefined }
+          : selection
+      ),
+    },
+  };
+}
+
+// Records as they travel over the wire, without undefined members.
+function wireRecord(record: KernelSelectionRecord | undefined): unknown {
+  return record === undefined ? undefined : JSON.parse(JSON.stringify(record));
+}
+
+const selectionIdCases = parityCases.filter((parityCase) =>
+  ["extrude", "extrude-poly", "revolve"].includes(parityCase.name)
+);
+
 const tests = [
   {
     name: "occt native server parity: supported primitive feature flows match direct backend outputs and selection ids",
@@ -246,6 +289,76 @@ const tests = [
       }
     },
   },
+  {
+    name: "occt native server parity: server selection ids match the client's assignStableSelectionIds",
+    fn: async () => {
+      if (process.env.TF_NATIVE_SERVER !== "1") {
+        return;
+      }
+
+      const server = await startServer(8082);
+      try {
+        const http = new HttpOcctTransport({ baseUrl: server.url });
+        const served = new Map<string, { id: string; record: unknown }>();
+        const transport: NativeOcctTransport = {
+          capabilities: () => http.capabilities(),
+          execFeature: async (request) => {
+            const response = await http.execFeature(request);
+            for (const selection of response.result.selections) {
+              served.set(`${selection.kind}:${selection.meta.handle}`, {
+                id: selection.id,
+                record: wireRecord(selection.record),
+              });
+            }
+            return withGenericSelectionIds(response);
+          },
+          mesh: (request) => http.mesh(request),
+          exportStep: (request) => http.exportStep(request),
+        };
+        const backend = new OcctNativeBackend({ transport });
+
+        for (const parityCase of selectionIdCases) {
+          served.clear();
+          const built = await buildPartAsync(parityCase.part, backend);
+          const selections = built.final.selections.filter(
+            (selection) => selection.kind === "face" || selection.kind === "edge"
+          );
+          assert.ok(selections.length > 0, `${parityCase.name}: no face or edge selections`);
+          for (const selection of selections) {
+            const fromServer = served.get(`${selection.kind}:${String(selection.meta.handle)}`);
+            assert.ok(fromServer, `${parityCase.name}: ${selection.id} missing from the server result`);
+            assert.notEqual(fromServer.id, selection.kind, `${parityCase.name}: server left a generic id`);
+            assert.equal(fromServer.id, selection.id, `${parityCase.name}: selection id drifted`);
+            assert.deepEqual(
+              fromServer.record,
+              wireRecord(selection.record),
+              `${parityCase.name}: selection record of ${selection.id} drifted`
+            );
+          }
+
+          if (parityCase.name === "extrude") {
+            // Slotted: the caps and sides carry ledger slots in their ids.
+            const slots = selections
+              .filter((selection) => selection.kind === "face")
+              .map((selection) => selection.record?.slot)
+              .sort();
+            assert.deepEqual(slots, ["bottom", "side.1", "side.2", "side.3", "side.4", "top"]);
+            // Colliding base ids: the unslotted edges share semantic
+            // fingerprints, so their ids fall back to the tie-break order.
+            const edgeIds = selections
+              .filter((selection) => selection.kind === "edge")
+              .map((selection) => selection.id);
+            assert.ok(
+              edgeIds.some((id) => /\.\d+$/.test(id)),
+              "extrude: expected edges with colliding base ids"
+            );
+          }
+        }
+      } finally {
+        await stopServer(server);
+      }
+    },
+  },
 ];
 
 runTests(tests).catch((err) => {
@@ -0,0 +1,136 @@
+import assert from "node:assert/strict";
+import { spawn } from "node:child_process";
+import { dsl } from "../dsl.js";
+import { runTests } from "./occt_test_utils.js";
+
+type ServerHandle = {
+  process: ReturnType<typeof spawn>;
+  url: string;
+};
+
+async function startServer(port: number): Promise<ServerHandle> {
+  const bin = "native/occt_server/build/occt_server";
+  const proc = spawn(bin, ["127.0.0.1", String(port)], {
+    stdio: ["ignore", "pipe", "pipe"],
+  });
+
+  await new Promise<void>((resolve, reject) => {
+    const timeout = setTimeout(() => {
+      reject(new Error("occt_server did not start in time"));
+    }, 5000);
+    const onData = (chunk: Buffer) => {
+      const msg = chunk.toString("utf8");
+      if (msg.includes("occt_server listening")) {
+        clearTimeout(timeout);
+        proc.stdout?.off("data", onData);
+        resolve();
+      }
+    };
+    proc.stdout?.on("data", onData);
+    proc.on("exit", (code) => {
+      clearTimeout(timeout);
+      reject(new Error(`occt_server exited with code ${code ?? "unknown"}`));
+    });
+  });
+
+  return { process: proc, url: `http://127.0.0.1:${port}` };
+}
+
+function stopServer(handle: ServerHandle): Promise<void> {
+  return new Promise((resolve) => {
+    handle.process.once("exit", () => resolve());
+    handle.process.kill("SIGTERM");
+  });
+}
+
+type SweepRecord = {
+  index?: number;
+  value?: number;
+  outputs?: Record<string, { volume?: number; bounds?: { min: number[]; max: number[] } }>;
+  error?: string;
+  done?: boolean;
+  variants?: number;
+  failed?: number;
+};
+
+async function postSweep(url: string, request: unknown): Promise<SweepRecord[]> {
+  const response = await fetch(`${url}/v1/sweep`, {
+    method: "POST",
+    headers: { "content-type": "application/json" },
+    body: JSON.stringify(request),
+  });
+  assert.equal(response.status, 200, await response.clone().text());
+  const text = await response.text();
+  return text
+    .split("\n")
+    .filter((line) => line.trim().length > 0)
+    .map((line) => JSON.parse(line) as SweepRecord);
+}
+
+const tests = [
+  {
+    name: "occt native server sweep: evaluates parameter expressions with literals",
+    fn: async () => {
+      if (process.env.TF_NATIVE_SERVER !== "1") {
+        return;
+      }
+      const server = await startServer(8083);
+      try {
+        const depth = dsl.exprMul(dsl.exprParam("height"), dsl.exprLiteral(2));
+        const records = await postSweep(server.url, {
+          upstream: { outputs: [], selections: [] },
+          features: [dsl.extrude("boss", dsl.profileRect(10, 10), depth, "body:main")],
+          parameter: "height",
+          values: [3, 5],
+          outputs: ["body:main"],
+          quantities: ["volume", "bounds"],
+        });
+
+        const summary = records[records.length - 1];
+        assert.deepEqual(
+          { done: summary?.done, variants: summary?.variants, failed: summary?.failed },
+          { done: true, variants: 2, failed: 0 }
+        );
+        const variants = records.filter((record) => record.index !== undefined);
+        assert.equal(variants.length, 2);
+        for (const variant of variants) {
+          assert.equal(variant.error, undefined, `variant ${variant.value} failed: ${variant.error}`);
+          const body = variant.outputs?.["body:main"];
+          const height = (variant.value ?? 0) * 2;
+          assert.ok(body, `variant ${variant.value}: missing body:main`);
+          assert.ok(Math.abs((body.volume ?? 0) - 100 * height) < 1e-6, `variant ${variant.value}: volume`);
+          assert.ok(
+            Math.abs((body.bounds?.max[2] ?? 0) - (body.bounds?.min[2] ?? 0) - height) < 1e-3,
+            `variant ${variant.value}: height`
+          );
+        }
+
+        // An expression the server cannot evaluate fails its variant instead
+        // of building with a zero depth.
+        const unitRecords = await postSweep(server.url, {
+          upstream: { outputs: [], selections: [] },
+          features: [
+            dsl.extrude(
+              "boss",
+              dsl.profileRect(10, 10),
+              dsl.exprMul(dsl.exprParam("height"), dsl.exprLiteral(2, "cm")),
+              "body:main"
+            ),
+          ],
+          parameter: "height",
+          values: [3],
+          quantities: ["volume"],
+        });
+        const failed = unitRecords.find((record) => record.index === 0);
+        assert.match(failed?.error ?? "", /unitless/);
+      } finally {
+        await stopServer(server);
+      }
+    },
+  },
+];
+
+runTests(tests).catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});
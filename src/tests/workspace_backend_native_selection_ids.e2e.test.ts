@@ -0,0 +1,132 @@
+import assert from "node:assert/strict";
+import type { KernelSelection } from "../backend.js";
+import { dsl } from "../dsl.js";
+import type { NativeKernelResult, NativeOcctTransport } from "../backend_occt_native.js";
+import { runTests } from "./occt_test_utils.js";
+
+const backendModuleId = "@trueform/backend-native";
+const workspaceBackend = (await import(backendModuleId)) as typeof import("../backend_occt_native.js");
+
+function faceSelection(id: string, slot: string, record?: KernelSelection["record"]) {
+  return {
+    id,
+    kind: "face" as const,
+    meta: {
+      handle: `face:${slot}`,
+      ownerKey: "body:main",
+      createdBy: "base",
+      role: slot,
+      selectionSlot: slot,
+    },
+    ...(record ? { record } : {}),
+  };
+}
+
+// A transport that answers every exec-feature with `result`.
+function fixedTransport(result: NativeKernelResult): NativeOcctTransport {
+  return {
+    execFeature: async () => ({ result }),
+    mesh: async () => {
+      throw new Error("not used");
+    },
+    exportStep: async () => new Uint8Array(),
+  };
+}
+
+async function execute(result: NativeKernelResult): Promise<KernelSelection[]> {
+  const backend = new workspaceBackend.OcctNativeBackend({ transport: fixedTransport(result) });
+  const executed = await backend.execute({
+    feature: dsl.extrude("base", dsl.profileRect(10, 10), 5, "body:main"),
+    upstream: { outputs: new Map(), selections: [] },
+    resolve: () => {
+      throw new Error("not used");
+    },
+  });
+  return executed.selections;
+}
+
+const canonicalIds = ["face:body.main~base.top", "face:body.main~base.bottom"];
+const canonicalRecords = ["top", "bottom"].map((slot) => ({
+  ownerKey: "body:main",
+  createdBy: "base",
+  role: slot,
+  slot,
+  lineage: { kind: "created" },
+}));
+
+const tests = [
+  {
+    name: "workspace backend-native: server selection ids of the current version pass through unchanged",
+    fn: async () => {
+      const record = {
+        ownerKey: "body:main",
+        createdBy: "base",
+        role: "top",
+        slot: "top",
+        lineage: { kind: "created" as const },
+      };
+      const selections = [
+        faceSelection("face:server.top", "top", record),
+        faceSelection("face:server.bottom", "bottom", { ...record, role: "bottom", slot: "bottom" }),
+      ];
+      const result = await execute({ outputs: [], selections, selectionIds: 1 });
+      assert.deepEqual(
+        result.map((selection) => selection.id),
+        ["face:server.top", "face:server.bottom"]
+      );
+      assert.deepEqual(
+        result.map((selection) => selection.record),
+        selections.map((selection) => selection.record)
+      );
+    },
+  },
+  {
+    name: "workspace backend-native: generic selection ids are canonicalized without a server version",
+    fn: async () => {
+      const result = await execute({
+        outputs: [],
+        selections: [faceSelection("face", "top"), faceSelection("face", "bottom")],
+      });
+      assert.deepEqual(
+        result.map((selection) => selection.id),
+        canonicalIds
+      );
+      assert.deepEqual(
+        result.map((selection) => JSON.parse(JSON.stringify(selection.record))),
+        canonicalRecords
+      );
+    },
+  },
+  {
+    name: "workspace backend-native: selection ids of another version are re-canonicalized",
+    fn: async () => {
+      const stale = {
+        ownerKey: "body:main",
+        createdBy: "base",
+        role: "stale",
+        lineage: { kind: "created" as const },
+      };
+      const result = await execute({
+        outputs: [],
+        selections: [
+          faceSelection("face:stale.1", "top", stale),
+          faceSelection("face:stale.2", "bottom", stale),
+        ],
+        selectionIds: 2,
+      });
+      assert.deepEqual(
+        result.map((selection) => selection.id),
+        canonicalIds
+      );
+      assert.deepEqual(
+        result.map((selection) => JSON.parse(JSON.stringify(selection.record))),
+        canonicalRecords
+      );
+    },
+  },
+];
+
+runTests(tests).catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});